@@ -20,103 +20,578 @@
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 #include "MessageManager.h"
+#include "../utility/core.hpp"
+#include <algorithm>
+#include <vector>
 
 
-MessageManager::MessageManager()
+MessageManager::WindowList::WindowList()
 {
     // do nothing
 }
 
 
-MessageManager::~MessageManager()
+MessageManager::WindowList::~WindowList()
 {
     // do nothing
 }
 
 
-void MessageManager::AddMessage(HWND window, UINT message)
+MessageManager::MessageTable::MessageTable()
 {
-    Lock lock(m_cs);
-    m_MessageMap[message].insert(window);
+    // do nothing
 }
 
 
-void MessageManager::AddMessages(HWND window, UINT *pMessages)
+MessageManager::MessageTable::MessageTable(const MessageTable& rhs)
+    : message_map(rhs.message_map)
 {
-    Lock lock(m_cs);
+    for (messageMapT::value_type& value : message_map)
+    {
+        value.second->AddRef();
+    }
+}
 
-    if (pMessages != NULL)
+
+MessageManager::MessageTable::~MessageTable()
+{
+    for (messageMapT::value_type& value : message_map)
+    {
+        value.second->Release();
+    }
+}
+
+
+bool MessageManager::MessageTable::Less(const messageMapT::value_type& value, UINT message)
+{
+    return value.first < message;
+}
+
+
+MessageManager::messageMapT::iterator MessageManager::MessageTable::LowerBound(UINT message)
+{
+    return std::lower_bound(message_map.begin(), message_map.end(), message, Less);
+}
+
+
+MessageManager::WindowList* MessageManager::MessageTable::Find(UINT message) const
+{
+    messageMapT::const_iterator it = std::lower_bound(
+        message_map.begin(), message_map.end(), message, Less);
+
+    if (it != message_map.end() && it->first == message)
+    {
+        return it->second;
+    }
+
+    return nullptr;
+}
+
+
+MessageManager::MessageManager()
+    : m_pTable(new MessageTable())
+    , m_lEpoch(0)
+    , m_lSlowCount(0)
+    , m_lTimeout(0)
+    , m_lSlowPolicy(SLOW_SKIP)
+    , m_lRetryDelay(0)
+    , m_pTransport(new Win32MessageTransport())
+    , m_pTracer(nullptr)
+{
+    m_lReaders[0] = 0;
+    m_lReaders[1] = 0;
+}
+
+
+MessageManager::~MessageManager()
+{
+    m_pTable->Release();
+    delete m_pTransport;
+}
+
+
+LONG MessageManager::_EnterRead() const
+{
+    for (;;)
     {
-        while (*pMessages != 0)
+        LONG lEpoch = m_lEpoch;
+        InterlockedIncrement(&m_lReaders[lEpoch & 1]);
+
+        // If a writer bumped the epoch in the meantime it might not wait for
+        // us, so register again under the new one
+        if (m_lEpoch == lEpoch)
         {
-            AddMessage(window, *pMessages++);
+            return lEpoch;
         }
+
+        InterlockedDecrement(&m_lReaders[lEpoch & 1]);
     }
 }
 
 
-void MessageManager::RemoveMessage(HWND window, UINT message)
+void MessageManager::_LeaveRead(LONG lEpoch) const
+{
+    InterlockedDecrement(&m_lReaders[lEpoch & 1]);
+}
+
+
+void MessageManager::_Publish(MessageTable* pTable)
+{
+    MessageTable* pOldTable = (MessageTable*)InterlockedExchangePointer(
+        (PVOID volatile*)&m_pTable, pTable);
+
+    // Readers only take a reference to a window list while they are
+    // registered, so this wait is short no matter what the windows do
+    LONG lEpoch = InterlockedIncrement(&m_lEpoch) - 1;
+
+    for (UINT uSpins = 0; m_lReaders[lEpoch & 1] != 0; ++uSpins)
+    {
+        if (uSpins < 64)
+        {
+            YieldProcessor();
+        }
+        else
+        {
+            Sleep(1);
+        }
+    }
+
+    pOldTable->Release();
+}
+
+
+void MessageManager::_Update(HWND window, const UINT* pMessages, size_t cMessages, bool bAdd)
 {
-    //
-    // This function is the main reason why everything here is locked...
-    // You wouldn't want this function to mess around while another thread is in
-    // SendMessage for example.
-    //
     Lock lock(m_cs);
 
-    messageMapT::iterator it = m_MessageMap.find(message);
+    MessageTable* pTable = new MessageTable(*m_pTable);
+    bool bChanged = false;
+
+    // Looked up the first time it is needed
+    volatile LONG* plCounter = nullptr;
 
-    if (it != m_MessageMap.end())
+    for (size_t uIndex = 0; uIndex < cMessages; ++uIndex)
     {
-        it->second.erase(window);
+        messageMapT::iterator it = pTable->LowerBound(pMessages[uIndex]);
+        bool bListed = (it != pTable->message_map.end() &&
+            it->first == pMessages[uIndex]);
 
-        if (it->second.empty())
+        const std::vector<HWND>* pOldWindows = nullptr;
+
+        if (bListed)
         {
-            m_MessageMap.erase(it);
+            pOldWindows = &it->second->windows;
         }
+
+        std::vector<HWND>::const_iterator pos;
+        bool bFound = false;
+
+        if (pOldWindows != nullptr)
+        {
+            pos = std::lower_bound(pOldWindows->begin(), pOldWindows->end(), window);
+            bFound = (pos != pOldWindows->end() && *pos == window);
+        }
+
+        if (bAdd == bFound)
+        {
+            continue;
+        }
+
+        if (bAdd && plCounter == nullptr)
+        {
+            plCounter = _GetCounter(window);
+        }
+
+        // Published lists are shared with readers, so build a new one
+        WindowList* pList = new WindowList();
+
+        if (pOldWindows != nullptr)
+        {
+            const std::vector<volatile LONG*>& oldCounters = it->second->counters;
+            std::vector<volatile LONG*>::const_iterator posCounter =
+                oldCounters.begin() + (pos - pOldWindows->begin());
+
+            pList->windows.reserve(pOldWindows->size() + 1);
+            pList->windows.assign(pOldWindows->begin(), pos);
+            pList->counters.reserve(pOldWindows->size() + 1);
+            pList->counters.assign(oldCounters.begin(), posCounter);
+
+            if (bAdd)
+            {
+                pList->windows.push_back(window);
+                pList->windows.insert(pList->windows.end(), pos, pOldWindows->end());
+                pList->counters.push_back(plCounter);
+                pList->counters.insert(pList->counters.end(), posCounter, oldCounters.end());
+            }
+            else
+            {
+                pList->windows.insert(pList->windows.end(), pos + 1, pOldWindows->end());
+                pList->counters.insert(pList->counters.end(), posCounter + 1, oldCounters.end());
+            }
+        }
+        else
+        {
+            pList->windows.push_back(window);
+            pList->counters.push_back(plCounter);
+        }
+
+        if (bListed)
+        {
+            it->second->Release();
+
+            if (pList->windows.empty())
+            {
+                pTable->message_map.erase(it);
+                pList->Release();
+            }
+            else
+            {
+                it->second = pList;
+            }
+        }
+        else
+        {
+            pTable->message_map.insert(it,
+                messageMapT::value_type(pMessages[uIndex], pList));
+        }
+
+        _Index(window, pMessages[uIndex], bAdd);
+        bChanged = true;
+    }
+
+    if (bChanged)
+    {
+        _Publish(pTable);
+    }
+    else
+    {
+        pTable->Release();
     }
 }
 
 
-void MessageManager::RemoveMessages(HWND window, UINT *pMessages)
+void MessageManager::_Index(HWND window, UINT message, bool bAdd)
 {
-    Lock lock(m_cs);
+    std::vector<UINT>& messages = m_windowMap[window];
+    std::vector<UINT>::iterator pos =
+        std::lower_bound(messages.begin(), messages.end(), message);
+
+    if (bAdd)
+    {
+        messages.insert(pos, message);
+    }
+    else
+    {
+        if (pos != messages.end() && *pos == message)
+        {
+            messages.erase(pos);
+        }
+
+        if (messages.empty())
+        {
+            m_windowMap.erase(window);
+        }
+    }
+}
+
+
+volatile LONG* MessageManager::_GetCounter(HWND window)
+{
+    HINSTANCE hInstance = m_pTransport->GetInstance(window);
+
+    std::pair<deliveryMapT::iterator, bool> inserted =
+        m_deliveries.insert(deliveryMapT::value_type(hInstance, 0));
+
+    return &inserted.first->second;
+}
+
+
+MessageManager::WindowList* MessageManager::_Acquire(UINT message) const
+{
+    LONG lEpoch = _EnterRead();
+    WindowList* pList = m_pTable->Find(message);
+
+    if (pList != nullptr)
+    {
+        pList->AddRef();
+    }
+
+    _LeaveRead(lEpoch);
+
+    return pList;
+}
+
+
+bool MessageManager::_IsValueMessage(UINT message)
+{
+    // Messages whose parameters are only numbers and window or monitor
+    // handles. Anything else may point to the sender's stack or to a buffer
+    // the sender frees once the broadcast returns.
+    switch (message)
+    {
+    case LM_WINDOWCREATED:
+    case LM_WINDOWDESTROYED:
+    case LM_ACTIVATESHELLWINDOW:
+    case LM_WINDOWACTIVATED:
+    case LM_REDRAW:
+    case LM_TASKMAN:
+    case LM_LANGUAGE:
+    case LM_ACCESSIBILITYSTATE:
+    case LM_APPCOMMAND:
+    case LM_WINDOWREPLACED:
+    case LM_WINDOWREPLACING:
+    case LM_MONITORCHANGED:
+    case LM_FULLSCREENACTIVATED:
+    case LM_FULLSCREENDEACTIVATED:
+    case LM_WALLPAPERCHANGE:
+    case LM_MODULEREADY:
+    case LM_SETTINGSCHANGED:
+    case LM_TASK_SETPROGRESSSTATE:
+    case LM_TASK_SETPROGRESSVALUE:
+    case LM_TASK_MARKASACTIVE:
+    case LM_TASK_REGISTERTAB:
+    case LM_TASK_UNREGISTERTAB:
+    case LM_TASK_SETACTIVETAB:
+    case LM_TASK_SETTABORDER:
+    case LM_TASK_SETTABPROPERTIES:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+
+LRESULT MessageManager::_Deliver(HWND hWnd, volatile LONG* plCounter,
+    UINT message, WPARAM wParam, LPARAM lParam)
+{
+    LRESULT lResult = 0;
+    UINT uTimeout = (UINT)m_lTimeout;
+    bool bValueMessage = _IsValueMessage(message);
+
+    if (uTimeout == 0)
+    {
+        if (m_pTransport->Send(hWnd, message, wParam, lParam, 0, &lResult) ==
+            IMessageTransport::SEND_FAILED)
+        {
+            _Purge(hWnd);
+        }
+        else
+        {
+            InterlockedIncrement(plCounter);
+        }
+
+        return lResult;
+    }
+
+    bool bKnownSlow = false;
+    bool bSkip = false;
+
+    if (m_lSlowCount != 0)
+    {
+        Lock lock(m_csSlow);
+        slowMapT::iterator it = m_slowWindows.find(hWnd);
 
+        if (it != m_slowWindows.end())
+        {
+            bKnownSlow = true;
+
+            // Give it another chance once the retry delay has passed
+            if (m_pTransport->GetTime() - it->second.dwMarked <
+                (DWORD)m_lRetryDelay)
+            {
+                ++it->second.dwSkipped;
+                bSkip = true;
+            }
+        }
+    }
+
+    if (bSkip)
+    {
+        // Only messages without pointers can be posted, the others are
+        // skipped whatever the policy is
+        if (bValueMessage && m_lSlowPolicy == SLOW_POST &&
+            m_pTransport->Post(hWnd, message, wParam, lParam))
+        {
+            InterlockedIncrement(plCounter);
+        }
+
+        return 0;
+    }
+
+    // A message that timed out is still handled once the window gets to it,
+    // so only messages without pointers may be sent with a time limit
+    if (!bValueMessage)
+    {
+        uTimeout = 0;
+    }
+
+    IMessageTransport::SendResult result = m_pTransport->Send(
+        hWnd, message, wParam, lParam, uTimeout, &lResult);
+
+    if (result == IMessageTransport::SEND_TIMEOUT)
+    {
+        TRACE("Window %p timed out on message %u", hWnd, message);
+
+        Lock lock(m_csSlow);
+        std::pair<slowMapT::iterator, bool> inserted =
+            m_slowWindows.insert(slowMapT::value_type(hWnd, SlowWindow()));
+
+        SlowWindow& slow = inserted.first->second;
+
+        if (inserted.second)
+        {
+            slow.dwTimeouts = 0;
+            slow.dwSkipped = 0;
+            InterlockedIncrement(&m_lSlowCount);
+        }
+
+        slow.uLastMessage = message;
+        slow.dwMarked = m_pTransport->GetTime();
+        ++slow.dwTimeouts;
+    }
+    else if (result == IMessageTransport::SEND_FAILED)
+    {
+        _Purge(hWnd);
+    }
+    else
+    {
+        InterlockedIncrement(plCounter);
+
+        if (bKnownSlow)
+        {
+            // It caught up
+            _ForgetSlow(hWnd);
+        }
+    }
+
+    return lResult;
+}
+
+
+void MessageManager::_ForgetSlow(HWND hWnd)
+{
+    Lock lock(m_csSlow);
+
+    if (m_slowWindows.erase(hWnd) != 0)
+    {
+        InterlockedDecrement(&m_lSlowCount);
+    }
+}
+
+
+void MessageManager::_Purge(HWND hWnd)
+{
+    TRACE("Window %p no longer exists, unregistering it", hWnd);
+
+    // Safe while broadcasting, senders work on their own snapshot
+    RemoveWindow(hWnd);
+}
+
+
+void MessageManager::AddMessage(HWND window, UINT message)
+{
+    _Update(window, &message, 1, true);
+}
+
+
+void MessageManager::AddMessages(HWND window, UINT *pMessages)
+{
     if (pMessages != NULL)
     {
-        while (*pMessages != 0)
+        size_t cMessages = 0;
+
+        while (pMessages[cMessages] != 0)
+        {
+            ++cMessages;
+        }
+
+        _Update(window, pMessages, cMessages, true);
+    }
+}
+
+
+void MessageManager::RemoveMessage(HWND window, UINT message)
+{
+    _Update(window, &message, 1, false);
+}
+
+
+void MessageManager::RemoveMessages(HWND window, UINT *pMessages)
+{
+    if (pMessages != NULL)
+    {
+        size_t cMessages = 0;
+
+        while (pMessages[cMessages] != 0)
+        {
+            ++cMessages;
+        }
+
+        _Update(window, pMessages, cMessages, false);
+    }
+}
+
+
+void MessageManager::RemoveWindow(HWND window)
+{
+    {
+        Lock lock(m_cs);
+        windowMapT::const_iterator it = m_windowMap.find(window);
+
+        if (it != m_windowMap.end())
         {
-            RemoveMessage(window, *pMessages++);
+            // Copy, _Update changes the index as it goes
+            std::vector<UINT> messages(it->second);
+            _Update(window, messages.data(), messages.size(), false);
         }
     }
+
+    _ForgetSlow(window);
 }
 
 
 void MessageManager::ClearMessages(void)
 {
     Lock lock(m_cs);
-    m_MessageMap.clear();
+    _Publish(new MessageTable());
+    m_windowMap.clear();
+
+    // m_deliveries stays, senders may still be using the old window lists
+
+    Lock lockSlow(m_csSlow);
+    m_slowWindows.clear();
+    InterlockedExchange(&m_lSlowCount, 0);
 }
 
 
 LRESULT MessageManager::SendMessage(UINT message, WPARAM wParam, LPARAM lParam)
 {
-    Lock lock(m_cs);
     LRESULT lResult = 0;
 
-    messageMapT::iterator it = m_MessageMap.find(message);
+    // The snapshot stays the same even if modules unregister messages in
+    // their message handlers
+    WindowList* pList = _Acquire(message);
 
-    if (it != m_MessageMap.end())
+    if (pList != nullptr)
     {
-        // Make a copy since modules may unregister messages in their message
-        // handlers
-        windowSetT windowSet(it->second);
+        bool bTrace = (m_pTracer != nullptr && m_pTracer->IsEnabled());
 
-        for (windowSetT::const_iterator winIt = windowSet.begin();
-            winIt != windowSet.end(); ++winIt)
+        for (size_t uIndex = 0; uIndex < pList->windows.size(); ++uIndex)
         {
-            lResult |= ::SendMessage(*winIt, message, wParam, lParam);
+            HWND hWnd = pList->windows[uIndex];
+            ULONGLONG ullStart = bTrace ? MessageTracer::GetTimestamp() : 0;
+
+            lResult |= _Deliver(hWnd, pList->counters[uIndex],
+                message, wParam, lParam);
+
+            if (bTrace)
+            {
+                m_pTracer->RecordDelivery(message, hWnd, ullStart);
+            }
         }
+
+        pList->Release();
     }
 
     return lResult;
@@ -125,20 +600,31 @@ LRESULT MessageManager::SendMessage(UINT message, WPARAM wParam, LPARAM lParam)
 
 BOOL MessageManager::PostMessage(UINT message, WPARAM wParam, LPARAM lParam)
 {
-    Lock lock(m_cs);
     BOOL bResult = TRUE;
+    WindowList* pList = _Acquire(message);
 
-    messageMapT::iterator it = m_MessageMap.find(message);
-
-    if (it != m_MessageMap.end())
+    if (pList != nullptr)
     {
-        windowSetT::iterator winIt;
-
-        for (winIt = it->second.begin();
-            winIt != it->second.end() && bResult; ++winIt)
+        for (size_t uIndex = 0;
+            uIndex < pList->windows.size() && bResult; ++uIndex)
         {
-            bResult = ::PostMessage(*winIt, message, wParam, lParam);
+            HWND hWnd = pList->windows[uIndex];
+
+            if (m_pTransport->Post(hWnd, message, wParam, lParam))
+            {
+                InterlockedIncrement(pList->counters[uIndex]);
+            }
+            else if (m_pTransport->IsAlive(hWnd))
+            {
+                bResult = FALSE;
+            }
+            else
+            {
+                _Purge(hWnd);
+            }
         }
+
+        pList->Release();
     }
 
     return bResult;
@@ -147,23 +633,108 @@ BOOL MessageManager::PostMessage(UINT message, WPARAM wParam, LPARAM lParam)
 
 BOOL MessageManager::HandlerExists(UINT message)
 {
-    Lock lock(m_cs);
-    return (m_MessageMap.find(message) != m_MessageMap.end()) ? TRUE : FALSE;
+    LONG lEpoch = _EnterRead();
+    BOOL bResult = (m_pTable->Find(message) != nullptr) ? TRUE : FALSE;
+    _LeaveRead(lEpoch);
+
+    return bResult;
 }
 
 
 bool MessageManager::GetWindowsForMessage(UINT uMsg, windowSetT& setWindows) const
 {
-    Lock lock(m_cs);
     bool bResult = false;
+    WindowList* pList = _Acquire(uMsg);
 
-    messageMapT::const_iterator iter = m_MessageMap.find(uMsg);
-
-    if (iter != m_MessageMap.end())
+    if (pList != nullptr)
     {
-        setWindows = iter->second;
+        setWindows.clear();
+        setWindows.insert(pList->windows.begin(), pList->windows.end());
+        pList->Release();
+
         bResult = true;
     }
 
     return bResult;
 }
+
+
+void MessageManager::SetBroadcastPolicy(UINT uTimeout, SlowPolicy slowPolicy, DWORD dwRetryDelay)
+{
+    InterlockedExchange(&m_lTimeout, (LONG)uTimeout);
+    InterlockedExchange(&m_lSlowPolicy, (LONG)slowPolicy);
+    InterlockedExchange(&m_lRetryDelay, (LONG)dwRetryDelay);
+}
+
+
+void MessageManager::SetTransport(IMessageTransport* pTransport)
+{
+    ASSERT(pTransport != nullptr);
+
+    delete m_pTransport;
+    m_pTransport = pTransport;
+}
+
+
+void MessageManager::SetTracer(MessageTracer* pTracer)
+{
+    m_pTracer = pTracer;
+}
+
+
+HRESULT MessageManager::EnumSlowWindows(LSENUMSLOWWINDOWSPROC pfnCallback, LPARAM lParam) const
+{
+    std::vector<LSSLOWWINDOW> slowWindows;
+
+    {
+        Lock lock(m_csSlow);
+        slowWindows.reserve(m_slowWindows.size());
+
+        for (const slowMapT::value_type& value : m_slowWindows)
+        {
+            LSSLOWWINDOW info = { 0 };
+            info.cbSize = sizeof(LSSLOWWINDOW);
+            info.hWnd = value.first;
+            info.uLastMessage = value.second.uLastMessage;
+            info.dwTimeouts = value.second.dwTimeouts;
+            info.dwSkipped = value.second.dwSkipped;
+
+            slowWindows.push_back(info);
+        }
+    }
+
+    // The callback runs without the lock, it may well broadcast something
+    HRESULT hr = S_OK;
+
+    for (const LSSLOWWINDOW& info : slowWindows)
+    {
+        if (!pfnCallback(&info, lParam))
+        {
+            hr = S_FALSE;
+            break;
+        }
+    }
+
+    return hr;
+}
+
+
+DWORD MessageManager::GetDeliveryCount(HINSTANCE hInstance) const
+{
+    Lock lock(m_cs);
+    deliveryMapT::const_iterator it = m_deliveries.find(hInstance);
+
+    return (it != m_deliveries.end()) ? (DWORD)it->second : 0;
+}
+
+
+void MessageManager::ResetDeliveryCount(HINSTANCE hInstance)
+{
+    Lock lock(m_cs);
+    deliveryMapT::iterator it = m_deliveries.find(hInstance);
+
+    if (it != m_deliveries.end())
+    {
+        InterlockedExchange(&it->second, 0);
+    }
+}
@@ -22,11 +22,16 @@
 #if !defined(MESSAGEMANAGER_H)
 #define MESSAGEMANAGER_H
 
+#include "MessageTracer.h"
+#include "MessageTransport.h"
+#include "../lsapi/lsapidefines.h"
 #include "../utility/common.h"
+#include "../utility/Base.h"
 #include "../utility/criticalsection.h"
 
 #include <map>
 #include <set>
+#include <vector>
 
 
 /**
@@ -36,6 +41,23 @@
  * of window messages using <code>LM_REGISTERMESSAGE</code>. Whenever
  * LiteStep's main window (GetLitestepWnd) receives a message it doesn't
  * handle, that message is resent to all windows that registered for it.
+ *
+ * The registrations are kept in immutable snapshots, so messages are sent
+ * without holding any lock. Handlers may register and unregister messages,
+ * and a hung window only holds up the thread that is sending to it.
+ *
+ * Sending can be given a time limit per window, see SetBroadcastPolicy.
+ * Windows that exceed it are considered slow for a while, and are either
+ * skipped or only posted to during that time. The time limit and posting
+ * only apply to messages whose parameters are plain values or handles.
+ * Messages that may carry pointers are always sent without a time limit,
+ * and are skipped for slow windows.
+ *
+ * Windows that are destroyed without unregistering are dropped the first
+ * time a message can't be delivered to them.
+ *
+ * Delivered messages are counted per instance handle the receiving windows
+ * were created with, see GetDeliveryCount.
  */
 class MessageManager
 {
@@ -53,16 +75,257 @@ public:
     /** Set of window handles */
     typedef std::set<HWND> windowSetT;
 
+    /** What happens to broadcasts to slow windows */
+    enum SlowPolicy
+    {
+        SLOW_SKIP,      // they are not delivered
+        SLOW_POST       // they are posted instead of sent, if they carry
+                        // no pointers
+    };
+
 private:
-    /** Maps message numbers to sets of window handles */
-    typedef std::map<UINT, windowSetT> messageMapT;
+    /**
+     * The windows registered for one message, sorted by handle. Never
+     * changed once published.
+     */
+    class WindowList : public CountedBase
+    {
+    public:
+        WindowList();
+
+        /** Registered windows */
+        std::vector<HWND> windows;
+
+        /** Delivery counter of each window, in the same order */
+        std::vector<volatile LONG*> counters;
+
+    protected:
+        virtual ~WindowList();
+
+    private:
+        // Not implemented
+        WindowList(const WindowList& rhs);
+        WindowList& operator=(const WindowList& rhs);
+    };
+
+    /** Maps message numbers to window lists, sorted by message number */
+    typedef std::vector<std::pair<UINT, WindowList*> > messageMapT;
+
+    /**
+     * An immutable snapshot of the message map. The table holds a reference
+     * to each of its window lists.
+     */
+    class MessageTable : public CountedBase
+    {
+    public:
+        MessageTable();
+        MessageTable(const MessageTable& rhs);
+
+        /** Message map */
+        messageMapT message_map;
 
-    /** Message map */
-    messageMapT m_MessageMap;
+        /**
+         * Returns the position of a message in the map, or where it would
+         * have to be inserted.
+         */
+        messageMapT::iterator LowerBound(UINT message);
 
-    /** Critical section used to serialize access to data members */
+        /**
+         * Returns the windows registered for a message.
+         *
+         * @return Window list, or <code>nullptr</code> if there is none. No
+         *         reference is added.
+         */
+        WindowList* Find(UINT message) const;
+
+    protected:
+        virtual ~MessageTable();
+
+    private:
+        /** Orders map entries by message number */
+        static bool Less(const messageMapT::value_type& value, UINT message);
+
+        // Not implemented
+        MessageTable& operator=(const MessageTable& rhs);
+    };
+
+    /**
+     * The current table. Readers use it without locking, writers build a
+     * modified copy and swap it in.
+     */
+    MessageTable* volatile m_pTable;
+
+    /**
+     * Number of readers that entered during even and odd epochs, see
+     * BangManager, which uses the same scheme.
+     */
+    mutable volatile LONG m_lReaders[2];
+
+    /** Current reader epoch */
+    volatile LONG m_lEpoch;
+
+    /** Critical section for serializing writers */
     mutable CriticalSection m_cs;
 
+    /** Maps window handles to the messages they registered, sorted */
+    typedef std::map<HWND, std::vector<UINT> > windowMapT;
+
+    /**
+     * Reverse index of the current table, so a window can be unregistered
+     * without scanning every message. Protected by m_cs.
+     */
+    windowMapT m_windowMap;
+
+    /** Maps instance handles to the number of messages delivered */
+    typedef std::map<HINSTANCE, volatile LONG> deliveryMapT;
+
+    /**
+     * Delivery counters. Entries are never removed, since window lists
+     * point to them. Protected by m_cs, the counters themselves are updated
+     * with interlocked operations.
+     */
+    deliveryMapT m_deliveries;
+
+    /** A window that timed out, see LSSLOWWINDOW */
+    struct SlowWindow
+    {
+        UINT uLastMessage;
+        DWORD dwTimeouts;
+        DWORD dwSkipped;
+
+        /** Transport time of the last timeout */
+        DWORD dwMarked;
+    };
+
+    /** Maps window handles to their slow state */
+    typedef std::map<HWND, SlowWindow> slowMapT;
+
+    /** Slow windows, protected by m_csSlow */
+    slowMapT m_slowWindows;
+
+    /** Number of entries in m_slowWindows, read without locking */
+    volatile LONG m_lSlowCount;
+
+    /** Critical section for m_slowWindows */
+    mutable CriticalSection m_csSlow;
+
+    /** Time limit per window in milliseconds, 0 for none */
+    volatile LONG m_lTimeout;
+
+    /** SlowPolicy for slow windows */
+    volatile LONG m_lSlowPolicy;
+
+    /** How long a window is considered slow, in milliseconds */
+    volatile LONG m_lRetryDelay;
+
+    /** Delivers the messages */
+    IMessageTransport* m_pTransport;
+
+    /** Records delivery times, not owned */
+    MessageTracer* m_pTracer;
+
+    /**
+     * Marks the start of a read of m_pTable.
+     *
+     * @return Epoch to pass to _LeaveRead
+     */
+    LONG _EnterRead() const;
+
+    /**
+     * Marks the end of a read of m_pTable.
+     *
+     * @param  lEpoch  Value returned by _EnterRead
+     */
+    void _LeaveRead(LONG lEpoch) const;
+
+    /**
+     * Makes pTable the current table, and releases the previous one once
+     * no reader can be using it anymore. Must be called with m_cs held.
+     *
+     * @param  pTable  New table. The manager takes over the reference.
+     */
+    void _Publish(MessageTable* pTable);
+
+    /**
+     * Registers or unregisters a window for several messages at once.
+     *
+     * @param  window     window's handle
+     * @param  pMessages  message numbers
+     * @param  cMessages  number of messages
+     * @param  bAdd       <code>true</code> to register, <code>false</code> to
+     *                    unregister
+     */
+    void _Update(HWND window, const UINT* pMessages, size_t cMessages, bool bAdd);
+
+    /**
+     * Records a registration change in m_windowMap. Must be called with m_cs
+     * held.
+     *
+     * @param  window   window's handle
+     * @param  message  message number
+     * @param  bAdd     <code>true</code> if the window was registered,
+     *                  <code>false</code> if it was unregistered
+     */
+    void _Index(HWND window, UINT message, bool bAdd);
+
+    /**
+     * Returns the delivery counter for a window's instance handle. Must be
+     * called with m_cs held.
+     *
+     * @param  window  window's handle
+     */
+    volatile LONG* _GetCounter(HWND window);
+
+    /**
+     * Removes a window from the slow windows, if it is there.
+     *
+     * @param  hWnd  window handle
+     */
+    void _ForgetSlow(HWND hWnd);
+
+    /**
+     * Drops a window that no longer exists.
+     *
+     * @param  hWnd  window handle
+     */
+    void _Purge(HWND hWnd);
+
+    /**
+     * Takes a snapshot of the windows registered for a message.
+     *
+     * @param  message  message number
+     * @return Window list, or <code>nullptr</code> if no window is registered
+     *         for the message. Release it when done.
+     */
+    WindowList* _Acquire(UINT message) const;
+
+    /**
+     * Sends a message to one window, taking the broadcast policy into
+     * account.
+     *
+     * @param  hWnd        window handle
+     * @param  plCounter   window's delivery counter
+     * @param  message     message number
+     * @param  wParam      message parameter
+     * @param  lParam      message parameter
+     * @return Result of the message, 0 if it wasn't sent
+     */
+    LRESULT _Deliver(HWND hWnd, volatile LONG* plCounter, UINT message,
+        WPARAM wParam, LPARAM lParam);
+
+    /**
+     * Checks whether a message's parameters are only values or handles, so
+     * it may be posted or handled after the sender has returned.
+     *
+     * @param  message  message number
+     * @return <code>true</code> if the message carries no pointers
+     */
+    static bool _IsValueMessage(UINT message);
+
+    // Not implemented
+    MessageManager(const MessageManager& rhs);
+    MessageManager& operator=(const MessageManager& rhs);
+
 public:
     /**
      * Registers a window as a handler for a message.
@@ -96,6 +359,14 @@ public:
      */
     void RemoveMessages(HWND window, UINT *pMessages);
 
+    /**
+     * Unregisters a window for all messages it registered. Takes time
+     * proportional to the number of messages the window registered.
+     *
+     * @param  window  window's handle
+     */
+    void RemoveWindow(HWND window);
+
     /**
      * Clears all registrations from the message map.
      */
@@ -103,7 +374,9 @@ public:
 
     /**
      * Sends a message to all windows that have registered for it. Does
-     * not return until all windows have processed the message.
+     * not return until all windows have processed the message, or timed
+     * out. Windows that register or unregister in the meantime may or may
+     * not receive it.
      *
      * @param   message  message number
      * @param   wParam   message parameter
@@ -146,6 +419,66 @@ public:
      *         message, <code>false</code> otherwise
      */
     bool GetWindowsForMessage(UINT uMsg, windowSetT& setWindows) const;
+
+    /**
+     * Sets how SendMessage deals with windows that take long to handle a
+     * message. Only windows that belong to other threads can be timed out.
+     *
+     * @param  uTimeout      time limit per window in milliseconds, or 0 to
+     *                       wait as long as it takes
+     * @param  slowPolicy    what to do with windows that exceeded it
+     * @param  dwRetryDelay  time after which slow windows are sent messages
+     *                       again, in milliseconds
+     */
+    void SetBroadcastPolicy(UINT uTimeout, SlowPolicy slowPolicy, DWORD dwRetryDelay);
+
+    /**
+     * Replaces the transport used to deliver messages. Meant for testing.
+     *
+     * @param  pTransport  new transport. The message manager takes over
+     *                     ownership. Must not be changed while messages
+     *                     are being sent.
+     */
+    void SetTransport(IMessageTransport* pTransport);
+
+    /**
+     * Sets the tracer that records how long each window takes to handle
+     * the messages sent by SendMessage.
+     *
+     * @param  pTracer  tracer, or <code>nullptr</code> for none. Must stay
+     *                  valid until it is replaced.
+     */
+    void SetTracer(MessageTracer* pTracer);
+
+    /**
+     * Calls a callback function once for each window that is currently
+     * considered slow. Continues so long as the callback function returns
+     * <code>TRUE</code>.
+     *
+     * @param   pfnCallback  callback function
+     * @param   lParam       parameter passed to callback function
+     * @return  <code>S_OK</code> if all windows were enumerated,
+     *          <code>S_FALSE</code> if the callback function returned
+     *          <code>FALSE</code>
+     */
+    HRESULT EnumSlowWindows(LSENUMSLOWWINDOWSPROC pfnCallback, LPARAM lParam) const;
+
+    /**
+     * Returns the number of messages sent or posted to windows that were
+     * created with an instance handle, since LiteStep started or since
+     * ResetDeliveryCount was last called for it.
+     *
+     * @param  hInstance  instance handle, usually a module's
+     */
+    DWORD GetDeliveryCount(HINSTANCE hInstance) const;
+
+    /**
+     * Starts counting deliveries for an instance handle over, e.g. because
+     * the module it belonged to was unloaded.
+     *
+     * @param  hInstance  instance handle
+     */
+    void ResetDeliveryCount(HINSTANCE hInstance);
 };
 
 
@@ -0,0 +1,268 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "MessageTracer.h"
+#include "../utility/core.hpp"
+#include "../utility/perfcounter.h"
+#include <algorithm>
+
+// Number of individual calls kept, older ones only show up in the totals
+#define MESSAGETRACE_EVENTS 65536
+
+
+static double ToMicroseconds(ULONGLONG ullTicks)
+{
+    return (double)ullTicks * 1000000.0 / (double)GetPerformanceFrequency();
+}
+
+
+MessageTracer::MessageTracer()
+    : m_bEnabled(false)
+    , m_ullOrigin(0)
+    , m_uNextEvent(0)
+    , m_bWrapped(false)
+{
+    // do nothing
+}
+
+
+MessageTracer::~MessageTracer()
+{
+    // do nothing
+}
+
+
+void MessageTracer::Start(LPCWSTR pwzFile)
+{
+    ASSERT(pwzFile != nullptr);
+
+    Lock lock(m_cs);
+
+    m_sFile = pwzFile;
+    m_stats.clear();
+    m_events.resize(MESSAGETRACE_EVENTS);
+    m_uNextEvent = 0;
+    m_bWrapped = false;
+    m_ullOrigin = GetTimestamp();
+
+    m_bEnabled = true;
+}
+
+
+void MessageTracer::Stop()
+{
+    Lock lock(m_cs);
+
+    if (m_bEnabled)
+    {
+        _Write(m_sFile.c_str());
+
+        m_bEnabled = false;
+        m_stats.clear();
+
+        std::vector<Event>().swap(m_events);
+    }
+}
+
+
+ULONGLONG MessageTracer::GetTimestamp()
+{
+    return GetPerformanceCounter();
+}
+
+
+void MessageTracer::RecordMessage(UINT uMsg, ULONGLONG ullStart)
+{
+    _Record(uMsg, nullptr, ullStart);
+}
+
+
+void MessageTracer::RecordDelivery(UINT uMsg, HWND hWnd, ULONGLONG ullStart)
+{
+    _Record(uMsg, hWnd, ullStart);
+}
+
+
+void MessageTracer::_Record(UINT uMsg, HWND hWnd, ULONGLONG ullStart)
+{
+    ULONGLONG ullDuration = GetTimestamp() - ullStart;
+    ULONGLONG ullMicroseconds = PerformanceTicksToMicroseconds(ullDuration);
+
+    Lock lock(m_cs);
+
+    // Tracing may have been stopped or restarted while the message was
+    // handled, as happens with LM_RECYCLE
+    if (!m_bEnabled || ullStart < m_ullOrigin)
+    {
+        return;
+    }
+
+    std::pair<statsMapT::iterator, bool> inserted =
+        m_stats.insert(statsMapT::value_type(statsKeyT(uMsg, hWnd), Stats()));
+
+    Stats& stats = inserted.first->second;
+
+    if (inserted.second)
+    {
+        stats.dwCount = 0;
+        stats.ullTotal = 0;
+        stats.ullMax = 0;
+        ZeroMemory(stats.dwBuckets, sizeof(stats.dwBuckets));
+
+        // Look up the owning module now, it may be gone when the trace is
+        // written
+        wchar_t wzModule[MAX_PATH] = { 0 };
+
+        if (hWnd != nullptr)
+        {
+            HMODULE hModule = (HMODULE)GetWindowLongPtr(hWnd, GWLP_HINSTANCE);
+
+            if (hModule != nullptr &&
+                GetModuleFileNameW(hModule, wzModule, MAX_PATH) != 0)
+            {
+                stats.sModule = PathFindFileNameW(wzModule);
+            }
+        }
+        else
+        {
+            stats.sModule = L"litestep";
+        }
+    }
+
+    ++stats.dwCount;
+    stats.ullTotal += ullMicroseconds;
+    stats.ullMax = std::max(stats.ullMax, ullMicroseconds);
+    ++stats.dwBuckets[GetLog2Bucket(ullMicroseconds, BUCKETS)];
+
+    Event& event = m_events[m_uNextEvent];
+    event.ullStart = ullStart;
+    event.ullDuration = ullDuration;
+    event.uMsg = uMsg;
+    event.hWnd = hWnd;
+    event.dwThreadId = GetCurrentThreadId();
+
+    if (++m_uNextEvent == m_events.size())
+    {
+        m_uNextEvent = 0;
+        m_bWrapped = true;
+    }
+}
+
+
+HRESULT MessageTracer::Write(LPCWSTR pwzFile) const
+{
+    Lock lock(m_cs);
+
+    if (!m_bEnabled)
+    {
+        return S_FALSE;
+    }
+
+    if (pwzFile == nullptr || *pwzFile == L'\0')
+    {
+        pwzFile = m_sFile.c_str();
+    }
+
+    return _Write(pwzFile);
+}
+
+
+HRESULT MessageTracer::_Write(LPCWSTR pwzFile) const
+{
+    FILE* pFile = nullptr;
+
+    if (_wfopen_s(&pFile, pwzFile, L"wt, ccs=UTF-8") != 0 || pFile == nullptr)
+    {
+        TRACE("MessageTracer: Could not open \"%ls\"", pwzFile);
+        return E_FAIL;
+    }
+
+    DWORD dwProcessId = GetCurrentProcessId();
+
+    fwprintf(pFile, L"{\"traceEvents\":[\n");
+
+    // Oldest first. Broadcasts end up nested in the message that caused
+    // them, as they run on the same thread within its time span.
+    size_t cEvents = m_bWrapped ? m_events.size() : m_uNextEvent;
+    size_t uFirst = m_bWrapped ? m_uNextEvent : 0;
+
+    for (size_t uIndex = 0; uIndex < cEvents; ++uIndex)
+    {
+        const Event& event = m_events[(uFirst + uIndex) % m_events.size()];
+        const Stats& stats =
+            m_stats.find(statsKeyT(event.uMsg, event.hWnd))->second;
+
+        // Messages are named by number, deliveries by recipient module
+        wchar_t wzName[MAX_PATH];
+
+        if (event.hWnd != nullptr)
+        {
+            StringCchCopyW(wzName, MAX_PATH, stats.sModule.c_str());
+        }
+        else
+        {
+            StringCchPrintfW(wzName, MAX_PATH, L"message %u", event.uMsg);
+        }
+
+        fwprintf(pFile,
+            L"%ls{\"name\":\"%ls\",\"cat\":\"%ls\",\"ph\":\"X\","
+            L"\"ts\":%.3f,\"dur\":%.3f,\"pid\":%lu,\"tid\":%lu,"
+            L"\"args\":{\"message\":%u,\"window\":\"%p\"}}\n",
+            (uIndex == 0) ? L"" : L",", wzName,
+            event.hWnd ? L"delivery" : L"message",
+            ToMicroseconds(event.ullStart - m_ullOrigin),
+            ToMicroseconds(event.ullDuration),
+            dwProcessId, event.dwThreadId, event.uMsg, event.hWnd);
+    }
+
+    // Not part of the trace-event format, viewers ignore it
+    fwprintf(pFile, L"],\n\"displayTimeUnit\":\"ms\",\n\"messageStats\":[\n");
+
+    bool bFirst = true;
+
+    for (const statsMapT::value_type& value : m_stats)
+    {
+        const Stats& stats = value.second;
+
+        fwprintf(pFile,
+            L"%ls{\"message\":%u,\"window\":\"%p\",\"module\":\"%ls\","
+            L"\"count\":%lu,\"totalUs\":%llu,\"maxUs\":%llu,\"histogram\":[",
+            bFirst ? L"" : L",", value.first.first, value.first.second,
+            stats.sModule.c_str(), stats.dwCount, stats.ullTotal,
+            stats.ullMax);
+
+        for (UINT uBucket = 0; uBucket < BUCKETS; ++uBucket)
+        {
+            fwprintf(pFile, L"%ls%lu",
+                (uBucket == 0) ? L"" : L",", stats.dwBuckets[uBucket]);
+        }
+
+        fwprintf(pFile, L"]}\n");
+        bFirst = false;
+    }
+
+    fwprintf(pFile, L"]}\n");
+
+    HRESULT hr = ferror(pFile) ? E_FAIL : S_OK;
+    fclose(pFile);
+
+    return hr;
+}
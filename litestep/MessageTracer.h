@@ -0,0 +1,162 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(MESSAGETRACER_H)
+#define MESSAGETRACER_H
+
+#include "../utility/common.h"
+#include "../utility/criticalsection.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+
+/**
+ * Optional record of how long LiteStep's main window takes to handle each
+ * message, and how long each registered window takes to handle the messages
+ * MessageManager broadcasts to it.
+ *
+ * The most recent calls are kept as individual events. All calls are summed
+ * up per message and window, including a log2 histogram of their durations.
+ * Both are written as a trace-event JSON file, which can be opened with
+ * chrome://tracing and similar viewers.
+ *
+ * While tracing is off the only cost is the IsEnabled check.
+ */
+class MessageTracer
+{
+public:
+    /** Number of histogram buckets. Bucket n counts calls under 2^n us. */
+    enum { BUCKETS = 20 };
+
+    /**
+     * Constructor.
+     */
+    MessageTracer();
+
+    /**
+     * Destructor.
+     */
+    ~MessageTracer();
+
+    /**
+     * Discards anything recorded so far and starts tracing.
+     *
+     * @param  pwzFile  file written by Stop and by Write with no file name
+     */
+    void Start(LPCWSTR pwzFile);
+
+    /**
+     * Writes the trace file passed to Start, and stops tracing. Does nothing
+     * if tracing is off.
+     */
+    void Stop();
+
+    /**
+     * Checks if tracing is on. Callers skip everything else if it isn't.
+     */
+    bool IsEnabled() const
+    {
+        return m_bEnabled;
+    }
+
+    /**
+     * Returns a timestamp to pass to the Record functions.
+     */
+    static ULONGLONG GetTimestamp();
+
+    /**
+     * Records the handling of a message by the main window.
+     *
+     * @param  uMsg      message number
+     * @param  ullStart  GetTimestamp from before the message was handled
+     */
+    void RecordMessage(UINT uMsg, ULONGLONG ullStart);
+
+    /**
+     * Records the delivery of a broadcast message to one window.
+     *
+     * @param  uMsg      message number
+     * @param  hWnd      recipient
+     * @param  ullStart  GetTimestamp from before the message was sent
+     */
+    void RecordDelivery(UINT uMsg, HWND hWnd, ULONGLONG ullStart);
+
+    /**
+     * Writes what has been recorded so far, without stopping.
+     *
+     * @param  pwzFile  file to write, or <code>nullptr</code> or an empty
+     *                  string for the file passed to Start
+     * @return <code>S_OK</code> if the file was written, <code>S_FALSE</code>
+     *         if tracing is off, or an error code
+     */
+    HRESULT Write(LPCWSTR pwzFile) const;
+
+private:
+    /** Totals for one message and recipient */
+    struct Stats
+    {
+        std::wstring sModule;
+        DWORD dwCount;
+        ULONGLONG ullTotal;
+        ULONGLONG ullMax;
+        DWORD dwBuckets[BUCKETS];
+    };
+
+    /** One call, in timestamp units */
+    struct Event
+    {
+        ULONGLONG ullStart;
+        ULONGLONG ullDuration;
+        UINT uMsg;
+        HWND hWnd;
+        DWORD dwThreadId;
+    };
+
+    /** Recipient, or nullptr for the main window itself */
+    typedef std::pair<UINT, HWND> statsKeyT;
+    typedef std::map<statsKeyT, Stats> statsMapT;
+
+    void _Record(UINT uMsg, HWND hWnd, ULONGLONG ullStart);
+    HRESULT _Write(LPCWSTR pwzFile) const;
+
+    volatile bool m_bEnabled;
+    std::wstring m_sFile;
+
+    /** Time tracing started */
+    ULONGLONG m_ullOrigin;
+
+    statsMapT m_stats;
+
+    /** Ring buffer of the most recent calls */
+    std::vector<Event> m_events;
+    size_t m_uNextEvent;
+    bool m_bWrapped;
+
+    mutable CriticalSection m_cs;
+
+    // Not implemented
+    MessageTracer(const MessageTracer& rhs);
+    MessageTracer& operator=(const MessageTracer& rhs);
+};
+
+#endif // MESSAGETRACER_H
@@ -0,0 +1,78 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "MessageTransport.h"
+
+
+IMessageTransport::SendResult Win32MessageTransport::Send(HWND hWnd, UINT uMsg,
+    WPARAM wParam, LPARAM lParam, UINT uTimeout, LRESULT* plResult)
+{
+    if (uTimeout == 0)
+    {
+        SetLastError(ERROR_SUCCESS);
+        *plResult = ::SendMessage(hWnd, uMsg, wParam, lParam);
+
+        // The handler may have set the same error itself
+        if (*plResult == 0 &&
+            GetLastError() == ERROR_INVALID_WINDOW_HANDLE && !IsWindow(hWnd))
+        {
+            return SEND_FAILED;
+        }
+
+        return SEND_OK;
+    }
+
+    DWORD_PTR dwpResult = 0;
+
+    if (SendMessageTimeout(hWnd, uMsg, wParam, lParam,
+        SMTO_NORMAL | SMTO_ABORTIFHUNG, uTimeout, &dwpResult))
+    {
+        *plResult = (LRESULT)dwpResult;
+        return SEND_OK;
+    }
+
+    *plResult = 0;
+    return IsWindow(hWnd) ? SEND_TIMEOUT : SEND_FAILED;
+}
+
+
+BOOL Win32MessageTransport::Post(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+    return ::PostMessage(hWnd, uMsg, wParam, lParam);
+}
+
+
+BOOL Win32MessageTransport::IsAlive(HWND hWnd)
+{
+    return IsWindow(hWnd);
+}
+
+
+HINSTANCE Win32MessageTransport::GetInstance(HWND hWnd)
+{
+    return (HINSTANCE)GetWindowLongPtr(hWnd, GWLP_HINSTANCE);
+}
+
+
+DWORD Win32MessageTransport::GetTime()
+{
+    return GetTickCount();
+}
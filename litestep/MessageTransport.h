@@ -0,0 +1,110 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(MESSAGETRANSPORT_H)
+#define MESSAGETRANSPORT_H
+
+#include "../utility/common.h"
+
+
+/**
+ * Delivers the messages MessageManager broadcasts to registered windows.
+ *
+ * The transport only moves messages. Which windows get what, and how slow
+ * ones are dealt with, is up to MessageManager.
+ */
+class IMessageTransport
+{
+public:
+    /** Outcome of Send */
+    enum SendResult
+    {
+        SEND_OK,        // the window handled the message
+        SEND_TIMEOUT,   // the window didn't handle it in time, or is hung
+        SEND_FAILED     // the window doesn't exist (anymore)
+    };
+
+    virtual ~IMessageTransport()
+    {
+        // do nothing
+    }
+
+    /**
+     * Sends a message to a window.
+     *
+     * @param  hWnd      window handle
+     * @param  uMsg      message number
+     * @param  wParam    message parameter
+     * @param  lParam    message parameter
+     * @param  uTimeout  time limit in milliseconds, 0 to wait indefinitely
+     * @param  plResult  receives the result of the message
+     * @return Outcome of the send
+     */
+    virtual SendResult Send(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam,
+        UINT uTimeout, LRESULT* plResult) = 0;
+
+    /**
+     * Posts a message to a window.
+     *
+     * @return <code>TRUE</code> if the message was posted
+     */
+    virtual BOOL Post(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) = 0;
+
+    /**
+     * Checks if a window still exists.
+     */
+    virtual BOOL IsAlive(HWND hWnd) = 0;
+
+    /**
+     * Returns the instance handle a window was created with.
+     */
+    virtual HINSTANCE GetInstance(HWND hWnd) = 0;
+
+    /**
+     * Returns the current time in milliseconds, as GetTickCount does.
+     */
+    virtual DWORD GetTime() = 0;
+};
+
+
+/**
+ * Transport that uses SendMessageTimeout and PostMessage.
+ *
+ * Note that a window that times out still gets the message once it catches
+ * up, so message parameters that point to the sender's data may no longer be
+ * valid by then. Windows that are already hung are not sent anything.
+ */
+class Win32MessageTransport : public IMessageTransport
+{
+public:
+    SendResult Send(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam,
+        UINT uTimeout, LRESULT* plResult) override;
+
+    BOOL Post(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) override;
+
+    BOOL IsAlive(HWND hWnd) override;
+
+    HINSTANCE GetInstance(HWND hWnd) override;
+
+    DWORD GetTime() override;
+};
+
+#endif // MESSAGETRANSPORT_H
@@ -20,12 +20,15 @@
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 #include "module.h"
-#include "../lsapi/ThreadedBangCommand.h"
+#include "../lsapi/StartupTimeline.h"
 #include "../utility/macros.h"
 #include "../utility/core.hpp"
+#include "../utility/perfcounter.h"
 #include "../utility/stringutility.h"
+#include "../utility/tokenizer.h"
 
 #include <process.h>
+#include <Psapi.h>
 
 
 Module::Module(const std::wstring& sLocation, DWORD dwFlags)
@@ -36,12 +39,79 @@ Module::Module(const std::wstring& sLocation, DWORD dwFlags)
     m_hInitEvent = nullptr;
     m_hInitCopyEvent = nullptr;
     m_pQuit = nullptr;
+    m_pSaveState = nullptr;
+    m_pRestoreState = nullptr;
+    m_pvState = nullptr;
+    m_cbState = 0;
+    m_uStateReason = 0;
+    m_dwStateVersion = 0;
     m_dwFlags = dwFlags;
     m_dwLoadTime = 0;
+    m_ullInitStart = 0;
+    m_ullDllTime = 0;
+    m_ullInitTime = 0;
+    m_ullReadyTime = 0;
+    m_llPrivateBytes = 0;
+    m_lHandles = 0;
+    m_ullInitCpuTime = 0;
     m_wzLocation = sLocation;
 }
 
 
+//
+// Resource usage at one point in time, see TakeSample
+//
+struct ResourceSample
+{
+    ULONGLONG ullTime;
+    ULONGLONG ullCpuTime;
+    SIZE_T cbPrivate;
+    DWORD dwHandles;
+};
+
+
+//
+// Returns the user and kernel time of a thread, in microseconds
+//
+static ULONGLONG GetThreadCpuTime(HANDLE hThread)
+{
+    FILETIME ftCreation, ftExit, ftKernel, ftUser;
+
+    if (!GetThreadTimes(hThread, &ftCreation, &ftExit, &ftKernel, &ftUser))
+    {
+        return 0;
+    }
+
+    ULARGE_INTEGER uliKernel = { ftKernel.dwLowDateTime, ftKernel.dwHighDateTime };
+    ULARGE_INTEGER uliUser = { ftUser.dwLowDateTime, ftUser.dwHighDateTime };
+
+    // FILETIMEs count 100ns intervals
+    return (uliKernel.QuadPart + uliUser.QuadPart) / 10;
+}
+
+
+static void TakeSample(ResourceSample& sample)
+{
+    PROCESS_MEMORY_COUNTERS_EX pmc = { 0 };
+    pmc.cb = sizeof(pmc);
+
+    if (!GetProcessMemoryInfo(GetCurrentProcess(),
+        (PPROCESS_MEMORY_COUNTERS)&pmc, sizeof(pmc)))
+    {
+        pmc.PrivateUsage = 0;
+    }
+
+    if (!GetProcessHandleCount(GetCurrentProcess(), &sample.dwHandles))
+    {
+        sample.dwHandles = 0;
+    }
+
+    sample.cbPrivate = pmc.PrivateUsage;
+    sample.ullCpuTime = GetThreadCpuTime(GetCurrentThread());
+    sample.ullTime = GetPerformanceCounter();
+}
+
+
 static WORD GetModuleArchitecture(LPCWSTR wzModuleName)
 {
     WORD wRet = 0;
@@ -97,9 +167,17 @@ bool Module::_LoadDll()
         // disabled them via SetErrorMode. We force their display here.
         // First, make Windows display all errors
         UINT uOldMode = SetErrorMode(0);
+        std::wstring sFileName = PathFindFileNameW(m_wzLocation.c_str());
+
+        {
+            TimelineSpan span(L"module", L"LoadLibrary " + sFileName);
+            m_hInstance = LoadLibraryW(m_wzLocation.c_str());
+        }
 
-        if ((m_hInstance = LoadLibraryW(m_wzLocation.c_str())) != nullptr)
+        if (m_hInstance != nullptr)
         {
+            TimelineSpan span(L"module", L"GetProcAddress " + sFileName);
+
             AssignToFunction(m_pInit, (initModuleProc) GetProcAddress(
                 m_hInstance, "initModuleW"));
 
@@ -151,6 +229,33 @@ bool Module::_LoadDll()
             }
             else
             {
+                m_pSaveState = (saveModuleStateProc)GetProcAddress(
+                    m_hInstance, "saveModuleState");
+                m_pRestoreState = (restoreModuleStateProc)GetProcAddress(
+                    m_hInstance, "restoreModuleState");
+
+                moduleDependenciesProc pDependencies = (moduleDependenciesProc)
+                    GetProcAddress(m_hInstance, "moduleDependencies");
+
+                if (pDependencies)
+                {
+                    LPCWSTR pwzDependencies = pDependencies();
+
+                    if (pwzDependencies)
+                    {
+                        Tokenizer tokenizer(pwzDependencies, false);
+                        TokenSpan name;
+
+                        while (tokenizer.Next(name))
+                        {
+                            wchar_t wzName[MAX_PATH];
+                            name.CopyTo(wzName, COUNTOF(wzName));
+
+                            m_dependencies.push_back(wzName);
+                        }
+                    }
+                }
+
                 bReturn = true;
             }
         }
@@ -254,13 +359,39 @@ Module::~Module()
         FreeLibrary(m_hInstance);
         m_hInstance = NULL;
     }
+
+    // Not handed over, or not taken by the new instance
+    if (m_pvState)
+    {
+        LocalFree(m_pvState);
+        m_pvState = nullptr;
+    }
 }
 
 
-bool Module::Init(HWND hMainWindow, const std::wstring& sAppPath)
+bool Module::Load()
 {
-    ASSERT(NULL == m_hInstance);
+    if (m_hInstance)
+    {
+        return true;
+    }
+
+    m_ullInitStart = GetPerformanceCounter();
 
+    if (!_LoadDll())
+    {
+        return false;
+    }
+
+    m_ullDllTime = PerformanceTicksToMicroseconds(
+        GetPerformanceCounter() - m_ullInitStart);
+
+    return true;
+}
+
+
+bool Module::Init(HWND hMainWindow, const std::wstring& sAppPath)
+{
     DWORD dwStartTime = 0;
     __int64 iStartTime, iEndTime, iFrequency;
     bool bResult = false;
@@ -272,7 +403,7 @@ bool Module::Init(HWND hMainWindow, const std::wstring& sAppPath)
 
     // delaying the LoadLibrary call until this point is necessary to make
     // grdtransparent work (it hooks LoadLibrary)
-    if (_LoadDll())
+    if (Load())
     {
         ASSERT(nullptr != m_pInit);
         ASSERT(nullptr != m_pQuit);
@@ -319,21 +450,91 @@ bool Module::Init(HWND hMainWindow, const std::wstring& sAppPath)
 int Module::CallInit()
 {
     ASSERT(m_pInit != nullptr);
-    return m_pInit(m_hMainWindow, m_hInstance, m_wzAppPath.c_str());
+
+    // Runs on the module's own thread for threaded modules
+    TimelineSpan span(L"module",
+        L"initModule " + std::wstring(PathFindFileNameW(m_wzLocation.c_str())));
+
+    ResourceSample before, after;
+    TakeSample(before);
+
+    int nResult = m_pInit(m_hMainWindow, m_hInstance, m_wzAppPath.c_str());
+
+    if (nResult == 0 && m_pvState && m_pRestoreState)
+    {
+        // The module owns the state from here on
+        LPVOID pvState = m_pvState;
+        m_pvState = nullptr;
+
+        m_pRestoreState(m_hInstance,
+            m_uStateReason, m_dwStateVersion, pvState, m_cbState);
+    }
+
+    TakeSample(after);
+
+    m_ullInitTime =
+        PerformanceTicksToMicroseconds(after.ullTime - before.ullTime);
+    m_ullReadyTime =
+        PerformanceTicksToMicroseconds(after.ullTime - m_ullInitStart);
+    m_ullInitCpuTime = after.ullCpuTime - before.ullCpuTime;
+    m_llPrivateBytes = (LONGLONG)after.cbPrivate - (LONGLONG)before.cbPrivate;
+    m_lHandles = (LONG)after.dwHandles - (LONG)before.dwHandles;
+
+    return nResult;
+}
+
+
+void Module::GetStats(LSMODULESTATS& stats) const
+{
+    stats.dwFlags = m_dwFlags;
+    stats.ullLoadTime = m_ullDllTime;
+    stats.ullInitTime = m_ullInitTime;
+    stats.ullReadyTime = m_ullReadyTime;
+    stats.llPrivateBytes = m_llPrivateBytes;
+    stats.lHandles = m_lHandles;
+
+    // The thread handle is gone once the module is being unloaded
+    if (m_hThread != nullptr)
+    {
+        stats.ullCpuTime = GetThreadCpuTime(m_hThread);
+    }
+    else
+    {
+        stats.ullCpuTime = m_ullInitCpuTime;
+    }
 }
 
 
 void Module::CallQuit()
 {
     ASSERT(m_pQuit != NULL);
+
+    if (m_uStateReason != 0 && m_pSaveState)
+    {
+        DWORD dwVersion = 0;
+        SIZE_T cbState = 0;
+        LPVOID pvState =
+            m_pSaveState(m_hInstance, m_uStateReason, &dwVersion, &cbState);
+
+        if (pvState)
+        {
+            m_pvState = pvState;
+            m_cbState = cbState;
+            m_dwStateVersion = dwVersion;
+        }
+    }
+
     m_pQuit(m_hInstance);
 }
 
 
-void Module::Quit()
+void Module::Quit(UINT uStateReason)
 {
     if (m_hInstance)
     {
+        // Read by CallQuit, on the module's thread for threaded modules
+        m_uStateReason = uStateReason;
+
         if (m_dwFlags & LS_MODULE_THREADED)
         {
             PostThreadMessage(m_dwThreadID, WM_DESTROY, 0, (LPARAM)this);
@@ -346,6 +547,20 @@ void Module::Quit()
 }
 
 
+void Module::HandOverState(Module& next)
+{
+    ASSERT(next.m_pvState == nullptr);
+
+    next.m_pvState = m_pvState;
+    next.m_cbState = m_cbState;
+    next.m_uStateReason = m_uStateReason;
+    next.m_dwStateVersion = m_dwStateVersion;
+
+    m_pvState = nullptr;
+    m_cbState = 0;
+}
+
+
 UINT __stdcall Module::ThreadProc(void* dllModPtr)
 {
     Module* dllMod = (Module*)dllModPtr;
@@ -355,6 +570,9 @@ UINT __stdcall Module::ThreadProc(void* dllModPtr)
     DbgSetCurrentThreadName(WCSTOMBS(pszFileName));
 #endif
 
+    // Before initModule, which may already add bang commands
+    LSAPIAttachThread();
+
     dllMod->CallInit();
 
     // We must use a copy of our event, and hope no one has closed it before
@@ -378,6 +596,8 @@ UINT __stdcall Module::ThreadProc(void* dllModPtr)
         }
     }
 
+    LSAPIDetachThread();
+
     return 0;
 }
 
@@ -388,13 +608,8 @@ void Module::HandleThreadMessage(MSG &msg)
     {
     case LM_THREAD_BANGCOMMAND:
         {
-            ThreadedBangCommand * pInfo = (ThreadedBangCommand*)msg.wParam;
-
-            if (pInfo != NULL)
-            {
-                pInfo->Execute();
-                pInfo->Release(); //check BangCommand.cpp for the reason
-            }
+            // one wakeup covers everything queued so far
+            LSAPIProcessBangQueue();
         }
         break;
 
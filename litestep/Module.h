@@ -26,6 +26,7 @@
 #include "../utility/common.h"
 #include <string>
 #include <functional>
+#include <vector>
 
 
 /**
@@ -58,12 +59,44 @@ private:
     /** Pointer to <code>quitModule</code> function */
     quitModuleProc m_pQuit;
 
+    /** Pointers to the optional <code>saveModuleState</code> and
+        <code>restoreModuleState</code> functions */
+    saveModuleStateProc m_pSaveState;
+    restoreModuleStateProc m_pRestoreState;
+
+    /**
+     * State saved by this module on Quit, or handed over to it by its
+     * previous instance. Allocated with LocalAlloc, owned by this object.
+     */
+    LPVOID m_pvState;
+    SIZE_T m_cbState;
+
+    /** Reason and format version passed along with m_pvState */
+    UINT m_uStateReason;
+    DWORD m_dwStateVersion;
+
     /** Flags used to load module */
     DWORD m_dwFlags;
 
     /** The amount of time it took to load the module */
     DWORD m_dwLoadTime;
 
+    /** Timestamp taken when Init started */
+    ULONGLONG m_ullInitStart;
+
+    /** See LSMODULESTATS */
+    ULONGLONG m_ullDllTime;
+    ULONGLONG m_ullInitTime;
+    ULONGLONG m_ullReadyTime;
+    LONGLONG m_llPrivateBytes;
+    LONG m_lHandles;
+
+    /** CPU time used by initModule */
+    ULONGLONG m_ullInitCpuTime;
+
+    /** Names of the modules this one has to be initialized after */
+    std::vector<std::wstring> m_dependencies;
+
     /**
      * Event that is triggered when a threaded module completes initialization
      */
@@ -84,6 +117,14 @@ public:
      */
     virtual ~Module();
 
+    /**
+     * Loads the module's DLL without initializing the module. Init does this
+     * as well if it hasn't been done yet.
+     *
+     * @return <code>true</code> if successful or <code>false</code> otherwise
+     */
+    bool Load();
+
     /**
      * Loads and initializes the module. If the module is loaded in its own
      * thread then initialization is done asynchronously. Use the event handle
@@ -101,8 +142,22 @@ public:
      * Shuts down the module and unloads it. If the module was loaded in its
      * own thread then shutdown is done asynchronously. Use event handle
      * returned by <code>GetQuitEvent</code> to wait for shutdown to complete.
+     *
+     * @param  uStateReason  one of the <code>LS_MODULESTATE_</code> reasons
+     *                       to call the module's <code>saveModuleState</code>
+     *                       function first, see HandOverState, or 0
+     */
+    void Quit(UINT uStateReason = 0);
+
+    /**
+     * Moves the state this module saved on Quit to the instance that replaces
+     * it, which passes it to its <code>restoreModuleState</code> function
+     * once it has been initialized. Call once this module's thread, if any,
+     * has exited. The state is freed if the new instance doesn't take it.
+     *
+     * @param  next  module that hasn't been initialized yet
      */
-    void Quit();
+    void HandOverState(Module& next);
 
     /**
      * Entry point for the module's main thread.
@@ -190,6 +245,27 @@ public:
         return m_dwFlags;
     }
 
+    /**
+     * Adds the names of modules that have to be initialized before this one.
+     *
+     * @param  dependencies  module names
+     */
+    void AddDependencies(const std::vector<std::wstring>& dependencies)
+    {
+        m_dependencies.insert(m_dependencies.end(),
+            dependencies.begin(), dependencies.end());
+    }
+
+    /**
+     * Returns the names of the modules that have to be initialized before
+     * this one. Includes those returned by the module's
+     * <code>moduleDependencies</code> function once it has been loaded.
+     */
+    const std::vector<std::wstring>& GetDependencies() const
+    {
+        return m_dependencies;
+    }
+
     /**
      * Returns how long this module took to load.
      */
@@ -198,6 +274,15 @@ public:
         return m_dwLoadTime;
     }
 
+    /**
+     * Fills in what this module cost to load and initialize. Leaves the
+     * fields that aren't tracked by the module itself, dwBangs and
+     * dwBroadcasts, alone. Meaningful once the module has been initialized.
+     *
+     * @param  stats  structure to fill in
+     */
+    void GetStats(LSMODULESTATS& stats) const;
+
     /**
      * Returns a pointer to this module's <code>quitModule</code> function.
      */
@@ -0,0 +1,70 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(MODULELOADER_H)
+#define MODULELOADER_H
+
+#include "../utility/common.h"
+
+
+/**
+ * Maps module DLLs into the process for ModulePreloader.
+ *
+ * Implementations must be safe to call from several threads at once.
+ */
+class IModuleLoader
+{
+public:
+    virtual ~IModuleLoader()
+    {
+        // do nothing
+    }
+
+    /**
+     * Loads a DLL along with the DLLs it depends on.
+     *
+     * @param  pwzPath  path to the DLL, as given to LoadModule
+     * @return Module handle, or <code>nullptr</code> if it couldn't be loaded
+     */
+    virtual HMODULE Load(LPCWSTR pwzPath) = 0;
+
+    /**
+     * Releases a handle returned by Load.
+     *
+     * @param  hModule  module handle
+     */
+    virtual void Free(HMODULE hModule) = 0;
+};
+
+
+/**
+ * Loader that uses LoadLibrary and FreeLibrary. Doesn't show any error
+ * messages, those are left to Module when it loads the DLL for real.
+ */
+class Win32ModuleLoader : public IModuleLoader
+{
+public:
+    HMODULE Load(LPCWSTR pwzPath) override;
+
+    void Free(HMODULE hModule) override;
+};
+
+#endif // MODULELOADER_H
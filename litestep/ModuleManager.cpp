@@ -20,13 +20,23 @@
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 #include "ModuleManager.h"
+#include "MessageManager.h"
+#include "ModulePreloader.h"
+#include "ModuleScheduler.h"
+#include "../lsapi/StartupTimeline.h"
 #include "../utility/core.hpp"
+#include "../utility/tokenizer.h"
 #include <algorithm>
+#include <map>
 #include <vector>
 
+// Number of threads that preload module DLLs. Loading is mostly waiting for
+// the disk, so this doesn't depend on the number of processors.
+#define MODULE_PRELOAD_THREADS 4
+
 
 ModuleManager::ModuleManager() :
-    m_pILiteStep(NULL), m_hLiteStep(NULL)
+    m_pMessageManager(nullptr), m_pILiteStep(NULL), m_hLiteStep(NULL)
 {
     // do nothing
 }
@@ -114,6 +124,8 @@ UINT ModuleManager::_LoadModules()
     UINT uReturn = 0;
     wchar_t wzLine[MAX_LINE_LENGTH];
 
+    TimelineSpan span(L"litestep", L"ModuleManager::_LoadModules");
+
     LPVOID f = LCOpenW(nullptr);
 
     if (f)
@@ -130,33 +142,52 @@ UINT ModuleManager::_LoadModules()
         while (LCReadNextConfigW(f, L"LoadModule", wzLine, MAX_LINE_LENGTH))
 #endif
         {
-            wchar_t wzCommand[MAX_RCCOMMAND] = { 0 };
-            wchar_t wzToken1[MAX_LINE_LENGTH] = { 0 };
-            wchar_t wzToken2[MAX_LINE_LENGTH] = { 0 };
+            Tokenizer tokenizer(wzLine, false);
 
-            // first buffer takes the "LoadModule" token
-            LPWSTR lpwzBuffers[] = { wzCommand, wzToken1, wzToken2 };
+            // first token is the "LoadModule" command
+            TokenSpan command, location, option;
 
-            if (LCTokenizeW(wzLine, lpwzBuffers, 3, nullptr) >= 2)
+            if (tokenizer.Next(command) && tokenizer.Next(location))
             {
 #if defined(LS_COMPAT_LCREADNEXTCONFIG)
-                if (_wcsicmp(wzCommand, L"LoadModule"))
+                if (!command.IsEqual(L"LoadModule"))
                 {
                     continue;
                 }
 #endif
 
                 DWORD dwFlags = 0;
+                std::vector<std::wstring> vecDependencies;
+                bool bAfter = false;
 
-                if (_wcsicmp(wzToken2, L"threaded") == 0)
+                // LoadModule <location> [threaded] [after <name> ...]
+                while (tokenizer.Next(option))
                 {
-                    dwFlags |= LS_MODULE_THREADED;
+                    if (bAfter)
+                    {
+                        wchar_t wzName[MAX_PATH];
+                        option.CopyTo(wzName, COUNTOF(wzName));
+
+                        vecDependencies.push_back(wzName);
+                    }
+                    else if (option.IsEqual(L"after"))
+                    {
+                        bAfter = true;
+                    }
+                    else if (option.IsEqual(L"threaded"))
+                    {
+                        dwFlags |= LS_MODULE_THREADED;
+                    }
                 }
 
-                Module* pModule = _MakeModule(wzToken1, dwFlags);
+                wchar_t wzLocation[MAX_LINE_LENGTH];
+                location.CopyTo(wzLocation, COUNTOF(wzLocation));
+
+                Module* pModule = _MakeModule(wzLocation, dwFlags);
 
                 if (pModule)
                 {
+                    pModule->AddDependencies(vecDependencies);
                     mqModules.push_back(pModule);
                 }
             }
@@ -199,22 +230,64 @@ UINT ModuleManager::_StartModules(ModuleQueue& mqModules)
 
     if (mqModules.size() > 0)
     {
-        std::vector<HANDLE> vecInitEvents;
+        std::vector<StartingModule> vecStarting;
         ModuleQueue::iterator iter = mqModules.begin();
 
+        // Holds on to the preloaded DLLs until we are done here
+        ModulePreloader preloader(new Win32ModuleLoader());
+
+        // With dependencies, all DLLs are loaded first and initialized once
+        // everything they depend on has been
+        bool bSchedule = mqModules.size() > 1 &&
+            GetRCBoolW(L"LSParallelModuleInit", TRUE);
+
+        if (mqModules.size() > 1 && GetRCBoolW(L"LSPreloadModules", TRUE))
+        {
+            std::vector<std::wstring> vecPaths;
+
+            for (const Module* pModule : mqModules)
+            {
+                if (pModule &&
+                    _FindModule(pModule->GetLocation()) == m_ModuleQueue.end())
+                {
+                    vecPaths.push_back(pModule->GetLocation());
+                }
+            }
+
+            preloader.Start(vecPaths, MODULE_PRELOAD_THREADS);
+        }
+
         while (iter != mqModules.end())
         {
             if (*iter)
             {
-                if (_FindModule((*iter)->GetLocation()) == m_ModuleQueue.end())
+                // Scheduled modules only end up in m_ModuleQueue later on
+                if (_FindModule((*iter)->GetLocation()) == m_ModuleQueue.end() &&
+                    std::find_if(mqModules.begin(), iter,
+                        IsLocationEqual((*iter)->GetLocation())) == iter)
                 {
-                    if ((*iter)->Init(m_hLiteStep, m_sAppPath))
+                    HANDLE hPreload = preloader.Claim((*iter)->GetLocation());
+
+                    if (hPreload)
+                    {
+                        TimelineSpan span(L"module", L"Wait for preload " +
+                            std::wstring(PathFindFileNameW((*iter)->GetLocation())));
+                        _WaitForModules(&hPreload, 1);
+                    }
+
+                    if (bSchedule)
+                    {
+                        if ((*iter)->Load())
+                        {
+                            ++iter;
+                            continue;
+                        }
+                    }
+                    else if ((*iter)->Init(m_hLiteStep, m_sAppPath))
                     {
                         if ((*iter)->GetInitEvent())
                         {
-                            // Note: We are taking ownership of the Event handle
-                            //       here.  We call CloseHandle() below.
-                            vecInitEvents.push_back((*iter)->TakeInitEvent());
+                            vecStarting.push_back(_MakeStarting(*iter));
                         }
 
                         m_ModuleQueue.push_back(*iter);
@@ -229,19 +302,150 @@ UINT ModuleManager::_StartModules(ModuleQueue& mqModules)
             // If we got here, then this is an invalid entry, and needs erased.
             ModuleQueue::iterator iterOld = iter++;
 
-            delete *iterOld;
+            _DeleteModule(*iterOld);
             mqModules.erase(iterOld);
         }
 
+        if (bSchedule)
+        {
+            uReturn = _InitScheduled(mqModules);
+        }
+
         // Are there any "threaded" modules?
-        if (!vecInitEvents.empty())
+        if (!vecStarting.empty())
+        {
+            // Wait for all modules to signal that they have started, or to
+            // run out of time.
+            TimelineSpan span(L"module", L"Wait for threaded modules");
+
+            DWORD dwTimeout = (DWORD)std::max(0,
+                GetRCIntW(L"LSModuleInitTimeout", 0));
+
+            while (!vecStarting.empty())
+            {
+                size_t uStarted = _WaitForStartingModule(vecStarting, dwTimeout);
+                vecStarting.erase(vecStarting.begin() + uStarted);
+            }
+        }
+    }
+
+    return uReturn;
+}
+
+
+//
+// Returns the name other modules use to refer to a module, i.e. the file name
+// of its DLL without the extension
+//   (local helper function)
+//
+static std::wstring GetModuleName(LPCWSTR pwzLocation)
+{
+    std::wstring sName = PathFindFileNameW(pwzLocation);
+    std::wstring::size_type pos = sName.rfind(L'.');
+
+    if (pos != std::wstring::npos)
+    {
+        sName.erase(pos);
+    }
+
+    return sName;
+}
+
+
+UINT ModuleManager::_InitScheduled(ModuleQueue& mqModules)
+{
+    UINT uReturn = 0;
+
+    TimelineSpan span(L"module", L"Initialize modules in dependency order");
+
+    ModuleScheduler scheduler;
+    std::vector<Module*> vecModules(mqModules.begin(), mqModules.end());
+
+    for (const Module* pModule : vecModules)
+    {
+        scheduler.AddModule(GetModuleName(pModule->GetLocation()),
+            (pModule->GetFlags() & LS_MODULE_THREADED) ?
+            ModuleScheduler::THREAD_WORKER : ModuleScheduler::THREAD_MAIN);
+    }
+
+    for (size_t uIndex = 0; uIndex < vecModules.size(); ++uIndex)
+    {
+        for (const std::wstring& sDependency :
+            vecModules[uIndex]->GetDependencies())
+        {
+            if (!scheduler.AddDependency(uIndex, sDependency))
+            {
+                TRACE("%ls: ignoring unknown dependency \"%ls\"",
+                    vecModules[uIndex]->GetLocation(), sDependency.c_str());
+            }
+        }
+    }
+
+    scheduler.Start();
+
+    // Threaded modules that are still starting up
+    std::vector<StartingModule> vecStarting;
+
+    DWORD dwTimeout = (DWORD)std::max(0, GetRCIntW(L"LSModuleInitTimeout", 0));
+
+    while (!scheduler.IsDone())
+    {
+        size_t uModule = 0;
+
+        // Threaded modules first, so they get going while the main thread
+        // is busy
+        if (scheduler.NextReady(ModuleScheduler::THREAD_WORKER, &uModule) ||
+            scheduler.NextReady(ModuleScheduler::THREAD_MAIN, &uModule))
+        {
+            Module* pModule = vecModules[uModule];
+
+            if (pModule->Init(m_hLiteStep, m_sAppPath))
+            {
+                m_ModuleQueue.push_back(pModule);
+                ++uReturn;
+
+                if (pModule->GetInitEvent())
+                {
+                    vecStarting.push_back(_MakeStarting(pModule));
+                    vecStarting.back().uNode = uModule;
+                }
+                else
+                {
+                    scheduler.Complete(uModule);
+                }
+            }
+            else
+            {
+                mqModules.remove(pModule);
+                _DeleteModule(pModule);
+
+                scheduler.Complete(uModule);
+            }
+        }
+        else if (!vecStarting.empty())
+        {
+            // A module whose dependents started before it finished could
+            // find it half initialized, so those wait however long it takes
+            for (StartingModule& starting : vecStarting)
+            {
+                if (starting.bDeadline &&
+                    scheduler.HasWaitingDependents(starting.uNode))
+                {
+                    starting.bDeadline = false;
+                }
+            }
+
+            size_t uStarted = _WaitForStartingModule(vecStarting, dwTimeout);
+
+            scheduler.Complete(vecStarting[uStarted].uNode);
+            vecStarting.erase(vecStarting.begin() + uStarted);
+        }
+        else if (scheduler.IsStalled())
         {
-            // Wait for all modules to signal that they have started.
-            _WaitForModules(&vecInitEvents[0], vecInitEvents.size());
+            size_t uModule = scheduler.BreakCycle();
 
-            // Close the handles we have taken ownership of.
-            std::for_each(
-                vecInitEvents.begin(), vecInitEvents.end(), CloseHandle);
+            TRACE("%ls: dependency cycle, initializing anyway",
+                vecModules[uModule]->GetLocation());
         }
     }
 
@@ -251,6 +455,14 @@ UINT ModuleManager::_StartModules(ModuleQueue& mqModules)
 
 void ModuleManager::_QuitModules()
 {
+    std::vector<HANDLE> vecLateEvents;
+
+    // Nobody needs to hear about them anymore
+    while (!m_lateModules.empty())
+    {
+        vecLateEvents.push_back(_ForgetLateModule(m_lateModules.begin()));
+    }
+
     std::vector<HANDLE> vecQuitObjects;
     ModuleQueue::reverse_iterator iter = m_ModuleQueue.rbegin();
     ModuleQueue TempQueue;
@@ -289,11 +501,14 @@ void ModuleManager::_QuitModules()
             vecQuitObjects.begin(), vecQuitObjects.end(), CloseHandle);
     }
 
+    // Their threads are gone, so nobody sets these anymore
+    std::for_each(vecLateEvents.begin(), vecLateEvents.end(), CloseHandle);
+
     // Clean it all up
     iter = TempQueue.rbegin();
     while (iter != TempQueue.rend())
     {
-        delete *iter;
+        _DeleteModule(*iter);
         ++iter;
     }
 }
@@ -305,6 +520,8 @@ BOOL ModuleManager::QuitModule(HINSTANCE hModule)
 
     if (iter != m_ModuleQueue.end() && *iter)
     {
+        HANDLE hLateEvent = _ForgetLateModule(*iter);
+
         (*iter)->Quit();
 
         if ((*iter)->GetThread())
@@ -316,7 +533,12 @@ BOOL ModuleManager::QuitModule(HINSTANCE hModule)
             CloseHandle(hThread);
         }
 
-        delete *iter;
+        if (hLateEvent)
+        {
+            CloseHandle(hLateEvent);
+        }
+
+        _DeleteModule(*iter);
         m_ModuleQueue.erase(iter);
     }
 
@@ -345,19 +567,153 @@ BOOL ModuleManager::ReloadModule(HINSTANCE hModule)
 
     ModuleQueue::iterator iter = _FindModule(hModule);
 
-    if (iter != m_ModuleQueue.end())
+    if (iter != m_ModuleQueue.end() && *iter)
     {
-        std::wstring sLocation = (*iter)->GetLocation();
-        DWORD dwFlags = (*iter)->GetFlags();
-
-        QuitModule(hModule);
-        bReturn = LoadModule(sLocation.c_str(), dwFlags);
+        bReturn = ReloadModule((*iter)->GetLocation(), (*iter)->GetFlags());
     }
 
     return bReturn;
 }
 
 
+BOOL ModuleManager::ReloadModule(LPCWSTR pwzLocation, DWORD dwFlags)
+{
+    ModuleQueue::iterator iter = _FindModule(pwzLocation);
+
+    if (iter == m_ModuleQueue.end() || !*iter)
+    {
+        return LoadModule(pwzLocation, dwFlags);
+    }
+
+    Module* pModule = _MakeModule(pwzLocation, dwFlags);
+
+    if (pModule)
+    {
+        pModule->AddDependencies((*iter)->GetDependencies());
+    }
+
+    std::vector<std::pair<Module*, Module*> > vecReload(
+        1, std::make_pair(*iter, pModule));
+
+    return (_ReloadModules(vecReload, LS_MODULESTATE_RELOAD) == 1);
+}
+
+
+bool ModuleManager::ReloadModules(const std::vector<HINSTANCE>& vecModules)
+{
+    for (HINSTANCE hModule : vecModules)
+    {
+        if (_FindModule(hModule) == m_ModuleQueue.end())
+        {
+            return false;
+        }
+    }
+
+    // In the order they were loaded
+    std::vector<std::pair<Module*, Module*> > vecReload;
+
+    for (Module* pOld : m_ModuleQueue)
+    {
+        if (pOld && std::find(vecModules.begin(), vecModules.end(),
+            pOld->GetInstance()) != vecModules.end())
+        {
+            Module* pModule =
+                _MakeModule(pOld->GetLocation(), pOld->GetFlags());
+
+            if (pModule)
+            {
+                pModule->AddDependencies(pOld->GetDependencies());
+            }
+
+            vecReload.push_back(std::make_pair(pOld, pModule));
+        }
+    }
+
+    _ReloadModules(vecReload, LS_MODULESTATE_SETTINGSCHANGED);
+
+    return true;
+}
+
+
+UINT ModuleManager::_ReloadModules(
+    const std::vector<std::pair<Module*, Module*> >& vecReload, UINT uReason)
+{
+    std::vector<HANDLE> vecQuitObjects;
+    std::vector<HANDLE> vecLateEvents;
+    ModuleQueue mqModules;
+
+    // Quit in reverse order like _QuitModules, and wait for the threaded
+    // ones all at once
+    for (std::vector<std::pair<Module*, Module*> >::const_reverse_iterator
+         iter = vecReload.rbegin(); iter != vecReload.rend(); ++iter)
+    {
+        Module* pOld = iter->first;
+
+        HANDLE hLateEvent = _ForgetLateModule(pOld);
+
+        if (hLateEvent)
+        {
+            vecLateEvents.push_back(hLateEvent);
+        }
+
+        // No point saving state nobody will take
+        pOld->Quit(iter->second != nullptr ? uReason : 0);
+
+        if (pOld->GetThread())
+        {
+            vecQuitObjects.push_back(pOld->TakeThread());
+        }
+    }
+
+    if (!vecQuitObjects.empty())
+    {
+        _WaitForModules(&vecQuitObjects[0], vecQuitObjects.size());
+
+        std::for_each(
+            vecQuitObjects.begin(), vecQuitObjects.end(), CloseHandle);
+    }
+
+    std::for_each(vecLateEvents.begin(), vecLateEvents.end(), CloseHandle);
+
+    for (const std::pair<Module*, Module*>& reload : vecReload)
+    {
+        Module* pOld = reload.first;
+
+        if (reload.second)
+        {
+            // Moves the buffer, however large, without copying it
+            pOld->HandOverState(*reload.second);
+            mqModules.push_back(reload.second);
+        }
+
+        m_ModuleQueue.remove(pOld);
+        _DeleteModule(pOld);
+    }
+
+    return _StartModules(mqModules);
+}
+
+
+void ModuleManager::_DeleteModule(Module* pModule)
+{
+    if (pModule)
+    {
+        // The next DLL may well be loaded at the same address
+        if (m_pMessageManager)
+        {
+            m_pMessageManager->ResetDeliveryCount(pModule->GetInstance());
+        }
+
+        LSAPIForgetSettingsReader(pModule->GetInstance());
+
+        // Their functions are about to be unloaded
+        LSAPICancelModuleTasks(pModule->GetInstance());
+    }
+
+    delete pModule;
+}
+
+
 ModuleQueue::iterator ModuleManager::_FindModule(LPCWSTR pwzLocation)
 {
     return std::find_if(m_ModuleQueue.begin(), m_ModuleQueue.end(),
@@ -399,6 +755,179 @@ void ModuleManager::_WaitForModules(const HANDLE* pHandles, size_t stCount) cons
 }
 
 
+ModuleManager::StartingModule ModuleManager::_MakeStarting(Module* pModule)
+{
+    StartingModule starting;
+    starting.pModule = pModule;
+    starting.uNode = 0;
+    starting.bDeadline = true;
+
+    // Note: We are taking ownership of the Event handle here. It is closed
+    //       once the module is ready, or handed over to m_lateModules.
+    starting.hInitEvent = pModule->TakeInitEvent();
+
+    starting.dwStart = GetTickCount();
+    starting.ullStart = StartupTimeline::GetTimestamp();
+
+    return starting;
+}
+
+
+size_t ModuleManager::_WaitForStartingModule(
+    const std::vector<StartingModule>& vecStarting, DWORD dwTimeout)
+{
+    std::vector<HANDLE> vecEvents;
+
+    for (const StartingModule& starting : vecStarting)
+    {
+        vecEvents.push_back(starting.hInitEvent);
+    }
+
+    for (;;)
+    {
+        DWORD dwWait = INFINITE;
+
+        if (dwTimeout > 0)
+        {
+            DWORD dwNow = GetTickCount();
+
+            for (size_t uIndex = 0; uIndex < vecStarting.size(); ++uIndex)
+            {
+                if (!vecStarting[uIndex].bDeadline)
+                {
+                    continue;
+                }
+
+                DWORD dwElapsed = dwNow - vecStarting[uIndex].dwStart;
+
+                if (dwElapsed >= dwTimeout)
+                {
+                    _AddLateModule(vecStarting[uIndex]);
+                    return uIndex;
+                }
+
+                dwWait = std::min(dwWait, dwTimeout - dwElapsed);
+            }
+        }
+
+        // Handle all pending messages first
+        m_pILiteStep->PeekAllMsgs();
+
+        DWORD dwWaitStatus = MsgWaitForMultipleObjects((DWORD)vecEvents.size(),
+            &vecEvents[0], FALSE, dwWait, QS_ALLINPUT);
+
+        if ((dwWaitStatus >= WAIT_OBJECT_0) &&
+            (dwWaitStatus < (WAIT_OBJECT_0 + vecEvents.size())))
+        {
+            size_t uIndex = dwWaitStatus - WAIT_OBJECT_0;
+
+            CloseHandle(vecEvents[uIndex]);
+            return uIndex;
+        }
+    }
+}
+
+
+VOID CALLBACK ModuleManager::_LateModuleProc(PVOID pvLate, BOOLEAN /* bTimerFired */)
+{
+    const LateModule* pLate = (const LateModule*)pvLate;
+
+    PostMessage(pLate->hNotify, LM_MODULEINITDONE, (WPARAM)pLate->hInitEvent, 0);
+}
+
+
+void ModuleManager::_AddLateModule(const StartingModule& starting)
+{
+    TRACE("%ls did not start within %u ms, continuing without it",
+        starting.pModule->GetLocation(), GetTickCount() - starting.dwStart);
+
+    m_lateModules.push_back(LateModule());
+
+    LateModule& late = m_lateModules.back();
+    late.pModule = starting.pModule;
+    late.hInitEvent = starting.hInitEvent;
+    late.hWait = nullptr;
+    late.hNotify = m_hLiteStep;
+    late.ullStart = starting.ullStart;
+
+    if (!RegisterWaitForSingleObject(&late.hWait, late.hInitEvent,
+        _LateModuleProc, &late, INFINITE, WT_EXECUTEONLYONCE))
+    {
+        // Still tracked, just never announced
+        TRACE("Can't watch %ls: %u", late.pModule->GetLocation(),
+            GetLastError());
+
+        late.hWait = nullptr;
+    }
+}
+
+
+HANDLE ModuleManager::_ForgetLateModule(LateModuleList::iterator iter)
+{
+    if (iter->hWait)
+    {
+        // Blocks until _LateModuleProc is done with the entry
+        UnregisterWaitEx(iter->hWait, INVALID_HANDLE_VALUE);
+    }
+
+    HANDLE hInitEvent = iter->hInitEvent;
+    m_lateModules.erase(iter);
+
+    return hInitEvent;
+}
+
+
+HANDLE ModuleManager::_ForgetLateModule(const Module* pModule)
+{
+    for (LateModuleList::iterator iter = m_lateModules.begin();
+        iter != m_lateModules.end(); ++iter)
+    {
+        if (iter->pModule == pModule)
+        {
+            return _ForgetLateModule(iter);
+        }
+    }
+
+    return nullptr;
+}
+
+
+void ModuleManager::LateModuleReady(HANDLE hInitEvent)
+{
+    LateModuleList::iterator iter = m_lateModules.begin();
+
+    while (iter != m_lateModules.end() && iter->hInitEvent != hInitEvent)
+    {
+        ++iter;
+    }
+
+    // Gone already if the module has been unloaded in the meantime. The
+    // handle value may have been reused since, so check the event as well.
+    if (iter == m_lateModules.end() ||
+        WaitForSingleObject(hInitEvent, 0) != WAIT_OBJECT_0)
+    {
+        return;
+    }
+
+    Module* pModule = iter->pModule;
+
+    LSAPIRecordTimeline(L"module", (L"Late module " +
+        std::wstring(PathFindFileNameW(pModule->GetLocation()))).c_str(),
+        iter->ullStart, StartupTimeline::GetTimestamp());
+
+    // The thread has set the event already
+    CloseHandle(_ForgetLateModule(iter));
+
+    TRACE("%ls is ready", pModule->GetLocation());
+
+    if (m_pMessageManager)
+    {
+        m_pMessageManager->SendMessage(LM_MODULEREADY,
+            (WPARAM)pModule->GetInstance(), 0);
+    }
+}
+
+
 HRESULT ModuleManager::EnumModules(LSENUMMODULESPROCW pfnCallback, LPARAM lParam) const
 {
     HRESULT hr = S_OK;
@@ -435,3 +964,64 @@ HRESULT ModuleManager::EnumPerformance(LSENUMPERFORMANCEPROCW pfnCallback, LPARA
 
     return hr;
 }
+
+
+//
+// Sums up the calls to each module's bang commands
+//   (local helper function)
+//
+static BOOL CALLBACK CountBangCalls(HINSTANCE hInstance, LPCWSTR /* pwzBang */,
+    const LSBANGSTATS* pStats, LPARAM lParam)
+{
+    std::map<HINSTANCE, DWORD>& calls = *(std::map<HINSTANCE, DWORD>*)lParam;
+    calls[hInstance] += pStats->dwDirectCalls + pStats->dwQueuedCalls;
+
+    return TRUE;
+}
+
+
+HRESULT ModuleManager::EnumModuleStats(LSENUMMODULESTATSPROCW pfnCallback, LPARAM lParam) const
+{
+    std::map<HINSTANCE, DWORD> bangCalls;
+    EnumLSDataW(ELD_BANGSTATS, (FARPROC)CountBangCalls, (LPARAM)&bangCalls);
+
+    HRESULT hr = S_OK;
+
+    for (ModuleQueue::const_iterator iter = m_ModuleQueue.begin();
+        iter != m_ModuleQueue.end(); ++iter)
+    {
+        HINSTANCE hInstance = (*iter)->GetInstance();
+
+        LSMODULESTATS stats = { 0 };
+        stats.cbSize = sizeof(LSMODULESTATS);
+
+        (*iter)->GetStats(stats);
+
+        std::map<HINSTANCE, DWORD>::const_iterator calls =
+            bangCalls.find(hInstance);
+
+        if (calls != bangCalls.end())
+        {
+            stats.dwBangs = calls->second;
+        }
+
+        if (m_pMessageManager)
+        {
+            stats.dwBroadcasts = m_pMessageManager->GetDeliveryCount(hInstance);
+        }
+
+        if (!pfnCallback((*iter)->GetLocation(), &stats, lParam))
+        {
+            hr = S_FALSE;
+            break;
+        }
+    }
+
+    return hr;
+}
+
+
+void ModuleManager::SetMessageManager(MessageManager* pMessageManager)
+{
+    m_pMessageManager = pMessageManager;
+}
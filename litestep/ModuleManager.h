@@ -26,6 +26,10 @@
 #include "../utility/IManager.h"
 #include "../utility/common.h"
 #include <list>
+#include <utility>
+#include <vector>
+
+class MessageManager;
 
 
 /** List of modules */
@@ -107,7 +111,9 @@ public:
     BOOL QuitModule(LPCWSTR pwzLocation);
 
     /**
-     * Reloads a module given its instance handle
+     * Reloads a module given its instance handle. The module's state is
+     * handed over to the new instance if it supports that, see
+     * <code>saveModuleState</code>.
      *
      * @param  hModule  handle to the module's DLL instance
      * @return <code>TRUE</code> if successful or <code>FALSE</code> if an
@@ -115,6 +121,29 @@ public:
      */
     BOOL ReloadModule(HINSTANCE hModule);
 
+    /**
+     * Reloads a module given the path to its DLL, handing its state over
+     * like the other overload. Loads the module if it isn't loaded.
+     *
+     * @param  pwzLocation  path to the module's DLL
+     * @param  dwFlags      set of flags that control how the module is loaded
+     * @return <code>TRUE</code> if successful or <code>FALSE</code> if an
+     *         error occurs
+     */
+    BOOL ReloadModule(LPCWSTR pwzLocation, DWORD dwFlags);
+
+    /**
+     * Quits several modules and loads them again, keeping the order they
+     * were loaded in and their dependencies. Used by selective recycles, so
+     * the modules are told their settings changed when asked for their
+     * state.
+     *
+     * @param  vecModules  instance handles of the modules' DLLs
+     * @return <code>false</code> if one of the handles doesn't belong to a
+     *         loaded module, in which case nothing is done
+     */
+    bool ReloadModules(const std::vector<HINSTANCE>& vecModules);
+
     /**
      * Enumerates loaded modules. Calls the callback function once for each
      * loaded module. Continues until all modules have been enumerated or the
@@ -143,7 +172,75 @@ public:
      */
     HRESULT EnumPerformance(LSENUMPERFORMANCEPROCW pfnCallback, LPARAM lParam) const;
 
+    /**
+     * Enumerates extended statistics for loaded modules, see LSMODULESTATS.
+     * Calls the callback function once for each loaded module. Continues
+     * until all modules have been enumerated or the callback function returns
+     * <code>FALSE</code>.
+     *
+     * @param  pfnCallback  pointer to callback function
+     * @param  lParam       application-defined value passed to the callback
+     *                      function
+     * @return <code>S_OK</code> if all modules were enumerated,
+     *         <code>S_FALSE</code> if the callback function returned
+     *         <code>FALSE</code>, or an error code
+     */
+    HRESULT EnumModuleStats(LSENUMMODULESTATSPROCW pfnCallback, LPARAM lParam) const;
+
+    /**
+     * Sets the message manager that counts the broadcast messages modules
+     * handle.
+     *
+     * @param  pMessageManager  message manager, or <code>nullptr</code> for
+     *                          none. Must stay valid until it is replaced.
+     */
+    void SetMessageManager(MessageManager* pMessageManager);
+
+    /**
+     * Called on LM_MODULEINITDONE, once a threaded module that missed
+     * LSModuleInitTimeout has finished initializing. Announces the module
+     * with LM_MODULEREADY.
+     *
+     * @param  hInitEvent  the module's init event
+     */
+    void LateModuleReady(HANDLE hInitEvent);
+
 private:
+    /** A threaded module that is still initializing */
+    struct StartingModule
+    {
+        Module* pModule;
+        HANDLE hInitEvent;
+
+        /** Node in the ModuleScheduler, if any */
+        size_t uNode;
+
+        /** Whether LSModuleInitTimeout applies, see _InitScheduled */
+        bool bDeadline;
+
+        /** GetTickCount and StartupTimeline timestamp at Init */
+        DWORD dwStart;
+        ULONGLONG ullStart;
+    };
+
+    /** A threaded module that missed LSModuleInitTimeout */
+    struct LateModule
+    {
+        Module* pModule;
+        HANDLE hInitEvent;
+
+        /** RegisterWaitForSingleObject handle */
+        HANDLE hWait;
+
+        /** Window to post LM_MODULEINITDONE to */
+        HWND hNotify;
+
+        ULONGLONG ullStart;
+    };
+
+    /** Elements must not move while their wait is registered */
+    typedef std::list<LateModule> LateModuleList;
+
     /**
      * Loads all the modules specified in <code>step.rc</code>.
      *
@@ -159,11 +256,39 @@ private:
      */
     UINT _StartModules(ModuleQueue& mqModules);
 
+    /**
+     * Initializes loaded modules once the modules they depend on have been
+     * initialized, see ModuleScheduler. Threaded modules start up alongside
+     * each other and the main thread. A module that other modules still wait
+     * for is never left behind by LSModuleInitTimeout. Removes the modules
+     * that fail to initialize from the list.
+     *
+     * @param  mqModules  list of loaded modules to initialize
+     * @return number of modules initialized
+     */
+    UINT _InitScheduled(ModuleQueue& mqModules);
+
     /**
      * Unloads all loaded modules.
      */
     void _QuitModules();
 
+    /**
+     * Replaces loaded modules with new instances. The old ones are quit in
+     * reverse order and their state is handed over to the new ones, which
+     * are then initialized like in <code>_StartModules</code>.
+     *
+     * @param  vecReload  pairs of a loaded module, in the order they were
+     *                    loaded, and the module that replaces it, or
+     *                    <code>nullptr</code>
+     * @param  uReason    <code>LS_MODULESTATE_</code> reason passed to the
+     *                    modules' <code>saveModuleState</code> functions
+     * @return number of modules initialized
+     */
+    UINT _ReloadModules(
+        const std::vector<std::pair<Module*, Module*> >& vecReload,
+        UINT uReason);
+
     /**
      * Finds a module in the loaded module list based on the path to its DLL.
      *
@@ -196,9 +321,69 @@ private:
      */
     void _WaitForModules(const HANDLE* pHandles, size_t stCount) const;
 
+    /**
+     * Takes over a threaded module's init event, and notes when it started.
+     *
+     * @param  pModule  module that has just been initialized
+     */
+    StartingModule _MakeStarting(Module* pModule);
+
+    /**
+     * Waits for one of the starting modules to be ready or to miss its
+     * deadline, while remaining responsive to user input. The init event of
+     * a ready module is closed, a late one goes to <code>_AddLateModule</code>.
+     * Modules whose <code>bDeadline</code> is cleared are waited for however
+     * long they take.
+     *
+     * @param  vecStarting  modules that are starting, must not be empty
+     * @param  dwTimeout    deadline of each module in milliseconds after it
+     *                      was started, or 0 for none
+     * @return index of the module
+     */
+    size_t _WaitForStartingModule(
+        const std::vector<StartingModule>& vecStarting, DWORD dwTimeout);
+
+    /**
+     * Continues without a module that missed its deadline. It is announced
+     * once it is ready, see <code>LateModuleReady</code>.
+     */
+    void _AddLateModule(const StartingModule& starting);
+
+    /**
+     * Stops tracking a late module. Its thread may still be initializing and
+     * set the init event, so the caller closes it once the thread is gone.
+     *
+     * @return the module's init event
+     */
+    HANDLE _ForgetLateModule(LateModuleList::iterator iter);
+
+    /**
+     * Stops tracking a module if it is late.
+     *
+     * @return the module's init event, or <code>nullptr</code> if it isn't
+     *         late
+     */
+    HANDLE _ForgetLateModule(const Module* pModule);
+
+    /** Wait callback for late modules, runs on a thread pool thread */
+    static VOID CALLBACK _LateModuleProc(PVOID pvLate, BOOLEAN bTimerFired);
+
+    /**
+     * Deletes a module that has quit.
+     *
+     * @param  pModule  module to delete
+     */
+    void _DeleteModule(Module* pModule);
+
     /** List of loaded modules */
     ModuleQueue m_ModuleQueue;
 
+    /** Loaded modules that are still initializing past their deadline */
+    LateModuleList m_lateModules;
+
+    /** Counts broadcast messages, not owned */
+    MessageManager* m_pMessageManager;
+
     /** Pointer to LiteStep's core interface */
     ILiteStep *m_pILiteStep;
 
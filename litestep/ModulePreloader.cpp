@@ -0,0 +1,169 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "ModulePreloader.h"
+#include "../utility/core.hpp"
+#include <algorithm>
+#include <functional>
+
+
+ModulePreloader::ModulePreloader(IModuleLoader* pLoader)
+    : m_pLoader(pLoader)
+    , m_uNext(0)
+{
+    ASSERT(pLoader != nullptr);
+}
+
+
+ModulePreloader::~ModulePreloader()
+{
+    Stop();
+    delete m_pLoader;
+}
+
+
+void ModulePreloader::Start(const std::vector<std::wstring>& paths, UINT uThreads)
+{
+    ASSERT(m_entries.empty() && m_workers.empty());
+
+    m_entries.resize(paths.size());
+
+    for (size_t uIndex = 0; uIndex < paths.size(); ++uIndex)
+    {
+        Entry& entry = m_entries[uIndex];
+
+        entry.sPath = paths[uIndex];
+        entry.state = STATE_QUEUED;
+        entry.hModule = nullptr;
+        entry.hDone = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    }
+
+    size_t cThreads = std::min<size_t>(uThreads, paths.size());
+
+    for (size_t uThread = 0; uThread < cThreads; ++uThread)
+    {
+        m_workers.push_back(
+            std::thread(std::bind(&ModulePreloader::_ThreadProc, this)));
+    }
+}
+
+
+HANDLE ModulePreloader::Claim(LPCWSTR pwzPath)
+{
+    Lock lock(m_cs);
+
+    for (Entry& entry : m_entries)
+    {
+        if (_wcsicmp(entry.sPath.c_str(), pwzPath) != 0)
+        {
+            continue;
+        }
+
+        if (entry.state == STATE_QUEUED)
+        {
+            // Quicker to load it right away than to wait for a worker
+            entry.state = STATE_CANCELLED;
+        }
+        else if (entry.state == STATE_LOADING)
+        {
+            return entry.hDone;
+        }
+    }
+
+    return nullptr;
+}
+
+
+void ModulePreloader::Stop()
+{
+    {
+        Lock lock(m_cs);
+
+        for (Entry& entry : m_entries)
+        {
+            if (entry.state == STATE_QUEUED)
+            {
+                entry.state = STATE_CANCELLED;
+            }
+        }
+    }
+
+    for (std::thread& worker : m_workers)
+    {
+        worker.join();
+    }
+
+    m_workers.clear();
+
+    for (Entry& entry : m_entries)
+    {
+        // Modules that loaded keep their own reference
+        if (entry.hModule != nullptr)
+        {
+            m_pLoader->Free(entry.hModule);
+        }
+
+        CloseHandle(entry.hDone);
+    }
+
+    m_entries.clear();
+    m_uNext = 0;
+}
+
+
+void ModulePreloader::_ThreadProc()
+{
+    for (;;)
+    {
+        Entry* pEntry = nullptr;
+
+        {
+            Lock lock(m_cs);
+
+            while (m_uNext < m_entries.size() && pEntry == nullptr)
+            {
+                if (m_entries[m_uNext].state == STATE_QUEUED)
+                {
+                    pEntry = &m_entries[m_uNext];
+                    pEntry->state = STATE_LOADING;
+                }
+
+                ++m_uNext;
+            }
+        }
+
+        if (pEntry == nullptr)
+        {
+            break;
+        }
+
+        HMODULE hModule = m_pLoader->Load(pEntry->sPath.c_str());
+
+        {
+            Lock lock(m_cs);
+
+            pEntry->hModule = hModule;
+            pEntry->state = STATE_DONE;
+        }
+
+        SetEvent(pEntry->hDone);
+    }
+}
@@ -0,0 +1,127 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(MODULEPRELOADER_H)
+#define MODULEPRELOADER_H
+
+#include "ModuleLoader.h"
+#include "../utility/common.h"
+#include "../utility/criticalsection.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Loads module DLLs on worker threads ahead of time, so the disk I/O and
+ * relocation of all of them overlaps while the modules are still
+ * initialized one by one, in order, on the main thread.
+ *
+ * Modules are preloaded in the order they are given. Before the main thread
+ * loads a module itself it calls Claim, which either cancels a preload that
+ * hasn't started yet or returns an event to wait for. The preloader holds on
+ * to the DLLs it loaded until Stop, by which time the modules have loaded
+ * them for themselves.
+ */
+class ModulePreloader
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param  pLoader  loader to use. The preloader takes over ownership.
+     */
+    explicit ModulePreloader(IModuleLoader* pLoader);
+
+    /**
+     * Destructor. Calls Stop.
+     */
+    ~ModulePreloader();
+
+    /**
+     * Starts preloading. Must not be called again before Stop.
+     *
+     * @param  paths     DLLs to preload, as given to LoadModule
+     * @param  uThreads  maximum number of worker threads
+     */
+    void Start(const std::vector<std::wstring>& paths, UINT uThreads);
+
+    /**
+     * Gets a DLL ready to be loaded by the main thread. A preload that has
+     * not started yet is cancelled.
+     *
+     * @param  pwzPath  path to the DLL, as passed to Start
+     * @return Event that is set once a preload that is in progress is done,
+     *         or <code>nullptr</code> if there is nothing to wait for. The
+     *         event stays valid until Stop.
+     */
+    HANDLE Claim(LPCWSTR pwzPath);
+
+    /**
+     * Cancels the preloads that haven't started, waits for the others, and
+     * releases all preloaded DLLs.
+     */
+    void Stop();
+
+private:
+    /** Progress of a single DLL */
+    enum State
+    {
+        STATE_QUEUED,
+        STATE_LOADING,
+        STATE_DONE,
+        STATE_CANCELLED
+    };
+
+    /** A DLL to preload */
+    struct Entry
+    {
+        std::wstring sPath;
+        State state;
+        HMODULE hModule;
+
+        /** Set once state is STATE_DONE */
+        HANDLE hDone;
+    };
+
+    /** Loads queued DLLs until there are none left */
+    void _ThreadProc();
+
+    IModuleLoader* m_pLoader;
+
+    /** Never resized while the workers run */
+    std::vector<Entry> m_entries;
+
+    /** First entry that may still be queued */
+    size_t m_uNext;
+
+    std::vector<std::thread> m_workers;
+
+    /** Protects the entries' state and hModule, and m_uNext */
+    CriticalSection m_cs;
+
+    // Not implemented
+    ModulePreloader(const ModulePreloader& rhs);
+    ModulePreloader& operator=(const ModulePreloader& rhs);
+};
+
+#endif // MODULEPRELOADER_H
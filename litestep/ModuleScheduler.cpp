@@ -0,0 +1,189 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "ModuleScheduler.h"
+#include <cwctype>
+
+
+static bool IsNameEqual(const std::wstring& sLeft, const std::wstring& sRight)
+{
+    if (sLeft.size() != sRight.size())
+    {
+        return false;
+    }
+
+    for (size_t uIndex = 0; uIndex < sLeft.size(); ++uIndex)
+    {
+        if (towlower(sLeft[uIndex]) != towlower(sRight[uIndex]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+ModuleScheduler::ModuleScheduler()
+    : m_cDone(0)
+    , m_cRunning(0)
+{
+    // do nothing
+}
+
+
+size_t ModuleScheduler::AddModule(const std::wstring& sName, Thread thread)
+{
+    Node node;
+    node.sName = sName;
+    node.thread = thread;
+    node.state = STATE_WAITING;
+    node.cPending = 0;
+
+    m_nodes.push_back(node);
+
+    return m_nodes.size() - 1;
+}
+
+
+bool ModuleScheduler::AddDependency(size_t uModule, const std::wstring& sDependency)
+{
+    bool bFound = false;
+
+    for (size_t uIndex = 0; uIndex < m_nodes.size(); ++uIndex)
+    {
+        if (uIndex != uModule && IsNameEqual(m_nodes[uIndex].sName, sDependency))
+        {
+            m_nodes[uIndex].dependents.push_back(uModule);
+            ++m_nodes[uModule].cPending;
+
+            bFound = true;
+        }
+    }
+
+    return bFound;
+}
+
+
+void ModuleScheduler::Start()
+{
+    for (Node& node : m_nodes)
+    {
+        if (node.cPending == 0)
+        {
+            node.state = STATE_READY;
+        }
+    }
+}
+
+
+bool ModuleScheduler::NextReady(Thread thread, size_t* puModule)
+{
+    for (size_t uIndex = 0; uIndex < m_nodes.size(); ++uIndex)
+    {
+        Node& node = m_nodes[uIndex];
+
+        if (node.state == STATE_READY && node.thread == thread)
+        {
+            node.state = STATE_RUNNING;
+            ++m_cRunning;
+
+            *puModule = uIndex;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void ModuleScheduler::Complete(size_t uModule)
+{
+    Node& node = m_nodes[uModule];
+
+    if (node.state != STATE_RUNNING)
+    {
+        return;
+    }
+
+    node.state = STATE_DONE;
+    --m_cRunning;
+    ++m_cDone;
+
+    for (size_t uDependent : node.dependents)
+    {
+        Node& dependent = m_nodes[uDependent];
+
+        // BreakCycle may have let it go ahead already
+        if (dependent.state == STATE_WAITING && --dependent.cPending == 0)
+        {
+            dependent.state = STATE_READY;
+        }
+    }
+}
+
+
+bool ModuleScheduler::IsStalled() const
+{
+    if (IsDone() || m_cRunning != 0)
+    {
+        return false;
+    }
+
+    for (const Node& node : m_nodes)
+    {
+        if (node.state == STATE_READY)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool ModuleScheduler::HasWaitingDependents(size_t uModule) const
+{
+    for (size_t uDependent : m_nodes[uModule].dependents)
+    {
+        if (m_nodes[uDependent].state == STATE_WAITING)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+size_t ModuleScheduler::BreakCycle()
+{
+    for (size_t uIndex = 0; uIndex < m_nodes.size(); ++uIndex)
+    {
+        if (m_nodes[uIndex].state == STATE_WAITING)
+        {
+            m_nodes[uIndex].state = STATE_READY;
+            return uIndex;
+        }
+    }
+
+    return m_nodes.size();
+}
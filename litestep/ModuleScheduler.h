@@ -0,0 +1,158 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(MODULESCHEDULER_H)
+#define MODULESCHEDULER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+/**
+ * Decides in which order modules are initialized when they declare
+ * dependencies on each other, see LSParallelModuleInit.
+ *
+ * A module becomes ready once all modules it depends on have completed
+ * their initialization. Modules that run on their own thread can then be
+ * started right away, alongside each other and the main thread. Modules
+ * that run on the main thread are initialized one at a time. Among ready
+ * modules, those added first go first.
+ *
+ * This class only keeps the books, ModuleManager does the actual work. It
+ * doesn't depend on anything Windows specific, so it can be tested on its
+ * own with made-up module graphs.
+ */
+class ModuleScheduler
+{
+public:
+    /** Where a module is initialized */
+    enum Thread
+    {
+        THREAD_MAIN,        // on the main thread, one at a time
+        THREAD_WORKER       // on its own thread
+    };
+
+    /**
+     * Constructor.
+     */
+    ModuleScheduler();
+
+    /**
+     * Adds a module. Must be called before Start.
+     *
+     * @param  sName   name that other modules refer to it by
+     * @param  thread  where the module is initialized
+     * @return index of the module, which the other functions take
+     */
+    size_t AddModule(const std::wstring& sName, Thread thread);
+
+    /**
+     * Makes a module wait for all added modules with a name. Must be called
+     * before Start.
+     *
+     * @param  uModule      index of the dependent module
+     * @param  sDependency  name of the module(s) it depends on. Names are
+     *                      compared case insensitively.
+     * @return <code>false</code> if no other module has that name
+     */
+    bool AddDependency(size_t uModule, const std::wstring& sDependency);
+
+    /**
+     * Finishes setting up. Modules without dependencies become ready.
+     */
+    void Start();
+
+    /**
+     * Takes the next ready module that runs on the given thread, and marks
+     * it as running.
+     *
+     * @param  thread     kind of thread that wants work
+     * @param  puModule   receives the index of the module
+     * @return <code>false</code> if no such module is ready
+     */
+    bool NextReady(Thread thread, size_t* puModule);
+
+    /**
+     * Marks a running module as initialized, whether or not that succeeded.
+     * Modules waiting for it may become ready.
+     *
+     * @param  uModule  index of the module
+     */
+    void Complete(size_t uModule);
+
+    /**
+     * Checks if all modules have been initialized.
+     */
+    bool IsDone() const
+    {
+        return m_cDone == m_nodes.size();
+    }
+
+    /**
+     * Checks if the modules that are left wait for each other. That is the
+     * case if none is ready or running, but not all are done.
+     */
+    bool IsStalled() const;
+
+    /**
+     * Checks if any module is still waiting for a module to complete.
+     *
+     * @param  uModule  index of the module
+     */
+    bool HasWaitingDependents(size_t uModule) const;
+
+    /**
+     * Breaks a dependency cycle by making the first waiting module ready,
+     * regardless of what it waits for.
+     *
+     * @return index of the module
+     */
+    size_t BreakCycle();
+
+private:
+    enum State
+    {
+        STATE_WAITING,
+        STATE_READY,
+        STATE_RUNNING,
+        STATE_DONE
+    };
+
+    struct Node
+    {
+        std::wstring sName;
+        Thread thread;
+        State state;
+
+        /** Number of dependencies that aren't done yet */
+        size_t cPending;
+
+        /** Modules that depend on this one */
+        std::vector<size_t> dependents;
+    };
+
+    std::vector<Node> m_nodes;
+    size_t m_cDone;
+    size_t m_cRunning;
+};
+
+#endif // MODULESCHEDULER_H
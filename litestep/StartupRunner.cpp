@@ -20,6 +20,7 @@
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 #include "StartupRunner.h"
+#include "../lsapi/StartupTimeline.h"
 #include "../utility/core.hpp"
 #include <regstr.h>
 
@@ -57,6 +58,8 @@ void StartupRunner::Run(BOOL bForce)
 
 DWORD WINAPI StartupRunner::_ThreadProc(LPVOID lpData)
 {
+    TimelineSpan span(L"startup", L"StartupRunner");
+
     bool bRunStartup = IsFirstRunThisSession(_T("StartupHasBeenRun"));
     BOOL bForceStartup = (lpData != 0);
 
@@ -142,6 +145,8 @@ DWORD WINAPI StartupRunner::_ThreadProc(LPVOID lpData)
 
 void StartupRunner::_RunRunOnceEx()
 {
+    TimelineSpan span(L"startup", L"RunOnceEx");
+
     //
     // TODO: Figure out how this works on Win64
     //
@@ -166,6 +171,8 @@ void StartupRunner::_RunRunOnceEx()
 
 void StartupRunner::_RunStartupMenu()
 {
+    TimelineSpan span(L"startup", L"Startup folders");
+
     _RunShellFolderContents(CSIDL_COMMON_STARTUP);
     _RunShellFolderContents(CSIDL_COMMON_ALTSTARTUP);
 
@@ -335,6 +342,9 @@ bool StartupRunner::IsFirstRunThisSession(LPCTSTR pszSubkey)
 //
 void StartupRunner::_RunRegKeys(HKEY hkParent, LPCTSTR ptzSubKey, DWORD dwFlags)
 {
+    TimelineSpan span(L"startup", std::wstring(
+        (hkParent == HKEY_LOCAL_MACHINE) ? L"HKLM\\" : L"HKCU\\") + ptzSubKey);
+
 #ifdef _WIN64
     if (dwFlags & ERK_WIN64_BOTH)
 #else
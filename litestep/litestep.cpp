@@ -32,6 +32,7 @@
 
 // Managers
 #include "MessageManager.h"
+#include "MessageTracer.h"
 #include "ModuleManager.h"
 
 // Other
@@ -39,11 +40,12 @@
 #include "StartupRunner.h"
 #include "Utility.h"
 #include "../lsapi/lsapiInit.h"
-#include "../lsapi/ThreadedBangCommand.h"
+#include "../lsapi/StartupTimeline.h"
 #include "../utility/macros.h"
 #include "../utility/core.hpp"
 #include <algorithm>
 #include <functional>
+#include <vector>
 #include <Psapi.h>
 #include <WtsApi32.h>
 
@@ -265,6 +267,7 @@ CLiteStep::CLiteStep()
     m_pModuleManager = nullptr;
     m_pDataStoreManager = nullptr;
     m_pMessageManager = nullptr;
+    m_pMessageTracer = nullptr;
     m_bSignalExit = false;
     m_pTrayService = nullptr;
     m_pFullscreenMonitor = nullptr;
@@ -411,7 +414,11 @@ HRESULT CLiteStep::Start(HINSTANCE hInstance, WORD wStartFlags)
 
     if (SUCCEEDED(hr))
     {
+        TimelineSpan span(L"litestep", L"CreateMainWindow");
         hr = CreateMainWindow();
+
+        // Wakes up the main thread for bang commands queued by other threads
+        LSAPIAttachThread();
     }
 
     //
@@ -471,6 +478,8 @@ HRESULT CLiteStep::Stop()
     _StopManagers();
     _CleanupManagers();
 
+    LSAPIDetachThread();
+
     _StopServices();
     _CleanupServices();
 
@@ -642,14 +651,8 @@ void CLiteStep::MessageHandler(MSG &message)
         {
         case LM_THREAD_BANGCOMMAND:
             {
-                ThreadedBangCommand* pInfo = \
-                    (ThreadedBangCommand*)message.wParam;
-
-                if (NULL != pInfo)
-                {
-                    pInfo->Execute();
-                    pInfo->Release(); // check BangCommand.cpp for the reason
-                }
+                // one wakeup covers everything queued so far
+                LSAPIProcessBangQueue();
             }
             break;
 
@@ -791,6 +794,19 @@ LRESULT CALLBACK CLiteStep::ExternalWndProc(HWND hWnd, UINT uMsg, WPARAM wParam,
 
     if (pLiteStep)
     {
+        MessageTracer* pTracer = pLiteStep->m_pMessageTracer;
+
+        if (pTracer != nullptr && pTracer->IsEnabled())
+        {
+            ULONGLONG ullStart = MessageTracer::GetTimestamp();
+
+            LRESULT lResult =
+                pLiteStep->InternalWndProc(hWnd, uMsg, wParam, lParam);
+
+            pTracer->RecordMessage(uMsg, ullStart);
+            return lResult;
+        }
+
         return pLiteStep->InternalWndProc(hWnd, uMsg, wParam, lParam);
     }
 
@@ -931,6 +947,56 @@ LRESULT CLiteStep::InternalWndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM l
         }
         break;
 
+    case LM_ENUMMODULESTATS:
+        {
+            HRESULT hr = E_FAIL;
+
+            if (m_pModuleManager)
+            {
+                hr = m_pModuleManager->EnumModuleStats(
+                    (LSENUMMODULESTATSPROCW)wParam, lParam);
+            }
+
+            return hr;
+        }
+        break;
+
+    case LM_MODULEINITDONE:
+        {
+            if (m_pModuleManager)
+            {
+                m_pModuleManager->LateModuleReady((HANDLE)wParam);
+            }
+        }
+        break;
+
+    case LM_DUMPMESSAGETRACE:
+        {
+            HRESULT hr = E_FAIL;
+
+            if (m_pMessageTracer)
+            {
+                hr = m_pMessageTracer->Write((LPCWSTR)lParam);
+            }
+
+            return hr;
+        }
+        break;
+
+    case LM_ENUMSLOWWINDOWS:
+        {
+            HRESULT hr = E_FAIL;
+
+            if (m_pMessageManager)
+            {
+                hr = m_pMessageManager->EnumSlowWindows(
+                    (LSENUMSLOWWINDOWSPROC)wParam, lParam);
+            }
+
+            return hr;
+        }
+        break;
+
     case LM_RECYCLE:
         {
             switch (wParam)
@@ -987,9 +1053,8 @@ LRESULT CLiteStep::InternalWndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM l
 
                     if (pszPath != nullptr)
                     {
-                        std::unique_ptr<wchar_t> wzPath(WCSFromMBS(pszPath));
-                        m_pModuleManager->QuitModule(wzPath.get());
-                        m_pModuleManager->LoadModule(wzPath.get(), (DWORD)lParam);
+                        ConvertedWCS<> wzPath(pszPath);
+                        m_pModuleManager->ReloadModule(wzPath.get(), (DWORD)lParam);
                     }
                 }
             }
@@ -1012,8 +1077,7 @@ LRESULT CLiteStep::InternalWndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM l
 
                     if (pwzPath != nullptr)
                     {
-                        m_pModuleManager->QuitModule(pwzPath);
-                        m_pModuleManager->LoadModule(pwzPath, (DWORD)lParam);
+                        m_pModuleManager->ReloadModule(pwzPath, (DWORD)lParam);
                     }
                 }
             }
@@ -1134,7 +1198,15 @@ LRESULT CLiteStep::InternalWndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM l
         {
             if (m_pMessageManager)
             {
-                m_pMessageManager->RemoveMessages((HWND)wParam, (UINT *)lParam);
+                // A NULL list unregisters everything the window registered
+                if (lParam == 0)
+                {
+                    m_pMessageManager->RemoveWindow((HWND)wParam);
+                }
+                else
+                {
+                    m_pMessageManager->RemoveMessages((HWND)wParam, (UINT *)lParam);
+                }
             }
         }
         break;
@@ -1219,6 +1291,7 @@ LRESULT CLiteStep::_HandleSessionChange(DWORD dwCode, DWORD /* dwSession */)
 //
 HRESULT CLiteStep::_InitServices(bool bSetAsShell)
 {
+    TimelineSpan span(L"litestep", L"CLiteStep::_InitServices");
     IService* pService = nullptr;
 
     //
@@ -1320,6 +1393,8 @@ HRESULT CLiteStep::_InitServices(bool bSetAsShell)
 //
 HRESULT CLiteStep::_StartServices()
 {
+    TimelineSpan span(L"litestep", L"CLiteStep::_StartServices");
+
     // use std::transform to add error checking to this
     for_each(m_Services.begin(), m_Services.end(), mem_fun(&IService::Start));
     return S_OK;
@@ -1357,7 +1432,11 @@ HRESULT CLiteStep::_InitManagers()
 
     m_pMessageManager = new MessageManager();
 
+    m_pMessageTracer = new MessageTracer();
+    m_pMessageManager->SetTracer(m_pMessageTracer);
+
     m_pModuleManager = new ModuleManager();
+    m_pModuleManager->SetMessageManager(m_pMessageManager);
 
     // Note:
     // - The DataStore manager is dynamically initialized/started.
@@ -1375,11 +1454,39 @@ HRESULT CLiteStep::_StartManagers()
 {
     HRESULT hr = S_OK;
 
+    // Also covers recycles
+    TimelineSpan span(L"litestep", L"CLiteStep::_StartManagers");
+
+    // Record which settings each module reads, so the next recycle can
+    // restart just the modules whose settings have changed
+    LSAPITrackSettings(GetRCBoolW(L"LSSelectiveRecycle", TRUE));
+
+    // Time limit for broadcasts to each module window, so a hung module
+    // can't freeze the shell. Read here so it follows recycles.
+    wchar_t wzSlowPolicy[MAX_PATH] = { 0 };
+    GetRCStringW(L"LSBroadcastSlowWindows", wzSlowPolicy, L"skip", MAX_PATH);
+
+    m_pMessageManager->SetBroadcastPolicy(
+        (UINT)std::max(0, GetRCIntW(L"LSBroadcastTimeout", 0)),
+        (_wcsicmp(wzSlowPolicy, L"post") == 0) ?
+            MessageManager::SLOW_POST : MessageManager::SLOW_SKIP,
+        (DWORD)std::max(0, GetRCIntW(L"LSBroadcastRetry", 30000)));
+
+    // Message tracing, off unless a file is given
+    wchar_t wzTraceFile[MAX_PATH] = { 0 };
+
+    if (GetRCStringW(L"LSMessageTrace", wzTraceFile, nullptr, MAX_PATH) &&
+        wzTraceFile[0] != L'\0')
+    {
+        m_pMessageTracer->Start(wzTraceFile);
+    }
+
     // Load modules
     m_pModuleManager->Start(this);
 
     // Note:
-    // - MessageManager has/needs no Start method.
+    // - MessageManager has/needs no Start method, SetBroadcastPolicy is
+    //   all it needs.
     // - The DataStore manager is dynamically initialized/started.
 
     return hr;
@@ -1398,6 +1505,9 @@ HRESULT CLiteStep::_StopManagers()
     // Clean up as modules might not have
     m_pMessageManager->ClearMessages();
 
+    // Writes the trace file, if tracing is on
+    m_pMessageTracer->Stop();
+
     // Note:
     // - The DataStore manager is persistent.
     // - The Message manager can not be "stopped", just cleared.
@@ -1423,6 +1533,12 @@ void CLiteStep::_CleanupManagers()
         m_pMessageManager = NULL;
     }
 
+    if (m_pMessageTracer)
+    {
+        delete m_pMessageTracer;
+        m_pMessageTracer = nullptr;
+    }
+
     if (m_pDataStoreManager)
     {
         delete m_pDataStoreManager;
@@ -1445,6 +1561,17 @@ void CLiteStep::_Recycle()
     {
         return;
     }
+
+    // Otherwise every recycle adds to the timeline until it is full, and
+    // the latest ones are never recorded
+    LSAPIResetTimeline();
+
+    // Pausing only makes sense while all modules are unloaded
+    if (!(GetAsyncKeyState(VK_SHIFT) & 0x8000) && _RecycleChanged())
+    {
+        return;
+    }
+
     _StopManagers();
 
     if (GetAsyncKeyState(VK_SHIFT) & 0x8000)
@@ -1465,6 +1592,49 @@ void CLiteStep::_Recycle()
 }
 
 
+//
+// CollectChangedReader
+//   (Callback for LSAPIReloadChangedSettings)
+//
+static void CALLBACK CollectChangedReader(HINSTANCE hReader, LPARAM lParam)
+{
+    ((std::vector<HINSTANCE>*)lParam)->push_back(hReader);
+}
+
+
+//
+// _RecycleChanged
+//
+bool CLiteStep::_RecycleChanged()
+{
+    TimelineSpan span(L"litestep", L"CLiteStep::_RecycleChanged");
+
+    std::vector<HINSTANCE> vecChanged;
+
+    // Does nothing unless LSSelectiveRecycle was on when the modules were
+    // started, since their reads have to be known
+    if (!LSAPIReloadChangedSettings(CollectChangedReader, (LPARAM)&vecChanged))
+    {
+        return false;
+    }
+
+    // Anything but a module, e.g. litestep.exe reading the LoadModule lines,
+    // takes a full recycle. So does turning LSSelectiveRecycle off.
+    if (!GetRCBoolW(L"LSSelectiveRecycle", TRUE) ||
+        !m_pModuleManager->ReloadModules(vecChanged))
+    {
+        return false;
+    }
+
+    TRACE("Selective recycle: restarted %u modules", (UINT)vecChanged.size());
+
+    // The others can check for themselves whether anything they use changed
+    m_pMessageManager->SendMessage(LM_SETTINGSCHANGED, 0, 0);
+
+    return true;
+}
+
+
 //
 // _EnumRevIDs
 //
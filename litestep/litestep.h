@@ -34,6 +34,7 @@ class TrayService;
 class FullscreenMonitor;
 class DataStore;
 class MessageManager;
+class MessageTracer;
 class ModuleManager;
 
 
@@ -91,6 +92,7 @@ private:
     LRESULT _HandleSessionChange(DWORD dwCode, DWORD dwSession);
 
     void _Recycle();
+    bool _RecycleChanged();
     HRESULT _EnumRevIDs(LSENUMREVIDSPROCW pfnCallback, LPARAM lParam) const;
     static BOOL _SetShellWindow(HWND hWnd);
 
@@ -120,6 +122,7 @@ private:
     ModuleManager* m_pModuleManager; // = NULL;
     DataStore* m_pDataStoreManager; // = NULL;
     MessageManager* m_pMessageManager; // = NULL;
+    MessageTracer* m_pMessageTracer; // = nullptr;
 
     HRESULT _InitManagers();
     HRESULT _StartManagers();
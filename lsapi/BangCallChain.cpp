@@ -0,0 +1,290 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "BangCallChain.h"
+#include "BangCommand.h"
+#include "lsapiInit.h"
+#include "../utility/core.hpp"
+#include "../utility/macros.h"
+#include <vector>
+
+// Default for LSBangMaxDepth. Real configurations rarely nest more than a
+// few bang commands, this leaves plenty of room while keeping well clear of
+// the stack limit.
+#define BANG_DEFAULT_MAX_DEPTH 32
+
+// Parameters are cut off after this many characters in the report
+#define BANG_REPORT_PARAMS 64
+
+// Innermost call of each thread. If no TLS index is available the chain is
+// not tracked.
+static DWORD g_dwTlsIndex = TlsAlloc();
+
+// LSBangMaxDepth and LSBangCycleCheck, read again when the settings change
+static volatile LONG g_lMaxDepth = BANG_DEFAULT_MAX_DEPTH;
+static volatile LONG g_lCycleCheck = TRUE;
+static volatile LONG g_lLimitsGeneration = -1;
+
+// Reports are only shown once per settings generation, so a bang command
+// that is triggered over and over again doesn't bury the user in them
+static volatile LONG g_lReportGeneration = -1;
+
+
+//
+// Reads LSBangMaxDepth and LSBangCycleCheck if the settings changed
+//   (local helper function)
+//
+static void UpdateLimits()
+{
+    if (!g_LSAPIManager.IsInitialized())
+    {
+        return;
+    }
+
+    LONG lGeneration = SettingsManager::GetGeneration();
+
+    if (g_lLimitsGeneration != lGeneration)
+    {
+        int nMaxDepth = GetRCIntW(L"LSBangMaxDepth", BANG_DEFAULT_MAX_DEPTH);
+
+        if (nMaxDepth < 1)
+        {
+            nMaxDepth = BANG_DEFAULT_MAX_DEPTH;
+        }
+
+        InterlockedExchange(&g_lMaxDepth, nMaxDepth);
+        InterlockedExchange(&g_lCycleCheck,
+            GetRCBoolDefW(L"LSBangCycleCheck", TRUE));
+        InterlockedExchange(&g_lLimitsGeneration, lGeneration);
+    }
+}
+
+
+//
+// Appends "!Bang params" to a report
+//   (local helper function)
+//
+static void AppendCall(std::wstring& sReport, const Bang* pBang, LPCWSTR pwzParams)
+{
+    sReport += pBang->GetCommand();
+
+    if (pwzParams != nullptr && pwzParams[0] != L'\0')
+    {
+        sReport += L' ';
+
+        if (wcslen(pwzParams) > BANG_REPORT_PARAMS)
+        {
+            sReport.append(pwzParams, BANG_REPORT_PARAMS);
+            sReport += L"...";
+        }
+        else
+        {
+            sReport += pwzParams;
+        }
+    }
+}
+
+
+//
+// BangCallChain(const Bang* pBang, LPCWSTR pwzParams)
+//
+BangCallChain::BangCallChain(const Bang* pBang, LPCWSTR pwzParams)
+    : m_pBang(pBang)
+    , m_pwzParams(pwzParams)
+    , m_pParent(nullptr)
+    , m_pRoot(this)
+    , m_uDepth(1)
+    , m_bEntered(false)
+{
+    ASSERT(pBang != nullptr);
+}
+
+
+//
+// ~BangCallChain()
+//
+BangCallChain::~BangCallChain()
+{
+    if (!m_bEntered)
+    {
+        return;
+    }
+
+    // The index may have been freed by Shutdown in the meantime
+    if (g_dwTlsIndex != TLS_OUT_OF_INDEXES)
+    {
+        TlsSetValue(g_dwTlsIndex, m_pParent);
+    }
+
+    if (m_pParent == nullptr && !m_sReport.empty())
+    {
+        // The whole chain has unwound by now, so it is safe to block here
+        LONG lGeneration = SettingsManager::GetGeneration();
+
+        if (InterlockedExchange(&g_lReportGeneration, lGeneration) != lGeneration)
+        {
+            RESOURCE_STREX(
+                GetModuleHandle(NULL), IDS_RUNAWAYBANG,
+                resourceTextBuffer, MAX_LINE_LENGTH,
+                L"Error: Runaway bang command stopped.\n\n%ls",
+                m_sReport.c_str());
+
+            RESOURCE_MSGBOX_F(L"LiteStep", MB_ICONERROR);
+        }
+    }
+}
+
+
+//
+// Enter()
+//
+bool BangCallChain::Enter()
+{
+    ASSERT(!m_bEntered);
+
+    if (g_dwTlsIndex == TLS_OUT_OF_INDEXES)
+    {
+        return true;
+    }
+
+    UpdateLimits();
+
+    m_pParent = (BangCallChain*)TlsGetValue(g_dwTlsIndex);
+
+    if (m_pParent != nullptr)
+    {
+        m_pRoot = m_pParent->m_pRoot;
+        m_uDepth = m_pParent->m_uDepth + 1;
+
+        if (m_uDepth > (UINT)g_lMaxDepth)
+        {
+            _Trip(L"nested too deeply");
+            return false;
+        }
+
+        if (g_lCycleCheck)
+        {
+            LPCWSTR pwzParams = (m_pwzParams != nullptr) ? m_pwzParams : L"";
+
+            for (const BangCallChain* pCall = m_pParent; pCall != nullptr;
+                pCall = pCall->m_pParent)
+            {
+                if (pCall->m_pBang == m_pBang &&
+                    wcscmp(pCall->m_pwzParams != nullptr ?
+                        pCall->m_pwzParams : L"", pwzParams) == 0)
+                {
+                    _Trip(L"calls itself");
+                    return false;
+                }
+            }
+        }
+    }
+
+    TlsSetValue(g_dwTlsIndex, this);
+    m_bEntered = true;
+
+    return true;
+}
+
+
+//
+// _Trip(LPCWSTR pwzReason)
+//
+// Records the chain that led to a refused call. Only the first refused call
+// of a chain is recorded, the callers further up may well try again.
+//
+void BangCallChain::_Trip(LPCWSTR pwzReason)
+{
+    TRACE("Bang command %ls refused at depth %u: %ls",
+        m_pBang->GetCommand(), m_uDepth, pwzReason);
+
+    if (!m_pRoot->m_sReport.empty())
+    {
+        return;
+    }
+
+    std::vector<const BangCallChain*> chain;
+
+    for (const BangCallChain* pCall = this; pCall != nullptr;
+        pCall = pCall->m_pParent)
+    {
+        chain.push_back(pCall);
+    }
+
+    std::wstring& sReport = m_pRoot->m_sReport;
+
+    sReport = m_pBang->GetCommand();
+    sReport += L' ';
+    sReport += pwzReason;
+    sReport += L":\n";
+
+    for (std::vector<const BangCallChain*>::reverse_iterator iter =
+        chain.rbegin(); iter != chain.rend(); ++iter)
+    {
+        sReport += (iter == chain.rbegin()) ? L"  " : L"  calls ";
+        AppendCall(sReport, (*iter)->m_pBang, (*iter)->m_pwzParams);
+        sReport += L'\n';
+
+        TRACE("  %u: %ls %ls", (*iter)->m_uDepth,
+            (*iter)->m_pBang->GetCommand(),
+            (*iter)->m_pwzParams != nullptr ? (*iter)->m_pwzParams : L"");
+    }
+}
+
+
+//
+// Shutdown()
+//
+void BangCallChain::Shutdown()
+{
+    if (g_dwTlsIndex != TLS_OUT_OF_INDEXES)
+    {
+        TlsFree(g_dwTlsIndex);
+        g_dwTlsIndex = TLS_OUT_OF_INDEXES;
+    }
+}
+
+
+//
+// ModalScope()
+//
+BangCallChain::ModalScope::ModalScope()
+    : m_pvSaved(nullptr)
+{
+    if (g_dwTlsIndex != TLS_OUT_OF_INDEXES)
+    {
+        m_pvSaved = TlsGetValue(g_dwTlsIndex);
+        TlsSetValue(g_dwTlsIndex, nullptr);
+    }
+}
+
+
+//
+// ~ModalScope()
+//
+BangCallChain::ModalScope::~ModalScope()
+{
+    // Chains started inside the loop have unwound by now
+    if (g_dwTlsIndex != TLS_OUT_OF_INDEXES)
+    {
+        TlsSetValue(g_dwTlsIndex, m_pvSaved);
+    }
+}
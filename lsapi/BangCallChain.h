@@ -0,0 +1,98 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(BANGCALLCHAIN_H)
+#define BANGCALLCHAIN_H
+
+#include "../utility/common.h"
+#include <string>
+
+class Bang;
+
+/**
+ * One entry in the chain of bang commands that are currently executing on a
+ * thread. Each bang command call puts one on the stack while it runs.
+ *
+ * A call is refused if the chain is already LSBangMaxDepth entries deep, or
+ * if the same bang command is already running with the same parameters,
+ * which can only end in a loop. The chain is reported once it has unwound.
+ *
+ * Bang commands that run a modal loop hide the chain while it runs, see
+ * ModalScope, so the loop can dispatch unrelated bang commands.
+ */
+class BangCallChain
+{
+    const Bang* m_pBang;
+    LPCWSTR m_pwzParams;
+
+    BangCallChain* m_pParent;
+    BangCallChain* m_pRoot;
+    UINT m_uDepth;
+    bool m_bEntered;
+
+    // Only used by the outermost entry
+    std::wstring m_sReport;
+
+    void _Trip(LPCWSTR pwzReason);
+
+    // not implemented
+    BangCallChain(const BangCallChain& rhs);
+    BangCallChain& operator=(const BangCallChain& rhs);
+
+public:
+    BangCallChain(const Bang* pBang, LPCWSTR pwzParams);
+    ~BangCallChain();
+
+    /**
+     * Adds this call to the chain of the current thread.
+     *
+     * @return <code>true</code> if the call may go ahead, or
+     *         <code>false</code> if it would be a runaway call
+     */
+    bool Enter();
+
+    /**
+     * Frees the TLS index. Called when the LSAPI shuts down, no chains are
+     * tracked after that.
+     */
+    static void Shutdown();
+
+    /**
+     * Hides the current thread's chain for its lifetime. Used around modal
+     * loops, so that a bang command they dispatch, e.g. from a hotkey, starts
+     * a chain of its own instead of being taken for a call made by the bang
+     * command that opened the loop.
+     */
+    class ModalScope
+    {
+        LPVOID m_pvSaved;
+
+        // not implemented
+        ModalScope(const ModalScope& rhs);
+        ModalScope& operator=(const ModalScope& rhs);
+
+    public:
+        ModalScope();
+        ~ModalScope();
+    };
+};
+
+#endif // BANGCALLCHAIN_H
@@ -20,59 +20,67 @@
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 #include "BangCommand.h"
-#include "ThreadedBangCommand.h"
+#include "BangCallChain.h"
 #include <memory>
 #include "../utility/stringutility.h"
 
 
 Bang::Bang(DWORD dwThread, BangCommandW pfnBang, LPCWSTR pwzCommand)
     : m_dwThreadID(dwThread)
+    , m_pQueue(BangQueue::ForThread(dwThread))
     , m_bEX(false)
     , m_pAddress(pfnBang)
     , m_bBang(pfnBang)
     , m_bBangEX(nullptr)
     , m_pwzCommand(_wcsdup(pwzCommand))
+    , m_lCoalesceDelay(COALESCE_NONE)
 {
 }
 
 
 Bang::Bang(DWORD dwThread, BangCommandA pfnBang, LPCWSTR pwzCommand)
     : m_dwThreadID(dwThread)
+    , m_pQueue(BangQueue::ForThread(dwThread))
     , m_bEX(false)
     , m_pAddress(pfnBang)
     , m_bBang([pfnBang] (HWND hOwner, LPCWSTR pwzArgs) -> void
       {
-          pfnBang(hOwner, std::unique_ptr<char>(MBSFromWCS(pwzArgs)).get());
+          pfnBang(hOwner, WCSTOMBS(pwzArgs));
       })
     , m_bBangEX(nullptr)
     , m_pwzCommand(_wcsdup(pwzCommand))
+    , m_lCoalesceDelay(COALESCE_NONE)
 {
 }
 
 
 Bang::Bang(DWORD dwThread, BangCommandExW pfnBang, LPCWSTR pwzCommand)
     : m_dwThreadID(dwThread)
+    , m_pQueue(BangQueue::ForThread(dwThread))
     , m_bEX(true)
     , m_pAddress(pfnBang)
     , m_bBang(nullptr)
     , m_bBangEX(pfnBang)
     , m_pwzCommand(_wcsdup(pwzCommand))
+    , m_lCoalesceDelay(COALESCE_NONE)
 {
 }
 
 
 Bang::Bang(DWORD dwThread, BangCommandExA pfnBang, LPCWSTR pwzCommand)
     : m_dwThreadID(dwThread)
+    , m_pQueue(BangQueue::ForThread(dwThread))
     , m_bEX(true)
     , m_pAddress(pfnBang)
     , m_bBang(nullptr)
     , m_bBangEX([pfnBang](HWND hOwner, LPCWSTR pwzCommand, LPCWSTR pwzArgs) -> void
       {
           pfnBang(hOwner,
-          std::unique_ptr<char>(MBSFromWCS(pwzCommand)).get(),
-          std::unique_ptr<char>(MBSFromWCS(pwzArgs)).get());
+          WCSTOMBS(pwzCommand),
+          WCSTOMBS(pwzArgs));
       })
     , m_pwzCommand(_wcsdup(pwzCommand))
+    , m_lCoalesceDelay(COALESCE_NONE)
 {
 }
 
@@ -80,37 +88,71 @@ Bang::Bang(DWORD dwThread, BangCommandExA pfnBang, LPCWSTR pwzCommand)
 Bang::~Bang()
 {
     free((LPVOID)m_pwzCommand);
+    m_pQueue->Release();
 }
 
 
 void Bang::Execute(HWND hCaller, LPCWSTR pwzParams) const
 {
-    if (GetCurrentThreadId() != m_dwThreadID)
+    LONG lDelay = m_lCoalesceDelay;
+    bool bOtherThread = (GetCurrentThreadId() != m_dwThreadID);
+
+    if (lDelay > 0 || (lDelay == 0 && bOtherThread))
+    {
+        // Debounced calls are always delayed, "latest wins" only matters if
+        // the call has to wait in the queue anyway
+        m_pQueue->PostCoalesced(hCaller, m_pwzCommand, pwzParams, (DWORD)lDelay);
+    }
+    else if (bOtherThread)
     {
-        ThreadedBangCommand * pInfo = new ThreadedBangCommand(hCaller,
-            m_pwzCommand, pwzParams);
-
-        if (pInfo != nullptr)
-        {
-            // target thread releases pInfo
-            PostThreadMessageW(m_dwThreadID, LM_THREAD_BANGCOMMAND,
-                (WPARAM)pInfo, 0);
-        }
+        // the owning thread executes it when it processes its queue
+        m_pQueue->Post(hCaller, m_pwzCommand, pwzParams);
     }
     else
     {
-        if (m_bEX)
-        {
-            m_bBangEX(hCaller, m_pwzCommand, pwzParams);
-        }
-        else
-        {
-            m_bBang(hCaller, pwzParams);
-        }
+        _Invoke(hCaller, pwzParams, BangProfile::DISPATCH_DIRECT);
     }
 }
 
 
+void Bang::ExecuteQueued(HWND hCaller, LPCWSTR pwzParams, ULONGLONG ullPosted) const
+{
+    m_profile.RecordWait(BangProfile::GetTimestamp() - ullPosted);
+
+    _Invoke(hCaller, pwzParams, BangProfile::DISPATCH_QUEUED);
+}
+
+
+void Bang::_Invoke(HWND hCaller, LPCWSTR pwzParams, BangProfile::Dispatch dispatch) const
+{
+    BangCallChain call(this, pwzParams);
+
+    if (!call.Enter())
+    {
+        return;
+    }
+
+    ULONGLONG ullStart = BangProfile::GetTimestamp();
+
+    if (m_bEX)
+    {
+        m_bBangEX(hCaller, m_pwzCommand, pwzParams);
+    }
+    else
+    {
+        m_bBang(hCaller, pwzParams);
+    }
+
+    m_profile.RecordCall(dispatch, BangProfile::GetTimestamp() - ullStart);
+}
+
+
+bool Bang::ExecuteAsync(HWND hCaller, LPCWSTR pwzParams, BangRequest* pRequest) const
+{
+    return m_pQueue->Post(hCaller, m_pwzCommand, pwzParams, pRequest);
+}
+
+
 HINSTANCE Bang::GetModule() const
 {
     HINSTANCE hModule = nullptr;
@@ -131,6 +173,18 @@ HINSTANCE Bang::GetModule() const
 }
 
 
+void Bang::SetCoalescing(LONG lDelay)
+{
+    InterlockedExchange(&m_lCoalesceDelay, lDelay);
+}
+
+
+void Bang::GetStats(LSBANGSTATS* pStats) const
+{
+    m_profile.GetStats(pStats);
+}
+
+
 LPCWSTR Bang::GetCommand() const
 {
     return m_pwzCommand;
@@ -23,6 +23,8 @@
 #define BANGCOMMAND_H
 
 #include "../utility/base.h"
+#include "BangProfile.h"
+#include "BangQueue.h"
 #include "lsapidefines.h"
 #include <string>
 #include <functional>
@@ -90,10 +92,57 @@ public:
      */
     void Execute(HWND hCaller, LPCWSTR pwzParams) const;
 
+    /**
+     * Schedules this bang command for execution on the thread that owns it,
+     * even if that is the current thread.
+     *
+     * @param  hCaller    window handle belonging to caller
+     * @param  pwzParams  parameters for the bang command
+     * @param  pRequest   request to complete once the bang command has run
+     * @return <code>true</code> if the bang command was scheduled
+     */
+    bool ExecuteAsync(HWND hCaller, LPCWSTR pwzParams, BangRequest* pRequest) const;
+
+    /**
+     * Executes this bang command on the current thread on behalf of a queued
+     * call. Must be called on the thread that owns this bang command.
+     *
+     * @param  hCaller     window handle belonging to caller
+     * @param  pwzParams   parameters for the bang command
+     * @param  ullPosted   BangProfile timestamp of when the call was queued
+     */
+    void ExecuteQueued(HWND hCaller, LPCWSTR pwzParams, ULONGLONG ullPosted) const;
+
+    /** Coalescing delay that turns coalescing off, see SetCoalescing */
+    static const LONG COALESCE_NONE = -1;
+
+    /**
+     * Sets how bursts of calls to this bang command are combined.
+     *
+     * @param  lDelay  <code>COALESCE_NONE</code> to execute every call,
+     *                 0 to let a queued call take the arguments of newer
+     *                 calls ("latest wins"), or a debounce delay in
+     *                 milliseconds. Debounced calls are executed once no
+     *                 new call came in for that long, with the arguments of
+     *                 the last one.
+     */
+    void SetCoalescing(LONG lDelay);
+
+    /**
+     * Retrieves the execution statistics of this bang command.
+     *
+     * @param  pStats  receives the statistics
+     */
+    void GetStats(LSBANGSTATS* pStats) const;
+
     LPCWSTR GetCommand() const;
 
     HINSTANCE GetModule() const;
 
+private:
+    /** Calls the callback function and records how long it took */
+    void _Invoke(HWND hCaller, LPCWSTR pwzParams, BangProfile::Dispatch dispatch) const;
+
 private:
     Bang(const Bang &) = delete;
     Bang & operator=(const Bang &) = delete;
@@ -102,6 +151,9 @@ private:
     /** Thread that owns this bang command */
     const DWORD m_dwThreadID;
 
+    /** Queue used to execute this bang command from other threads */
+    BangQueue* const m_pQueue;
+
     /**
      * <code>true</code> if the bang command name is passed to the callback
      * function
@@ -119,6 +171,12 @@ private:
 
     /** Name of this bang command */
     const LPCWSTR m_pwzCommand;
+
+    /** Execution statistics */
+    mutable BangProfile m_profile;
+
+    /** Coalescing delay, see SetCoalescing */
+    volatile LONG m_lCoalesceDelay;
 };
 
 #endif // BANGCOMMAND_H
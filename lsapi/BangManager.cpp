@@ -20,18 +20,103 @@
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 #include "BangManager.h"
-#include "../utility/debug.hpp"
+#include "SettingsManager.h"
+#include "../utility/core.hpp"
+#include "../utility/tokenizer.h"
 
 
-BangManager::BangManager()
+BangManager::BangTable::BangTable()
 {
     // do nothing
 }
 
 
+BangManager::BangTable::BangTable(const BangTable& rhs)
+    : CountedBase()
+    , bang_map(rhs.bang_map)
+{
+    for (const BangMap::value_type & value : bang_map)
+    {
+        value.second->AddRef();
+    }
+}
+
+
+BangManager::BangTable::~BangTable()
+{
+    for (const BangMap::value_type & value : bang_map)
+    {
+        value.second->Release();
+    }
+}
+
+
+BangManager::BangManager()
+    : m_pTable(new BangTable)
+    , m_lEpoch(0)
+    , m_lCoalesceGeneration(0)
+{
+    m_lReaders[0] = 0;
+    m_lReaders[1] = 0;
+}
+
+
 BangManager::~BangManager()
 {
-    // do nothing
+    m_pTable->Release();
+}
+
+
+// Register as a reader of the current epoch
+LONG BangManager::_EnterRead() const
+{
+    for (;;)
+    {
+        LONG lEpoch = m_lEpoch;
+        InterlockedIncrement(&m_lReaders[lEpoch & 1]);
+
+        // If a writer bumped the epoch in the meantime it might not wait for
+        // us, so register again under the new one
+        if (m_lEpoch == lEpoch)
+        {
+            return lEpoch;
+        }
+
+        InterlockedDecrement(&m_lReaders[lEpoch & 1]);
+    }
+}
+
+
+void BangManager::_LeaveRead(LONG lEpoch) const
+{
+    InterlockedDecrement(&m_lReaders[lEpoch & 1]);
+}
+
+
+// Swap in a new table and get rid of the old one
+void BangManager::_Publish(BangTable* pTable)
+{
+    BangTable* pOldTable = (BangTable*)InterlockedExchangePointer(
+        (PVOID volatile*)&m_pTable, pTable);
+
+    // Readers entering from now on see the new table. Wait for the ones that
+    // might still be looking at the old one. They only do a lookup, so this
+    // is short.
+    LONG lEpoch = InterlockedIncrement(&m_lEpoch) - 1;
+
+    for (UINT uSpins = 0; m_lReaders[lEpoch & 1] != 0; ++uSpins)
+    {
+        if (uSpins < 64)
+        {
+            YieldProcessor();
+        }
+        else
+        {
+            Sleep(1);
+        }
+    }
+
+    pOldTable->Release();
 }
 
 
@@ -40,18 +125,31 @@ BOOL BangManager::AddBangCommand(Bang *pbbBang)
 {
     Lock lock(m_cs);
 
-    BangMap::iterator iter = bang_map.find(pbbBang->GetCommand());
+    BangTable* pTable = new BangTable(*m_pTable);
+    BangMap::iterator iter = pTable->bang_map.find(pbbBang->GetCommand());
 
-    if (iter != bang_map.end())
+    if (iter != pTable->bang_map.end())
     {
         Bang * bang = iter->second;
-        bang_map.erase(iter);
+        pTable->bang_map.erase(iter);
         bang->Release(); // We must erase before we release since the key is stored inside the Bang.
     }
 
-    bang_map.emplace(pbbBang->GetCommand(), pbbBang);
+    // The new Bang object starts out without coalescing
+    m_requestedCoalescing.erase(pbbBang->GetCommand());
+
+    LONG lDelay;
+
+    if (_GetConfiguredCoalescing(pbbBang->GetCommand(), &lDelay))
+    {
+        pbbBang->SetCoalescing(lDelay);
+    }
+
+    pTable->bang_map.emplace(pbbBang->GetCommand(), pbbBang);
     pbbBang->AddRef();
 
+    _Publish(pTable);
+
     return TRUE;
 }
 
@@ -63,14 +161,20 @@ BOOL BangManager::RemoveBangCommand(LPCWSTR pwzName)
     BOOL bReturn = FALSE;
 
     ASSERT(pwzName != nullptr);
-    BangMap::iterator iter = bang_map.find(pwzName);
 
-    if (iter != bang_map.end())
+    if (m_pTable->bang_map.find(pwzName) != m_pTable->bang_map.end())
     {
+        BangTable* pTable = new BangTable(*m_pTable);
+        BangMap::iterator iter = pTable->bang_map.find(pwzName);
+
         Bang * bang = iter->second;
-        bang_map.erase(iter);
+        pTable->bang_map.erase(iter);
         bang->Release(); // We must erase before we release since the key is stored inside the Bang.
 
+        m_requestedCoalescing.erase(pwzName);
+
+        _Publish(pTable);
+
         bReturn = TRUE;
     }
 
@@ -78,26 +182,158 @@ BOOL BangManager::RemoveBangCommand(LPCWSTR pwzName)
 }
 
 
-// Execute named bang command, passing params, getting result
-BOOL BangManager::ExecuteBangCommand(LPCWSTR pszName, HWND hCaller, LPCWSTR pwzParams)
+// Set the coalescing policy of a bang command, unless the theme overrides it
+BOOL BangManager::SetBangCommandCoalescing(LPCWSTR pwzName, LONG lDelay)
 {
-    BOOL bReturn = FALSE;
-    Bang* pToExec = nullptr;
+    Lock lock(m_cs);
+
+    BangMap::const_iterator iter = m_pTable->bang_map.find(pwzName);
+
+    if (iter == m_pTable->bang_map.end())
+    {
+        return FALSE;
+    }
+
+    m_requestedCoalescing[pwzName] = lDelay;
+
+    LONG lConfiguredDelay;
+
+    if (!_GetConfiguredCoalescing(pwzName, &lConfiguredDelay))
+    {
+        iter->second->SetCoalescing(lDelay);
+    }
+
+    return TRUE;
+}
 
-    // Acquiring lock manually to allow manual release below
-    m_cs.Acquire();
 
-    BangMap::const_iterator iter = bang_map.find(pszName);
+// Apply the "*BangCoalesce" lines to the live bang commands after a reload
+// of the settings that didn't restart the modules that own them
+void BangManager::ReapplyCoalescing()
+{
+    Lock lock(m_cs);
 
-    if (iter != bang_map.end())
+    for (const BangMap::value_type& value : m_pTable->bang_map)
     {
-        pToExec = iter->second;
-        pToExec->AddRef();
+        LONG lDelay = Bang::COALESCE_NONE;
+
+        if (!_GetConfiguredCoalescing(value.first, &lDelay))
+        {
+            CoalesceMap::const_iterator iter =
+                m_requestedCoalescing.find(value.first);
+
+            if (iter != m_requestedCoalescing.end())
+            {
+                lDelay = iter->second;
+            }
+        }
+
+        value.second->SetCoalescing(lDelay);
     }
+}
 
-    // Release lock before executing the !bang since the BangProc might
-    // (recursively) enter this function again
-    m_cs.Release();
+
+// Read "*BangCoalesce !Bang none|latest|debounce <ms>" lines when the
+// settings have changed, and look up a bang command in them
+bool BangManager::_GetConfiguredCoalescing(LPCWSTR pwzName, LONG* plDelay)
+{
+    LONG lGeneration = SettingsManager::GetGeneration();
+
+    if (lGeneration != m_lCoalesceGeneration)
+    {
+        m_coalesceSettings.clear();
+        m_lCoalesceGeneration = lGeneration;
+
+        LPVOID pFile = LCOpenW(nullptr);
+
+        if (pFile)
+        {
+            wchar_t wzLine[MAX_LINE_LENGTH];
+
+            while (LCReadNextConfigW(pFile, L"*BangCoalesce", wzLine, MAX_LINE_LENGTH))
+            {
+                Tokenizer tokenizer(wzLine, false);
+
+                // first token is the "*BangCoalesce" key
+                TokenSpan key, bang, policy, delay;
+
+                if (!tokenizer.Next(key) || !tokenizer.Next(bang) ||
+                    !tokenizer.Next(policy))
+                {
+                    continue;
+                }
+
+                wchar_t wzBang[MAX_PATH];
+                bang.CopyTo(wzBang, COUNTOF(wzBang));
+
+                if (policy.IsEqual(L"none"))
+                {
+                    m_coalesceSettings[wzBang] = Bang::COALESCE_NONE;
+                }
+                else if (policy.IsEqual(L"latest"))
+                {
+                    m_coalesceSettings[wzBang] = 0;
+                }
+                else if (policy.IsEqual(L"debounce") && tokenizer.Next(delay))
+                {
+                    wchar_t wzDelay[16];
+                    delay.CopyTo(wzDelay, COUNTOF(wzDelay));
+
+                    int nDelay = _wtoi(wzDelay);
+                    m_coalesceSettings[wzBang] = (nDelay > 0) ? nDelay : 1;
+                }
+                else
+                {
+                    TRACE("Invalid *BangCoalesce line: %ls", wzLine);
+                }
+            }
+
+            LCClose(pFile);
+        }
+    }
+
+    CoalesceMap::const_iterator iter = m_coalesceSettings.find(pwzName);
+
+    if (iter == m_coalesceSettings.end())
+    {
+        return false;
+    }
+
+    *plDelay = iter->second;
+    return true;
+}
+
+
+// Look up a bang command and reference it
+Bang* BangManager::_Acquire(LPCWSTR pwzName) const
+{
+    Bang* pBang = nullptr;
+
+    // Only the lookup happens inside the read section, the !bang is executed
+    // afterwards since the BangProc might (recursively) enter this class
+    // again or add and remove bang commands
+    LONG lEpoch = _EnterRead();
+
+    const BangMap& bangMap = m_pTable->bang_map;
+    BangMap::const_iterator iter = bangMap.find(pwzName);
+
+    if (iter != bangMap.end())
+    {
+        pBang = iter->second;
+        pBang->AddRef();
+    }
+
+    _LeaveRead(lEpoch);
+
+    return pBang;
+}
+
+
+// Execute named bang command, passing params, getting result
+BOOL BangManager::ExecuteBangCommand(LPCWSTR pszName, HWND hCaller, LPCWSTR pwzParams)
+{
+    BOOL bReturn = FALSE;
+    Bang* pToExec = _Acquire(pszName);
 
     if (pToExec)
     {
@@ -111,29 +347,106 @@ BOOL BangManager::ExecuteBangCommand(LPCWSTR pszName, HWND hCaller, LPCWSTR pwzP
 }
 
 
-void BangManager::ClearBangCommands()
+// Execute named bang command on behalf of a BangQueue
+BOOL BangManager::ExecuteQueuedBangCommand(LPCWSTR pszName, HWND hCaller,
+    LPCWSTR pwzParams, ULONGLONG ullPosted)
 {
-    Lock lock(m_cs);
+    BOOL bReturn = FALSE;
+    Bang* pToExec = _Acquire(pszName);
+
+    if (pToExec)
+    {
+        pToExec->ExecuteQueued(hCaller, pwzParams, ullPosted);
+        pToExec->Release();
+
+        bReturn = TRUE;
+    }
+
+    return bReturn;
+}
 
-    BangMap::iterator iter = bang_map.begin();
 
-    while (iter != bang_map.end())
+// Schedule named bang command, the request is completed once it has run
+BOOL BangManager::ExecuteBangCommandAsync(LPCWSTR pszName, HWND hCaller,
+    LPCWSTR pwzParams, BangRequest* pRequest)
+{
+    BOOL bReturn = FALSE;
+    Bang* pToExec = _Acquire(pszName);
+
+    if (pToExec)
     {
-        iter->second->Release();
-        ++iter;
+        bReturn = pToExec->ExecuteAsync(hCaller, pwzParams, pRequest) ? TRUE : FALSE;
+        pToExec->Release();
     }
 
-    bang_map.clear();
+    return bReturn;
 }
 
 
-HRESULT BangManager::EnumBangs(LSENUMBANGSV2PROCW pfnCallback, LPARAM lParam) const
+// Look up a bang command for later use with AcquireBangCommand
+Bang* BangManager::FindBangCommand(LPCWSTR pwzName, LONG* plGeneration) const
+{
+    Bang* pBang = nullptr;
+
+    LONG lEpoch = _EnterRead();
+
+    const BangMap& bangMap = m_pTable->bang_map;
+    BangMap::const_iterator iter = bangMap.find(pwzName);
+
+    if (iter != bangMap.end())
+    {
+        pBang = iter->second;
+    }
+
+    _LeaveRead(lEpoch);
+
+    *plGeneration = lEpoch;
+    return pBang;
+}
+
+
+// Reference a bang command found earlier, unless the table has changed since
+bool BangManager::AcquireBangCommand(Bang* pBang, LONG lGeneration) const
+{
+    // While we are registered under the same epoch neither the table pBang
+    // was found in nor its successor can have been released, so pBang is
+    // still alive
+    LONG lEpoch = _EnterRead();
+    bool bValid = (lEpoch == lGeneration);
+
+    if (bValid && pBang != nullptr)
+    {
+        pBang->AddRef();
+    }
+
+    _LeaveRead(lEpoch);
+
+    return bValid;
+}
+
+
+void BangManager::ClearBangCommands()
 {
     Lock lock(m_cs);
 
+    m_requestedCoalescing.clear();
+    _Publish(new BangTable);
+}
+
+
+HRESULT BangManager::EnumBangs(LSENUMBANGSV2PROCW pfnCallback, LPARAM lParam) const
+{
+    // Hold on to the current table so nothing is locked during the callbacks
+    LONG lEpoch = _EnterRead();
+
+    BangTable* pTable = m_pTable;
+    pTable->AddRef();
+
+    _LeaveRead(lEpoch);
+
     HRESULT hr = S_OK;
 
-    for (const BangMap::value_type & value : bang_map)
+    for (const BangMap::value_type & value : pTable->bang_map)
     {
         if (!pfnCallback(value.second->GetModule(), value.first, lParam))
         {
@@ -142,5 +455,36 @@ HRESULT BangManager::EnumBangs(LSENUMBANGSV2PROCW pfnCallback, LPARAM lParam) co
         }
     }
 
+    pTable->Release();
+
+    return hr;
+}
+
+
+HRESULT BangManager::EnumBangStats(LSENUMBANGSTATSPROCW pfnCallback, LPARAM lParam) const
+{
+    LONG lEpoch = _EnterRead();
+
+    BangTable* pTable = m_pTable;
+    pTable->AddRef();
+
+    _LeaveRead(lEpoch);
+
+    HRESULT hr = S_OK;
+
+    for (const BangMap::value_type & value : pTable->bang_map)
+    {
+        LSBANGSTATS stats;
+        value.second->GetStats(&stats);
+
+        if (!pfnCallback(value.second->GetModule(), value.first, &stats, lParam))
+        {
+            hr = S_FALSE;
+            break;
+        }
+    }
+
+    pTable->Release();
+
     return hr;
 }
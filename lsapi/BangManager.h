@@ -37,12 +37,106 @@ private:
     /** Maps bang command names to Bang objects. */
     typedef StringKeyedMaps<LPCWSTR, Bang*>::UnorderedMap BangMap;
 
-    /** List of bang commands indexed by name */
-    BangMap bang_map;
+    /** Maps bang command names to coalescing delays. */
+    typedef StringKeyedMaps<std::wstring, LONG>::UnorderedMap CoalesceMap;
 
-    /** Critical section for serializing access to data members */
+    /**
+     * An immutable snapshot of the bang commands. The table holds a
+     * reference to each of its Bang objects.
+     */
+    class BangTable : public CountedBase
+    {
+    public:
+        BangTable();
+        BangTable(const BangTable& rhs);
+
+        /** List of bang commands indexed by name */
+        BangMap bang_map;
+
+    protected:
+        virtual ~BangTable();
+
+    private:
+        // Not implemented
+        BangTable& operator=(const BangTable& rhs);
+    };
+
+    /**
+     * The current table. Readers use it without locking, writers build a
+     * modified copy and swap it in.
+     */
+    BangTable* volatile m_pTable;
+
+    /**
+     * Number of readers that entered during even and odd epochs. A writer
+     * that swapped in a new table bumps the epoch and waits for the readers
+     * of the previous one to leave before releasing the old table.
+     */
+    mutable volatile LONG m_lReaders[2];
+
+    /** Current reader epoch */
+    volatile LONG m_lEpoch;
+
+    /** Critical section for serializing writers */
     mutable CriticalSection m_cs;
 
+    /**
+     * Coalescing delays set by "*BangCoalesce" lines, see Bang::SetCoalescing.
+     * Protected by m_cs.
+     */
+    CoalesceMap m_coalesceSettings;
+
+    /** Settings generation m_coalesceSettings was read in */
+    LONG m_lCoalesceGeneration;
+
+    /**
+     * Coalescing delays modules asked for through SetBangCommandCoalescing,
+     * which apply whenever the theme doesn't override them. Protected by
+     * m_cs.
+     */
+    CoalesceMap m_requestedCoalescing;
+
+    /**
+     * Marks the start of a read of m_pTable.
+     *
+     * @return Epoch to pass to _LeaveRead
+     */
+    LONG _EnterRead() const;
+
+    /**
+     * Marks the end of a read of m_pTable.
+     *
+     * @param  lEpoch  Value returned by _EnterRead
+     */
+    void _LeaveRead(LONG lEpoch) const;
+
+    /**
+     * Makes pTable the current table, and releases the previous one once
+     * no reader can be using it anymore. Must be called with m_cs held.
+     *
+     * @param  pTable  New table. The manager takes over the reference.
+     */
+    void _Publish(BangTable* pTable);
+
+    /**
+     * Looks up a bang command and takes a reference to it.
+     *
+     * @param  pwzName  bang command name
+     * @return Bang object, or <code>nullptr</code> if there is no such bang
+     *         command. Release it when done.
+     */
+    Bang* _Acquire(LPCWSTR pwzName) const;
+
+    /**
+     * Looks up the coalescing delay the settings define for a bang command.
+     * Must be called with m_cs held.
+     *
+     * @param  pwzName  bang command name
+     * @param  plDelay  receives the delay
+     * @return <code>true</code> if the settings define one
+     */
+    bool _GetConfiguredCoalescing(LPCWSTR pwzName, LONG* plDelay);
+
     // Not implemented
     BangManager(const BangManager& rhs);
     BangManager& operator=(const BangManager& rhs);
@@ -73,6 +167,25 @@ public:
      */
     BOOL RemoveBangCommand(LPCWSTR pwzName);
 
+    /**
+     * Sets how bursts of calls to a bang command are combined, see
+     * Bang::SetCoalescing. Settings in the theme take precedence.
+     *
+     * @param  pwzName  bang command name
+     * @param  lDelay   coalescing delay
+     * @return <code>TRUE</code> if the bang command exists or
+     *         <code>FALSE</code> otherwise
+     */
+    BOOL SetBangCommandCoalescing(LPCWSTR pwzName, LONG lDelay);
+
+    /**
+     * Applies the "*BangCoalesce" lines of the current settings to all bang
+     * commands. Bang commands that are no longer configured go back to the
+     * delay their module asked for. Call after the settings have been
+     * reloaded without restarting the modules.
+     */
+    void ReapplyCoalescing();
+
     /**
      * Removes all bang commands from the list.
      */
@@ -89,9 +202,70 @@ public:
      */
     BOOL ExecuteBangCommand(LPCWSTR pwzName, HWND hCaller, LPCWSTR pwzParams);
 
+    /**
+     * Executes a bang command that was queued for the current thread. Must be
+     * called on the thread that owns the bang command.
+     *
+     * @param  pwzName     bang command name
+     * @param  hCaller     handle to owner window
+     * @param  pwzParams   command-line arguments
+     * @param  ullPosted   BangProfile timestamp of when the call was queued
+     * @return <code>TRUE</code> if the bang command exists or
+     *         <code>FALSE</code> otherwise
+     */
+    BOOL ExecuteQueuedBangCommand(LPCWSTR pwzName, HWND hCaller,
+        LPCWSTR pwzParams, ULONGLONG ullPosted);
+
+    /**
+     * Schedules a bang command for execution on the thread that owns it.
+     *
+     * @param  pwzName     bang command name
+     * @param  hCaller     handle to owner window
+     * @param  pwzParams   command-line arguments
+     * @param  pRequest    request to complete once the bang command has run
+     * @return <code>TRUE</code> if the bang command was scheduled or
+     *         <code>FALSE</code> if it doesn't exist
+     */
+    BOOL ExecuteBangCommandAsync(LPCWSTR pwzName, HWND hCaller, LPCWSTR pwzParams,
+        BangRequest* pRequest);
+
+    /**
+     * Looks up a bang command without executing it. The result is only valid
+     * for the returned generation of the list.
+     *
+     * @param  pwzName       bang command name
+     * @param  plGeneration  receives the generation of the list
+     * @return Bang object, or <code>nullptr</code> if there is no such bang
+     *         command. The object isn't referenced, use AcquireBangCommand
+     *         to get hold of it.
+     */
+    Bang* FindBangCommand(LPCWSTR pwzName, LONG* plGeneration) const;
+
+    /**
+     * Takes a reference to a Bang object returned by FindBangCommand,
+     * provided no bang commands have been added or removed since.
+     *
+     * @param  pBang        Bang object, may be <code>nullptr</code>
+     * @param  lGeneration  generation returned by FindBangCommand
+     * @return <code>true</code> if pBang is still valid, in which case it
+     *         has been AddRef'd unless it is <code>nullptr</code>
+     */
+    bool AcquireBangCommand(Bang* pBang, LONG lGeneration) const;
+
+    /**
+     * Returns the current generation of the list. It changes whenever bang
+     * commands are added or removed.
+     */
+    LONG GetGeneration() const
+    {
+        return m_lEpoch;
+    }
+
     /**
      * Calls a callback function once for each bang command in the list.
      * Continues so long as the callback function returns <code>TRUE</code>.
+     * The callback sees a snapshot of the list and may add or remove bang
+     * commands itself.
      *
      * @param   pfnCallback  callback function
      * @param   lParam       parameter passed to callback function
@@ -100,6 +274,18 @@ public:
      *          <code>FALSE</code>, or an error code
      */
     HRESULT EnumBangs(LSENUMBANGSV2PROCW pfnCallback, LPARAM lParam) const;
+
+    /**
+     * Calls a callback function once for each bang command in the list, with
+     * the execution statistics of the bang command. Works like EnumBangs.
+     *
+     * @param   pfnCallback  callback function
+     * @param   lParam       parameter passed to callback function
+     * @return  <code>S_OK</code> if all bang commands were enumerated,
+     *          <code>S_FALSE</code> if the callback function returned
+     *          <code>FALSE</code>, or an error code
+     */
+    HRESULT EnumBangStats(LSENUMBANGSTATSPROCW pfnCallback, LPARAM lParam) const;
 };
 
 #endif // BANGMANAGER_H
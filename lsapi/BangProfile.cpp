@@ -0,0 +1,118 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "BangProfile.h"
+#include "../utility/core.hpp"
+#include "../utility/perfcounter.h"
+
+
+//
+// Histogram::Record(ULONGLONG ullMicroseconds)
+//
+void BangProfile::Histogram::Record(ULONGLONG ullMicroseconds)
+{
+    InterlockedIncrement(&lCount);
+    InterlockedExchangeAdd64(&llTotal, (LONGLONG)ullMicroseconds);
+    InterlockedIncrement(&lBuckets[GetLog2Bucket(ullMicroseconds, LS_BANGSTATS_BUCKETS)]);
+}
+
+
+//
+// Histogram::CopyTo(DWORD& dwCount, ULONGLONG& ullTotal, DWORD* pdwBuckets)
+//
+void BangProfile::Histogram::CopyTo(DWORD& dwCount, ULONGLONG& ullTotal, DWORD* pdwBuckets) const
+{
+    dwCount = (DWORD)lCount;
+
+    // A plain 64-bit read may tear on 32-bit platforms
+    ullTotal = (ULONGLONG)InterlockedCompareExchange64(
+        (volatile LONGLONG*)&llTotal, 0, 0);
+
+    for (UINT uBucket = 0; uBucket < LS_BANGSTATS_BUCKETS; ++uBucket)
+    {
+        pdwBuckets[uBucket] = (DWORD)lBuckets[uBucket];
+    }
+}
+
+
+//
+// BangProfile()
+//
+BangProfile::BangProfile()
+{
+    ZeroMemory(&m_direct, sizeof(m_direct));
+    ZeroMemory(&m_queued, sizeof(m_queued));
+    ZeroMemory(&m_wait, sizeof(m_wait));
+}
+
+
+//
+// RecordCall(Dispatch dispatch, ULONGLONG ullMicroseconds)
+//
+void BangProfile::RecordCall(Dispatch dispatch, ULONGLONG ullMicroseconds)
+{
+    if (dispatch == DISPATCH_QUEUED)
+    {
+        m_queued.Record(ullMicroseconds);
+    }
+    else
+    {
+        m_direct.Record(ullMicroseconds);
+    }
+}
+
+
+//
+// RecordWait(ULONGLONG ullMicroseconds)
+//
+void BangProfile::RecordWait(ULONGLONG ullMicroseconds)
+{
+    m_wait.Record(ullMicroseconds);
+}
+
+
+//
+// GetStats(LSBANGSTATS* pStats)
+//
+void BangProfile::GetStats(LSBANGSTATS* pStats) const
+{
+    ASSERT(pStats != nullptr);
+
+    pStats->cbSize = sizeof(LSBANGSTATS);
+
+    m_direct.CopyTo(pStats->dwDirectCalls, pStats->ullDirectTime,
+        pStats->dwDirectHistogram);
+
+    m_queued.CopyTo(pStats->dwQueuedCalls, pStats->ullQueuedTime,
+        pStats->dwQueuedHistogram);
+
+    DWORD dwWaits;
+    m_wait.CopyTo(dwWaits, pStats->ullWaitTime, pStats->dwWaitHistogram);
+}
+
+
+//
+// GetTimestamp()
+//
+ULONGLONG BangProfile::GetTimestamp()
+{
+    return PerformanceTicksToMicroseconds(GetPerformanceCounter());
+}
@@ -0,0 +1,97 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(BANGPROFILE_H)
+#define BANGPROFILE_H
+
+#include "../utility/common.h"
+#include "lsapidefines.h"
+
+/**
+ * Execution statistics of a single bang command, see ELD_BANGSTATS.
+ *
+ * Recording is a handful of interlocked operations, so it is always on.
+ * Readers may see a call counted in one field but not yet in another.
+ */
+class BangProfile
+{
+public:
+    /** How a call reached the bang command */
+    enum Dispatch
+    {
+        DISPATCH_DIRECT,
+        DISPATCH_QUEUED
+    };
+
+private:
+    /** Call count, total time and log2 histogram of one kind of timing */
+    struct Histogram
+    {
+        volatile LONG lCount;
+        volatile LONGLONG llTotal;
+        volatile LONG lBuckets[LS_BANGSTATS_BUCKETS];
+
+        void Record(ULONGLONG ullMicroseconds);
+        void CopyTo(DWORD& dwCount, ULONGLONG& ullTotal, DWORD* pdwBuckets) const;
+    };
+
+    Histogram m_direct;
+    Histogram m_queued;
+    Histogram m_wait;
+
+    // not implemented
+    BangProfile(const BangProfile& rhs);
+    BangProfile& operator=(const BangProfile& rhs);
+
+public:
+    BangProfile();
+
+    /**
+     * Records the time it took to execute the bang command once.
+     *
+     * @param  dispatch         How the call reached the bang command
+     * @param  ullMicroseconds  Execution time
+     */
+    void RecordCall(Dispatch dispatch, ULONGLONG ullMicroseconds);
+
+    /**
+     * Records the time a queued call waited before it was executed.
+     *
+     * @param  ullMicroseconds  Time between posting and execution
+     */
+    void RecordWait(ULONGLONG ullMicroseconds);
+
+    /**
+     * Copies the statistics collected so far.
+     *
+     * @param  pStats  Receives the statistics. cbSize is filled in as well.
+     */
+    void GetStats(LSBANGSTATS* pStats) const;
+
+    /**
+     * Returns a timestamp for use with the Record functions.
+     *
+     * @return Microseconds since an arbitrary point in time
+     */
+    static ULONGLONG GetTimestamp();
+};
+
+#endif // BANGPROFILE_H
@@ -0,0 +1,484 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "BangQueue.h"
+#include "BangProfile.h"
+#include "lsapiInit.h"
+#include "ThreadWindow.h"
+#include "../utility/core.hpp"
+#include "../utility/criticalsection.h"
+#include <stddef.h>
+#include <unordered_map>
+
+
+//
+// Queue registry, indexed by thread ID. The lock also protects the
+// reference counts, so a lookup can never resurrect a dying queue.
+//
+typedef std::unordered_map<DWORD, BangQueue*> BangQueueMap;
+
+static BangQueueMap g_bangQueues;
+static CriticalSection g_csBangQueues;
+
+
+//
+// BangQueue(DWORD dwThreadID)
+//
+BangQueue::BangQueue(DWORD dwThreadID)
+    : m_dwThreadID(dwThreadID)
+    , m_cRefs(1)
+    , m_pHead(nullptr)
+    , m_lWakeup(0)
+{
+    // do nothing
+}
+
+
+//
+// ~BangQueue()
+//
+// Bang commands still queued at this point belong to a thread that no
+// longer has any bang commands, so they are discarded. Pending requests are
+// cancelled so nobody waits for them forever.
+//
+BangQueue::~BangQueue()
+{
+    BangRecord* pRecord = m_pHead;
+
+    while (pRecord != nullptr)
+    {
+        BangRecord* pNext = pRecord->pNext;
+
+        if (pRecord->pRequest)
+        {
+            pRecord->pRequest->Cancel();
+            pRecord->pRequest->Release();
+        }
+
+        free(pRecord);
+        pRecord = pNext;
+    }
+}
+
+
+//
+// ForThread(DWORD dwThreadID)
+//
+BangQueue* BangQueue::ForThread(DWORD dwThreadID)
+{
+    Lock lock(g_csBangQueues);
+
+    BangQueue*& pQueue = g_bangQueues[dwThreadID];
+
+    if (pQueue == nullptr)
+    {
+        pQueue = new BangQueue(dwThreadID);
+    }
+    else
+    {
+        ++pQueue->m_cRefs;
+    }
+
+    return pQueue;
+}
+
+
+//
+// FindForThread(DWORD dwThreadID)
+//
+BangQueue* BangQueue::FindForThread(DWORD dwThreadID)
+{
+    Lock lock(g_csBangQueues);
+
+    BangQueueMap::iterator iter = g_bangQueues.find(dwThreadID);
+
+    if (iter == g_bangQueues.end())
+    {
+        return nullptr;
+    }
+
+    ++iter->second->m_cRefs;
+    return iter->second;
+}
+
+
+//
+// AddRef()
+//
+ULONG BangQueue::AddRef()
+{
+    Lock lock(g_csBangQueues);
+    return ++m_cRefs;
+}
+
+
+//
+// Release()
+//
+ULONG BangQueue::Release()
+{
+    Lock lock(g_csBangQueues);
+
+    ULONG cRefs = --m_cRefs;
+
+    if (cRefs == 0)
+    {
+        g_bangQueues.erase(m_dwThreadID);
+        delete this;
+    }
+
+    return cRefs;
+}
+
+
+//
+// Post(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs, BangRequest* pRequest)
+//
+bool BangQueue::Post(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs, BangRequest* pRequest)
+{
+    return _Post(hCaller, pwzCommand, pwzArgs, pRequest, false);
+}
+
+
+//
+// _Post(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs,
+//       BangRequest* pRequest, bool bCoalesced)
+//
+// Pushes a record onto the queue. Coalesced records only tell Process to
+// execute the pending call of their bang command.
+//
+bool BangQueue::_Post(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs,
+    BangRequest* pRequest, bool bCoalesced)
+{
+    ASSERT(pwzCommand != nullptr);
+
+    if (pwzArgs == nullptr)
+    {
+        pwzArgs = L"";
+    }
+
+    size_t cchCommand = wcslen(pwzCommand) + 1;
+    size_t cchArgs = wcslen(pwzArgs) + 1;
+
+    BangRecord* pRecord = (BangRecord*)malloc(offsetof(BangRecord, wzCommand) +
+        (cchCommand + cchArgs) * sizeof(wchar_t));
+
+    if (pRecord == nullptr)
+    {
+        return false;
+    }
+
+    pRecord->hCaller = hCaller;
+    pRecord->pRequest = pRequest;
+    pRecord->ullPosted = BangProfile::GetTimestamp();
+    pRecord->bCoalesced = bCoalesced;
+
+    if (pRequest)
+    {
+        pRequest->AddRef();
+        pRequest->SetThread(m_dwThreadID);
+    }
+
+    memcpy(pRecord->wzCommand, pwzCommand, cchCommand * sizeof(wchar_t));
+    memcpy(pRecord->wzCommand + cchCommand, pwzArgs, cchArgs * sizeof(wchar_t));
+    pRecord->pwzArgs = pRecord->wzCommand + cchCommand;
+
+    // Push onto the list. Only Process ever removes records, and it always
+    // takes the whole list, so there is no ABA problem here.
+    BangRecord* pHead;
+
+    do
+    {
+        pHead = m_pHead;
+        pRecord->pNext = pHead;
+    }
+    while (InterlockedCompareExchangePointer((PVOID volatile*)&m_pHead,
+        pRecord, pHead) != pHead);
+
+    // Wake up the thread unless a wakeup is already pending. If that fails
+    // the record stays queued and the next Post tries again. The wakeup goes
+    // to the thread's ThreadWindow, since modal loops would throw away a
+    // thread message and leave the queue stalled. Threads that don't have
+    // one only get the thread message.
+    if (InterlockedExchange(&m_lWakeup, 1) == 0)
+    {
+        if (!ThreadWindow::Post(m_dwThreadID, LM_THREAD_BANGCOMMAND, 0, 0) &&
+            !PostThreadMessageW(m_dwThreadID, LM_THREAD_BANGCOMMAND, 0, 0))
+        {
+            TRACE("Failed to wake up thread %u for bang command %ls",
+                m_dwThreadID, pwzCommand);
+
+            InterlockedExchange(&m_lWakeup, 0);
+
+            // The record may never be executed, so don't leave the caller
+            // waiting. Process skips it if it does get there.
+            if (pRequest && pRequest->Start())
+            {
+                pRequest->Complete(FALSE);
+            }
+        }
+    }
+
+    return true;
+}
+
+
+//
+// PostCoalesced(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs, DWORD dwDelay)
+//
+bool BangQueue::PostCoalesced(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs, DWORD dwDelay)
+{
+    ASSERT(pwzCommand != nullptr);
+
+    if (pwzArgs == nullptr)
+    {
+        pwzArgs = L"";
+    }
+
+    ULONGLONG ullNow = BangProfile::GetTimestamp();
+    bool bPost = false;
+    bool bTimerFailed = false;
+
+    {
+        Lock lock(m_csCoalesced);
+
+        std::pair<CoalescedMap::iterator, bool> result =
+            m_coalesced.emplace(pwzCommand, CoalescedCall());
+
+        // Latest wins, whether or not the call has been queued already
+        CoalescedCall& call = result.first->second;
+        call.hCaller = hCaller;
+        call.sArgs = pwzArgs;
+        call.ullDue = ullNow + (ULONGLONG)dwDelay * 1000;
+
+        if (result.second)
+        {
+            call.ullPosted = ullNow;
+            call.bQueued = (dwDelay == 0);
+
+            if (dwDelay == 0)
+            {
+                bPost = true;
+            }
+            else
+            {
+                // The timer holds a reference to the queue until it is done
+                DebounceTimer* pTimer = new DebounceTimer;
+                pTimer->pQueue = this;
+                pTimer->hTimer = nullptr;
+                pTimer->sCommand = pwzCommand;
+
+                AddRef();
+
+                if (!_ArmTimer(pTimer, call.ullDue))
+                {
+                    // Run it without delay rather than not at all
+                    call.bQueued = true;
+                    bPost = true;
+
+                    delete pTimer;
+                    bTimerFailed = true;
+                }
+            }
+        }
+    }
+
+    if (bTimerFailed)
+    {
+        Release();
+    }
+
+    if (bPost)
+    {
+        if (!_Post(nullptr, pwzCommand, nullptr, nullptr, true))
+        {
+            Lock lock(m_csCoalesced);
+            m_coalesced.erase(pwzCommand);
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+//
+// _ArmTimer(DebounceTimer* pTimer, ULONGLONG ullDue)
+//
+// Starts a timer that fires at the given BangProfile timestamp. Must be
+// called with m_csCoalesced held, so that the timer callback doesn't see
+// the handle before it is set.
+//
+bool BangQueue::_ArmTimer(DebounceTimer* pTimer, ULONGLONG ullDue)
+{
+    ULONGLONG ullNow = BangProfile::GetTimestamp();
+    DWORD dwDueTime = 0;
+
+    if (ullDue > ullNow)
+    {
+        dwDueTime = (DWORD)((ullDue - ullNow + 999) / 1000);
+    }
+
+    return CreateTimerQueueTimer(&pTimer->hTimer, nullptr, _DebounceProc,
+        pTimer, dwDueTime, 0, WT_EXECUTEONLYONCE) != FALSE;
+}
+
+
+//
+// _DebounceProc(PVOID pvTimer, BOOLEAN bTimerFired)
+//
+// Queues a debounced call once no new calls came in for the debounce delay,
+// otherwise waits some more.
+//
+VOID CALLBACK BangQueue::_DebounceProc(PVOID pvTimer, BOOLEAN /* bTimerFired */)
+{
+    DebounceTimer* pTimer = (DebounceTimer*)pvTimer;
+    BangQueue* pQueue = pTimer->pQueue;
+
+    bool bPost = false;
+    bool bDone = true;
+
+    {
+        Lock lock(pQueue->m_csCoalesced);
+
+        // This timer has fired, a new one is created if necessary. Without a
+        // completion event this doesn't wait for the callback to return.
+        DeleteTimerQueueTimer(nullptr, pTimer->hTimer, nullptr);
+
+        CoalescedMap::iterator iter = pQueue->m_coalesced.find(pTimer->sCommand);
+
+        if (iter != pQueue->m_coalesced.end() && !iter->second.bQueued)
+        {
+            if (iter->second.ullDue > BangProfile::GetTimestamp() &&
+                pQueue->_ArmTimer(pTimer, iter->second.ullDue))
+            {
+                bDone = false;
+            }
+            else
+            {
+                iter->second.bQueued = true;
+                bPost = true;
+            }
+        }
+    }
+
+    if (bPost)
+    {
+        if (!pQueue->_Post(nullptr, pTimer->sCommand.c_str(), nullptr, nullptr, true))
+        {
+            Lock lock(pQueue->m_csCoalesced);
+            pQueue->m_coalesced.erase(pTimer->sCommand);
+        }
+    }
+
+    if (bDone)
+    {
+        delete pTimer;
+        pQueue->Release();
+    }
+}
+
+
+//
+// Process()
+//
+UINT BangQueue::Process()
+{
+    ASSERT(GetCurrentThreadId() == m_dwThreadID);
+
+    // Anything posted after this point needs another wakeup
+    InterlockedExchange(&m_lWakeup, 0);
+
+    BangRecord* pRecord = (BangRecord*)InterlockedExchangePointer(
+        (PVOID volatile*)&m_pHead, nullptr);
+
+    // The list is in LIFO order, turn it around
+    BangRecord* pFirst = nullptr;
+
+    while (pRecord != nullptr)
+    {
+        BangRecord* pNext = pRecord->pNext;
+        pRecord->pNext = pFirst;
+        pFirst = pRecord;
+        pRecord = pNext;
+    }
+
+    UINT uCount = 0;
+    BangManager* pBangManager = g_LSAPIManager.GetBangManager();
+
+    while (pFirst != nullptr)
+    {
+        BangRecord* pNext = pFirst->pNext;
+
+        // Cannot use ParseBangCommand here because that would expand
+        // variables again - and some themes rely on the fact that they are
+        // expanded only once. Besides, it would create inconsistent behavior.
+        if (pFirst->bCoalesced)
+        {
+            // Execute whatever the latest arguments are by now
+            CoalescedCall call;
+            bool bFound = false;
+
+            {
+                Lock lock(m_csCoalesced);
+
+                CoalescedMap::iterator iter = m_coalesced.find(pFirst->wzCommand);
+
+                if (iter != m_coalesced.end())
+                {
+                    call = iter->second;
+                    m_coalesced.erase(iter);
+                    bFound = true;
+                }
+            }
+
+            if (bFound)
+            {
+                pBangManager->ExecuteQueuedBangCommand(pFirst->wzCommand,
+                    call.hCaller, call.sArgs.c_str(), call.ullPosted);
+            }
+        }
+        else if (pFirst->pRequest == nullptr)
+        {
+            pBangManager->ExecuteQueuedBangCommand(pFirst->wzCommand,
+                pFirst->hCaller, pFirst->pwzArgs, pFirst->ullPosted);
+        }
+        else
+        {
+            // Skip requests that were cancelled while queued
+            if (pFirst->pRequest->Start())
+            {
+                pFirst->pRequest->Complete(
+                    pBangManager->ExecuteQueuedBangCommand(pFirst->wzCommand,
+                    pFirst->hCaller, pFirst->pwzArgs, pFirst->ullPosted));
+            }
+
+            pFirst->pRequest->Release();
+        }
+
+        free(pFirst);
+        pFirst = pNext;
+        ++uCount;
+    }
+
+    return uCount;
+}
@@ -0,0 +1,178 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(BANGQUEUE_H)
+#define BANGQUEUE_H
+
+#include "../utility/common.h"
+#include "../utility/criticalsection.h"
+#include "../utility/stringutility.h"
+#include "BangRequest.h"
+#include <string>
+
+/**
+ * Queue of bang commands waiting to be executed on the thread that owns them.
+ *
+ * Any thread may post to the queue without locking. The owning thread gets a
+ * single LM_THREAD_BANGCOMMAND message whenever the queue goes from idle to
+ * non-empty, sent to its ThreadWindow so modal loops don't lose it, and
+ * executes everything queued up to that point in one batch
+ * (see LSAPIProcessBangQueue). Posted bang commands are never dropped, if the
+ * wakeup message can't be posted the next post tries again. A request
+ * waiting on such a bang command is completed with <code>FALSE</code> right
+ * away though, as there may never be a next post.
+ *
+ * Bang commands with a coalescing policy (see Bang::SetCoalescing) keep at
+ * most one pending call per bang command. Newer calls replace the arguments
+ * of the pending one, and debounced calls are only queued once no new call
+ * came in for the debounce delay.
+ *
+ * There is one queue per thread. Each Bang holds a reference to the queue of
+ * its thread.
+ */
+class BangQueue
+{
+    /** A queued bang command. Name and arguments are stored inline. */
+    struct BangRecord
+    {
+        BangRecord* pNext;
+        HWND hCaller;
+        BangRequest* pRequest;
+        ULONGLONG ullPosted;
+        bool bCoalesced;
+        LPCWSTR pwzArgs;
+        wchar_t wzCommand[1];
+    };
+
+    /** The pending call of a bang command with a coalescing policy */
+    struct CoalescedCall
+    {
+        HWND hCaller;
+        std::wstring sArgs;
+
+        // BangProfile timestamps of the first call merged into this one, and
+        // of when a debounced call is due
+        ULONGLONG ullPosted;
+        ULONGLONG ullDue;
+
+        // Set once a record for the call has been queued
+        bool bQueued;
+    };
+
+    typedef StringKeyedMaps<std::wstring, CoalescedCall>::UnorderedMap CoalescedMap;
+
+    /** Timer that queues a debounced call once it is due */
+    struct DebounceTimer
+    {
+        BangQueue* pQueue;
+        HANDLE hTimer;
+        std::wstring sCommand;
+    };
+
+    /** Thread that executes the queued bang commands */
+    const DWORD m_dwThreadID;
+
+    /** Reference count, protected by the registry lock */
+    ULONG m_cRefs;
+
+    /** Most recently posted record first */
+    BangRecord* volatile m_pHead;
+
+    /** Non-zero while a wakeup message is on its way to the thread */
+    volatile LONG m_lWakeup;
+
+    /** Pending calls of bang commands with a coalescing policy */
+    CoalescedMap m_coalesced;
+
+    /** Critical section protecting m_coalesced and the debounce timers */
+    CriticalSection m_csCoalesced;
+
+    explicit BangQueue(DWORD dwThreadID);
+    ~BangQueue();
+
+    bool _Post(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs,
+        BangRequest* pRequest, bool bCoalesced);
+
+    bool _ArmTimer(DebounceTimer* pTimer, ULONGLONG ullDue);
+    static VOID CALLBACK _DebounceProc(PVOID pvTimer, BOOLEAN bTimerFired);
+
+    // not implemented
+    BangQueue(const BangQueue& rhs);
+    BangQueue& operator=(const BangQueue& rhs);
+
+public:
+    /**
+     * Returns the queue of a thread, creating it if necessary. Release it
+     * when done.
+     *
+     * @param  dwThreadID  Thread that owns the queue
+     */
+    static BangQueue* ForThread(DWORD dwThreadID);
+
+    /**
+     * Returns the queue of a thread if there is one. Release it when done.
+     *
+     * @param  dwThreadID  Thread that owns the queue
+     * @return Queue, or <code>nullptr</code> if the thread doesn't own any
+     *         bang commands
+     */
+    static BangQueue* FindForThread(DWORD dwThreadID);
+
+    ULONG AddRef();
+    ULONG Release();
+
+    /**
+     * Queues a bang command for execution on the owning thread.
+     *
+     * @param  hCaller     Window handle belonging to the caller
+     * @param  pwzCommand  Bang command name
+     * @param  pwzArgs     Bang command arguments, may be <code>nullptr</code>
+     * @param  pRequest    Request to complete once the bang command has been
+     *                     executed, may be <code>nullptr</code>
+     * @return <code>true</code> if the bang command was queued
+     */
+    bool Post(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs,
+        BangRequest* pRequest = nullptr);
+
+    /**
+     * Queues a call to a bang command with a coalescing policy. If a call to
+     * the same bang command is already pending it is updated instead.
+     *
+     * @param  hCaller     Window handle belonging to the caller
+     * @param  pwzCommand  Bang command name
+     * @param  pwzArgs     Bang command arguments, may be <code>nullptr</code>
+     * @param  dwDelay     Debounce delay in milliseconds, or 0 to queue the
+     *                     call right away
+     * @return <code>true</code> if the call was queued or merged
+     */
+    bool PostCoalesced(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs,
+        DWORD dwDelay);
+
+    /**
+     * Executes all queued bang commands, in the order they were posted. Must
+     * be called on the owning thread.
+     *
+     * @return Number of bang commands executed
+     */
+    UINT Process();
+};
+
+#endif // BANGQUEUE_H
@@ -0,0 +1,166 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "BangRequest.h"
+#include "../utility/core.hpp"
+
+
+//
+// BangRequest(LSBANGCOMPLETIONPROC pfnCallback, LPARAM lParam)
+//
+BangRequest::BangRequest(LSBANGCOMPLETIONPROC pfnCallback, LPARAM lParam)
+    : m_lState(STATE_PENDING)
+    , m_bResult(FALSE)
+    , m_hEvent(CreateEvent(nullptr, TRUE, FALSE, nullptr))
+    , m_dwThreadID(0)
+    , m_pfnCallback(pfnCallback)
+    , m_lParam(lParam)
+{
+    // do nothing
+}
+
+
+//
+// ~BangRequest()
+//
+BangRequest::~BangRequest()
+{
+    if (m_hEvent)
+    {
+        CloseHandle(m_hEvent);
+    }
+}
+
+
+//
+// SetThread(DWORD dwThreadID)
+//
+void BangRequest::SetThread(DWORD dwThreadID)
+{
+    m_dwThreadID = dwThreadID;
+}
+
+
+//
+// Start()
+//
+bool BangRequest::Start()
+{
+    return InterlockedCompareExchange(&m_lState,
+        STATE_RUNNING, STATE_PENDING) == STATE_PENDING;
+}
+
+
+//
+// Complete(BOOL bResult)
+//
+void BangRequest::Complete(BOOL bResult)
+{
+    // The callback goes first, so anyone who sees the request done, through
+    // GetResult or by waiting, can rely on it having run
+    if (m_pfnCallback)
+    {
+        m_pfnCallback(this, bResult, m_lParam);
+    }
+
+    m_bResult = bResult;
+    InterlockedExchange(&m_lState, STATE_DONE);
+
+    if (m_hEvent)
+    {
+        SetEvent(m_hEvent);
+    }
+}
+
+
+//
+// Cancel()
+//
+bool BangRequest::Cancel()
+{
+    if (InterlockedCompareExchange(&m_lState,
+        STATE_CANCELLED, STATE_PENDING) != STATE_PENDING)
+    {
+        return false;
+    }
+
+    if (m_hEvent)
+    {
+        SetEvent(m_hEvent);
+    }
+
+    return true;
+}
+
+
+//
+// Wait(DWORD dwMilliseconds)
+//
+DWORD BangRequest::Wait(DWORD dwMilliseconds)
+{
+    if (m_dwThreadID == GetCurrentThreadId())
+    {
+        if (m_lState == STATE_PENDING)
+        {
+            LSAPIProcessBangQueue();
+        }
+
+        // Still pending if it is part of the batch the queue is executing
+        // further up the stack, or running if it waits for itself. Either
+        // way it can't finish until this returns.
+        if (dwMilliseconds != 0 &&
+            (m_lState == STATE_PENDING || m_lState == STATE_RUNNING))
+        {
+            SetLastError(ERROR_POSSIBLE_DEADLOCK);
+            return WAIT_FAILED;
+        }
+    }
+
+    if (m_hEvent == nullptr)
+    {
+        return WAIT_FAILED;
+    }
+
+    return WaitForSingleObject(m_hEvent, dwMilliseconds);
+}
+
+
+//
+// GetResult(LPBOOL pbResult)
+//
+HRESULT BangRequest::GetResult(LPBOOL pbResult) const
+{
+    switch (m_lState)
+    {
+    case STATE_DONE:
+        if (pbResult)
+        {
+            *pbResult = m_bResult;
+        }
+        return S_OK;
+
+    case STATE_CANCELLED:
+        return E_ABORT;
+
+    default:
+        return E_PENDING;
+    }
+}
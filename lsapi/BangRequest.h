@@ -0,0 +1,132 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(BANGREQUEST_H)
+#define BANGREQUEST_H
+
+#include "../utility/common.h"
+#include "../utility/Base.h"
+#include "lsapidefines.h"
+
+/**
+ * Tracks a bang command started with ExecuteBangCommandAsync.
+ *
+ * The request is queued on the thread that owns the bang command. It can be
+ * cancelled until that thread picks it up, after that it runs to completion.
+ * The completion callback runs on the thread that executed the bang command,
+ * or on the calling thread if the bang command does not exist or could not
+ * be queued. It is not
+ * called for cancelled requests.
+ */
+class BangRequest : public CountedBase
+{
+    enum State
+    {
+        STATE_PENDING,
+        STATE_RUNNING,
+        STATE_DONE,
+        STATE_CANCELLED
+    };
+
+    volatile LONG m_lState;
+    BOOL m_bResult;
+
+    /** Signaled once the request is done or cancelled */
+    HANDLE m_hEvent;
+
+    /** Thread that executes the bang command */
+    DWORD m_dwThreadID;
+
+    LSBANGCOMPLETIONPROC m_pfnCallback;
+    LPARAM m_lParam;
+
+    // not implemented
+    BangRequest(const BangRequest& rhs);
+    BangRequest& operator=(const BangRequest& rhs);
+
+protected:
+    virtual ~BangRequest();
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param  pfnCallback  Called once the bang command has been executed,
+     *                      may be <code>nullptr</code>
+     * @param  lParam       Passed to pfnCallback
+     */
+    BangRequest(LSBANGCOMPLETIONPROC pfnCallback, LPARAM lParam);
+
+    /**
+     * Called when the request is queued.
+     *
+     * @param  dwThreadID  Thread that will execute the bang command
+     */
+    void SetThread(DWORD dwThreadID);
+
+    /**
+     * Moves the request from pending to running.
+     *
+     * @return <code>false</code> if the request was cancelled
+     */
+    bool Start();
+
+    /**
+     * Stores the result, calls the callback, and wakes up waiters.
+     *
+     * @param  bResult  <code>TRUE</code> if the bang command was found
+     */
+    void Complete(BOOL bResult);
+
+    /**
+     * Cancels the request if it hasn't started yet.
+     *
+     * @return <code>true</code> if the request was cancelled
+     */
+    bool Cancel();
+
+    /**
+     * Waits until the request is done or cancelled. If called on the thread
+     * that executes the request, its queue is processed first. If the
+     * request is still not done after that, it is part of the batch that
+     * thread is executing already, or it is the caller itself, so waiting
+     * fails right away instead of deadlocking.
+     *
+     * @param  dwMilliseconds  Timeout, may be <code>INFINITE</code>
+     * @return <code>WAIT_OBJECT_0</code> if the request is done or
+     *         cancelled, <code>WAIT_TIMEOUT</code> if the timeout elapsed,
+     *         or <code>WAIT_FAILED</code> with the last error set to
+     *         <code>ERROR_POSSIBLE_DEADLOCK</code> if it would never finish
+     */
+    DWORD Wait(DWORD dwMilliseconds);
+
+    /**
+     * Retrieves the result.
+     *
+     * @param  pbResult  Receives the result if the request is done
+     * @return <code>S_OK</code> if the request is done,
+     *         <code>E_PENDING</code> if it hasn't finished yet, or
+     *         <code>E_ABORT</code> if it was cancelled
+     */
+    HRESULT GetResult(LPBOOL pbResult) const;
+};
+
+#endif // BANGREQUEST_H
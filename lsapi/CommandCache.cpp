@@ -0,0 +1,394 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "CommandCache.h"
+#include "lsapi.h"
+#include "lsapiInit.h"
+#include "BangCommand.h"
+#include "../utility/core.hpp"
+#include "../utility/criticalsection.h"
+#include <unordered_map>
+
+// Number of entries kept by each cache. Command lines come from the settings
+// so there are only ever so many of them, once this many are cached the
+// cache is simply started over.
+#define COMMAND_CACHE_SIZE 256
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// CommandCacheMap
+//
+// Maps source strings to CompiledCommand or CommandSequence objects. The map
+// holds a reference to each of them.
+//
+template <class T>
+class CommandCacheMap
+{
+    typedef std::unordered_map<std::wstring, T*> EntryMap;
+
+    EntryMap m_entries;
+    CriticalSection m_cs;
+
+    void _Clear()
+    {
+        for (const typename EntryMap::value_type& value : m_entries)
+        {
+            value.second->Release();
+        }
+
+        m_entries.clear();
+    }
+
+public:
+    ~CommandCacheMap()
+    {
+        _Clear();
+    }
+
+    T* Find(LPCWSTR pwzKey)
+    {
+        Lock lock(m_cs);
+
+        typename EntryMap::iterator iter = m_entries.find(pwzKey);
+
+        if (iter == m_entries.end())
+        {
+            return nullptr;
+        }
+
+        iter->second->AddRef();
+        return iter->second;
+    }
+
+    void Store(LPCWSTR pwzKey, T* pEntry)
+    {
+        Lock lock(m_cs);
+
+        if (m_entries.size() >= COMMAND_CACHE_SIZE)
+        {
+            _Clear();
+        }
+
+        std::pair<typename EntryMap::iterator, bool> result =
+            m_entries.emplace(pwzKey, pEntry);
+
+        if (!result.second)
+        {
+            result.first->second->Release();
+            result.first->second = pEntry;
+        }
+
+        pEntry->AddRef();
+    }
+};
+
+static CommandCacheMap<CompiledCommand> g_commandCache;
+static CommandCacheMap<CommandSequence> g_sequenceCache;
+static CommandCacheMap<ExpandedString> g_expansionCache;
+
+
+//
+// Like VarExpansionExW, but also tells if the result only depends on the
+// settings
+//   (local helper function)
+//
+static bool ExpandVariables(LPWSTR pwzExpanded, LPCWSTR pwzTemplate, size_t cchExpanded)
+{
+    bool bStable = false;
+
+    if (g_LSAPIManager.IsInitialized())
+    {
+        g_LSAPIManager.GetSettingsManager()->VarExpansionEx(
+            pwzExpanded, pwzTemplate, cchExpanded, &bStable);
+    }
+    else
+    {
+        StringCchCopyW(pwzExpanded, cchExpanded, pwzTemplate);
+    }
+
+    return bStable;
+}
+
+
+//
+// CompiledCommand(LPCWSTR pwzCommandLine, LONG lSettingsGeneration)
+//
+// Does what LSExecuteW does before it executes a command line: expand it and
+// split off the command. For bang commands it also does what
+// ParseBangCommandW does before a bang command is looked up: expand the
+// arguments once more.
+//
+CompiledCommand::CompiledCommand(LPCWSTR pwzCommandLine, LONG lSettingsGeneration)
+    : m_lSettingsGeneration(lSettingsGeneration)
+    , m_bStable(false)
+    , m_bIsBang(false)
+    , m_bHasArgs(false)
+    , m_pBang(nullptr)
+    , m_lBangGeneration(0)
+{
+    wchar_t wzExpandedCommand[MAX_LINE_LENGTH];
+    wchar_t wzCommand[MAX_LINE_LENGTH];
+    LPCWSTR pwzArgs;
+
+    m_bStable = ExpandVariables(
+        wzExpandedCommand, pwzCommandLine, MAX_LINE_LENGTH);
+
+    if (!GetTokenW(wzExpandedCommand, wzCommand, &pwzArgs, TRUE))
+    {
+        return;
+    }
+
+    if (pwzArgs > (wzExpandedCommand + wcslen(wzExpandedCommand)))
+    {
+        pwzArgs = nullptr;
+    }
+
+    m_sCommand = wzCommand;
+
+    if (wzCommand[0] != L'!')
+    {
+        if (pwzArgs != nullptr)
+        {
+            m_bHasArgs = true;
+            m_sArgs = pwzArgs;
+        }
+    }
+    else
+    {
+        wchar_t wzExpandedArgs[MAX_LINE_LENGTH] = { 0 };
+
+        if (pwzArgs != nullptr &&
+            !ExpandVariables(wzExpandedArgs, pwzArgs, MAX_LINE_LENGTH))
+        {
+            m_bStable = false;
+        }
+
+        m_bIsBang = true;
+        m_bHasArgs = true;
+        m_sArgs = wzExpandedArgs;
+
+        m_pBang = g_LSAPIManager.GetBangManager()->
+            FindBangCommand(wzCommand, &m_lBangGeneration);
+    }
+}
+
+
+//
+// ~CompiledCommand()
+//
+CompiledCommand::~CompiledCommand()
+{
+    // do nothing
+}
+
+
+//
+// FromCache(LPCWSTR pwzCommandLine)
+//
+CompiledCommand* CompiledCommand::FromCache(LPCWSTR pwzCommandLine)
+{
+    if (pwzCommandLine == nullptr || !g_LSAPIManager.IsInitialized())
+    {
+        return nullptr;
+    }
+
+    CompiledCommand* pCommand = g_commandCache.Find(pwzCommandLine);
+
+    if (pCommand != nullptr)
+    {
+        if (pCommand->IsCurrent())
+        {
+            return pCommand;
+        }
+
+        pCommand->Release();
+    }
+
+    // Read the generation before expanding, so a change made while we are at
+    // it leaves the result out of date rather than wrongly current
+    pCommand = new CompiledCommand(pwzCommandLine,
+        SettingsManager::GetGeneration());
+
+    if (pCommand->m_bStable)
+    {
+        g_commandCache.Store(pwzCommandLine, pCommand);
+    }
+
+    return pCommand;
+}
+
+
+//
+// IsCurrent()
+//
+bool CompiledCommand::IsCurrent() const
+{
+    if (!m_bStable ||
+        m_lSettingsGeneration != SettingsManager::GetGeneration())
+    {
+        return false;
+    }
+
+    return !m_bIsBang ||
+        m_lBangGeneration == g_LSAPIManager.GetBangManager()->GetGeneration();
+}
+
+
+//
+// Execute(HWND hCaller)
+//
+BOOL CompiledCommand::Execute(HWND hCaller) const
+{
+    TRACE("ParseBangCommand(%p, \"%ls\", \"%ls\"); (cached)",
+        hCaller, m_sCommand.c_str(), m_sArgs.c_str());
+
+    BangManager* pBangManager = g_LSAPIManager.GetBangManager();
+
+    if (!pBangManager->AcquireBangCommand(m_pBang, m_lBangGeneration))
+    {
+        // The bang commands changed since we were compiled
+        return pBangManager->ExecuteBangCommand(
+            m_sCommand.c_str(), hCaller, m_sArgs.c_str());
+    }
+
+    if (m_pBang == nullptr)
+    {
+        return FALSE;
+    }
+
+    m_pBang->Execute(hCaller, m_sArgs.c_str());
+    m_pBang->Release();
+
+    return TRUE;
+}
+
+
+//
+// CommandSequence(LPCWSTR pwzArgs)
+//
+CommandSequence::CommandSequence(LPCWSTR pwzArgs)
+{
+    LPCWSTR pwzNextToken = pwzArgs;
+    wchar_t wzCommand[MAX_LINE_LENGTH];
+
+    while (GetTokenW(pwzNextToken, wzCommand, &pwzNextToken, TRUE))
+    {
+        m_commands.push_back(wzCommand);
+    }
+}
+
+
+//
+// ~CommandSequence()
+//
+CommandSequence::~CommandSequence()
+{
+    // do nothing
+}
+
+
+//
+// FromCache(LPCWSTR pwzArgs)
+//
+CommandSequence* CommandSequence::FromCache(LPCWSTR pwzArgs)
+{
+    if (pwzArgs == nullptr)
+    {
+        return nullptr;
+    }
+
+    CommandSequence* pSequence = g_sequenceCache.Find(pwzArgs);
+
+    if (pSequence == nullptr)
+    {
+        pSequence = new CommandSequence(pwzArgs);
+        g_sequenceCache.Store(pwzArgs, pSequence);
+    }
+
+    return pSequence;
+}
+
+
+//
+// ExpandedString(LPCWSTR pwzTemplate)
+//
+ExpandedString::ExpandedString(LPCWSTR pwzTemplate)
+    : m_lSettingsGeneration(SettingsManager::GetGeneration())
+    , m_bStable(false)
+{
+    wchar_t wzExpanded[MAX_LINE_LENGTH];
+
+    m_bStable = ExpandVariables(wzExpanded, pwzTemplate, MAX_LINE_LENGTH);
+    m_sExpanded = wzExpanded;
+}
+
+
+//
+// ~ExpandedString()
+//
+ExpandedString::~ExpandedString()
+{
+    // do nothing
+}
+
+
+//
+// FromCache(LPCWSTR pwzTemplate)
+//
+ExpandedString* ExpandedString::FromCache(LPCWSTR pwzTemplate)
+{
+    if (pwzTemplate == nullptr || !g_LSAPIManager.IsInitialized())
+    {
+        return nullptr;
+    }
+
+    ExpandedString* pExpanded = g_expansionCache.Find(pwzTemplate);
+
+    if (pExpanded != nullptr)
+    {
+        if (pExpanded->IsCurrent())
+        {
+            return pExpanded;
+        }
+
+        pExpanded->Release();
+    }
+
+    pExpanded = new ExpandedString(pwzTemplate);
+
+    if (pExpanded->m_bStable)
+    {
+        g_expansionCache.Store(pwzTemplate, pExpanded);
+    }
+
+    return pExpanded;
+}
+
+
+//
+// IsCurrent()
+//
+bool ExpandedString::IsCurrent() const
+{
+    return m_bStable &&
+        m_lSettingsGeneration == SettingsManager::GetGeneration();
+}
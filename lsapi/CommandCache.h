@@ -0,0 +1,209 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(COMMANDCACHE_H)
+#define COMMANDCACHE_H
+
+#include "../utility/common.h"
+#include "../utility/Base.h"
+#include <string>
+#include <vector>
+
+class Bang;
+
+/**
+ * A command line, as passed to LSExecute, that has been expanded and
+ * tokenized once. For bang command lines ("!Bang args") the arguments are
+ * expanded as well, and the bang command they resolved to is kept.
+ *
+ * Compiled commands are only valid for the settings generation they were
+ * expanded in, and only if nothing but the settings went into the expansion
+ * (see SettingsManager::VarExpansionEx). The resolved bang command is
+ * revalidated against the bang command list each time the command is
+ * executed.
+ */
+class CompiledCommand : public CountedBase
+{
+    LONG m_lSettingsGeneration;
+    bool m_bStable;
+    bool m_bIsBang;
+    bool m_bHasArgs;
+
+    std::wstring m_sCommand;
+    std::wstring m_sArgs;
+
+    // Not referenced, see BangManager::AcquireBangCommand
+    Bang* m_pBang;
+    LONG m_lBangGeneration;
+
+    CompiledCommand(LPCWSTR pwzCommandLine, LONG lSettingsGeneration);
+    virtual ~CompiledCommand();
+
+    // not implemented
+    CompiledCommand(const CompiledCommand& rhs);
+    CompiledCommand& operator=(const CompiledCommand& rhs);
+
+public:
+    /**
+     * Returns a compiled command line from the shared cache, compiling it if
+     * it isn't there or out of date. Release it when done.
+     *
+     * @param  pwzCommandLine  Command line, as passed to LSExecute
+     * @return Compiled command, or <code>nullptr</code> if pwzCommandLine
+     *         is <code>nullptr</code> or the LSAPI isn't initialized
+     */
+    static CompiledCommand* FromCache(LPCWSTR pwzCommandLine);
+
+    /**
+     * Checks if the command line is a bang command. Anything else has to be
+     * executed the regular way, see GetCommand and GetArgs.
+     */
+    bool IsBangCommand() const
+    {
+        return m_bIsBang;
+    }
+
+    /**
+     * Returns the first token of the expanded command line, or an empty
+     * string if there is none.
+     */
+    LPCWSTR GetCommand() const
+    {
+        return m_sCommand.c_str();
+    }
+
+    /**
+     * Returns the rest of the expanded command line. Only bang command
+     * arguments are expanded a second time, like ParseBangCommand does.
+     *
+     * @return Arguments, or <code>nullptr</code> if there are none
+     */
+    LPCWSTR GetArgs() const
+    {
+        return m_bHasArgs ? m_sArgs.c_str() : nullptr;
+    }
+
+    /**
+     * Checks if the command is still up to date.
+     */
+    bool IsCurrent() const;
+
+    /**
+     * Executes the bang command, with the same result as ParseBangCommand.
+     *
+     * @param  hCaller  handle to owner window
+     * @return <code>TRUE</code> if the bang command exists
+     */
+    BOOL Execute(HWND hCaller) const;
+};
+
+
+/**
+ * The list of commands in a "[!Bang1 arg][!Bang2 arg]" argument string, as
+ * used by !Execute. The list only depends on the string itself, so it never
+ * goes out of date. Each command is compiled separately when it is run.
+ */
+class CommandSequence : public CountedBase
+{
+    std::vector<std::wstring> m_commands;
+
+    explicit CommandSequence(LPCWSTR pwzArgs);
+    virtual ~CommandSequence();
+
+    // not implemented
+    CommandSequence(const CommandSequence& rhs);
+    CommandSequence& operator=(const CommandSequence& rhs);
+
+public:
+    /**
+     * Returns a tokenized argument string from the shared cache. Release it
+     * when done.
+     *
+     * @param  pwzArgs  Argument string
+     * @return Command sequence, or <code>nullptr</code> if pwzArgs is
+     *         <code>nullptr</code>
+     */
+    static CommandSequence* FromCache(LPCWSTR pwzArgs);
+
+    /**
+     * Returns the commands in the sequence.
+     */
+    const std::vector<std::wstring>& GetCommands() const
+    {
+        return m_commands;
+    }
+};
+
+/**
+ * A string with its variable references expanded, as used for the arguments
+ * of bang commands. Expansions that only depend on the settings are shared
+ * until the settings generation changes.
+ */
+class ExpandedString : public CountedBase
+{
+    LONG m_lSettingsGeneration;
+    bool m_bStable;
+    std::wstring m_sExpanded;
+
+    explicit ExpandedString(LPCWSTR pwzTemplate);
+    virtual ~ExpandedString();
+
+    // not implemented
+    ExpandedString(const ExpandedString& rhs);
+    ExpandedString& operator=(const ExpandedString& rhs);
+
+public:
+    /**
+     * Returns the expanded form of a string, from the shared cache if
+     * possible. Release it when done.
+     *
+     * Strings without variable references are not cached; check for those
+     * before calling this, they can be used as they are.
+     *
+     * @param  pwzTemplate  String to expand
+     * @return Expanded string, or <code>nullptr</code> if pwzTemplate is
+     *         <code>nullptr</code> or the LSAPI isn't initialized
+     */
+    static ExpandedString* FromCache(LPCWSTR pwzTemplate);
+
+    /**
+     * Checks if a string contains anything VarExpansionEx would replace.
+     */
+    static bool NeedsExpansion(LPCWSTR pwzTemplate)
+    {
+        return pwzTemplate != nullptr && wcschr(pwzTemplate, L'$') != nullptr;
+    }
+
+    /**
+     * Checks if the expansion is still up to date.
+     */
+    bool IsCurrent() const;
+
+    /**
+     * Returns the expanded string.
+     */
+    LPCWSTR GetString() const
+    {
+        return m_sExpanded.c_str();
+    }
+};
+
+#endif // COMMANDCACHE_H
@@ -21,8 +21,10 @@
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 #include "SettingsFileParser.h"
 #include "MathEvaluate.h"
+#include "StartupTimeline.h"
 #include "../utility/core.hpp"
 #include "../utility/macros.h"
+#include "../utility/scan.h"
 #include <algorithm>
 #include <vector>
 
@@ -73,6 +75,9 @@ void FileParser::ParseFile(LPCTSTR ptzFileName)
     VarExpansionExW(tzExpandedPath, ptzFileName, MAX_PATH_LENGTH);
     PathUnquoteSpaces(tzExpandedPath);
 
+    // Included files show up nested in the file that includes them
+    TimelineSpan span(L"settings", tzExpandedPath);
+
     DWORD dwLen = GetFullPathName(
         tzExpandedPath, MAX_PATH_LENGTH, m_tzFullPath, nullptr);
 
@@ -177,13 +182,14 @@ bool FileParser::_ReadNextLine(LPTSTR ptzBuffer)
         LPTSTR ptzCurrent = tzBuffer;
 
         // Jump over any initial whitespace
-        ptzCurrent += _tcsspn(ptzCurrent, WHITESPACE);
+        ptzCurrent = SkipWhitespace(ptzCurrent);
 
         // Ignore empty lines, and comments
         if (ptzCurrent[0] != '\0' && ptzCurrent[0] != _T(';'))
         {
             // End on first reserved character or whitespace
-            size_t stEndConfig = _tcscspn(ptzCurrent, WHITESPACE RESERVEDCHARS);
+            size_t stEndConfig =
+                ScanFor(ptzCurrent, SCAN_WHITESPACE | SCAN_RESERVED) - ptzCurrent;
 
             // If the character is not whitespace or a comment
             // then the line has an invalid format.  Ignore it.
@@ -238,7 +244,8 @@ bool FileParser::_ReadLineFromFile(LPTSTR ptzName, LPTSTR ptzValue)
         LPTSTR ptzCurrent = m_tzReadAhead;
 
         // End on first reserved character or whitespace
-        size_t stEndConfig = _tcscspn(ptzCurrent, WHITESPACE RESERVEDCHARS);
+        size_t stEndConfig =
+            ScanFor(ptzCurrent, SCAN_WHITESPACE | SCAN_RESERVED) - ptzCurrent;
 
         if (stEndConfig != 0)
         {
@@ -286,7 +293,7 @@ bool FileParser::_ReadLineFromFile(LPTSTR ptzName, LPTSTR ptzValue)
 
                     // Avoid expensive in-place copy from _StripString
                     // Simply increment passed any whitespace, here.
-                    ptzValueStart += _tcsspn(ptzValueStart, WHITESPACE);
+                    ptzValueStart = SkipWhitespace(ptzValueStart);
 
                     // Removing trailing whitespace and comments
                     _StripString(ptzValueStart);
@@ -297,7 +304,7 @@ bool FileParser::_ReadLineFromFile(LPTSTR ptzName, LPTSTR ptzValue)
                     if (!m_stPrefixes.empty())
                     {
                         LPTSTR ptzAtSearch;
-                        while ((ptzAtSearch = _tcschr(ptzValueStart, _T('@'))) != nullptr)
+                        while (*(ptzAtSearch = ScanFor(ptzValueStart, SCAN_AT)) != _T('\0'))
                         {
                             // Copy this part of the value over.
                             DWORD nSize = (DWORD)(ptzAtSearch - ptzValueStart);
@@ -421,6 +428,13 @@ void FileParser::_StripString(LPTSTR ptzString)
         }
 
         ++ptzCurrent;
+
+        // Inside a word only whitespace, quotes, brackets and comments matter
+        if (ptzStart != NULL && ptzLast == NULL)
+        {
+            ptzCurrent = ScanFor(ptzCurrent,
+                SCAN_WHITESPACE | SCAN_QUOTE | SCAN_BRACKET | SCAN_COMMENT);
+        }
     }
 
     if (ptzLast != NULL)
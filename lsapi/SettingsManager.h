@@ -29,6 +29,7 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 
 /**
@@ -262,6 +263,19 @@ public:
      */
     BOOL LCClose(LPVOID pFile);
 
+    /**
+     * Checks if a file handle was returned by this settings manager's
+     * {@link #LCOpen} and hasn't been closed yet.
+     *
+     * @param   pFile  file handle, may be <code>NULL</code>
+     */
+    bool IsOpen(LPVOID pFile);
+
+    /**
+     * Checks if any file handles returned by {@link #LCOpen} are still open.
+     */
+    bool HasOpenFiles();
+
     /**
      * Retrieves the next config line (one that starts with a '*') that begins
      * with the specified setting name from a configuration file. The entire
@@ -333,8 +347,47 @@ public:
      * @param  pwzTemplate      string to be expanded
      * @param  cchBufferLen     size of the buffer
      * @param  recursiveVarSet  recursive variable set
+     * @param  pbStable         cleared if the result depends on anything but
+     *                          the settings. May be <code>nullptr</code>.
+     */
+    void VarExpansionEx(LPWSTR pwzExpandedString, LPCWSTR pwzTemplate, size_t stLength, const StringSet& recursiveVarSet, bool* pbStable = nullptr);
+
+    /**
+     * Expands variable references, and tells if the result can be reused.
+     * Variables that aren't settings, such as environment variables, can
+     * change without the settings generation changing.
+     *
+     * @param  pwzBuffer     buffer to received the expanded string
+     * @param  pwzTemplate   string to be expanded
+     * @param  cchBufferLen  size of the buffer
+     * @param  pbStable      set to <code>true</code> if the result stays the
+     *                       same as long as GetGeneration doesn't change
+     */
+    void VarExpansionEx(LPWSTR pwzExpandedString, LPCWSTR pwzTemplate, size_t stLength, bool* pbStable);
+
+    /**
+     * Retrieves the unparsed values of a global setting, in the order they
+     * were defined. Config lines may have several. Unlike the other lookups
+     * this is not recorded by SettingsTracker.
+     *
+     * @param  pwzKeyName  setting name
+     * @param  vecValues   receives the values, empty if the setting does
+     *                     not exist
+     */
+    void GetRawValues(LPCWSTR pwzKeyName, std::vector<std::wstring>& vecValues);
+
+    /**
+     * Returns the settings generation. It changes whenever the global
+     * settings change, including when the settings are reloaded, so it can
+     * be used to tell if something derived from them is still current.
+     */
+    static LONG GetGeneration();
+
+    /**
+     * Changes the settings generation without changing the settings, e.g.
+     * once a SettingsManager has taken the place of another.
      */
-    void VarExpansionEx(LPWSTR pwzExpandedString, LPCWSTR pwzTemplate, size_t stLength, const StringSet& recursiveVarSet);
+    static void NewGeneration();
 };
 
 #endif // SETTINGSMANAGER_H
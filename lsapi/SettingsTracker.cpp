@@ -0,0 +1,293 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "SettingsTracker.h"
+#include "SettingsManager.h"
+#include "../utility/core.hpp"
+#include "../utility/criticalsection.h"
+#include <map>
+#include <string>
+
+
+//
+// What a DLL has read
+//   (local helper struct)
+//
+struct READER_INFO
+{
+    StringSet keys;
+
+    /** Depends on more than the keys */
+    bool bAll;
+
+    READER_INFO() : bAll(false)
+    {
+        // do nothing
+    }
+};
+
+static std::map<HMODULE, READER_INFO> g_readers;
+
+// Return addresses that have been seen, and the DLL each one belongs to.
+// Saves looking up the DLL on every call.
+static std::map<LPCVOID, HMODULE> g_addresses;
+
+static CriticalSection g_csReaders;
+static volatile bool g_bEnabled = false;
+
+// Holds the module handle of the current reader, or &g_bNobody
+static const DWORD g_dwTlsReader = TlsAlloc();
+
+// Reader of lookups that aren't recorded
+static const BYTE g_bNobody = 0;
+
+
+//
+// Returns the DLL a return address belongs to, or nullptr if its reads are
+// not recorded. That includes lsapi.dll's own reads, LSAPIInit refreshes
+// what it derives from them after a reload.
+//   (local helper function)
+//
+static HMODULE FindReader(LPCVOID pvAddress)
+{
+    static HMODULE s_hLsapi = nullptr;
+
+    {
+        Lock lock(g_csReaders);
+
+        std::map<LPCVOID, HMODULE>::const_iterator iter =
+            g_addresses.find(pvAddress);
+
+        if (iter != g_addresses.end())
+        {
+            return iter->second;
+        }
+    }
+
+    // Not under the lock, this may need the loader lock
+    if (s_hLsapi == nullptr)
+    {
+        GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+            GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+            (LPCWSTR)&g_bNobody, &s_hLsapi);
+    }
+
+    HMODULE hReader = nullptr;
+
+    if (!GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+        GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+        (LPCWSTR)pvAddress, &hReader) || hReader == s_hLsapi)
+    {
+        hReader = nullptr;
+    }
+
+    Lock lock(g_csReaders);
+    g_addresses[pvAddress] = hReader;
+
+    return hReader;
+}
+
+
+//
+// Enable(bool bEnable)
+//
+void SettingsTracker::Enable(bool bEnable)
+{
+    if (!bEnable)
+    {
+        Reset();
+    }
+
+    g_bEnabled = bEnable && g_dwTlsReader != TLS_OUT_OF_INDEXES;
+}
+
+
+//
+// IsEnabled()
+//
+bool SettingsTracker::IsEnabled()
+{
+    return g_bEnabled;
+}
+
+
+//
+// RecordKey(LPCWSTR pwzKey)
+//
+void SettingsTracker::RecordKey(LPCWSTR pwzKey)
+{
+    if (!g_bEnabled || pwzKey == nullptr)
+    {
+        return;
+    }
+
+    LPVOID pvReader = TlsGetValue(g_dwTlsReader);
+
+    if (pvReader != nullptr && pvReader != &g_bNobody)
+    {
+        Lock lock(g_csReaders);
+        g_readers[(HMODULE)pvReader].keys.insert(pwzKey);
+    }
+}
+
+
+//
+// RecordAll()
+//
+void SettingsTracker::RecordAll()
+{
+    if (!g_bEnabled)
+    {
+        return;
+    }
+
+    LPVOID pvReader = TlsGetValue(g_dwTlsReader);
+
+    if (pvReader != nullptr && pvReader != &g_bNobody)
+    {
+        Lock lock(g_csReaders);
+        g_readers[(HMODULE)pvReader].bAll = true;
+    }
+}
+
+
+//
+// Forget(HMODULE hReader)
+//
+void SettingsTracker::Forget(HMODULE hReader)
+{
+    Lock lock(g_csReaders);
+
+    g_readers.erase(hReader);
+
+    // The next DLL may well be loaded at the same address
+    std::map<LPCVOID, HMODULE>::iterator iter = g_addresses.begin();
+
+    while (iter != g_addresses.end())
+    {
+        if (iter->second == hReader)
+        {
+            iter = g_addresses.erase(iter);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+}
+
+
+//
+// Reset()
+//
+void SettingsTracker::Reset()
+{
+    Lock lock(g_csReaders);
+
+    g_readers.clear();
+    g_addresses.clear();
+}
+
+
+//
+// Compare(SettingsManager* pOld, SettingsManager* pNew, std::vector<HMODULE>& vecChanged)
+//
+void SettingsTracker::Compare(SettingsManager* pOld, SettingsManager* pNew,
+    std::vector<HMODULE>& vecChanged)
+{
+    ASSERT(pOld != nullptr && pNew != nullptr);
+
+    Lock lock(g_csReaders);
+
+    // Many keys are read by several modules
+    StringKeyedMaps<std::wstring, bool>::UnorderedMap changedKeys;
+
+    std::map<HMODULE, READER_INFO>::iterator iter = g_readers.begin();
+
+    while (iter != g_readers.end())
+    {
+        bool bChanged = iter->second.bAll;
+
+        for (StringSet::const_iterator itKey = iter->second.keys.begin();
+             !bChanged && itKey != iter->second.keys.end(); ++itKey)
+        {
+            StringKeyedMaps<std::wstring, bool>::UnorderedMap::iterator
+                itChanged = changedKeys.find(*itKey);
+
+            if (itChanged == changedKeys.end())
+            {
+                std::vector<std::wstring> vecOld, vecNew;
+                pOld->GetRawValues(itKey->c_str(), vecOld);
+                pNew->GetRawValues(itKey->c_str(), vecNew);
+
+                itChanged = changedKeys.insert(std::make_pair(
+                    *itKey, vecOld != vecNew)).first;
+            }
+
+            bChanged = itChanged->second;
+        }
+
+        if (bChanged)
+        {
+            vecChanged.push_back(iter->first);
+            iter = g_readers.erase(iter);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+}
+
+
+//
+// SettingsReader(LPCVOID pvReturnAddress)
+//
+SettingsReader::SettingsReader(LPCVOID pvReturnAddress)
+    : m_bOuter(false)
+{
+    if (g_bEnabled && TlsGetValue(g_dwTlsReader) == nullptr)
+    {
+        HMODULE hReader = nullptr;
+
+        if (pvReturnAddress != nullptr)
+        {
+            hReader = FindReader(pvReturnAddress);
+        }
+
+        TlsSetValue(g_dwTlsReader,
+            hReader ? (LPVOID)hReader : (LPVOID)&g_bNobody);
+
+        m_bOuter = true;
+    }
+}
+
+
+//
+// ~SettingsReader()
+//
+SettingsReader::~SettingsReader()
+{
+    if (m_bOuter)
+    {
+        TlsSetValue(g_dwTlsReader, nullptr);
+    }
+}
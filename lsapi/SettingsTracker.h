@@ -0,0 +1,145 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(SETTINGSTRACKER_H)
+#define SETTINGSTRACKER_H
+
+#include "../utility/common.h"
+#include <vector>
+
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#  pragma intrinsic(_ReturnAddress)
+#  define RETURN_ADDRESS() _ReturnAddress()
+#else
+#  define RETURN_ADDRESS() __builtin_return_address(0)
+#endif
+
+class SettingsManager;
+
+
+/**
+ * Records which global settings each module reads, so a selective recycle
+ * (see LSSelectiveRecycle) only has to restart the modules whose settings
+ * have changed.
+ *
+ * Reads are attributed to the DLL that called into the LSAPI, which is found
+ * from the return address of the exported function, see SettingsReader.
+ * Every lookup made on its behalf is recorded, including those of the
+ * variables a value refers to. Reads the LSAPI makes for itself are not
+ * recorded; it checks SettingsManager::GetGeneration instead.
+ *
+ * Only the LSAPI uses this class directly. litestep.exe goes through
+ * LSAPITrackSettings, LSAPIReloadChangedSettings and
+ * LSAPIForgetSettingsReader.
+ */
+class SettingsTracker
+{
+public:
+    /**
+     * Turns recording on or off. Turning it off forgets all reads.
+     */
+    static void Enable(bool bEnable);
+
+    /**
+     * Checks if reads are being recorded.
+     */
+    static bool IsEnabled();
+
+    /**
+     * Records that the current reader looked up a setting. Does nothing
+     * unless the lookup is made on behalf of a SettingsReader.
+     *
+     * @param  pwzKey  name of the setting, whether or not it exists
+     */
+    static void RecordKey(LPCWSTR pwzKey);
+
+    /**
+     * Records that the current reader depends on more than individual
+     * settings, e.g. by enumerating all lines or reading its own
+     * configuration file. Such readers are reported on every selective
+     * reload.
+     */
+    static void RecordAll();
+
+    /**
+     * Forgets the reads of a DLL, e.g. because it is being unloaded.
+     *
+     * @param  hReader  the DLL's module handle
+     */
+    static void Forget(HMODULE hReader);
+
+    /**
+     * Forgets all reads.
+     */
+    static void Reset();
+
+    /**
+     * Finds the readers that would get different values from the new
+     * settings than they got from the old ones, and forgets their reads.
+     * They will record them again once they read the new settings.
+     *
+     * @param  pOld        settings the recorded reads were made from
+     * @param  pNew        settings that replace them
+     * @param  vecChanged  receives the module handles of those readers
+     */
+    static void Compare(SettingsManager* pOld, SettingsManager* pNew,
+        std::vector<HMODULE>& vecChanged);
+};
+
+
+/**
+ * Makes the caller of an exported settings function the reader of all
+ * lookups on the current thread until it goes out of scope. Nested readers
+ * leave the outermost one in place, so an A function that calls its W
+ * counterpart is still attributed to the module that called it.
+ *
+ * Use SETTINGS_READER at the top of the exported function itself, since the
+ * return address is only meaningful there.
+ */
+class SettingsReader
+{
+    bool m_bOuter;
+
+    // not implemented
+    SettingsReader(const SettingsReader& rhs);
+    SettingsReader& operator=(const SettingsReader& rhs);
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param  pvReturnAddress  address in the calling DLL, or
+     *                          <code>nullptr</code> to record nothing on
+     *                          this thread, e.g. while the settings are
+     *                          being parsed
+     */
+    explicit SettingsReader(LPCVOID pvReturnAddress);
+
+    /**
+     * Destructor.
+     */
+    ~SettingsReader();
+};
+
+#define SETTINGS_READER() SettingsReader settingsReader(RETURN_ADDRESS())
+
+#endif // SETTINGSTRACKER_H
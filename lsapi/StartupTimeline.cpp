@@ -0,0 +1,161 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "StartupTimeline.h"
+#include "../utility/core.hpp"
+#include "../utility/criticalsection.h"
+#include "../utility/perfcounter.h"
+#include <vector>
+
+
+//
+// A recorded span
+//   (local helper struct)
+//
+struct TIMELINE_SPAN
+{
+    std::wstring sCategory;
+    std::wstring sName;
+    ULONGLONG ullStart;
+    ULONGLONG ullEnd;
+    DWORD dwThreadId;
+};
+
+static std::vector<TIMELINE_SPAN> g_spans;
+static CriticalSection g_csSpans;
+
+
+//
+// Writes a string as a JSON string literal
+//   (local helper function)
+//
+static void WriteJsonString(FILE* pFile, LPCWSTR pwzString)
+{
+    fputwc(L'"', pFile);
+
+    for (LPCWSTR pwzChar = pwzString; *pwzChar != L'\0'; ++pwzChar)
+    {
+        if (*pwzChar == L'"' || *pwzChar == L'\\')
+        {
+            fwprintf(pFile, L"\\%lc", *pwzChar);
+        }
+        else if (*pwzChar < L' ')
+        {
+            fwprintf(pFile, L"\\u%04x", (UINT)*pwzChar);
+        }
+        else
+        {
+            fputwc(*pwzChar, pFile);
+        }
+    }
+
+    fputwc(L'"', pFile);
+}
+
+
+//
+// Record(LPCWSTR pwzCategory, LPCWSTR pwzName, ULONGLONG ullStart, ULONGLONG ullEnd)
+//
+void StartupTimeline::Record(LPCWSTR pwzCategory, LPCWSTR pwzName,
+    ULONGLONG ullStart, ULONGLONG ullEnd)
+{
+    if (pwzCategory == nullptr || pwzName == nullptr)
+    {
+        return;
+    }
+
+    Lock lock(g_csSpans);
+
+    if (g_spans.size() < MAX_SPANS)
+    {
+        TIMELINE_SPAN span = { pwzCategory, pwzName, ullStart, ullEnd,
+            GetCurrentThreadId() };
+
+        g_spans.push_back(span);
+    }
+}
+
+
+//
+// Reset()
+//
+void StartupTimeline::Reset()
+{
+    Lock lock(g_csSpans);
+    g_spans.clear();
+}
+
+
+//
+// Write(LPCWSTR pwzFile)
+//
+HRESULT StartupTimeline::Write(LPCWSTR pwzFile)
+{
+    FILE* pFile = nullptr;
+
+    if (_wfopen_s(&pFile, pwzFile, L"wt, ccs=UTF-8") != 0 || pFile == nullptr)
+    {
+        TRACE("StartupTimeline: Could not open \"%ls\"", pwzFile);
+        return E_FAIL;
+    }
+
+    double dTicksPerUs = (double)GetPerformanceFrequency() / 1000000.0;
+    DWORD dwProcessId = GetCurrentProcessId();
+
+    Lock lock(g_csSpans);
+
+    // Make the earliest span start at 0
+    ULONGLONG ullOrigin = 0;
+
+    for (const TIMELINE_SPAN& span : g_spans)
+    {
+        if (ullOrigin == 0 || span.ullStart < ullOrigin)
+        {
+            ullOrigin = span.ullStart;
+        }
+    }
+
+    fwprintf(pFile, L"{\"traceEvents\":[\n");
+
+    for (size_t uIndex = 0; uIndex < g_spans.size(); ++uIndex)
+    {
+        const TIMELINE_SPAN& span = g_spans[uIndex];
+
+        fwprintf(pFile, L"%ls{\"name\":", (uIndex == 0) ? L"" : L",");
+        WriteJsonString(pFile, span.sName.c_str());
+
+        fwprintf(pFile, L",\"cat\":");
+        WriteJsonString(pFile, span.sCategory.c_str());
+
+        fwprintf(pFile,
+            L",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%lu,\"tid\":%lu}\n",
+            (double)(span.ullStart - ullOrigin) / dTicksPerUs,
+            (double)(span.ullEnd - span.ullStart) / dTicksPerUs,
+            dwProcessId, span.dwThreadId);
+    }
+
+    fwprintf(pFile, L"],\n\"displayTimeUnit\":\"ms\"}\n");
+
+    HRESULT hr = ferror(pFile) ? E_FAIL : S_OK;
+    fclose(pFile);
+
+    return hr;
+}
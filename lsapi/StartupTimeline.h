@@ -0,0 +1,123 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(STARTUPTIMELINE_H)
+#define STARTUPTIMELINE_H
+
+#include "../utility/common.h"
+#include "../utility/perfcounter.h"
+#include "lsapi.h"
+#include <string>
+
+/**
+ * Timeline of LiteStep's startup sequence, written as trace-event JSON by
+ * !DumpStartupTimeline.
+ *
+ * Spans are recorded by the LSAPI and by litestep.exe, from any thread. Each
+ * recycle starts a new timeline, see Reset. Recording is always on since it
+ * has to run before any setting could turn it on. It only costs a few
+ * hundred entries, and once MAX_SPANS have been recorded further spans are
+ * dropped.
+ *
+ * Only the LSAPI uses this class directly. Code outside of it goes through
+ * LSAPIRecordTimeline, usually by way of TimelineSpan.
+ */
+class StartupTimeline
+{
+public:
+    /** Number of spans kept */
+    enum { MAX_SPANS = 4096 };
+
+    /**
+     * Adds a span to the timeline.
+     *
+     * @param  pwzCategory  kind of span, e.g. "module"
+     * @param  pwzName      what was done
+     * @param  ullStart     GetTimestamp at the start of the span
+     * @param  ullEnd       GetTimestamp at the end of the span
+     */
+    static void Record(LPCWSTR pwzCategory, LPCWSTR pwzName,
+        ULONGLONG ullStart, ULONGLONG ullEnd);
+
+    /**
+     * Throws away all recorded spans.
+     */
+    static void Reset();
+
+    /**
+     * Writes the timeline recorded so far.
+     *
+     * @param  pwzFile  file to write
+     * @return <code>S_OK</code> or an error code
+     */
+    static HRESULT Write(LPCWSTR pwzFile);
+
+    /**
+     * Returns a timestamp for Record. Comparable across threads and across
+     * the LSAPI and litestep.exe.
+     */
+    static ULONGLONG GetTimestamp()
+    {
+        return GetPerformanceCounter();
+    }
+};
+
+
+/**
+ * Records the time from its construction to its destruction as one span of
+ * the startup timeline.
+ */
+class TimelineSpan
+{
+    LPCWSTR m_pwzCategory;
+    std::wstring m_sName;
+    ULONGLONG m_ullStart;
+
+    // not implemented
+    TimelineSpan(const TimelineSpan& rhs);
+    TimelineSpan& operator=(const TimelineSpan& rhs);
+
+public:
+    /**
+     * Starts the span.
+     *
+     * @param  pwzCategory  kind of span. Must be a string literal.
+     * @param  sName        what is being done
+     */
+    TimelineSpan(LPCWSTR pwzCategory, const std::wstring& sName)
+        : m_pwzCategory(pwzCategory)
+        , m_sName(sName)
+        , m_ullStart(StartupTimeline::GetTimestamp())
+    {
+        // do nothing
+    }
+
+    /**
+     * Ends the span and records it.
+     */
+    ~TimelineSpan()
+    {
+        LSAPIRecordTimeline(m_pwzCategory, m_sName.c_str(),
+            m_ullStart, StartupTimeline::GetTimestamp());
+    }
+};
+
+#endif // STARTUPTIMELINE_H
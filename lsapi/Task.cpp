@@ -0,0 +1,318 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "Task.h"
+#include "TaskPool.h"
+#include "ThreadWindow.h"
+#include "../utility/core.hpp"
+#include <unordered_set>
+
+
+//
+// Tasks that haven't finished yet, for CancelModule. Each of them is
+// referenced by a queue, a thread message or the task it follows, so they
+// are all alive.
+//
+static std::unordered_set<Task*> g_unfinishedTasks;
+static CriticalSection g_csUnfinishedTasks;
+
+
+//
+// GetImageSize
+//   (local helper function)
+//
+// Size of a loaded DLL's image, from its PE header
+//
+static SIZE_T GetImageSize(HMODULE hModule)
+{
+    const IMAGE_DOS_HEADER* pDosHeader = (const IMAGE_DOS_HEADER*)hModule;
+
+    if (pDosHeader == nullptr || pDosHeader->e_magic != IMAGE_DOS_SIGNATURE)
+    {
+        return 0;
+    }
+
+    const IMAGE_NT_HEADERS* pNtHeaders = (const IMAGE_NT_HEADERS*)(
+        (const BYTE*)hModule + pDosHeader->e_lfanew);
+
+    if (pNtHeaders->Signature != IMAGE_NT_SIGNATURE)
+    {
+        return 0;
+    }
+
+    return pNtHeaders->OptionalHeader.SizeOfImage;
+}
+
+
+//
+// Task(LSTASKPROC pfnTask, LPARAM lParam, DWORD dwThreadID)
+//
+Task::Task(LSTASKPROC pfnTask, LPARAM lParam, DWORD dwThreadID)
+    : m_lState(STATE_WAITING)
+    , m_hEvent(nullptr)
+    , m_dwThreadID(dwThreadID)
+    , m_pfnTask(pfnTask)
+    , m_lParam(lParam)
+{
+    Lock lock(g_csUnfinishedTasks);
+    g_unfinishedTasks.insert(this);
+}
+
+
+//
+// ~Task()
+//
+Task::~Task()
+{
+    ASSERT(m_continuations.empty());
+
+    if (m_hEvent)
+    {
+        CloseHandle(m_hEvent);
+    }
+}
+
+
+//
+// Schedule()
+//
+bool Task::Schedule()
+{
+    if (InterlockedCompareExchange(&m_lState,
+        STATE_PENDING, STATE_WAITING) != STATE_WAITING)
+    {
+        // Cancelled before it was due
+        return false;
+    }
+
+    if (m_dwThreadID == 0)
+    {
+        TaskPool::Get().Push(this);
+        return true;
+    }
+
+    // The message holds a reference until LSAPIRunThreadTask is done with it
+    AddRef();
+
+    // Only threads with a ThreadWindow run LiteStep's message loop. A thread
+    // message would be accepted by any thread and might never be handled.
+    if (!ThreadWindow::Post(m_dwThreadID, LM_THREAD_TASK, 0, (LPARAM)this))
+    {
+        TRACE("Failed to post task to thread %u", m_dwThreadID);
+
+        Cancel();
+        Release();
+
+        return false;
+    }
+
+    return true;
+}
+
+
+//
+// ContinueWith(Task* pContinuation)
+//
+void Task::ContinueWith(Task* pContinuation)
+{
+    {
+        Lock lock(m_cs);
+
+        if (m_lState != STATE_DONE && m_lState != STATE_CANCELLED)
+        {
+            pContinuation->AddRef();
+            m_continuations.push_back(pContinuation);
+
+            return;
+        }
+    }
+
+    pContinuation->Schedule();
+}
+
+
+//
+// Run()
+//
+void Task::Run()
+{
+    if (InterlockedCompareExchange(&m_lState,
+        STATE_RUNNING, STATE_PENDING) != STATE_PENDING)
+    {
+        return;
+    }
+
+    m_pfnTask(m_lParam);
+
+    _Finish(STATE_DONE);
+}
+
+
+//
+// Cancel()
+//
+bool Task::Cancel()
+{
+    LONG lState = m_lState;
+
+    while (lState == STATE_WAITING || lState == STATE_PENDING)
+    {
+        LONG lPrevious = InterlockedCompareExchange(&m_lState,
+            STATE_CANCELLED, lState);
+
+        if (lPrevious == lState)
+        {
+            _Finish(STATE_CANCELLED);
+            return true;
+        }
+
+        lState = lPrevious;
+    }
+
+    return false;
+}
+
+
+//
+// _Finish(LONG lState)
+//
+void Task::_Finish(LONG lState)
+{
+    _Forget();
+
+    std::vector<Task*> continuations;
+
+    {
+        Lock lock(m_cs);
+
+        InterlockedExchange(&m_lState, lState);
+        continuations.swap(m_continuations);
+
+        if (m_hEvent)
+        {
+            SetEvent(m_hEvent);
+        }
+    }
+
+    for (Task* pContinuation : continuations)
+    {
+        // Does nothing if it has been cancelled in the meantime
+        pContinuation->Schedule();
+        pContinuation->Release();
+    }
+}
+
+
+//
+// _Forget()
+//
+void Task::_Forget()
+{
+    Lock lock(g_csUnfinishedTasks);
+    g_unfinishedTasks.erase(this);
+}
+
+
+//
+// Wait(DWORD dwMilliseconds)
+//
+DWORD Task::Wait(DWORD dwMilliseconds)
+{
+    if (m_dwThreadID == 0 || m_dwThreadID == GetCurrentThreadId())
+    {
+        // Does nothing unless the task is still queued
+        Run();
+    }
+
+    HANDLE hEvent = nullptr;
+
+    {
+        Lock lock(m_cs);
+
+        if (m_lState == STATE_DONE || m_lState == STATE_CANCELLED)
+        {
+            return WAIT_OBJECT_0;
+        }
+
+        // Most tasks are never waited for, so the event is only created
+        // when needed
+        if (m_hEvent == nullptr)
+        {
+            m_hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+        }
+
+        hEvent = m_hEvent;
+    }
+
+    if (hEvent == nullptr)
+    {
+        return WAIT_FAILED;
+    }
+
+    return WaitForSingleObject(hEvent, dwMilliseconds);
+}
+
+
+//
+// CancelModule(HMODULE hModule)
+//
+UINT Task::CancelModule(HMODULE hModule)
+{
+    SIZE_T cbImage = GetImageSize(hModule);
+
+    if (cbImage == 0)
+    {
+        return 0;
+    }
+
+    const BYTE* pbStart = (const BYTE*)hModule;
+    std::vector<Task*> tasks;
+
+    {
+        Lock lock(g_csUnfinishedTasks);
+
+        for (Task* pTask : g_unfinishedTasks)
+        {
+            const BYTE* pbTask = (const BYTE*)pTask->m_pfnTask;
+
+            if (pbTask >= pbStart && pbTask < pbStart + cbImage)
+            {
+                pTask->AddRef();
+                tasks.push_back(pTask);
+            }
+        }
+    }
+
+    UINT uCancelled = 0;
+
+    // Cancel takes the lock again through _Forget
+    for (Task* pTask : tasks)
+    {
+        if (pTask->Cancel())
+        {
+            ++uCancelled;
+        }
+
+        pTask->Release();
+    }
+
+    return uCancelled;
+}
@@ -0,0 +1,149 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(TASK_H)
+#define TASK_H
+
+#include "../utility/common.h"
+#include "../utility/Base.h"
+#include "../utility/criticalsection.h"
+#include "lsapidefines.h"
+#include <vector>
+
+/**
+ * A piece of work started with LSSubmitTask, LSContinueTask or
+ * LSRunTaskOnThread.
+ *
+ * Tasks either run on the shared TaskPool, or on a thread that runs a
+ * LiteStep message loop, i.e. the main thread or the thread of a threaded
+ * module. Those get an LM_THREAD_TASK message for each task, sent to their
+ * ThreadWindow so modal loops don't lose it.
+ *
+ * A task can be cancelled until it starts running. Continuations are
+ * scheduled once the task they follow has finished, whether it ran or was
+ * cancelled. Tasks that haven't started yet are cancelled when the module
+ * their function belongs to is unloaded, see CancelModule. A module has to
+ * wait for its running tasks itself before it returns from quitModule.
+ */
+class Task : public CountedBase
+{
+    enum State
+    {
+        STATE_WAITING,      // a continuation whose antecedent isn't finished
+        STATE_PENDING,
+        STATE_RUNNING,
+        STATE_DONE,
+        STATE_CANCELLED
+    };
+
+    volatile LONG m_lState;
+
+    /** Signaled once the task is done or cancelled, created by Wait */
+    HANDLE m_hEvent;
+
+    /** Thread the task runs on, 0 for the pool */
+    DWORD m_dwThreadID;
+
+    LSTASKPROC m_pfnTask;
+    LPARAM m_lParam;
+
+    /** Tasks to schedule once this one has finished, each holds a reference */
+    std::vector<Task*> m_continuations;
+
+    /** Protects m_continuations, m_hEvent and the transition to finished */
+    CriticalSection m_cs;
+
+    /** Marks the task as done or cancelled, and schedules continuations */
+    void _Finish(LONG lState);
+
+    /** Removes the task from the list of unfinished tasks */
+    void _Forget();
+
+    // not implemented
+    Task(const Task& rhs);
+    Task& operator=(const Task& rhs);
+
+protected:
+    virtual ~Task();
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param  pfnTask     Function to run
+     * @param  lParam      Passed to pfnTask
+     * @param  dwThreadID  Thread to run on, or 0 for the pool
+     */
+    Task(LSTASKPROC pfnTask, LPARAM lParam, DWORD dwThreadID);
+
+    /**
+     * Hands the task over to the pool or its thread. Called once, when the
+     * task is submitted or its antecedent has finished.
+     *
+     * @return <code>false</code> if the task was cancelled, or if the thread
+     *         doesn't run a LiteStep message loop, in which case the task is
+     *         cancelled
+     */
+    bool Schedule();
+
+    /**
+     * Makes a new task follow this one. It is scheduled right away if this
+     * task has already finished.
+     *
+     * @param  pContinuation  Task that hasn't been scheduled yet
+     */
+    void ContinueWith(Task* pContinuation);
+
+    /**
+     * Runs the task unless it was cancelled or is already running or done.
+     * Called by the pool, by the task's thread, and by Wait.
+     */
+    void Run();
+
+    /**
+     * Cancels the task if it hasn't started yet.
+     *
+     * @return <code>true</code> if the task was cancelled
+     */
+    bool Cancel();
+
+    /**
+     * Waits until the task is done or cancelled. A task that is still queued
+     * for the pool or for the calling thread is run right away instead, so
+     * waiting never deadlocks on a busy pool.
+     *
+     * @param  dwMilliseconds  Timeout, may be <code>INFINITE</code>
+     * @return <code>WAIT_OBJECT_0</code> if the task is done or cancelled,
+     *         <code>WAIT_TIMEOUT</code> otherwise
+     */
+    DWORD Wait(DWORD dwMilliseconds);
+
+    /**
+     * Cancels all tasks that haven't started yet and whose function belongs
+     * to a module, e.g. because the module is being unloaded.
+     *
+     * @param  hModule  the module's DLL
+     * @return number of tasks cancelled
+     */
+    static UINT CancelModule(HMODULE hModule);
+};
+
+#endif // TASK_H
@@ -0,0 +1,278 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "TaskPool.h"
+#include "Task.h"
+#include "../utility/core.hpp"
+#include <algorithm>
+
+// Worker running on the current thread, if any. If no TLS index is
+// available all tasks are spread round robin.
+static const DWORD g_dwTlsWorker = TlsAlloc();
+
+static TaskPool* g_pTaskPool = nullptr;
+static CriticalSection g_csTaskPool;
+
+
+//
+// TaskPool(UINT uWorkers)
+//
+TaskPool::TaskPool(UINT uWorkers)
+    : m_cQueued(0)
+    , m_cSleeping(0)
+    , m_hWakeup(CreateSemaphore(nullptr, 0, LONG_MAX, nullptr))
+    , m_lNext(0)
+    , m_bStopping(false)
+{
+    ASSERT(uWorkers > 0);
+
+    for (UINT uWorker = 0; uWorker < uWorkers; ++uWorker)
+    {
+        Worker* pWorker = new Worker;
+        pWorker->pPool = this;
+
+        m_workers.push_back(pWorker);
+    }
+
+    // Only start once m_workers is complete, thieves go through all of it
+    for (Worker* pWorker : m_workers)
+    {
+        pWorker->thread = std::thread(&TaskPool::_ThreadProc, this, pWorker);
+    }
+}
+
+
+//
+// ~TaskPool()
+//
+TaskPool::~TaskPool()
+{
+    Stop();
+
+    for (Worker* pWorker : m_workers)
+    {
+        delete pWorker;
+    }
+
+    if (m_hWakeup)
+    {
+        CloseHandle(m_hWakeup);
+    }
+}
+
+
+//
+// Get()
+//
+TaskPool& TaskPool::Get()
+{
+    Lock lock(g_csTaskPool);
+
+    if (g_pTaskPool == nullptr)
+    {
+        SYSTEM_INFO si = { 0 };
+        GetSystemInfo(&si);
+
+        g_pTaskPool = new TaskPool(
+            si.dwNumberOfProcessors > 0 ? si.dwNumberOfProcessors : 1);
+    }
+
+    return *g_pTaskPool;
+}
+
+
+//
+// Push(Task* pTask)
+//
+void TaskPool::Push(Task* pTask)
+{
+    pTask->AddRef();
+
+    Worker* pWorker = nullptr;
+
+    if (g_dwTlsWorker != TLS_OUT_OF_INDEXES)
+    {
+        pWorker = (Worker*)TlsGetValue(g_dwTlsWorker);
+    }
+
+    if (pWorker == nullptr || pWorker->pPool != this)
+    {
+        LONG lNext = InterlockedIncrement(&m_lNext);
+        pWorker = m_workers[(ULONG)lNext % m_workers.size()];
+    }
+
+    // Count first, so a worker that finds the task doesn't take the count
+    // below zero and one that counts it is bound to find it
+    InterlockedIncrement(&m_cQueued);
+
+    {
+        Lock lock(pWorker->cs);
+        pWorker->tasks.push_back(pTask);
+    }
+
+    if (m_cSleeping > 0)
+    {
+        ReleaseSemaphore(m_hWakeup, 1, nullptr);
+    }
+}
+
+
+//
+// Stop()
+//
+void TaskPool::Stop()
+{
+    if (m_bStopping)
+    {
+        return;
+    }
+
+    m_bStopping = true;
+    ReleaseSemaphore(m_hWakeup, (LONG)m_workers.size(), nullptr);
+
+    for (Worker* pWorker : m_workers)
+    {
+        if (pWorker->thread.joinable())
+        {
+            pWorker->thread.join();
+        }
+    }
+
+    // Cancelling a task schedules its continuations, which may end up in
+    // a queue that has been emptied already
+    bool bFound;
+
+    do
+    {
+        bFound = false;
+
+        for (Worker* pWorker : m_workers)
+        {
+            Task* pTask = _Pop(pWorker);
+
+            if (pTask)
+            {
+                pTask->Cancel();
+                pTask->Release();
+
+                bFound = true;
+            }
+        }
+    }
+    while (bFound);
+}
+
+
+//
+// _Pop(Worker* pWorker)
+//
+Task* TaskPool::_Pop(Worker* pWorker)
+{
+    Lock lock(pWorker->cs);
+
+    if (pWorker->tasks.empty())
+    {
+        return nullptr;
+    }
+
+    Task* pTask = pWorker->tasks.back();
+    pWorker->tasks.pop_back();
+
+    return pTask;
+}
+
+
+//
+// _Steal(Worker* pWorker)
+//
+// Starts with the next worker, so thieves don't all pile onto the first one.
+//
+Task* TaskPool::_Steal(Worker* pWorker)
+{
+    size_t uSelf = std::find(m_workers.begin(), m_workers.end(), pWorker) -
+        m_workers.begin();
+
+    for (size_t uOffset = 1; uOffset < m_workers.size(); ++uOffset)
+    {
+        Worker* pVictim = m_workers[(uSelf + uOffset) % m_workers.size()];
+
+        Lock lock(pVictim->cs);
+
+        if (!pVictim->tasks.empty())
+        {
+            Task* pTask = pVictim->tasks.front();
+            pVictim->tasks.pop_front();
+
+            return pTask;
+        }
+    }
+
+    return nullptr;
+}
+
+
+//
+// _ThreadProc(Worker* pWorker)
+//
+void TaskPool::_ThreadProc(Worker* pWorker)
+{
+    if (g_dwTlsWorker != TLS_OUT_OF_INDEXES)
+    {
+        TlsSetValue(g_dwTlsWorker, pWorker);
+    }
+
+    while (!m_bStopping)
+    {
+        Task* pTask = _Pop(pWorker);
+
+        if (pTask == nullptr)
+        {
+            pTask = _Steal(pWorker);
+        }
+
+        if (pTask)
+        {
+            InterlockedDecrement(&m_cQueued);
+
+            // Does nothing if the task was cancelled or run by a waiter
+            pTask->Run();
+            pTask->Release();
+
+            continue;
+        }
+
+        // Announce the nap before the last look, so that Push either sees
+        // it and wakes us up, or queued its task before we look
+        InterlockedIncrement(&m_cSleeping);
+
+        if (m_cQueued <= 0 && !m_bStopping)
+        {
+            WaitForSingleObject(m_hWakeup, INFINITE);
+        }
+
+        InterlockedDecrement(&m_cSleeping);
+    }
+
+    if (g_dwTlsWorker != TLS_OUT_OF_INDEXES)
+    {
+        TlsSetValue(g_dwTlsWorker, nullptr);
+    }
+}
@@ -0,0 +1,131 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(TASKPOOL_H)
+#define TASKPOOL_H
+
+#include "../utility/common.h"
+#include "../utility/criticalsection.h"
+#include <deque>
+#include <thread>
+#include <vector>
+
+class Task;
+
+/**
+ * Work-stealing thread pool that runs the tasks of LSSubmitTask and
+ * LSContinueTask.
+ *
+ * Each worker has its own queue. Tasks submitted from a worker, usually
+ * continuations, go to that worker's queue and are taken newest first, so
+ * follow-up work runs while its data is still in the cache. Tasks submitted
+ * from other threads are spread over the workers round robin. A worker that
+ * runs out of work takes the oldest task of another worker before it goes
+ * to sleep.
+ *
+ * The LSAPI uses a single pool with one worker per processor, see Get. It
+ * is created on first use and lives until the process exits, since workers
+ * can't be joined while the DLL is being unloaded.
+ */
+class TaskPool
+{
+public:
+    /**
+     * Constructor. Starts the workers.
+     *
+     * @param  uWorkers  number of worker threads, at least 1
+     */
+    explicit TaskPool(UINT uWorkers);
+
+    /**
+     * Destructor. Calls Stop.
+     */
+    ~TaskPool();
+
+    /**
+     * Returns the LSAPI's pool, creating it if necessary.
+     */
+    static TaskPool& Get();
+
+    /**
+     * Queues a task. The pool holds a reference to it until it has run.
+     *
+     * @param  pTask  task in the pending state
+     */
+    void Push(Task* pTask);
+
+    /**
+     * Cancels all queued tasks, and waits for the workers to finish the
+     * tasks they are running.
+     */
+    void Stop();
+
+    /**
+     * Returns the number of worker threads.
+     */
+    UINT GetWorkerCount() const
+    {
+        return (UINT)m_workers.size();
+    }
+
+private:
+    struct Worker
+    {
+        TaskPool* pPool;
+
+        /** Oldest task first. The owner works at the back, thieves at the
+            front. */
+        std::deque<Task*> tasks;
+        CriticalSection cs;
+        std::thread thread;
+    };
+
+    /** Takes the newest task of a worker's own queue */
+    Task* _Pop(Worker* pWorker);
+
+    /** Takes the oldest task of any other worker's queue */
+    Task* _Steal(Worker* pWorker);
+
+    /** Runs tasks until the pool is stopped */
+    void _ThreadProc(Worker* pWorker);
+
+    std::vector<Worker*> m_workers;
+
+    /** Number of tasks queued, incremented before a task is pushed */
+    volatile LONG m_cQueued;
+
+    /** Number of workers that are about to sleep or sleeping */
+    volatile LONG m_cSleeping;
+
+    /** Wakes up sleeping workers */
+    HANDLE m_hWakeup;
+
+    /** Worker that gets the next task submitted from another thread */
+    volatile LONG m_lNext;
+
+    volatile bool m_bStopping;
+
+    // Not implemented
+    TaskPool(const TaskPool& rhs);
+    TaskPool& operator=(const TaskPool& rhs);
+};
+
+#endif // TASKPOOL_H
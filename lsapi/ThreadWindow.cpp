@@ -0,0 +1,214 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "ThreadWindow.h"
+#include "lsapi.h"
+#include "Task.h"
+#include "../utility/core.hpp"
+#include "../utility/criticalsection.h"
+#include <unordered_map>
+
+#define THREADWINDOW_CLASS L"LSThreadWindow"
+
+
+//
+// Windows indexed by the thread that owns them
+//
+typedef std::unordered_map<DWORD, HWND> ThreadWindowMap;
+
+static ThreadWindowMap g_threadWindows;
+static CriticalSection g_csThreadWindows;
+
+
+//
+// ThreadWindowProc
+//   (local helper function)
+//
+static LRESULT CALLBACK ThreadWindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+    switch (uMsg)
+    {
+    case LM_THREAD_BANGCOMMAND:
+        {
+            // one wakeup covers everything queued so far
+            LSAPIProcessBangQueue();
+        }
+        return 0;
+
+    case LM_THREAD_TASK:
+        {
+            LSAPIRunThreadTask((LPVOID)lParam);
+        }
+        return 0;
+
+    default:
+        {
+            // do nothing
+        }
+        break;
+    }
+
+    return DefWindowProcW(hWnd, uMsg, wParam, lParam);
+}
+
+
+//
+// RegisterThreadWindowClass
+//   (local helper function)
+//
+static HINSTANCE RegisterThreadWindowClass()
+{
+    static HINSTANCE s_hInstance = nullptr;
+
+    if (s_hInstance == nullptr)
+    {
+        HINSTANCE hInstance = nullptr;
+
+        // The class belongs to the LSAPI, not to litestep.exe
+        GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+            GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+            (LPCWSTR)ThreadWindowProc, &hInstance);
+
+        WNDCLASSEXW wc = { 0 };
+        wc.cbSize = sizeof(wc);
+        wc.lpfnWndProc = ThreadWindowProc;
+        wc.hInstance = hInstance;
+        wc.lpszClassName = THREADWINDOW_CLASS;
+
+        if (RegisterClassExW(&wc) ||
+            GetLastError() == ERROR_CLASS_ALREADY_EXISTS)
+        {
+            s_hInstance = hInstance;
+        }
+    }
+
+    return s_hInstance;
+}
+
+
+//
+// Attach()
+//
+bool ThreadWindow::Attach()
+{
+    DWORD dwThreadID = GetCurrentThreadId();
+    HINSTANCE hInstance = nullptr;
+
+    {
+        Lock lock(g_csThreadWindows);
+
+        if (g_threadWindows.find(dwThreadID) != g_threadWindows.end())
+        {
+            return true;
+        }
+
+        // Registration must not race with another thread's Attach
+        hInstance = RegisterThreadWindowClass();
+
+        if (hInstance == nullptr)
+        {
+            return false;
+        }
+    }
+
+    HWND hWnd = CreateWindowExW(0, THREADWINDOW_CLASS, L"", 0, 0, 0, 0, 0,
+        HWND_MESSAGE, nullptr, hInstance, nullptr);
+
+    if (hWnd == nullptr)
+    {
+        TRACE("Failed to create thread window for thread %u", dwThreadID);
+        return false;
+    }
+
+    Lock lock(g_csThreadWindows);
+    g_threadWindows[dwThreadID] = hWnd;
+
+    return true;
+}
+
+
+//
+// Detach()
+//
+void ThreadWindow::Detach()
+{
+    HWND hWnd = nullptr;
+
+    {
+        Lock lock(g_csThreadWindows);
+
+        ThreadWindowMap::iterator iter =
+            g_threadWindows.find(GetCurrentThreadId());
+
+        if (iter == g_threadWindows.end())
+        {
+            return;
+        }
+
+        // Nothing can be posted to it from here on
+        hWnd = iter->second;
+        g_threadWindows.erase(iter);
+    }
+
+    // Tasks posted before that will never run. Cancel them, so nobody waits
+    // for them forever.
+    MSG msg;
+
+    while (PeekMessageW(&msg, hWnd, LM_THREAD_TASK, LM_THREAD_TASK, PM_REMOVE))
+    {
+        Task* pTask = (Task*)msg.lParam;
+
+        pTask->Cancel();
+        pTask->Release();
+    }
+
+    DestroyWindow(hWnd);
+}
+
+
+//
+// Post(DWORD dwThreadID, UINT uMsg, WPARAM wParam, LPARAM lParam)
+//
+bool ThreadWindow::Post(DWORD dwThreadID, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+    // Posting under the lock keeps Detach from destroying the window in the
+    // meantime. PostMessage doesn't wait for the thread.
+    Lock lock(g_csThreadWindows);
+
+    ThreadWindowMap::const_iterator iter = g_threadWindows.find(dwThreadID);
+
+    if (iter == g_threadWindows.end())
+    {
+        return false;
+    }
+
+    return PostMessageW(iter->second, uMsg, wParam, lParam) != FALSE;
+}
+
+
+//
+// Exists(DWORD dwThreadID)
+//
+bool ThreadWindow::Exists(DWORD dwThreadID)
+{
+    Lock lock(g_csThreadWindows);
+    return g_threadWindows.find(dwThreadID) != g_threadWindows.end();
+}
@@ -0,0 +1,74 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(THREADWINDOW_H)
+#define THREADWINDOW_H
+
+#include "../utility/common.h"
+
+/**
+ * Message-only window that wakes up a thread running a LiteStep message
+ * loop, i.e. the main thread or the thread of a threaded module.
+ *
+ * Thread messages are thrown away by modal loops such as MessageBox,
+ * DialogBox or menus, while window messages are still dispatched. Wakeups
+ * posted to this window therefore can't get lost.
+ *
+ * Each thread creates its own window with Attach before it runs its message
+ * loop, and destroys it with Detach once the loop is done.
+ */
+class ThreadWindow
+{
+public:
+    /**
+     * Creates the window of the current thread, unless it already has one.
+     *
+     * @return <code>true</code> if the thread has a window
+     */
+    static bool Attach();
+
+    /**
+     * Destroys the window of the current thread. Tasks still queued for it
+     * are cancelled, other messages are discarded.
+     */
+    static void Detach();
+
+    /**
+     * Posts a message to the window of a thread.
+     *
+     * @param  dwThreadID  Thread to wake up
+     * @param  uMsg        LM_THREAD_BANGCOMMAND or LM_THREAD_TASK
+     * @param  wParam      Message parameter
+     * @param  lParam      Message parameter
+     * @return <code>false</code> if the thread has no window or the message
+     *         couldn't be posted
+     */
+    static bool Post(DWORD dwThreadID, UINT uMsg, WPARAM wParam, LPARAM lParam);
+
+    /**
+     * Checks if a thread has a window.
+     *
+     * @param  dwThreadID  Thread to look for
+     */
+    static bool Exists(DWORD dwThreadID);
+};
+
+#endif // THREADWINDOW_H
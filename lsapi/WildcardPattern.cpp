@@ -0,0 +1,492 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "WildcardPattern.h"
+#include "../utility/core.hpp"
+#include "../utility/criticalsection.h"
+#include "../utility/stringutility.h"
+#include <algorithm>
+#include <ctype.h>
+#include <list>
+
+// Number of patterns kept by FromCache
+#define PATTERN_CACHE_SIZE 64
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// PatternCache
+//
+// Keeps the most recently used patterns, so matchW doesn't have to parse the
+// same pattern over and over again.
+//
+class PatternCache
+{
+    typedef std::list<WildcardPattern*> PatternList;
+
+    // The keys point to the pattern text owned by the list entries
+    typedef StringKeyedMaps<LPCWSTR, PatternList::iterator, CaseSensitive>::UnorderedMap PatternMap;
+
+    // Most recently used first
+    PatternList m_lruList;
+    PatternMap m_patternMap;
+
+    CriticalSection m_cs;
+
+public:
+    ~PatternCache()
+    {
+        for (WildcardPattern* pPattern : m_lruList)
+        {
+            pPattern->Release();
+        }
+    }
+
+    WildcardPattern* Get(LPCWSTR pwzPattern)
+    {
+        {
+            Lock lock(m_cs);
+
+            PatternMap::iterator iter = m_patternMap.find(pwzPattern);
+
+            if (iter != m_patternMap.end())
+            {
+                m_lruList.splice(m_lruList.begin(), m_lruList, iter->second);
+
+                WildcardPattern* pPattern = *iter->second;
+                pPattern->AddRef();
+                return pPattern;
+            }
+        }
+
+        // Compile without holding the lock, another thread may add the same
+        // pattern in the meantime in which case ours is simply not cached.
+        WildcardPattern* pPattern = WildcardPattern::Create(pwzPattern);
+
+        Lock lock(m_cs);
+
+        if (m_patternMap.find(pwzPattern) == m_patternMap.end())
+        {
+            if (m_lruList.size() >= PATTERN_CACHE_SIZE)
+            {
+                WildcardPattern* pOldest = m_lruList.back();
+
+                m_patternMap.erase(pOldest->GetPattern());
+                m_lruList.pop_back();
+                pOldest->Release();
+            }
+
+            pPattern->AddRef();
+            m_lruList.push_front(pPattern);
+            m_patternMap.emplace(pPattern->GetPattern(), m_lruList.begin());
+        }
+
+        return pPattern;
+    }
+};
+
+static PatternCache g_patternCache;
+
+
+//
+// WildcardPattern(LPCWSTR pwzPattern)
+//
+WildcardPattern::WildcardPattern(LPCWSTR pwzPattern)
+    : m_wzPattern(pwzPattern, pwzPattern + wcslen(pwzPattern) + 1)
+    , m_bCompiled(false)
+    , m_uLiteralMask(0)
+    , m_uAnyMask(0)
+    , m_uClassMask(0)
+    , m_uStarMask(0)
+    , m_uAcceptMask(0)
+    , m_uTailMask(0)
+{
+    m_bCompiled = _Compile();
+
+    if (!m_bCompiled)
+    {
+        m_elements.clear();
+        m_ranges.clear();
+    }
+}
+
+
+//
+// ~WildcardPattern()
+//
+WildcardPattern::~WildcardPattern()
+{
+    // do nothing
+}
+
+
+//
+// Create(LPCWSTR pwzPattern)
+//
+WildcardPattern* WildcardPattern::Create(LPCWSTR pwzPattern)
+{
+    if (pwzPattern == nullptr)
+    {
+        return nullptr;
+    }
+
+    return new WildcardPattern(pwzPattern);
+}
+
+
+//
+// FromCache(LPCWSTR pwzPattern)
+//
+WildcardPattern* WildcardPattern::FromCache(LPCWSTR pwzPattern)
+{
+    if (pwzPattern == nullptr)
+    {
+        return nullptr;
+    }
+
+    return g_patternCache.Get(pwzPattern);
+}
+
+
+//
+// _Compile()
+//
+// Turns the pattern into a list of elements. This has to follow matcheW very
+// closely. Anything matcheW could report as MATCH_PATTERN is left to matcheW
+// since the outcome for those depends on the text.
+//
+// A run of '*' and '?' matches the same as its '?'s followed by a single '*'.
+// The only exception is a trailing run of two or more '*'s, which matcheW
+// does not match against an empty remainder. That one becomes "?*".
+//
+bool WildcardPattern::_Compile()
+{
+    LPCWSTR pwzCurrent = GetPattern();
+
+    while (*pwzCurrent)
+    {
+        Element element = { ELEMENT_LITERAL, 0, 0, 0, false };
+
+        switch (*pwzCurrent)
+        {
+        case L'?':
+            element.type = ELEMENT_ANY;
+            m_elements.push_back(element);
+            ++pwzCurrent;
+            break;
+
+        case L'*':
+            {
+                UINT uStars = 0;
+                UINT uAnys = 0;
+
+                for (; *pwzCurrent == L'*' || *pwzCurrent == L'?'; ++pwzCurrent)
+                {
+                    if (*pwzCurrent == L'?')
+                    {
+                        element.type = ELEMENT_ANY;
+                        m_elements.push_back(element);
+                        ++uAnys;
+                    }
+                    else
+                    {
+                        ++uStars;
+                    }
+                }
+
+                if (!*pwzCurrent && uAnys == 0 && uStars > 1)
+                {
+                    element.type = ELEMENT_ANY;
+                    m_elements.push_back(element);
+                }
+
+                element.type = ELEMENT_STAR;
+                m_elements.push_back(element);
+            }
+            break;
+
+        case L'[':
+            if (!_ParseClass(pwzCurrent))
+            {
+                return false;
+            }
+            break;
+
+        case L'\\':
+            ++pwzCurrent;
+
+            if (!*pwzCurrent)
+            {
+                return false;
+            }
+
+            // FALL THROUGH
+
+        default:
+            element.type = ELEMENT_LITERAL;
+            element.nUpper = toupper(*pwzCurrent);
+            m_elements.push_back(element);
+            ++pwzCurrent;
+            break;
+        }
+
+        if (m_elements.size() > MAX_ELEMENTS)
+        {
+            return false;
+        }
+    }
+
+    for (UINT uElement = 0; uElement < m_elements.size(); ++uElement)
+    {
+        UINT64 uBit = (UINT64)1 << uElement;
+
+        switch (m_elements[uElement].type)
+        {
+        case ELEMENT_LITERAL:
+            m_uLiteralMask |= uBit;
+            break;
+
+        case ELEMENT_ANY:
+            m_uAnyMask |= uBit;
+            break;
+
+        case ELEMENT_CLASS:
+            m_uClassMask |= uBit;
+            break;
+
+        case ELEMENT_STAR:
+            m_uStarMask |= uBit;
+            break;
+        }
+    }
+
+    m_uAcceptMask = (UINT64)1 << m_elements.size();
+
+    if (!m_elements.empty() && m_elements.back().type == ELEMENT_STAR)
+    {
+        m_uTailMask = (UINT64)1 << (m_elements.size() - 1);
+    }
+
+    return true;
+}
+
+
+//
+// _ParseClass(LPCWSTR& pwzPattern)
+//
+// Parses a [..] construct the same way matcheW does. On success pwzPattern
+// is moved past the closing bracket.
+//
+bool WildcardPattern::_ParseClass(LPCWSTR& pwzPattern)
+{
+    LPCWSTR pwzCurrent = pwzPattern + 1;
+    Element element = { ELEMENT_CLASS, 0, (UINT)m_ranges.size(), 0, false };
+
+    if (*pwzCurrent == L'!' || *pwzCurrent == L'^')
+    {
+        element.bInvert = true;
+        ++pwzCurrent;
+    }
+
+    if (*pwzCurrent == L']')
+    {
+        return false;
+    }
+
+    while (*pwzCurrent != L']')
+    {
+        Range range;
+
+        if (*pwzCurrent == L'\\')
+        {
+            ++pwzCurrent;
+        }
+
+        range.wcLow = range.wcHigh = *pwzCurrent;
+
+        if (!*pwzCurrent)
+        {
+            return false;
+        }
+
+        if (*++pwzCurrent == L'-')
+        {
+            range.wcHigh = *++pwzCurrent;
+
+            if (!range.wcHigh || range.wcHigh == L']')
+            {
+                return false;
+            }
+
+            if (range.wcHigh == L'\\')
+            {
+                range.wcHigh = *++pwzCurrent;
+
+                if (!range.wcHigh)
+                {
+                    return false;
+                }
+            }
+
+            ++pwzCurrent;
+        }
+
+        if (range.wcLow > range.wcHigh)
+        {
+            std::swap(range.wcLow, range.wcHigh);
+        }
+
+        m_ranges.push_back(range);
+        ++element.uRanges;
+    }
+
+    m_elements.push_back(element);
+    pwzPattern = pwzCurrent + 1;
+
+    return true;
+}
+
+
+//
+// MatchElement(const Element& element, wchar_t wc, int nUpper)
+//
+bool WildcardPattern::MatchElement(const Element& element, wchar_t wc, int nUpper) const
+{
+    switch (element.type)
+    {
+    case ELEMENT_LITERAL:
+        return element.nUpper == nUpper;
+
+    case ELEMENT_CLASS:
+        {
+            const Range* pRange = &m_ranges[element.uFirstRange];
+            const Range* pEnd = pRange + element.uRanges;
+
+            for (; pRange != pEnd; ++pRange)
+            {
+                if (wc >= pRange->wcLow && wc <= pRange->wcHigh)
+                {
+                    return !element.bInvert;
+                }
+            }
+
+            return element.bInvert;
+        }
+
+    default:
+        return true;
+    }
+}
+
+
+//
+// Match(LPCWSTR pwzText)
+//
+bool WildcardPattern::Match(LPCWSTR pwzText) const
+{
+    if (!m_bCompiled)
+    {
+        return matcheW(GetPattern(), pwzText) == MATCH_VALID;
+    }
+
+    if (m_uStarMask == 0)
+    {
+        return _MatchLinear(pwzText);
+    }
+
+    return _MatchNFA(pwzText);
+}
+
+
+//
+// _MatchLinear(LPCWSTR pwzText)
+//
+// Patterns without a '*' match exactly one character per element.
+//
+bool WildcardPattern::_MatchLinear(LPCWSTR pwzText) const
+{
+    LPCWSTR pwzCurrent = pwzText;
+
+    for (const Element& element : m_elements)
+    {
+        if (!*pwzCurrent)
+        {
+            return false;
+        }
+
+        if (element.type != ELEMENT_ANY &&
+            !MatchElement(element, *pwzCurrent, toupper(*pwzCurrent)))
+        {
+            return false;
+        }
+
+        ++pwzCurrent;
+    }
+
+    return *pwzCurrent == L'\0';
+}
+
+
+//
+// _MatchNFA(LPCWSTR pwzText)
+//
+// Bit n of the state set means the first n elements have been matched. A '*'
+// element stays active once reached and also activates the element after it,
+// which is why the closure below only has to look one element ahead ('*'s
+// are never adjacent after compilation).
+//
+bool WildcardPattern::_MatchNFA(LPCWSTR pwzText) const
+{
+    UINT64 uStates = 1 | ((1 & m_uStarMask) << 1);
+
+    for (LPCWSTR pwzCurrent = pwzText; *pwzCurrent; ++pwzCurrent)
+    {
+        if (uStates & m_uTailMask)
+        {
+            return true;
+        }
+
+        wchar_t wc = *pwzCurrent;
+        int nUpper = toupper(wc);
+
+        UINT64 uNext = ((uStates & m_uAnyMask) << 1) | (uStates & m_uStarMask);
+
+        for (UINT64 uActive = uStates & (m_uLiteralMask | m_uClassMask);
+             uActive; uActive &= uActive - 1)
+        {
+            UINT uElement = LowestBitIndex(uActive);
+
+            if (MatchElement(m_elements[uElement], wc, nUpper))
+            {
+                uNext |= (UINT64)2 << uElement;
+            }
+        }
+
+        uStates = uNext | ((uNext & m_uStarMask) << 1);
+
+        if (!uStates)
+        {
+            return false;
+        }
+    }
+
+    return (uStates & m_uAcceptMask) != 0;
+}
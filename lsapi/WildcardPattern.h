@@ -0,0 +1,196 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(WILDCARDPATTERN_H)
+#define WILDCARDPATTERN_H
+
+#include "../utility/common.h"
+#include "../utility/Base.h"
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/**
+ * A wildcard pattern (see match.cpp for the syntax) that has been parsed
+ * once so it can be matched against many strings.
+ *
+ * Well formed patterns of up to MAX_ELEMENTS elements are compiled into a
+ * small NFA which is simulated with one bit per element. Anything else keeps
+ * the pattern text and falls back to matcheW, so the results are always the
+ * same as matchW's, quirks included.
+ */
+class WildcardPattern : public CountedBase
+{
+public:
+    /** Largest number of elements that can be compiled */
+    static const UINT MAX_ELEMENTS = 63;
+
+    /** Kinds of pattern elements */
+    enum ElementType
+    {
+        ELEMENT_LITERAL,
+        ELEMENT_ANY,
+        ELEMENT_CLASS,
+        ELEMENT_STAR
+    };
+
+    /** One character range in a [..] construct */
+    struct Range
+    {
+        wchar_t wcLow;
+        wchar_t wcHigh;
+    };
+
+    /** A single element of a compiled pattern */
+    struct Element
+    {
+        ElementType type;
+
+        // ELEMENT_LITERAL: toupper() of the character to match
+        int nUpper;
+
+        // ELEMENT_CLASS: index of the first range, range count, and whether
+        // this is a [!..] construct
+        UINT uFirstRange;
+        UINT uRanges;
+        bool bInvert;
+    };
+
+private:
+    std::vector<wchar_t> m_wzPattern;
+    std::vector<Element> m_elements;
+    std::vector<Range> m_ranges;
+
+    bool m_bCompiled;
+
+    // One bit per element of each type, and the accepting state
+    UINT64 m_uLiteralMask;
+    UINT64 m_uAnyMask;
+    UINT64 m_uClassMask;
+    UINT64 m_uStarMask;
+    UINT64 m_uAcceptMask;
+
+    // Set if the pattern ends in a '*', once that is reached the rest of the
+    // text is irrelevant
+    UINT64 m_uTailMask;
+
+    explicit WildcardPattern(LPCWSTR pwzPattern);
+    virtual ~WildcardPattern();
+
+    bool _Compile();
+    bool _ParseClass(LPCWSTR& pwzPattern);
+
+    bool _MatchLinear(LPCWSTR pwzText) const;
+    bool _MatchNFA(LPCWSTR pwzText) const;
+
+    // not implemented
+    WildcardPattern(const WildcardPattern& rhs);
+    WildcardPattern& operator=(const WildcardPattern& rhs);
+
+public:
+    /**
+     * Creates a new pattern object. Release it when done.
+     *
+     * @param  pwzPattern  Pattern text
+     * @return New pattern object, or <code>nullptr</code> if pwzPattern is
+     *         <code>nullptr</code>
+     */
+    static WildcardPattern* Create(LPCWSTR pwzPattern);
+
+    /**
+     * Returns a pattern object from the shared cache of recently used
+     * patterns, compiling it if it isn't there yet. Release it when done.
+     *
+     * @param  pwzPattern  Pattern text
+     * @return Pattern object, or <code>nullptr</code> if pwzPattern is
+     *         <code>nullptr</code>
+     */
+    static WildcardPattern* FromCache(LPCWSTR pwzPattern);
+
+    /**
+     * Matches a string against this pattern.
+     *
+     * @param  pwzText  String to match
+     * @return <code>true</code> if the whole string matches
+     */
+    bool Match(LPCWSTR pwzText) const;
+
+    /**
+     * Returns the pattern text.
+     */
+    LPCWSTR GetPattern() const
+    {
+        return &m_wzPattern[0];
+    }
+
+    /**
+     * Checks if the pattern was compiled. Malformed or very long patterns are
+     * interpreted by matcheW instead.
+     */
+    bool IsCompiled() const
+    {
+        return m_bCompiled;
+    }
+
+    /**
+     * Returns the compiled elements. Empty if the pattern wasn't compiled.
+     */
+    const std::vector<Element>& GetElements() const
+    {
+        return m_elements;
+    }
+
+    /**
+     * Checks if a character matches a single ELEMENT_LITERAL or
+     * ELEMENT_CLASS element.
+     *
+     * @param  element  Element to test
+     * @param  wc       Text character
+     * @param  nUpper   toupper(wc)
+     */
+    bool MatchElement(const Element& element, wchar_t wc, int nUpper) const;
+
+    /**
+     * Returns the index of the lowest set bit. Used to walk NFA state sets.
+     *
+     * @param  uValue  Bit set, must not be zero
+     */
+    static UINT LowestBitIndex(UINT64 uValue)
+    {
+#if defined(_MSC_VER)
+        unsigned long ulIndex;
+
+        if (_BitScanForward(&ulIndex, (unsigned long)uValue))
+        {
+            return (UINT)ulIndex;
+        }
+
+        _BitScanForward(&ulIndex, (unsigned long)(uValue >> 32));
+        return (UINT)ulIndex + 32;
+#else
+        return (UINT)__builtin_ctzll(uValue);
+#endif
+    }
+};
+
+#endif // WILDCARDPATTERN_H
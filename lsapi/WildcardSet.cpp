@@ -0,0 +1,431 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "WildcardSet.h"
+#include "../utility/core.hpp"
+#include <algorithm>
+#include <ctype.h>
+
+// Upper limit for the number of DFA states kept per set. When it is reached
+// the DFA is thrown away and built up again from scratch.
+#define MAX_DFA_STATES 512
+
+
+//
+// _AddMatch
+//   (local helper function)
+//
+static inline void _AddMatch(UINT uPattern, UINT* puMatches, UINT cMaxMatches, UINT& cMatches)
+{
+    if (puMatches != nullptr && cMatches < cMaxMatches)
+    {
+        puMatches[cMatches] = uPattern;
+    }
+
+    ++cMatches;
+}
+
+
+//
+// DfaStateHash::operator()
+//
+size_t WildcardSet::DfaStateHash::operator()(const std::vector<UINT64>* pStates) const
+{
+    UINT64 uHash = 14695981039346656037ULL;
+
+    for (UINT64 uWord : *pStates)
+    {
+        uHash ^= uWord;
+        uHash *= 1099511628211ULL;
+    }
+
+    return (size_t)(uHash ^ (uHash >> 32));
+}
+
+
+//
+// WildcardSet(const LPCWSTR* ppwzPatterns, UINT cPatterns)
+//
+WildcardSet::WildcardSet(const LPCWSTR* ppwzPatterns, UINT cPatterns)
+    : m_cWords(0)
+{
+    for (UINT uIndex = 0; uIndex < cPatterns; ++uIndex)
+    {
+        WildcardPattern* pPattern = WildcardPattern::Create(ppwzPatterns[uIndex]);
+        m_patterns.push_back(pPattern);
+
+        if (pPattern == nullptr)
+        {
+            continue;
+        }
+
+        if (pPattern->IsCompiled())
+        {
+            _AddPattern(uIndex, pPattern);
+        }
+        else
+        {
+            m_fallbacks.push_back(uIndex);
+        }
+    }
+
+    m_cWords = std::max<size_t>((m_elements.size() + 63) / 64, 1);
+
+    m_uStartMask.resize(m_cWords);
+    m_uAnyMask.resize(m_cWords);
+    m_uTestMask.resize(m_cWords);
+    m_uStarMask.resize(m_cWords);
+    m_uAcceptMask.resize(m_cWords);
+    m_uStableMask.resize(m_cWords);
+
+    for (size_t uBit = 0; uBit < m_elements.size(); ++uBit)
+    {
+        const ElementRef& ref = m_elements[uBit];
+        UINT64 uMask = (UINT64)1 << (uBit % 64);
+
+        // A pattern starts right after the accept bit of the previous one
+        if (uBit == 0 || m_elements[uBit - 1].pPattern == nullptr)
+        {
+            m_uStartMask[uBit / 64] |= uMask;
+        }
+
+        if (ref.pPattern == nullptr)
+        {
+            m_uAcceptMask[uBit / 64] |= uMask;
+
+            // Once a trailing '*' is reached the pattern matches no matter
+            // what follows
+            if (uBit > 0 && (m_uStarMask[(uBit - 1) / 64] & ((UINT64)1 << ((uBit - 1) % 64))))
+            {
+                m_uStableMask[(uBit - 1) / 64] |= (UINT64)1 << ((uBit - 1) % 64);
+                m_uStableMask[uBit / 64] |= uMask;
+            }
+
+            continue;
+        }
+
+        switch (ref.pPattern->GetElements()[ref.uElement].type)
+        {
+        case WildcardPattern::ELEMENT_ANY:
+            m_uAnyMask[uBit / 64] |= uMask;
+            break;
+
+        case WildcardPattern::ELEMENT_STAR:
+            m_uStarMask[uBit / 64] |= uMask;
+            break;
+
+        default:
+            m_uTestMask[uBit / 64] |= uMask;
+            break;
+        }
+    }
+
+    _ResetDfa();
+}
+
+
+//
+// ~WildcardSet()
+//
+WildcardSet::~WildcardSet()
+{
+    for (DfaState* pState : m_dfaStates)
+    {
+        delete pState;
+    }
+
+    for (WildcardPattern* pPattern : m_patterns)
+    {
+        if (pPattern != nullptr)
+        {
+            pPattern->Release();
+        }
+    }
+}
+
+
+//
+// Create(const LPCWSTR* ppwzPatterns, UINT cPatterns)
+//
+WildcardSet* WildcardSet::Create(const LPCWSTR* ppwzPatterns, UINT cPatterns)
+{
+    if (ppwzPatterns == nullptr)
+    {
+        return nullptr;
+    }
+
+    return new WildcardSet(ppwzPatterns, cPatterns);
+}
+
+
+//
+// _AddPattern(UINT uIndex, WildcardPattern* pPattern)
+//
+// Appends the elements of a compiled pattern to the combined NFA. The accept
+// bit follows the last element and remembers the pattern index.
+//
+void WildcardSet::_AddPattern(UINT uIndex, WildcardPattern* pPattern)
+{
+    const UINT cElements = (UINT)pPattern->GetElements().size();
+
+    for (UINT uElement = 0; uElement < cElements; ++uElement)
+    {
+        ElementRef ref = { pPattern, uElement };
+        m_elements.push_back(ref);
+        m_acceptPattern.push_back(UINT(-1));
+    }
+
+    ElementRef accept = { nullptr, 0 };
+    m_elements.push_back(accept);
+    m_acceptPattern.push_back(uIndex);
+}
+
+
+//
+// _Close(UINT64* puStates)
+//
+// Every active '*' also activates the element after it.
+//
+void WildcardSet::_Close(UINT64* puStates) const
+{
+    UINT64 uCarry = 0;
+
+    for (size_t uWord = 0; uWord < m_cWords; ++uWord)
+    {
+        UINT64 uStars = puStates[uWord] & m_uStarMask[uWord];
+
+        puStates[uWord] |= (uStars << 1) | uCarry;
+        uCarry = uStars >> 63;
+    }
+}
+
+
+//
+// _Step(const UINT64* puStates, wchar_t wc, UINT64* puNext)
+//
+// Same as WildcardPattern::_MatchNFA, just spread over several words.
+//
+void WildcardSet::_Step(const UINT64* puStates, wchar_t wc, UINT64* puNext) const
+{
+    int nUpper = toupper(wc);
+    UINT64 uCarry = 0;
+
+    for (size_t uWord = 0; uWord < m_cWords; ++uWord)
+    {
+        UINT64 uMatched = puStates[uWord] & m_uAnyMask[uWord];
+
+        for (UINT64 uActive = puStates[uWord] & m_uTestMask[uWord];
+             uActive; uActive &= uActive - 1)
+        {
+            UINT uBit = WildcardPattern::LowestBitIndex(uActive);
+            const ElementRef& ref = m_elements[uWord * 64 + uBit];
+
+            if (ref.pPattern->MatchElement(
+                ref.pPattern->GetElements()[ref.uElement], wc, nUpper))
+            {
+                uMatched |= (UINT64)1 << uBit;
+            }
+        }
+
+        puNext[uWord] = (uMatched << 1) | uCarry | (puStates[uWord] & m_uStarMask[uWord]);
+        uCarry = uMatched >> 63;
+    }
+
+    _Close(puNext);
+}
+
+
+//
+// _AddDfaState(const std::vector<UINT64>& states)
+//
+int WildcardSet::_AddDfaState(const std::vector<UINT64>& states)
+{
+    DfaStateMap::const_iterator iter = m_dfaStateMap.find(&states);
+
+    if (iter != m_dfaStateMap.end())
+    {
+        return iter->second;
+    }
+
+    DfaState* pState = new DfaState;
+    pState->states = states;
+    pState->bStable = true;
+
+    for (int& nNext : pState->nAsciiNext)
+    {
+        nNext = -1;
+    }
+
+    for (size_t uWord = 0; uWord < m_cWords; ++uWord)
+    {
+        if (states[uWord] & ~m_uStableMask[uWord])
+        {
+            pState->bStable = false;
+            break;
+        }
+    }
+
+    int nState = (int)m_dfaStates.size();
+
+    m_dfaStates.push_back(pState);
+    m_dfaStateMap.emplace(&pState->states, nState);
+
+    return nState;
+}
+
+
+//
+// _GetTransition(int nState, wchar_t wc)
+//
+int WildcardSet::_GetTransition(int nState, wchar_t wc)
+{
+    if (m_dfaStates.size() >= MAX_DFA_STATES)
+    {
+        std::vector<UINT64> current(m_dfaStates[nState]->states);
+
+        _ResetDfa();
+        nState = _AddDfaState(current);
+    }
+
+    std::vector<UINT64> next(m_cWords);
+    _Step(&m_dfaStates[nState]->states[0], wc, &next[0]);
+
+    int nNext = _AddDfaState(next);
+
+    if (wc < 128)
+    {
+        m_dfaStates[nState]->nAsciiNext[wc] = nNext;
+    }
+    else
+    {
+        m_wideTransitions[((UINT)nState << 16) | wc] = nNext;
+    }
+
+    return nNext;
+}
+
+
+//
+// _ResetDfa()
+//
+void WildcardSet::_ResetDfa()
+{
+    for (DfaState* pState : m_dfaStates)
+    {
+        delete pState;
+    }
+
+    m_dfaStates.clear();
+    m_dfaStateMap.clear();
+    m_wideTransitions.clear();
+
+    std::vector<UINT64> start(m_uStartMask);
+    _Close(&start[0]);
+
+    _AddDfaState(start);
+}
+
+
+//
+// Match(LPCWSTR pwzText, UINT* puMatches, UINT cMaxMatches)
+//
+UINT WildcardSet::Match(LPCWSTR pwzText, UINT* puMatches, UINT cMaxMatches)
+{
+    if (pwzText == nullptr)
+    {
+        return 0;
+    }
+
+    Lock lock(m_cs);
+
+    int nState = 0;
+
+    for (LPCWSTR pwzCurrent = pwzText; *pwzCurrent; ++pwzCurrent)
+    {
+        const DfaState* pState = m_dfaStates[nState];
+
+        if (pState->bStable)
+        {
+            break;
+        }
+
+        wchar_t wc = *pwzCurrent;
+        int nNext = -1;
+
+        if (wc < 128)
+        {
+            nNext = pState->nAsciiNext[wc];
+        }
+        else
+        {
+            std::unordered_map<UINT, int>::const_iterator iter =
+                m_wideTransitions.find(((UINT)nState << 16) | wc);
+
+            if (iter != m_wideTransitions.end())
+            {
+                nNext = iter->second;
+            }
+        }
+
+        if (nNext < 0)
+        {
+            nNext = _GetTransition(nState, wc);
+        }
+
+        nState = nNext;
+    }
+
+    // Merge the patterns accepted by the DFA with the ones that have to be
+    // matched individually, so the indices come out in order
+    const std::vector<UINT64>& states = m_dfaStates[nState]->states;
+    std::vector<UINT>::const_iterator iterFallback = m_fallbacks.begin();
+    UINT cMatches = 0;
+
+    for (size_t uWord = 0; uWord < m_cWords; ++uWord)
+    {
+        for (UINT64 uAccepted = states[uWord] & m_uAcceptMask[uWord];
+             uAccepted; uAccepted &= uAccepted - 1)
+        {
+            UINT uBit = WildcardPattern::LowestBitIndex(uAccepted);
+            UINT uPattern = m_acceptPattern[uWord * 64 + uBit];
+
+            for (; iterFallback != m_fallbacks.end() && *iterFallback < uPattern; ++iterFallback)
+            {
+                if (m_patterns[*iterFallback]->Match(pwzText))
+                {
+                    _AddMatch(*iterFallback, puMatches, cMaxMatches, cMatches);
+                }
+            }
+
+            _AddMatch(uPattern, puMatches, cMaxMatches, cMatches);
+        }
+    }
+
+    for (; iterFallback != m_fallbacks.end(); ++iterFallback)
+    {
+        if (m_patterns[*iterFallback]->Match(pwzText))
+        {
+            _AddMatch(*iterFallback, puMatches, cMaxMatches, cMatches);
+        }
+    }
+
+    return cMatches;
+}
@@ -0,0 +1,146 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(WILDCARDSET_H)
+#define WILDCARDSET_H
+
+#include "WildcardPattern.h"
+#include "../utility/criticalsection.h"
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A set of wildcard patterns that are matched against a string together.
+ *
+ * The compiled patterns are laid out next to each other in one combined NFA.
+ * Sets of NFA states are turned into DFA states as the text is scanned, and
+ * the transitions are remembered, so once warmed up each character costs one
+ * table lookup no matter how many patterns there are. Patterns that could not
+ * be compiled are matched one by one.
+ */
+class WildcardSet : public CountedBase
+{
+    /** One element of the combined NFA */
+    struct ElementRef
+    {
+        const WildcardPattern* pPattern;
+        UINT uElement;
+    };
+
+    /** A set of NFA states, along with the transitions found so far */
+    struct DfaState
+    {
+        std::vector<UINT64> states;
+
+        // Next state for ASCII characters, -1 if not known yet
+        int nAsciiNext[128];
+
+        // Set if no further text can change the result
+        bool bStable;
+    };
+
+    struct DfaStateHash
+    {
+        size_t operator()(const std::vector<UINT64>* pStates) const;
+    };
+
+    struct DfaStateEqual
+    {
+        bool operator()(const std::vector<UINT64>* pLeft, const std::vector<UINT64>* pRight) const
+        {
+            return *pLeft == *pRight;
+        }
+    };
+
+    typedef std::unordered_map<const std::vector<UINT64>*, int, DfaStateHash, DfaStateEqual> DfaStateMap;
+
+    std::vector<WildcardPattern*> m_patterns;
+
+    // Indices of patterns which are matched one by one
+    std::vector<UINT> m_fallbacks;
+
+    // The combined NFA, one bit per element plus one accept bit per pattern
+    std::vector<ElementRef> m_elements;
+    std::vector<UINT> m_acceptPattern;
+    size_t m_cWords;
+
+    std::vector<UINT64> m_uStartMask;
+    std::vector<UINT64> m_uAnyMask;
+    std::vector<UINT64> m_uTestMask;
+    std::vector<UINT64> m_uStarMask;
+    std::vector<UINT64> m_uAcceptMask;
+    std::vector<UINT64> m_uStableMask;
+
+    // The DFA built so far. State 0 is always the start state.
+    std::vector<DfaState*> m_dfaStates;
+    DfaStateMap m_dfaStateMap;
+    std::unordered_map<UINT, int> m_wideTransitions;
+
+    mutable CriticalSection m_cs;
+
+    WildcardSet(const LPCWSTR* ppwzPatterns, UINT cPatterns);
+    virtual ~WildcardSet();
+
+    void _AddPattern(UINT uIndex, WildcardPattern* pPattern);
+    void _Close(UINT64* puStates) const;
+    void _Step(const UINT64* puStates, wchar_t wc, UINT64* puNext) const;
+
+    int _AddDfaState(const std::vector<UINT64>& states);
+    int _GetTransition(int nState, wchar_t wc);
+    void _ResetDfa();
+
+    // not implemented
+    WildcardSet(const WildcardSet& rhs);
+    WildcardSet& operator=(const WildcardSet& rhs);
+
+public:
+    /**
+     * Creates a new pattern set. Release it when done.
+     *
+     * @param  ppwzPatterns  Patterns to add. <code>nullptr</code> entries are
+     *                       allowed and never match.
+     * @param  cPatterns     Number of patterns
+     * @return New pattern set, or <code>nullptr</code> if ppwzPatterns is
+     *         <code>nullptr</code>
+     */
+    static WildcardSet* Create(const LPCWSTR* ppwzPatterns, UINT cPatterns);
+
+    /**
+     * Finds all patterns matching a string.
+     *
+     * @param  pwzText      String to match
+     * @param  puMatches    Receives the indices of the matching patterns, in
+     *                      ascending order. May be <code>nullptr</code>.
+     * @param  cMaxMatches  Size of puMatches
+     * @return Number of matching patterns. May be larger than cMaxMatches.
+     */
+    UINT Match(LPCWSTR pwzText, UINT* puMatches, UINT cMaxMatches);
+
+    /**
+     * Returns the number of patterns in the set.
+     */
+    UINT GetCount() const
+    {
+        return (UINT)m_patterns.size();
+    }
+};
+
+#endif // WILDCARDSET_H
@@ -322,9 +322,9 @@ static INT_PTR OnCommand(
         ListView_DeleteAllItems(hListView);
 
         // Delete listview columns
-        for (int nCol = 3; nCol >= 0; --nCol)
+        while (ListView_DeleteColumn(hListView, 0))
         {
-            ListView_DeleteColumn(hListView, nCol);
+            // do nothing
         }
 
         // get new selection
@@ -585,7 +585,7 @@ static void AboutModules(HWND hListView)
 // PerformanceCallback
 // Used by AboutPerformance
 //
-static BOOL CALLBACK PerformanceCallback(LPCWSTR pszPath, DWORD dwLoadTime, LPARAM lParam)
+static BOOL CALLBACK PerformanceCallback(LPCWSTR pszPath, const LSMODULESTATS* pStats, LPARAM lParam)
 {
     CallbackInfo* pCi = (CallbackInfo*)lParam;
 
@@ -601,8 +601,36 @@ static BOOL CALLBACK PerformanceCallback(LPCWSTR pszPath, DWORD dwLoadTime, LPAR
 
     ListView_InsertItem(pCi->hListView, &itemInfo);
 
-    StringCchPrintf(szModule, _countof(szModule), L"%dms", dwLoadTime);
-    ListView_SetItemText(pCi->hListView, pCi->nItem, 1, szModule);
+    wchar_t szText[64];
+
+    StringCchPrintf(szText, _countof(szText), L"%.1fms",
+        pStats->ullLoadTime / 1000.0);
+    ListView_SetItemText(pCi->hListView, pCi->nItem, 1, szText);
+
+    StringCchPrintf(szText, _countof(szText), L"%.1fms",
+        pStats->ullInitTime / 1000.0);
+    ListView_SetItemText(pCi->hListView, pCi->nItem, 2, szText);
+
+    StringCchPrintf(szText, _countof(szText), L"%.1fms",
+        pStats->ullCpuTime / 1000.0);
+    ListView_SetItemText(pCi->hListView, pCi->nItem, 3, szText);
+
+    if (pStats->llPrivateBytes < 0)
+    {
+        szText[0] = L'-';
+        FormatBytes(-pStats->llPrivateBytes, szText + 1, _countof(szText) - 1);
+    }
+    else
+    {
+        FormatBytes(pStats->llPrivateBytes, szText, _countof(szText));
+    }
+    ListView_SetItemText(pCi->hListView, pCi->nItem, 4, szText);
+
+    StringCchPrintf(szText, _countof(szText), L"%u", pStats->dwBangs);
+    ListView_SetItemText(pCi->hListView, pCi->nItem, 5, szText);
+
+    StringCchPrintf(szText, _countof(szText), L"%u", pStats->dwBroadcasts);
+    ListView_SetItemText(pCi->hListView, pCi->nItem, 6, szText);
 
     ++pCi->nItem;
     return TRUE;
@@ -615,31 +643,37 @@ static BOOL CALLBACK PerformanceCallback(LPCWSTR pszPath, DWORD dwLoadTime, LPAR
 //
 static void AboutPerformance(HWND hListView)
 {
+    static const wchar_t* const columns[] = \
+    {
+        L"Module", L"Load", L"Init", L"CPU", L"Memory", L"Bangs", L"Messages"
+    };
+
     LVCOLUMN columnInfo;
     wchar_t text[32];
 
     int width = GetClientWidth(hListView) - GetSystemMetrics(SM_CXVSCROLL);
 
-    StringCchCopy(text, _countof(text), L"Module");
-    columnInfo.mask = LVCF_FMT | LVCF_WIDTH | LVCF_TEXT | LVCF_SUBITEM;
-    columnInfo.fmt = LVCFMT_LEFT;
-    columnInfo.cx = width / 2;
-    columnInfo.pszText = text;
-    columnInfo.iSubItem = 0;
-
-    ListView_InsertColumn(hListView, 0, &columnInfo);
+    // The numbers share three quarters, the module name gets the rest
+    int numberWidth = (width - width / 4) / ((int)COUNTOF(columns) - 1);
 
-    StringCchCopy(text, _countof(text), L"Load Time");
-    columnInfo.cx = width - columnInfo.cx;
-    columnInfo.pszText = text;
-    columnInfo.iSubItem = 1;
+    columnInfo.mask = LVCF_FMT | LVCF_WIDTH | LVCF_TEXT | LVCF_SUBITEM;
 
-    ListView_InsertColumn(hListView, 1, &columnInfo);
+    for (int i = 0; i < (int)COUNTOF(columns); ++i)
+    {
+        StringCchCopy(text, _countof(text), columns[i]);
+        columnInfo.fmt = (i == 0) ? LVCFMT_LEFT : LVCFMT_RIGHT;
+        columnInfo.cx = (i == 0) ?
+            width - numberWidth * ((int)COUNTOF(columns) - 1) : numberWidth;
+        columnInfo.pszText = text;
+        columnInfo.iSubItem = i;
+
+        ListView_InsertColumn(hListView, i, &columnInfo);
+    }
 
     CallbackInfo ci = { 0 };
     ci.hListView = hListView;
 
-    EnumLSDataW(ELD_PERFORMANCE, (FARPROC)PerformanceCallback, (LPARAM)&ci);
+    EnumLSDataW(ELD_MODULESTATS, (FARPROC)PerformanceCallback, (LPARAM)&ci);
 }
 
 
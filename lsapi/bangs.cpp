@@ -19,7 +19,14 @@
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "BangCallChain.h"
+#include "CommandCache.h"
+#include "StartupTimeline.h"
 #include "../utility/core.hpp"
+#include <algorithm>
+#include <stdio.h>
+#include <string>
+#include <vector>
 
 
 extern DWORD WINAPI AboutBoxThread(LPVOID);
@@ -28,6 +35,9 @@ static void BangAbout(HWND hCaller, LPCWSTR pwzArgs);
 static void BangAlert(HWND hCaller, LPCWSTR pwzArgs);
 static void BangCascadeWindows(HWND hCaller, LPCWSTR pwzArgs);
 static void BangConfirm(HWND hCaller, LPCWSTR pwzArgs);
+static void BangDumpBangStats(HWND hCaller, LPCWSTR pwzArgs);
+static void BangDumpMessageTrace(HWND hCaller, LPCWSTR pwzArgs);
+static void BangDumpStartupTimeline(HWND hCaller, LPCWSTR pwzArgs);
 static void BangExecute(HWND hCaller, LPCWSTR pwzArgs);
 static void BangHideModules (HWND hCaller, LPCWSTR pwzArgs);
 static void BangLogoff(HWND hCaller, LPCWSTR pwzArgs);
@@ -54,6 +64,9 @@ void SetupBangs(void)
     AddBangCommandW(L"!Alert",            BangAlert);
     AddBangCommandW(L"!CascadeWindows",   BangCascadeWindows);
     AddBangCommandW(L"!Confirm",          BangConfirm);
+    AddBangCommandW(L"!DumpBangStats",    BangDumpBangStats);
+    AddBangCommandW(L"!DumpMessageTrace", BangDumpMessageTrace);
+    AddBangCommandW(L"!DumpStartupTimeline", BangDumpStartupTimeline);
     AddBangCommandW(L"!Execute",          BangExecute);
     AddBangCommandW(L"!HideModules",      BangHideModules);
     AddBangCommandW(L"!Logoff",           BangLogoff);
@@ -102,6 +115,7 @@ static void BangAlert(HWND hCaller, LPCWSTR pwzArgs)
             StringCchCopyW(wzTitle, MAX_PATH, L"LiteStep !Alert");
         }
 
+        BangCallChain::ModalScope modal;
         MessageBoxW(hCaller, wzMessage, wzTitle, MB_OK | MB_TOPMOST);
     }
 }
@@ -138,8 +152,13 @@ static void BangConfirm(HWND hCaller, LPCWSTR pwzArgs)
 
         LPCWSTR pwzTitle = (nTokenCount == 3) ? wzFourth : wzSecond;
 
-        INT idConfirm = MessageBoxW(hCaller,
-            wzFirst, pwzTitle, MB_YESNO | MB_ICONQUESTION | MB_TOPMOST);
+        INT idConfirm = IDNO;
+
+        {
+            BangCallChain::ModalScope modal;
+            idConfirm = MessageBoxW(hCaller,
+                wzFirst, pwzTitle, MB_YESNO | MB_ICONQUESTION | MB_TOPMOST);
+        }
 
         if (idConfirm == IDYES)
         {
@@ -155,17 +174,187 @@ static void BangConfirm(HWND hCaller, LPCWSTR pwzArgs)
 }
 
 
+//
+// Helper struct for BangDumpBangStats
+//
+struct BANGSTATS_ENTRY
+{
+    std::wstring sBang;
+    LSBANGSTATS stats;
+};
+
+
+//
+// CollectBangStats
+//   (local helper function)
+//
+static BOOL CALLBACK CollectBangStats(HINSTANCE, LPCWSTR pwzBang, const LSBANGSTATS* pStats, LPARAM lParam)
+{
+    BANGSTATS_ENTRY entry = { pwzBang, *pStats };
+    ((std::vector<BANGSTATS_ENTRY>*)lParam)->push_back(entry);
+
+    return TRUE;
+}
+
+
+//
+// WriteBangStatsLine
+//   (local helper function)
+//
+static void WriteBangStatsLine(FILE* pFile, LPCWSTR pwzLabel, DWORD dwCount,
+    ULONGLONG ullTotal, const DWORD* pdwHistogram)
+{
+    if (dwCount == 0)
+    {
+        return;
+    }
+
+    fwprintf(pFile, L"  %-7ls %8lu calls %12llu us total %10llu us mean ",
+        pwzLabel, dwCount, ullTotal, ullTotal / dwCount);
+
+    // Only the buckets in use, labelled with their upper bound
+    for (UINT uBucket = 0; uBucket < LS_BANGSTATS_BUCKETS; ++uBucket)
+    {
+        if (pdwHistogram[uBucket] == 0)
+        {
+            continue;
+        }
+
+        if (uBucket == LS_BANGSTATS_BUCKETS - 1)
+        {
+            fwprintf(pFile, L" >=%llu:%lu",
+                1ull << (uBucket - 1), pdwHistogram[uBucket]);
+        }
+        else
+        {
+            fwprintf(pFile, L" <%llu:%lu", 1ull << uBucket, pdwHistogram[uBucket]);
+        }
+    }
+
+    fwprintf(pFile, L"\n");
+}
+
+
+//
+// BangDumpBangStats(HWND hCaller, LPCWSTR pwzArgs)
+//
+// Writes the ELD_BANGSTATS data to a file, the slowest bang commands first.
+// The file defaults to BangStats.txt in the LiteStep directory.
+//
+static void BangDumpBangStats(HWND /* hCaller */, LPCWSTR pwzArgs)
+{
+    wchar_t wzPath[MAX_LINE_LENGTH] = { 0 };
+
+    if (!GetTokenW(pwzArgs, wzPath, nullptr, FALSE) || !*wzPath)
+    {
+        if (!LSGetLitestepPathW(wzPath, _countof(wzPath)) ||
+            !PathAppendW(wzPath, L"BangStats.txt"))
+        {
+            return;
+        }
+    }
+
+    std::vector<BANGSTATS_ENTRY> entries;
+    EnumLSDataW(ELD_BANGSTATS, (FARPROC)CollectBangStats, (LPARAM)&entries);
+
+    std::sort(entries.begin(), entries.end(),
+        [] (const BANGSTATS_ENTRY& a, const BANGSTATS_ENTRY& b) -> bool
+    {
+        return a.stats.ullDirectTime + a.stats.ullQueuedTime >
+            b.stats.ullDirectTime + b.stats.ullQueuedTime;
+    });
+
+    FILE* pFile = nullptr;
+
+    if (_wfopen_s(&pFile, wzPath, L"wt, ccs=UTF-8") != 0 || pFile == nullptr)
+    {
+        TRACE("!DumpBangStats: Could not open \"%ls\"", wzPath);
+        return;
+    }
+
+    for (const BANGSTATS_ENTRY& entry : entries)
+    {
+        const LSBANGSTATS& stats = entry.stats;
+
+        if (stats.dwDirectCalls == 0 && stats.dwQueuedCalls == 0)
+        {
+            continue;
+        }
+
+        fwprintf(pFile, L"%ls\n", entry.sBang.c_str());
+
+        WriteBangStatsLine(pFile, L"direct", stats.dwDirectCalls,
+            stats.ullDirectTime, stats.dwDirectHistogram);
+
+        WriteBangStatsLine(pFile, L"queued", stats.dwQueuedCalls,
+            stats.ullQueuedTime, stats.dwQueuedHistogram);
+
+        WriteBangStatsLine(pFile, L"wait", stats.dwQueuedCalls,
+            stats.ullWaitTime, stats.dwWaitHistogram);
+    }
+
+    fclose(pFile);
+}
+
+
+//
+// BangDumpMessageTrace(HWND hCaller, LPCWSTR pwzArgs)
+//
+// Writes the message trace recorded so far, see LSMessageTrace. The file
+// defaults to the one given by that setting.
+//
+static void BangDumpMessageTrace(HWND /* hCaller */, LPCWSTR pwzArgs)
+{
+    HWND hLiteStep = GetLitestepWnd();
+
+    if (hLiteStep)
+    {
+        wchar_t wzPath[MAX_LINE_LENGTH] = { 0 };
+        GetTokenW(pwzArgs, wzPath, nullptr, FALSE);
+
+        SendMessage(hLiteStep, LM_DUMPMESSAGETRACE, 0, (LPARAM)wzPath);
+    }
+}
+
+
+//
+// BangDumpStartupTimeline(HWND hCaller, LPCWSTR pwzArgs)
+//
+// Writes the startup timeline as trace-event JSON, see StartupTimeline. The
+// file defaults to StartupTimeline.json in the LiteStep directory.
+//
+static void BangDumpStartupTimeline(HWND /* hCaller */, LPCWSTR pwzArgs)
+{
+    wchar_t wzPath[MAX_LINE_LENGTH] = { 0 };
+
+    if (!GetTokenW(pwzArgs, wzPath, nullptr, FALSE) || !*wzPath)
+    {
+        if (!LSGetLitestepPathW(wzPath, _countof(wzPath)) ||
+            !PathAppendW(wzPath, L"StartupTimeline.json"))
+        {
+            return;
+        }
+    }
+
+    StartupTimeline::Write(wzPath);
+}
+
+
 //
 // BangExecute(HWND hCaller, LPCWSTR pwzArgs)
 //
 static void BangExecute(HWND hCaller, LPCWSTR pwzArgs)
 {
-    LPCWSTR pszNextToken = pwzArgs;
-    wchar_t wzCommand[MAX_LINE_LENGTH];
+    CommandSequence* pSequence = CommandSequence::FromCache(pwzArgs);
 
-    while (GetTokenW(pszNextToken, wzCommand, &pszNextToken, TRUE))
+    if (pSequence != nullptr)
     {
-        LSExecuteW(hCaller, wzCommand, SW_SHOWDEFAULT);
+        for (const std::wstring& sCommand : pSequence->GetCommands())
+        {
+            LSExecuteW(hCaller, sCommand.c_str(), SW_SHOWDEFAULT);
+        }
+
+        pSequence->Release();
     }
 }
 
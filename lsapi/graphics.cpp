@@ -20,6 +20,7 @@
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 #include "png_support.h"
+#include "SettingsTracker.h"
 #include "../utility/core.hpp"
 #include <algorithm>
 #include "../utility/stringutility.h"
@@ -243,6 +244,8 @@ HRGN BitmapToRegion(
 //   .extract=file.exe[,3]
 HBITMAP LoadLSImageW(LPCWSTR pwzImage, LPCWSTR pwzFile)
 {
+    SETTINGS_READER();
+
     HBITMAP hbmReturn = NULL;
 
     if (pwzImage != NULL)
@@ -415,9 +418,11 @@ HBITMAP LoadLSImageW(LPCWSTR pwzImage, LPCWSTR pwzFile)
 //
 HBITMAP LoadLSImageA(LPCSTR pszImage, LPCSTR pszFile)
 {
+    SETTINGS_READER();
+
     return LoadLSImageW(
-        std::unique_ptr<wchar_t>(WCSFromMBS(pszImage)).get(),
-        std::unique_ptr<wchar_t>(WCSFromMBS(pszFile)).get()
+        MBSTOWCS(pszImage),
+        MBSTOWCS(pszFile)
         );
 }
 
@@ -463,6 +468,8 @@ HBITMAP BitmapFromIcon(HICON hIcon)
 //   .extract=file.exe[,3]  ... and returns an icon
 HICON LoadLSIconW(LPCWSTR pwzIconPath, LPCWSTR pwzFile)
 {
+    SETTINGS_READER();
+
     HICON hIcon = NULL;
 
     if (pwzIconPath != NULL)
@@ -553,9 +560,11 @@ HICON LoadLSIconW(LPCWSTR pwzIconPath, LPCWSTR pwzFile)
 //
 HICON LoadLSIconA(LPCSTR pszIconPath, LPCSTR pszFile)
 {
+    SETTINGS_READER();
+
     return LoadLSIconW(
-        std::unique_ptr<wchar_t>(WCSFromMBS(pszIconPath)).get(),
-        std::unique_ptr<wchar_t>(WCSFromMBS(pszFile)).get()
+        MBSTOWCS(pszIconPath),
+        MBSTOWCS(pszFile)
         );
 }
 
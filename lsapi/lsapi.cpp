@@ -22,7 +22,13 @@
 #include "lsapi.h"
 #include "lsapiinit.h"
 #include "BangCommand.h"
+#include "CommandCache.h"
+#include "SettingsTracker.h"
+#include "StartupTimeline.h"
+#include "Task.h"
+#include "ThreadWindow.h"
 #include "../utility/core.hpp"
+#include "../utility/tokenizer.h"
 
 static int _Tokenize(LPCSTR pszString, LPSTR* lpszBuffers, DWORD dwNumBuffers,
                      LPSTR pszExtraParameters, BOOL bUseBrackets);
@@ -68,6 +74,47 @@ void LSAPIReloadSettings(VOID)
 }
 
 
+void LSAPITrackSettings(BOOL bTrack)
+{
+    SettingsTracker::Enable(bTrack != FALSE);
+}
+
+
+BOOL LSAPIReloadChangedSettings(LSCHANGEDREADERPROC pfnCallback, LPARAM lParam)
+{
+    BOOL bReturn = FALSE;
+
+    // Without the reads of every module there is nothing to go by
+    if (SettingsTracker::IsEnabled() && pfnCallback != nullptr)
+    {
+        try
+        {
+            std::vector<HMODULE> vecChanged;
+            g_LSAPIManager.ReloadChangedSettings(vecChanged);
+
+            for (HMODULE hReader : vecChanged)
+            {
+                pfnCallback((HINSTANCE)hReader, lParam);
+            }
+
+            bReturn = TRUE;
+        }
+        catch(LSAPIException& lse)
+        {
+            lse.Type();
+        }
+    }
+
+    return bReturn;
+}
+
+
+void LSAPIForgetSettingsReader(HINSTANCE hReader)
+{
+    SettingsTracker::Forget((HMODULE)hReader);
+}
+
+
 void LSAPISetLitestepWindow(HWND hLitestepWnd)
 {
     g_LSAPIManager.SetLitestepWindow(hLitestepWnd);
@@ -118,7 +165,7 @@ BOOL AddBangCommandW(LPCWSTR pwzCommand, BangCommandW pfnBangCommand)
 //
 BOOL AddBangCommandA(LPCSTR pszCommand, BangCommandA pfnBangCommand)
 {
-    return AddBangCommandWorker(std::unique_ptr<wchar_t>(WCSFromMBS(pszCommand)).get(),
+    return AddBangCommandWorker(MBSTOWCS(pszCommand),
         pfnBangCommand);
 }
 
@@ -137,7 +184,7 @@ BOOL AddBangCommandExW(LPCWSTR pwzCommand, BangCommandExW pfnBangCommand)
 //
 BOOL AddBangCommandExA(LPCSTR pszCommand, BangCommandExA pfnBangCommand)
 {
-    return AddBangCommandWorker(std::unique_ptr<wchar_t>(WCSFromMBS(pszCommand)).get(),
+    return AddBangCommandWorker(MBSTOWCS(pszCommand),
         pfnBangCommand);
 }
 
@@ -169,7 +216,7 @@ BOOL RemoveBangCommandA(LPCSTR pszCommand)
     if (pszCommand != nullptr)
     {
         bResult = g_LSAPIManager.GetBangManager()->RemoveBangCommand(
-            std::unique_ptr<wchar_t>(WCSFromMBS(pszCommand)).get()
+            MBSTOWCS(pszCommand)
         );
     }
 
@@ -177,6 +224,52 @@ BOOL RemoveBangCommandA(LPCSTR pszCommand)
 }
 
 
+//
+// SetBangCommandCoalescingW
+//
+BOOL SetBangCommandCoalescingW(LPCWSTR pwzCommand, UINT uPolicy, UINT uDelay)
+{
+    BOOL bResult = FALSE;
+
+    if (pwzCommand != nullptr)
+    {
+        LONG lDelay = Bang::COALESCE_NONE;
+
+        switch (uPolicy)
+        {
+        case LS_COALESCE_NONE:
+            break;
+
+        case LS_COALESCE_LATEST:
+            lDelay = 0;
+            break;
+
+        case LS_COALESCE_DEBOUNCE:
+            lDelay = (uDelay > LONG_MAX) ? LONG_MAX : (LONG)uDelay;
+            lDelay = (lDelay > 0) ? lDelay : 1;
+            break;
+
+        default:
+            return FALSE;
+        }
+
+        bResult = g_LSAPIManager.GetBangManager()->
+            SetBangCommandCoalescing(pwzCommand, lDelay);
+    }
+
+    return bResult;
+}
+
+
+//
+// SetBangCommandCoalescingA
+//
+BOOL SetBangCommandCoalescingA(LPCSTR pszCommand, UINT uPolicy, UINT uDelay)
+{
+    return SetBangCommandCoalescingW(MBSTOWCS(pszCommand), uPolicy, uDelay);
+}
+
+
 //
 // InternalExecuteBangCommand
 //   (Just like ParseBangCommand but without the variable expansion)
@@ -188,6 +281,92 @@ BOOL InternalExecuteBangCommand(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArg
 }
 
 
+//
+// LSAPIProcessBangQueue
+//   (Executes the bang commands other threads queued for the current one)
+//
+UINT LSAPIProcessBangQueue()
+{
+    UINT uCount = 0;
+    BangQueue* pQueue = BangQueue::FindForThread(GetCurrentThreadId());
+
+    if (pQueue != nullptr)
+    {
+        uCount = pQueue->Process();
+        pQueue->Release();
+    }
+
+    return uCount;
+}
+
+
+//
+// LSAPIAttachThread
+//   (Lets other threads wake up the current one, which runs a LiteStep
+//    message loop. See ThreadWindow.)
+//
+BOOL LSAPIAttachThread()
+{
+    return ThreadWindow::Attach() ? TRUE : FALSE;
+}
+
+
+//
+// LSAPIDetachThread
+//   (Called once the current thread's message loop is done)
+//
+void LSAPIDetachThread()
+{
+    ThreadWindow::Detach();
+}
+
+
+//
+// LSAPICancelModuleTasks
+//   (Cancels the queued tasks of a module that is being unloaded)
+//
+void LSAPICancelModuleTasks(HINSTANCE hModule)
+{
+    Task::CancelModule(hModule);
+}
+
+
+//
+// LSAPIRecordTimeline
+//   (Adds a span to the startup timeline, see TimelineSpan)
+//
+void LSAPIRecordTimeline(LPCWSTR pwzCategory, LPCWSTR pwzName, ULONGLONG ullStart, ULONGLONG ullEnd)
+{
+    StartupTimeline::Record(pwzCategory, pwzName, ullStart, ullEnd);
+}
+
+
+//
+// LSAPIResetTimeline
+//   (Starts a new startup timeline, for recycles)
+//
+void LSAPIResetTimeline()
+{
+    StartupTimeline::Reset();
+}
+
+
+//
+// LSAPIRunThreadTask
+//   (Runs a task posted to the current thread with LM_THREAD_TASK)
+//
+void LSAPIRunThreadTask(LPVOID pTask)
+{
+    if (pTask != nullptr)
+    {
+        ((Task*)pTask)->Run();
+
+        // The message's reference
+        ((Task*)pTask)->Release();
+    }
+}
+
+
 //
 // ParseBangCommandW
 //
@@ -196,18 +375,36 @@ BOOL ParseBangCommandW(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs)
     TRACE("ParseBangCommand(%p, \"%ls\", \"%ls\");",
         hCaller, pwzCommand, pwzArgs);
 
-    wchar_t wzExpandedArgs[MAX_LINE_LENGTH] = { 0 };
     BOOL bReturn = FALSE;
 
     if (pwzCommand != nullptr)
     {
-        if (pwzArgs != nullptr)
+        if (!ExpandedString::NeedsExpansion(pwzArgs))
         {
-            VarExpansionExW(wzExpandedArgs, pwzArgs, MAX_LINE_LENGTH);
+            // Nothing to expand, the arguments can be passed on as they are
+            bReturn = InternalExecuteBangCommand(hCaller, pwzCommand,
+                (pwzArgs != nullptr) ? pwzArgs : L"");
         }
+        else
+        {
+            ExpandedString* pExpanded = ExpandedString::FromCache(pwzArgs);
+
+            if (pExpanded != nullptr)
+            {
+                bReturn = InternalExecuteBangCommand(hCaller, pwzCommand,
+                    pExpanded->GetString());
+
+                pExpanded->Release();
+            }
+            else
+            {
+                wchar_t wzExpandedArgs[MAX_LINE_LENGTH];
+                VarExpansionExW(wzExpandedArgs, pwzArgs, MAX_LINE_LENGTH);
 
-        bReturn = \
-            InternalExecuteBangCommand(hCaller, pwzCommand, wzExpandedArgs);
+                bReturn = InternalExecuteBangCommand(
+                    hCaller, pwzCommand, wzExpandedArgs);
+            }
+        }
     }
 
     return bReturn;
@@ -220,8 +417,230 @@ BOOL ParseBangCommandW(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs)
 BOOL ParseBangCommandA(HWND hCaller, LPCSTR pszCommand, LPCSTR pszArgs)
 {
     return ParseBangCommandW(hCaller,
-        std::unique_ptr<wchar_t>(WCSFromMBS(pszCommand)).get(),
-        std::unique_ptr<wchar_t>(WCSFromMBS(pszArgs)).get());
+        MBSTOWCS(pszCommand),
+        MBSTOWCS(pszArgs));
+}
+
+
+//
+// ExecuteBangCommandAsyncW
+//   (Like ParseBangCommand, but only schedules the bang command. The
+//    returned handle must be closed with CloseBangCommand.)
+//
+LPVOID ExecuteBangCommandAsyncW(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs,
+    LSBANGCOMPLETIONPROC pfnCallback, LPARAM lParam)
+{
+    TRACE("ExecuteBangCommandAsync(%p, \"%ls\", \"%ls\");",
+        hCaller, pwzCommand, pwzArgs);
+
+    if (pwzCommand == nullptr)
+    {
+        return nullptr;
+    }
+
+    wchar_t wzExpandedArgs[MAX_LINE_LENGTH] = { 0 };
+
+    if (pwzArgs != nullptr)
+    {
+        VarExpansionExW(wzExpandedArgs, pwzArgs, MAX_LINE_LENGTH);
+    }
+
+    BangRequest* pRequest = new BangRequest(pfnCallback, lParam);
+
+    if (!g_LSAPIManager.GetBangManager()->ExecuteBangCommandAsync(
+        pwzCommand, hCaller, wzExpandedArgs, pRequest))
+    {
+        // No such bang command, or it couldn't be queued. Complete right
+        // away, the handle would never finish otherwise.
+        if (pRequest->Start())
+        {
+            pRequest->Complete(FALSE);
+        }
+    }
+
+    return pRequest;
+}
+
+
+//
+// ExecuteBangCommandAsyncA
+//
+LPVOID ExecuteBangCommandAsyncA(HWND hCaller, LPCSTR pszCommand, LPCSTR pszArgs,
+    LSBANGCOMPLETIONPROC pfnCallback, LPARAM lParam)
+{
+    return ExecuteBangCommandAsyncW(hCaller,
+        MBSTOWCS(pszCommand),
+        MBSTOWCS(pszArgs),
+        pfnCallback, lParam);
+}
+
+
+//
+// WaitForBangCommand
+//
+DWORD WaitForBangCommand(LPVOID pBang, DWORD dwMilliseconds)
+{
+    if (pBang == nullptr)
+    {
+        return WAIT_FAILED;
+    }
+
+    return ((BangRequest*)pBang)->Wait(dwMilliseconds);
+}
+
+
+//
+// CancelBangCommand
+//   (Only succeeds if the bang command hasn't started executing yet)
+//
+BOOL CancelBangCommand(LPVOID pBang)
+{
+    if (pBang == nullptr)
+    {
+        return FALSE;
+    }
+
+    return ((BangRequest*)pBang)->Cancel() ? TRUE : FALSE;
+}
+
+
+//
+// GetBangCommandResult
+//
+HRESULT GetBangCommandResult(LPVOID pBang, LPBOOL pbResult)
+{
+    if (pBang == nullptr)
+    {
+        return E_INVALIDARG;
+    }
+
+    return ((BangRequest*)pBang)->GetResult(pbResult);
+}
+
+
+//
+// CloseBangCommand
+//   (Does not cancel the bang command)
+//
+void CloseBangCommand(LPVOID pBang)
+{
+    if (pBang != nullptr)
+    {
+        ((BangRequest*)pBang)->Release();
+    }
+}
+
+
+//
+// LSSubmitTask
+//   (Runs a function on the shared thread pool. The returned handle must be
+//    closed with LSCloseTask.)
+//
+LPVOID LSSubmitTask(LSTASKPROC pfnTask, LPARAM lParam)
+{
+    if (pfnTask == nullptr)
+    {
+        return nullptr;
+    }
+
+    Task* pTask = new Task(pfnTask, lParam, 0);
+    pTask->Schedule();
+
+    return pTask;
+}
+
+
+//
+// LSContinueTask
+//   (Runs a function once another task is done or cancelled, on the pool if
+//    dwThreadID is 0 or else on that thread. See LSRunTaskOnThread.)
+//
+LPVOID LSContinueTask(LPVOID pTask, LSTASKPROC pfnTask, LPARAM lParam, DWORD dwThreadID)
+{
+    if (pTask == nullptr || pfnTask == nullptr)
+    {
+        return nullptr;
+    }
+
+    // Same check as LSRunTaskOnThread, before the continuation is due
+    if (dwThreadID != 0 && !ThreadWindow::Exists(dwThreadID))
+    {
+        return nullptr;
+    }
+
+    Task* pContinuation = new Task(pfnTask, lParam, dwThreadID);
+    ((Task*)pTask)->ContinueWith(pContinuation);
+
+    return pContinuation;
+}
+
+
+//
+// LSRunTaskOnThread
+//   (Runs a function on the main thread or the thread of a threaded module.
+//    Fails for threads that don't run LiteStep's message loop, i.e. that
+//    have no ThreadWindow.)
+//
+LPVOID LSRunTaskOnThread(DWORD dwThreadID, LSTASKPROC pfnTask, LPARAM lParam)
+{
+    if (dwThreadID == 0 || pfnTask == nullptr)
+    {
+        return nullptr;
+    }
+
+    Task* pTask = new Task(pfnTask, lParam, dwThreadID);
+
+    if (!pTask->Schedule())
+    {
+        pTask->Release();
+        pTask = nullptr;
+    }
+
+    return pTask;
+}
+
+
+//
+// LSWaitForTask
+//   (Runs the task right away if it is still queued for the pool or for the
+//    calling thread)
+//
+DWORD LSWaitForTask(LPVOID pTask, DWORD dwMilliseconds)
+{
+    if (pTask == nullptr)
+    {
+        return WAIT_FAILED;
+    }
+
+    return ((Task*)pTask)->Wait(dwMilliseconds);
+}
+
+
+//
+// LSCancelTask
+//   (Only succeeds if the task hasn't started running yet)
+//
+BOOL LSCancelTask(LPVOID pTask)
+{
+    if (pTask == nullptr)
+    {
+        return FALSE;
+    }
+
+    return ((Task*)pTask)->Cancel() ? TRUE : FALSE;
+}
+
+
+//
+// LSCloseTask
+//   (Does not cancel the task)
+//
+void LSCloseTask(LPVOID pTask)
+{
+    if (pTask != nullptr)
+    {
+        ((Task*)pTask)->Release();
+    }
 }
 
 
@@ -336,50 +755,91 @@ HINSTANCE LSExecuteExA(HWND hOwner, LPCSTR pszOperation, LPCSTR pszCommand, LPCS
 {
     return LSExecuteExW(
         hOwner,
-        std::unique_ptr<wchar_t>(WCSFromMBS(pszOperation)).get(),
-        std::unique_ptr<wchar_t>(WCSFromMBS(pszCommand)).get(),
-        std::unique_ptr<wchar_t>(WCSFromMBS(pszArgs)).get(),
-        std::unique_ptr<wchar_t>(WCSFromMBS(pszDirectory)).get(),
+        MBSTOWCS(pszOperation),
+        MBSTOWCS(pszCommand),
+        MBSTOWCS(pszArgs),
+        MBSTOWCS(pszDirectory),
         nShowCmd);
 }
 
 
+//
+// ExecuteTokenizedW
+//   (local helper function for LSExecuteW, executes an expanded command line
+//    that has been split into command and arguments)
+//
+static HINSTANCE ExecuteTokenizedW(HWND hOwner, LPCWSTR pwzCommand,
+    LPCWSTR pwzArgs, int nShowCmd)
+{
+    HINSTANCE hResult;
+
+    if (pwzCommand[0] == L'!')
+    {
+        hResult = LSExecuteExW(hOwner, nullptr,
+            pwzCommand, pwzArgs, nullptr, 0);
+    }
+    else
+    {
+        wchar_t wzDir[_MAX_DIR];
+        wchar_t wzFullDir[_MAX_DIR + _MAX_DRIVE];
+
+        _wsplitpath_s(pwzCommand, wzFullDir, _countof(wzFullDir), wzDir, _countof(wzDir), nullptr, 0, nullptr, 0);
+        StringCchCatW(wzFullDir, _MAX_DIR + _MAX_DRIVE, wzDir);
+
+        hResult = LSExecuteExW(hOwner, NULL, pwzCommand, pwzArgs,
+            wzFullDir, nShowCmd ? nShowCmd : SW_SHOWNORMAL);
+    }
+
+    return hResult;
+}
+
+
 //
 // LSExecuteW
 //
 HINSTANCE LSExecuteW(HWND hOwner, LPCWSTR pwzCommand, int nShowCmd)
 {
-    wchar_t wzCommand[MAX_LINE_LENGTH];
-    wchar_t wzExpandedCommand[MAX_LINE_LENGTH];
-    LPCWSTR pwzArgs;
     HINSTANCE hResult = HINSTANCE(32);
 
     if (pwzCommand != nullptr)
     {
-        VarExpansionExW(wzExpandedCommand, pwzCommand, MAX_LINE_LENGTH);
+        // Command lines are expanded and tokenized, and bang commands looked
+        // up, only once per settings generation
+        CompiledCommand* pCompiled = CompiledCommand::FromCache(pwzCommand);
 
-        if (GetTokenW(wzExpandedCommand, wzCommand, &pwzArgs, TRUE))
+        if (pCompiled != nullptr)
         {
-            if (pwzArgs > (wzExpandedCommand + wcslen(wzExpandedCommand)))
+            if (pCompiled->IsBangCommand())
             {
-                pwzArgs = nullptr;
+                hResult = pCompiled->Execute(hOwner) ?
+                    HINSTANCE(33) : HINSTANCE(32);
             }
-
-            if (wzCommand[0] == L'!')
+            else if (pCompiled->GetCommand()[0] != L'\0')
             {
-                hResult = LSExecuteExW(hOwner, nullptr,
-                    wzCommand, pwzArgs, nullptr, 0);
+                hResult = ExecuteTokenizedW(hOwner, pCompiled->GetCommand(),
+                    pCompiled->GetArgs(), nShowCmd);
             }
-            else
-            {
-                wchar_t wzDir[_MAX_DIR];
-                wchar_t wzFullDir[_MAX_DIR + _MAX_DRIVE];
 
-                _wsplitpath_s(wzCommand, wzFullDir, _countof(wzFullDir), wzDir, _countof(wzDir), nullptr, 0, nullptr, 0);
-                StringCchCatW(wzFullDir, _MAX_DIR + _MAX_DRIVE, wzDir);
+            pCompiled->Release();
+        }
+        else
+        {
+            // The LSAPI isn't initialized
+            wchar_t wzCommand[MAX_LINE_LENGTH];
+            wchar_t wzExpandedCommand[MAX_LINE_LENGTH];
+            LPCWSTR pwzArgs;
+
+            VarExpansionExW(wzExpandedCommand, pwzCommand, MAX_LINE_LENGTH);
 
-                hResult = LSExecuteExW(hOwner, NULL, wzCommand, pwzArgs,
-                    wzFullDir, nShowCmd ? nShowCmd : SW_SHOWNORMAL);
+            if (GetTokenW(wzExpandedCommand, wzCommand, &pwzArgs, TRUE))
+            {
+                if (pwzArgs > (wzExpandedCommand + wcslen(wzExpandedCommand)))
+                {
+                    pwzArgs = nullptr;
+                }
+
+                hResult = ExecuteTokenizedW(
+                    hOwner, wzCommand, pwzArgs, nShowCmd);
             }
         }
     }
@@ -393,7 +853,7 @@ HINSTANCE LSExecuteW(HWND hOwner, LPCWSTR pwzCommand, int nShowCmd)
 //
 HINSTANCE LSExecuteA(HWND hOwner, LPCSTR pszCommand, int nShowCmd)
 {
-    return LSExecuteW(hOwner, std::unique_ptr<wchar_t>(WCSFromMBS(pszCommand)).get(), nShowCmd);
+    return LSExecuteW(hOwner, MBSTOWCS(pszCommand), nShowCmd);
 }
 
 
@@ -491,6 +951,8 @@ void GetResStrExA(HINSTANCE hInstance, UINT uIDText, LPSTR pszText, size_t cchTe
 //
 BOOL WINAPI LSGetLitestepPathW(LPWSTR pwzPath, size_t cchPath)
 {
+    SETTINGS_READER();
+
     BOOL bReturn = FALSE;
 
     if (pwzPath != nullptr && cchPath > 0)
@@ -511,6 +973,8 @@ BOOL WINAPI LSGetLitestepPathW(LPWSTR pwzPath, size_t cchPath)
 //
 BOOL WINAPI LSGetLitestepPathA(LPSTR pszPath, size_t cchPath)
 {
+    SETTINGS_READER();
+
     BOOL bReturn = FALSE;
 
     if (pszPath != nullptr && cchPath > 0)
@@ -531,6 +995,8 @@ BOOL WINAPI LSGetLitestepPathA(LPSTR pszPath, size_t cchPath)
 //
 BOOL WINAPI LSGetImagePathW(LPWSTR pwzPath, size_t cchPath)
 {
+    SETTINGS_READER();
+
     BOOL bReturn = FALSE;
 
     if (pwzPath != nullptr && cchPath > 0)
@@ -558,6 +1024,8 @@ BOOL WINAPI LSGetImagePathW(LPWSTR pwzPath, size_t cchPath)
 //
 BOOL WINAPI LSGetImagePathA(LPSTR pszPath, size_t cchPath)
 {
+    SETTINGS_READER();
+
     BOOL bReturn = FALSE;
 
     if (pszPath != nullptr && cchPath > 0)
@@ -586,24 +1054,20 @@ BOOL WINAPI LSGetImagePathA(LPSTR pszPath, size_t cchPath)
 //
 static int _Tokenize(LPCWSTR pwzString, LPWSTR* lpwzBuffers, DWORD dwNumBuffers, LPWSTR pwzExtraParameters, BOOL bUseBrackets)
 {
-    wchar_t wzBuffer[MAX_LINE_LENGTH];
-    LPCWSTR pwzNextToken;
     DWORD dwTokens = 0;
 
     if (pwzString != nullptr)
     {
-        pwzNextToken = pwzString;
+        Tokenizer tokenizer(pwzString, bUseBrackets != FALSE);
+        TokenSpan token;
 
         if ((lpwzBuffers != nullptr) && (dwNumBuffers > 0))
         {
-            for (; pwzNextToken && dwTokens < dwNumBuffers; ++dwTokens)
+            for (; dwTokens < dwNumBuffers && tokenizer.Next(token); ++dwTokens)
             {
-                GetTokenW(pwzNextToken, wzBuffer, &pwzNextToken, bUseBrackets);
-
                 if (lpwzBuffers[dwTokens] != nullptr)
                 {
-                    StringCchCopyW(lpwzBuffers[dwTokens],
-                        wcslen(wzBuffer) + 1, wzBuffer);
+                    token.CopyTo(lpwzBuffers[dwTokens], token.cchLength + 1);
                 }
             }
 
@@ -617,10 +1081,12 @@ static int _Tokenize(LPCWSTR pwzString, LPWSTR* lpwzBuffers, DWORD dwNumBuffers,
 
             if (pwzExtraParameters != nullptr)
             {
-                if (pwzNextToken)
+                LPCWSTR pwzRemainder = tokenizer.GetRemainder();
+
+                if (pwzRemainder)
                 {
                     StringCchCopyW(pwzExtraParameters,
-                        wcslen(pwzNextToken) + 1, pwzNextToken);
+                        wcslen(pwzRemainder) + 1, pwzRemainder);
                 }
                 else
                 {
@@ -630,7 +1096,7 @@ static int _Tokenize(LPCWSTR pwzString, LPWSTR* lpwzBuffers, DWORD dwNumBuffers,
         }
         else
         {
-            while (GetTokenW(pwzNextToken, nullptr, &pwzNextToken, bUseBrackets))
+            while (tokenizer.Next(token) && token.IsValid())
             {
                 ++dwTokens;
             }
@@ -729,120 +1195,25 @@ int LCTokenizeA(LPCSTR pszString, LPSTR *lpszBuffers, DWORD dwNumBuffers, LPSTR
 //
 BOOL GetTokenW(LPCWSTR pszString, LPWSTR pszToken, LPCWSTR* pszNextToken, BOOL bUseBrackets)
 {
-    LPCWSTR pszCurrent = pszString;
-    LPCWSTR pszStartMarker = nullptr;
-    int iBracketLevel = 0;
-    WCHAR cQuote = L'\0';
-    bool bIsToken = false;
-    bool bAppendNextToken = false;
-
     if (pszString)
     {
-        if (pszToken)
-        {
-            pszToken[0] = '\0';
-        }
+        Tokenizer tokenizer(pszString, bUseBrackets != FALSE);
+        TokenSpan token;
 
-        if (pszNextToken)
-        {
-            *pszNextToken = nullptr;
-        }
+        tokenizer.Next(token);
 
-        pszCurrent += wcsspn(pszCurrent, WHITESPACEW);
-
-        for (; *pszCurrent; ++pszCurrent)
-        {
-            if (iswspace((wint_t)*pszCurrent) && !cQuote)
-            {
-                break;
-            }
-
-            if (bUseBrackets && wcschr(L"[]", *pszCurrent) &&
-                (!wcschr(L"\'\"", cQuote) || !cQuote))
-            {
-                if (*pszCurrent == L'[')
-                {
-                    if (bIsToken && !cQuote)
-                    {
-                        break;
-                    }
-
-                    ++iBracketLevel;
-                    cQuote = L'[';
-
-                    if (iBracketLevel == 1)
-                    {
-                        continue;
-                    }
-                }
-                else
-                {
-                    --iBracketLevel;
-
-                    if (iBracketLevel <= 0)
-                    {
-                        break;
-                    }
-                }
-            }
-
-            if (wcschr(L"\'\"", *pszCurrent) && (cQuote != L'['))
-            {
-                if (!cQuote)
-                {
-                    if (bIsToken)
-                    {
-                        bAppendNextToken = true;
-                        break;
-                    }
-
-                    cQuote = *pszCurrent;
-                    continue;
-                }
-                else if (*pszCurrent == cQuote)
-                {
-                    break;
-                }
-            }
-
-            if (!bIsToken)
-            {
-                bIsToken = true;
-                pszStartMarker = pszCurrent;
-            }
-        }
-
-        if (pszStartMarker && pszToken)
-        {
-            wcsncpy(pszToken, pszStartMarker, pszCurrent - pszStartMarker);
-            pszToken[pszCurrent - pszStartMarker] = L'\0';
-        }
-
-        if (!bAppendNextToken && *pszCurrent)
-        {
-            ++pszCurrent;
-        }
-
-        pszCurrent += wcsspn(pszCurrent, WHITESPACEW);
-
-        if (*pszCurrent && pszNextToken)
+        if (pszToken)
         {
-            *pszNextToken = pszCurrent;
+            // Callers don't pass a buffer size, assume the token fits
+            token.CopyTo(pszToken, token.cchLength + 1);
         }
 
-        if (bAppendNextToken && *pszCurrent)
+        if (pszNextToken)
         {
-            LPWSTR pszNewToken = pszToken;
-
-            if (pszNewToken)
-            {
-                pszNewToken += wcslen(pszToken);
-            }
-
-            GetTokenW(pszCurrent, pszNewToken, pszNextToken, bUseBrackets);
+            *pszNextToken = tokenizer.GetRemainder();
         }
 
-        return pszStartMarker != nullptr;
+        return token.IsValid();
     }
 
     return FALSE;
@@ -1004,6 +1375,8 @@ int CommandTokenizeA(LPCSTR pszString, LPSTR *lpszBuffers, DWORD dwNumBuffers, L
 //
 void VarExpansionW(LPWSTR pwzExpandedString, LPCWSTR pwzTemplate)
 {
+    SETTINGS_READER();
+
     if (pwzExpandedString != nullptr && pwzTemplate != nullptr)
     {
         wchar_t wzTempBuffer[MAX_LINE_LENGTH];
@@ -1022,6 +1395,8 @@ void VarExpansionW(LPWSTR pwzExpandedString, LPCWSTR pwzTemplate)
 //
 void VarExpansionA(LPSTR pszExpandedString, LPCSTR pszTemplate)
 {
+    SETTINGS_READER();
+
     if (pszExpandedString != nullptr && pszTemplate != nullptr)
     {
         char szTempBuffer[MAX_LINE_LENGTH];
@@ -1040,6 +1415,8 @@ void VarExpansionA(LPSTR pszExpandedString, LPCSTR pszTemplate)
 //
 void VarExpansionExW(LPWSTR pwzExpandedString, LPCWSTR pwzTemplate, size_t cchExpandedString)
 {
+    SETTINGS_READER();
+
     if (pwzExpandedString != nullptr &&
         cchExpandedString > 0 &&
         pwzTemplate != nullptr)
@@ -1062,17 +1439,18 @@ void VarExpansionExW(LPWSTR pwzExpandedString, LPCWSTR pwzTemplate, size_t cchEx
 //
 void VarExpansionExA(LPSTR pszExpandedString, LPCSTR pszTemplate, size_t cchExpandedString)
 {
+    SETTINGS_READER();
+
     if (pszExpandedString != nullptr &&
         cchExpandedString > 0 &&
         pszTemplate != nullptr)
     {
         if (g_LSAPIManager.IsInitialized())
         {
-            std::unique_ptr<wchar_t> temp(new wchar_t[cchExpandedString]);
+            ScratchBuffer<wchar_t, MAX_PATH> temp(cchExpandedString);
             g_LSAPIManager.GetSettingsManager()->VarExpansionEx(
                 temp.get(), MBSTOWCS(pszTemplate), cchExpandedString);
-            WideCharToMultiByte(CP_ACP, 0, temp.get(), -1,
-                pszExpandedString, (int)cchExpandedString, "?", nullptr);
+            ConvertWCSToMBS(temp.get(), pszExpandedString, cchExpandedString);
         }
         else
         {
@@ -1145,6 +1523,13 @@ HRESULT EnumLSDataW(UINT uInfo, FARPROC pfnCallback, LPARAM lParam)
             }
             break;
 
+        case ELD_BANGSTATS:
+            {
+                hr = g_LSAPIManager.GetBangManager()->
+                    EnumBangStats((LSENUMBANGSTATSPROCW)pfnCallback, lParam);
+            }
+            break;
+
         case ELD_REVIDS:
             {
                 hr = (HRESULT)SendMessage(GetLitestepWnd(), LM_ENUMREVIDS,
@@ -1166,6 +1551,20 @@ HRESULT EnumLSDataW(UINT uInfo, FARPROC pfnCallback, LPARAM lParam)
             }
             break;
 
+        case ELD_SLOWWINDOWS:
+            {
+                hr = (HRESULT)SendMessage(GetLitestepWnd(), LM_ENUMSLOWWINDOWS,
+                    (WPARAM)pfnCallback, lParam);
+            }
+            break;
+
+        case ELD_MODULESTATS:
+            {
+                hr = (HRESULT)SendMessage(GetLitestepWnd(), LM_ENUMMODULESTATS,
+                    (WPARAM)pfnCallback, lParam);
+            }
+            break;
+
         default:
             {
                 // do nothing
@@ -1188,29 +1587,39 @@ HRESULT EnumLSDataW(UINT uInfo, FARPROC pfnCallback, LPARAM lParam)
 static BOOL CALLBACK EnumLSDataBangsANSIIWrapper(LPCWSTR pwzBang, LPARAM lParam)
 {
     LPENUM_DATA pData = (LPENUM_DATA)lParam;
-    return LSENUMBANGSPROCA(pData->fnCallback)(std::unique_ptr<char>(MBSFromWCS(pwzBang)).get(), pData->lParam);
+    return LSENUMBANGSPROCA(pData->fnCallback)(WCSTOMBS(pwzBang), pData->lParam);
 }
 static BOOL CALLBACK EnumLSDataBangsV2ANSIIWrapper(HINSTANCE hInst, LPCWSTR pwzBang, LPARAM lParam)
 {
     LPENUM_DATA pData = (LPENUM_DATA)lParam;
-    return LSENUMBANGSV2PROCA(pData->fnCallback)(hInst, std::unique_ptr<char>(MBSFromWCS(pwzBang)).get(), pData->lParam);
+    return LSENUMBANGSV2PROCA(pData->fnCallback)(hInst, WCSTOMBS(pwzBang), pData->lParam);
+}
+static BOOL CALLBACK EnumLSDataBangStatsANSIIWrapper(HINSTANCE hInst, LPCWSTR pwzBang, const LSBANGSTATS* pStats, LPARAM lParam)
+{
+    LPENUM_DATA pData = (LPENUM_DATA)lParam;
+    return LSENUMBANGSTATSPROCA(pData->fnCallback)(hInst, WCSTOMBS(pwzBang), pStats, pData->lParam);
 }
 static BOOL CALLBACK EnumLSDataRevIDsANSIIWrapper(LPCWSTR pwzRevID, LPARAM lParam)
 {
     LPENUM_DATA pData = (LPENUM_DATA)lParam;
-    return LSENUMREVIDSPROCA(pData->fnCallback)(std::unique_ptr<char>(MBSFromWCS(pwzRevID)).get(), pData->lParam);
+    return LSENUMREVIDSPROCA(pData->fnCallback)(WCSTOMBS(pwzRevID), pData->lParam);
 
 }
 static BOOL CALLBACK EnumLSDataModulesANSIIWrapper(LPCWSTR pwzModule, DWORD fdwFlags, LPARAM lParam)
 {
     LPENUM_DATA pData = (LPENUM_DATA)lParam;
-    return LSENUMMODULESPROCA(pData->fnCallback)(std::unique_ptr<char>(MBSFromWCS(pwzModule)).get(), fdwFlags, pData->lParam);
+    return LSENUMMODULESPROCA(pData->fnCallback)(WCSTOMBS(pwzModule), fdwFlags, pData->lParam);
 
 }
 static BOOL CALLBACK EnumLSDataPerformanceANSIIWrapper(LPCWSTR pwzModule, DWORD dwLoadTime, LPARAM lParam)
 {
     LPENUM_DATA pData = (LPENUM_DATA)lParam;
-    return LSENUMPERFORMANCEPROCA(pData->fnCallback)(std::unique_ptr<char>(MBSFromWCS(pwzModule)).get(), dwLoadTime, pData->lParam);
+    return LSENUMPERFORMANCEPROCA(pData->fnCallback)(WCSTOMBS(pwzModule), dwLoadTime, pData->lParam);
+}
+static BOOL CALLBACK EnumLSDataModuleStatsANSIIWrapper(LPCWSTR pwzModule, const LSMODULESTATS* pStats, LPARAM lParam)
+{
+    LPENUM_DATA pData = (LPENUM_DATA)lParam;
+    return LSENUMMODULESTATSPROCA(pData->fnCallback)(WCSTOMBS(pwzModule), pStats, pData->lParam);
 }
 
 
@@ -1251,6 +1660,12 @@ HRESULT EnumLSDataA(UINT uInfo, FARPROC pfnCallback, LPARAM lParam)
             }
             break;
 
+        case ELD_BANGSTATS:
+            {
+                pfnCallback = FARPROC(EnumLSDataBangStatsANSIIWrapper);
+            }
+            break;
+
         case ELD_REVIDS:
             {
                 pfnCallback = FARPROC(EnumLSDataRevIDsANSIIWrapper);
@@ -1268,6 +1683,19 @@ HRESULT EnumLSDataA(UINT uInfo, FARPROC pfnCallback, LPARAM lParam)
                 pfnCallback = FARPROC(EnumLSDataPerformanceANSIIWrapper);
             }
             break;
+
+        case ELD_MODULESTATS:
+            {
+                pfnCallback = FARPROC(EnumLSDataModuleStatsANSIIWrapper);
+            }
+            break;
+
+        case ELD_SLOWWINDOWS:
+            {
+                // No strings involved, nothing to translate
+                hr = EnumLSDataW(uInfo, data.fnCallback, lParam);
+            }
+            break;
         }
 
         if (nullptr != pfnCallback)
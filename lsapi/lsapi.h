@@ -92,8 +92,25 @@ extern "C"
     LSAPI BOOL AddBangCommandExW(LPCWSTR pwzCommand, BangCommandExW pfnBangCommand);
     LSAPI BOOL RemoveBangCommandA(LPCSTR pszCommand);
     LSAPI BOOL RemoveBangCommandW(LPCWSTR pwzCommand);
+    LSAPI BOOL SetBangCommandCoalescingA(LPCSTR pszCommand, UINT uPolicy, UINT uDelay);
+    LSAPI BOOL SetBangCommandCoalescingW(LPCWSTR pwzCommand, UINT uPolicy, UINT uDelay);
     LSAPI BOOL ParseBangCommandA(HWND hCaller, LPCSTR pszCommand, LPCSTR pszArgs);
     LSAPI BOOL ParseBangCommandW(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs);
+    LSAPI LPVOID ExecuteBangCommandAsyncA(HWND hCaller, LPCSTR pszCommand, LPCSTR pszArgs,
+        LSBANGCOMPLETIONPROC pfnCallback, LPARAM lParam);
+    LSAPI LPVOID ExecuteBangCommandAsyncW(HWND hCaller, LPCWSTR pwzCommand, LPCWSTR pwzArgs,
+        LSBANGCOMPLETIONPROC pfnCallback, LPARAM lParam);
+    LSAPI DWORD WaitForBangCommand(LPVOID pBang, DWORD dwMilliseconds);
+    LSAPI BOOL CancelBangCommand(LPVOID pBang);
+    LSAPI HRESULT GetBangCommandResult(LPVOID pBang, LPBOOL pbResult);
+    LSAPI void CloseBangCommand(LPVOID pBang);
+
+    LSAPI LPVOID LSSubmitTask(LSTASKPROC pfnTask, LPARAM lParam);
+    LSAPI LPVOID LSContinueTask(LPVOID pTask, LSTASKPROC pfnTask, LPARAM lParam, DWORD dwThreadID);
+    LSAPI LPVOID LSRunTaskOnThread(DWORD dwThreadID, LSTASKPROC pfnTask, LPARAM lParam);
+    LSAPI DWORD LSWaitForTask(LPVOID pTask, DWORD dwMilliseconds);
+    LSAPI BOOL LSCancelTask(LPVOID pTask);
+    LSAPI void LSCloseTask(LPVOID pTask);
 
     LSAPI HRGN BitmapToRegion(HBITMAP hBmp, COLORREF cTransparentColor, COLORREF cTolerance, int xoffset, int yoffset);
     LSAPI HBITMAP BitmapFromIcon (HICON hIcon);
@@ -136,6 +153,16 @@ extern "C"
     LSAPI int matcheW(LPCWSTR pattern, LPCWSTR text);
     LSAPI BOOL is_valid_patternA(LPCSTR p, LPINT error_type);
     LSAPI BOOL is_valid_patternW(LPCWSTR p, LPINT error_type);
+    LSAPI LPVOID LSCompilePatternA(LPCSTR pszPattern);
+    LSAPI LPVOID LSCompilePatternW(LPCWSTR pwzPattern);
+    LSAPI BOOL LSMatchPatternA(LPVOID pPattern, LPCSTR pszText);
+    LSAPI BOOL LSMatchPatternW(LPVOID pPattern, LPCWSTR pwzText);
+    LSAPI void LSFreePattern(LPVOID pPattern);
+    LSAPI LPVOID LSCompilePatternSetA(const LPCSTR* ppszPatterns, UINT cPatterns);
+    LSAPI LPVOID LSCompilePatternSetW(const LPCWSTR* ppwzPatterns, UINT cPatterns);
+    LSAPI UINT LSMatchPatternSetA(LPVOID pSet, LPCSTR pszText, UINT* puMatches, UINT cMaxMatches);
+    LSAPI UINT LSMatchPatternSetW(LPVOID pSet, LPCWSTR pwzText, UINT* puMatches, UINT cMaxMatches);
+    LSAPI void LSFreePatternSet(LPVOID pSet);
 
     LSAPI void GetResStrA(HINSTANCE hInstance, UINT uIDText, LPSTR pszText, size_t cchText, LPCSTR pszDefText);
     LSAPI void GetResStrW(HINSTANCE hInstance, UINT uIDText, LPWSTR pwzText, size_t cchText, LPCWSTR pwzDefText);
@@ -168,6 +195,16 @@ extern "C"
     LSAPI void LSAPISetLitestepWindow(HWND hLitestepWnd);
     LSAPI void LSAPISetCOMFactory(IClassFactory *pFactory);
     LSAPI BOOL InternalExecuteBangCommand(HWND hCaller, LPCWSTR pszCommand, LPCWSTR pwzArgs);
+    LSAPI UINT LSAPIProcessBangQueue(void);
+    LSAPI BOOL LSAPIAttachThread(void);
+    LSAPI void LSAPIDetachThread(void);
+    LSAPI void LSAPICancelModuleTasks(HINSTANCE hModule);
+    LSAPI void LSAPIRunThreadTask(LPVOID pTask);
+    LSAPI void LSAPIRecordTimeline(LPCWSTR pwzCategory, LPCWSTR pwzName, ULONGLONG ullStart, ULONGLONG ullEnd);
+    LSAPI void LSAPIResetTimeline(void);
+    LSAPI void LSAPITrackSettings(BOOL bTrack);
+    LSAPI BOOL LSAPIReloadChangedSettings(LSCHANGEDREADERPROC pfnCallback, LPARAM lParam);
+    LSAPI void LSAPIForgetSettingsReader(HINSTANCE hReader);
 #endif /* LSAPI_PRIVATE */
 
 #if defined(__cplusplus)
@@ -21,6 +21,9 @@
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 #include "lsapiinit.h"
 #include "lsapi.h"
+#include "BangCallChain.h"
+#include "SettingsTracker.h"
+#include "StartupTimeline.h"
 #include "../utility/core.hpp"
 #include <time.h>
 #include <algorithm>
@@ -31,6 +34,8 @@ LSAPIInit g_LSAPIManager;
 LSAPIInit::LSAPIInit()
 :m_bmBangManager(NULL)
 ,m_smSettingsManager(NULL)
+,m_smLoading(nullptr)
+,m_dwLoadingThreadID(0)
 ,m_hLitestepWnd(NULL)
 ,m_bIsInitialized(false)
 {
@@ -46,11 +51,18 @@ LSAPIInit::~LSAPIInit()
     m_bIsInitialized = false;
     delete m_bmBangManager;
     delete m_smSettingsManager;
+
+    std::for_each(m_vecRetired.begin(), m_vecRetired.end(),
+        [] (SettingsManager* pRetired) { delete pRetired; });
+
+    BangCallChain::Shutdown();
 }
 
 
 void LSAPIInit::Initialize(LPCWSTR pwzLitestepPath, LPCWSTR pwzRcPath)
 {
+    TimelineSpan span(L"lsapi", L"LSAPIInit::Initialize");
+
     try
     {
         // Error if called again
@@ -97,13 +109,19 @@ void LSAPIInit::Initialize(LPCWSTR pwzLitestepPath, LPCWSTR pwzRcPath)
         m_bIsInitialized = true;
 
         // Initialize default variables
-        setLitestepVars();
+        {
+            TimelineSpan varsSpan(L"lsapi", L"setLitestepVars");
+            setLitestepVars();
+        }
 
         // Load the default RC config file
         m_smSettingsManager->ParseFile(m_wzRcPath);
 
         // Add our internal bang commands to the Bang Manager.
-        SetupBangs();
+        {
+            TimelineSpan bangsSpan(L"lsapi", L"SetupBangs");
+            SetupBangs();
+        }
     }
     catch(LSAPIException& lse)
     {
@@ -141,11 +159,22 @@ void LSAPIInit::ReloadSettings()
         throw LSAPIException(LSAPI_ERROR_NOTINITIALIZED);
     }
 
+    TimelineSpan span(L"lsapi", L"LSAPIInit::ReloadSettings");
+
     m_bIsInitialized = false;
 
     delete m_smSettingsManager;
     m_smSettingsManager = NULL;
 
+    {
+        Lock lock(m_csRetired);
+
+        std::for_each(m_vecRetired.begin(), m_vecRetired.end(),
+            [] (SettingsManager* pRetired) { delete pRetired; });
+
+        m_vecRetired.clear();
+    }
+
     m_smSettingsManager = new SettingsManager();
 
     if (!m_smSettingsManager)
@@ -163,13 +192,98 @@ void LSAPIInit::ReloadSettings()
 }
 
 
+void LSAPIInit::ReloadChangedSettings(std::vector<HMODULE>& vecChanged)
+{
+    if (!IsInitialized())
+    {
+        throw LSAPIException(LSAPI_ERROR_NOTINITIALIZED);
+    }
+
+    TimelineSpan span(L"lsapi", L"LSAPIInit::ReloadChangedSettings");
+
+    SettingsManager* pSettings = new SettingsManager();
+
+    // Modules keep running, so other threads go on using the current
+    // settings until the new ones are complete. The parser expands variables
+    // through the exported functions, so this thread has to see the new ones.
+    {
+        // None of this is read on behalf of a module
+        SettingsReader reader(nullptr);
+
+        m_smLoading = pSettings;
+        m_dwLoadingThreadID = GetCurrentThreadId();
+
+        setLitestepVars();
+        pSettings->ParseFile(m_wzRcPath);
+
+        m_smLoading = nullptr;
+    }
+
+    SettingsTracker::Compare(m_smSettingsManager, pSettings, vecChanged);
+
+    {
+        Lock lock(m_csRetired);
+
+        // Other threads may still be reading the old settings, so they are
+        // only deleted by the next reload, or once their LCOpen handles have
+        // all been closed, see m_vecRetired
+        std::vector<SettingsManager*>::iterator iter = std::remove_if(
+            m_vecRetired.begin(), m_vecRetired.end(),
+            [] (SettingsManager* pRetired) -> bool
+        {
+            if (pRetired->HasOpenFiles())
+            {
+                return false;
+            }
+
+            delete pRetired;
+            return true;
+        });
+
+        m_vecRetired.erase(iter, m_vecRetired.end());
+        m_vecRetired.push_back(m_smSettingsManager);
+
+        m_smSettingsManager = pSettings;
+    }
+
+    // Anything derived from the old settings while the new ones were being
+    // loaded has the new generation already
+    SettingsManager::NewGeneration();
+
+    // The LSAPI's own reads aren't tracked, so nothing above restarts the
+    // bang commands whose "*BangCoalesce" lines changed
+    m_bmBangManager->ReapplyCoalescing();
+}
+
+
+SettingsManager* LSAPIInit::GetSettingsManager(LPVOID pFile)
+{
+    SettingsManager* pSettings = GetSettingsManager();
+
+    if (!pSettings->IsOpen(pFile))
+    {
+        Lock lock(m_csRetired);
+
+        for (SettingsManager* pRetired : m_vecRetired)
+        {
+            if (pRetired->IsOpen(pFile))
+            {
+                return pRetired;
+            }
+        }
+    }
+
+    return pSettings;
+}
+
+
 void LSAPIInit::setLitestepVars()
 {
     wchar_t wzTemp[MAX_PATH];
     DWORD dwLength = MAX_PATH;
 
     // just using a shorter name, no real reason to re-assign.
-    SettingsManager *pSM = m_smSettingsManager;
+    SettingsManager *pSM = GetSettingsManager();
 
     // Set the variable "litestepdir" since it was never set
     if (SUCCEEDED(StringCchCopyW(wzTemp, MAX_PATH, m_wzLitestepPath)))
@@ -328,7 +442,7 @@ bool LSAPIInit::setShellFolderVariable(LPCWSTR pwzVariable, int nFolder)
         PathAddBackslashEx(wzPath, MAX_PATH);
         PathQuoteSpacesW(wzPath);
 
-        m_smSettingsManager->SetVariable(pwzVariable, wzPath);
+        GetSettingsManager()->SetVariable(pwzVariable, wzPath);
         bSuccess = true;
     }
 
@@ -25,6 +25,8 @@
 #include "BangManager.h"
 #include "SettingsManager.h"
 #include "../utility/common.h"
+#include "../utility/criticalsection.h"
+#include <vector>
 
 enum ErrorType
 {
@@ -82,9 +84,27 @@ public:
             throw LSAPIException(LSAPI_ERROR_NOTINITIALIZED);
         }
 
+        // The thread that loads new settings sees them before anyone else
+        if (m_smLoading != nullptr &&
+            m_dwLoadingThreadID == GetCurrentThreadId())
+        {
+            return m_smLoading;
+        }
+
         return m_smSettingsManager;
     }
 
+    /**
+     * Returns the settings manager an LCOpen handle belongs to. Handles that
+     * were opened before ReloadChangedSettings keep reading the settings
+     * they were opened on, until they are closed.
+     *
+     * @param  pFile  handle returned by LCOpen
+     * @return settings manager that opened it, or the current one if none
+     *         did
+     */
+    SettingsManager* GetSettingsManager(LPVOID pFile);
+
     HWND GetLitestepWnd() const
     {
         return m_hLitestepWnd;
@@ -105,6 +125,14 @@ public:
     void ReloadBangs();
     void ReloadSettings();
 
+    /**
+     * Reloads the settings while modules are running, and tells which
+     * modules read settings that have changed, see SettingsTracker.
+     *
+     * @param  vecChanged  receives the module handles of those modules
+     */
+    void ReloadChangedSettings(std::vector<HMODULE>& vecChanged);
+
     void SetLitestepWindow(HWND hLitestepWnd)
     {
         m_hLitestepWnd = hLitestepWnd;
@@ -126,6 +154,22 @@ private:
     BangManager* m_bmBangManager;
     SettingsManager* m_smSettingsManager;
 
+    /**
+     * Settings replaced by ReloadChangedSettings. The LSAPI doesn't count
+     * references to settings managers. A GetRC or LCReadNext call that
+     * picked up the old one just before the switch is assumed to be long
+     * done by the next ReloadChangedSettings, which only comes with another
+     * recycle, so that deletes them. Those with LCOpen handles that are
+     * still open are kept until a later reload finds them all closed. A
+     * full reload deletes all of them, since all modules have quit by then.
+     */
+    std::vector<SettingsManager*> m_vecRetired;
+    CriticalSection m_csRetired;
+
+    /** Settings being loaded by ReloadChangedSettings, and its thread */
+    SettingsManager* m_smLoading;
+    DWORD m_dwLoadingThreadID;
+
     HWND m_hLitestepWnd;
     IClassFactory *m_pComFactory;
     wchar_t m_wzLitestepPath[MAX_PATH];
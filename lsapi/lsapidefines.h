@@ -90,7 +90,7 @@
 
 #define LM_RECYCLE                  9260
 #define LM_REGISTERMESSAGE          9263
-#define LM_UNREGISTERMESSAGE        9264
+#define LM_UNREGISTERMESSAGE        9264  // lParam NULL unregisters all
 #define LM_GETREVIDA                9265
 #define LM_UNLOADMODULEA            9266
 #define LM_RELOADMODULEA            9267
@@ -104,6 +104,7 @@
 #define LM_THREAD_BANGCOMMAND       9310
 #define LM_THREADREADY              9311
 #define LM_THREADFINISHED           9312
+#define LM_THREAD_TASK              9313
 #endif
 
 // VWM Messages
@@ -130,8 +131,21 @@
 #define LM_ENUMREVIDS               9430
 #define LM_ENUMMODULES              9431
 #define LM_ENUMPERFORMANCE          9432
+#define LM_ENUMSLOWWINDOWS          9433
+#define LM_DUMPMESSAGETRACE         9434
+#define LM_ENUMMODULESTATS          9435
+#define LM_MODULEINITDONE           9436
 #endif
 
+// Sent to windows that registered for it when a threaded module that missed
+// LSModuleInitTimeout has finished initializing. wParam is its HINSTANCE.
+#define LM_MODULEREADY              9437
+
+// Sent to windows that registered for it after a selective recycle (see
+// LSSelectiveRecycle) to the modules that kept running. The settings may have
+// changed, but none that they have read so far.
+#define LM_SETTINGSCHANGED          9438
+
 
 #define LM_SHELLHOOK                9500    // not an actual message
 
@@ -229,6 +243,35 @@ typedef int  (__cdecl* initModuleProc)(HWND, HINSTANCE, LPCWSTR);
 typedef int  (__cdecl* initModuleProcA)(HWND, HINSTANCE, LPCSTR);
 typedef void (__cdecl* quitModuleProc)(HINSTANCE);
 
+// Optional export "moduleDependencies". Returns the names of the modules that
+// have to be initialized before this one, separated by spaces, e.g.
+// L"label popup2". Called before initModule, and only used when
+// LSParallelModuleInit is set.
+typedef LPCWSTR (__cdecl* moduleDependenciesProc)();
+
+// Optional exports "saveModuleState" and "restoreModuleState". When a module
+// is reloaded, saveModuleState is called right before quitModule with one of
+// the LS_MODULESTATE_ reasons below. It returns a buffer allocated with
+// LocalAlloc that holds the module's state, its size and a version word that
+// identifies its format, or NULL to start from scratch. The buffer is passed
+// as is to restoreModuleState of the new instance right after its initModule
+// succeeds, along with the same reason and version. It then owns the buffer
+// and frees it with LocalFree, and should ignore a version it doesn't know,
+// since the DLL may have been replaced in between. The old DLL is unloaded
+// before that, so the state must not point into it. Both run on the module's
+// own thread if it is threaded.
+typedef LPVOID (__cdecl* saveModuleStateProc)(
+    HINSTANCE, UINT, DWORD*, SIZE_T*);
+typedef void (__cdecl* restoreModuleStateProc)(
+    HINSTANCE, UINT, DWORD, LPVOID, SIZE_T);
+
+// saveModuleState/restoreModuleState reasons
+// !ReloadModule or LM_RELOADMODULE, nothing else changed
+#define LS_MODULESTATE_RELOAD           1
+// LSSelectiveRecycle, the module's settings changed. Only keep state that
+// doesn't depend on them, or return NULL to start over.
+#define LS_MODULESTATE_SETTINGSCHANGED  2
+
 
 //-----------------------------------------------------------------------------
 // BANG COMMAND DEFINES
@@ -240,6 +283,24 @@ typedef void (__cdecl *BangCommandExA) \
 typedef void (__cdecl *BangCommandExW) \
     (HWND hSender, LPCWSTR pszCommand, LPCWSTR pszArgs);
 
+// Called when a bang command started with ExecuteBangCommandAsync is done
+typedef void (CALLBACK* LSBANGCOMPLETIONPROC)(LPVOID pBang, BOOL bResult, LPARAM lParam);
+
+// Work started with LSSubmitTask, LSContinueTask or LSRunTaskOnThread
+typedef void (CALLBACK* LSTASKPROC)(LPARAM lParam);
+
+#if defined(LSAPI_PRIVATE)
+// Called by LSAPIReloadChangedSettings for each DLL that read settings which
+// have changed
+typedef void (CALLBACK* LSCHANGEDREADERPROC)(HINSTANCE hReader, LPARAM lParam);
+#endif
+
+// SetBangCommandCoalescing policies. Themes can override them with
+// "*BangCoalesce !Bang none|latest|debounce <ms>" lines.
+#define LS_COALESCE_NONE            0   // execute every call
+#define LS_COALESCE_LATEST          1   // queued calls take the newest arguments
+#define LS_COALESCE_DEBOUNCE        2   // wait until calls stop for uDelay ms
+
 typedef struct _LMBANGCOMMANDA
 {
     UINT cbSize;
@@ -322,6 +383,9 @@ typedef struct LSDESKTOPINFO
 #define ELD_REVIDS                  3
 #define ELD_BANGS_V2                4
 #define ELD_PERFORMANCE             5
+#define ELD_BANGSTATS               6
+#define ELD_SLOWWINDOWS             7
+#define ELD_MODULESTATS             8
 
 // ELD_MODULES: possible dwFlags values
 #define LS_MODULE_THREADED          0x0001
@@ -338,4 +402,71 @@ typedef BOOL (CALLBACK* LSENUMMODULESPROCW)(LPCWSTR, DWORD, LPARAM);
 typedef BOOL (CALLBACK* LSENUMPERFORMANCEPROCA)(LPCSTR, DWORD, LPARAM);
 typedef BOOL (CALLBACK* LSENUMPERFORMANCEPROCW)(LPCWSTR, DWORD, LPARAM);
 
+// ELD_BANGSTATS: number of latency histogram buckets. Bucket 0 counts calls
+// that took less than a microsecond, bucket n > 0 those that took from
+// 2^(n-1) up to 2^n microseconds. The last bucket also counts anything longer.
+#define LS_BANGSTATS_BUCKETS        24
+
+typedef struct LSBANGSTATS
+{
+    UINT cbSize;
+    // Calls made on the thread that owns the bang command
+    DWORD dwDirectCalls;
+    ULONGLONG ullDirectTime;                        // microseconds
+    DWORD dwDirectHistogram[LS_BANGSTATS_BUCKETS];
+    // Calls queued for the owning thread, from other threads or through
+    // ExecuteBangCommandAsync
+    DWORD dwQueuedCalls;
+    ULONGLONG ullQueuedTime;                        // microseconds
+    DWORD dwQueuedHistogram[LS_BANGSTATS_BUCKETS];
+    // Time queued calls spent waiting to be executed
+    ULONGLONG ullWaitTime;                          // microseconds
+    DWORD dwWaitHistogram[LS_BANGSTATS_BUCKETS];
+    //
+} LSBANGSTATS, *PLSBANGSTATS;
+
+typedef BOOL (CALLBACK* LSENUMBANGSTATSPROCA)(HINSTANCE, LPCSTR, const LSBANGSTATS*, LPARAM);
+typedef BOOL (CALLBACK* LSENUMBANGSTATSPROCW)(HINSTANCE, LPCWSTR, const LSBANGSTATS*, LPARAM);
+
+// ELD_SLOWWINDOWS: windows that didn't handle a broadcast message within
+// LSBroadcastTimeout. They are skipped, or sent posted messages, until
+// LSBroadcastRetry milliseconds have passed.
+typedef struct LSSLOWWINDOW
+{
+    UINT cbSize;
+    HWND hWnd;
+    UINT uLastMessage;      // message that timed out last
+    DWORD dwTimeouts;       // number of timeouts
+    DWORD dwSkipped;        // broadcasts it was skipped in, or posted
+    //
+} LSSLOWWINDOW, *PLSSLOWWINDOW;
+
+typedef BOOL (CALLBACK* LSENUMSLOWWINDOWSPROC)(const LSSLOWWINDOW*, LPARAM);
+
+// ELD_MODULESTATS: what a loaded module cost to start, and what it has done
+// since. The private bytes and handle deltas are those of the whole process
+// while initModule ran, so they include anything other threads did meanwhile.
+typedef struct LSMODULESTATS
+{
+    UINT cbSize;
+    DWORD dwFlags;                  // LS_MODULE_THREADED
+    ULONGLONG ullLoadTime;          // LoadLibrary and GetProcAddress, microseconds
+    ULONGLONG ullInitTime;          // initModule, microseconds
+    ULONGLONG ullReadyTime;         // from LoadLibrary until initModule returned,
+                                    // which is when threaded modules signal their
+                                    // init event, microseconds
+    LONGLONG llPrivateBytes;        // change in private bytes across initModule
+    LONG lHandles;                  // change in handle count across initModule
+    ULONGLONG ullCpuTime;           // threaded modules: CPU time of the module's
+                                    // thread so far, others: CPU time of
+                                    // initModule, microseconds
+    DWORD dwBangs;                  // calls to the module's bang commands
+    DWORD dwBroadcasts;             // broadcast messages delivered to windows
+                                    // created with the module's instance handle
+    //
+} LSMODULESTATS, *PLSMODULESTATS;
+
+typedef BOOL (CALLBACK* LSENUMMODULESTATSPROCA)(LPCSTR, const LSMODULESTATS*, LPARAM);
+typedef BOOL (CALLBACK* LSENUMMODULESTATSPROCW)(LPCWSTR, const LSMODULESTATS*, LPARAM);
+
 #endif // LSAPIDEFINES_H
@@ -37,7 +37,12 @@
    J. Kercheval  Tue, 03/12/1991  22:25:10  Released as V1.1 to Public Domain
 */
 #include "lsapi.h"
+#include "WildcardPattern.h"
+#include "WildcardSet.h"
+#include "../utility/stringutility.h"
 #include <locale>
+#include <string>
+#include <vector>
 
 static int matche_after_starA(LPCSTR pattern, LPCSTR text);
 static int matche_after_starW(LPCWSTR pattern, LPCWSTR text);
@@ -810,5 +815,126 @@ BOOL matchA(LPCSTR p, LPCSTR t)
 }
 BOOL matchW(LPCWSTR p, LPCWSTR t)
 {
-    return (matcheW(p, t) == MATCH_VALID) ? TRUE : FALSE;
+    // Patterns are usually matched many times (e.g. against every window
+    // or file name), so use the compiled version from the pattern cache.
+    WildcardPattern* pPattern = WildcardPattern::FromCache(p);
+
+    if (pPattern == nullptr)
+    {
+        return (matcheW(p, t) == MATCH_VALID) ? TRUE : FALSE;
+    }
+
+    BOOL bMatch = pPattern->Match(t) ? TRUE : FALSE;
+    pPattern->Release();
+
+    return bMatch;
+}
+
+/*-----------------------------------------------------------------------------
+*
+* LSCompilePattern() parses a pattern once, so it can be matched against many
+* strings with LSMatchPattern(). The results are the same as with matchW().
+* Free the returned handle with LSFreePattern().
+*
+-----------------------------------------------------------------------------*/
+LPVOID LSCompilePatternA(LPCSTR pszPattern)
+{
+    if (pszPattern == nullptr)
+    {
+        return nullptr;
+    }
+
+    return WildcardPattern::Create(MBSTOWCS(pszPattern));
+}
+LPVOID LSCompilePatternW(LPCWSTR pwzPattern)
+{
+    return WildcardPattern::Create(pwzPattern);
+}
+
+BOOL LSMatchPatternA(LPVOID pPattern, LPCSTR pszText)
+{
+    if (pPattern == nullptr || pszText == nullptr)
+    {
+        return FALSE;
+    }
+
+    return ((WildcardPattern*)pPattern)->Match(MBSTOWCS(pszText)) ? TRUE : FALSE;
+}
+BOOL LSMatchPatternW(LPVOID pPattern, LPCWSTR pwzText)
+{
+    if (pPattern == nullptr || pwzText == nullptr)
+    {
+        return FALSE;
+    }
+
+    return ((WildcardPattern*)pPattern)->Match(pwzText) ? TRUE : FALSE;
+}
+
+void LSFreePattern(LPVOID pPattern)
+{
+    if (pPattern != nullptr)
+    {
+        ((WildcardPattern*)pPattern)->Release();
+    }
+}
+
+/*-----------------------------------------------------------------------------
+*
+* LSCompilePatternSet() combines several patterns, so a string can be matched
+* against all of them in a single pass. LSMatchPatternSet() returns how many
+* of the patterns match, and stores the indices of up to cMaxMatches of them
+* in puMatches. Free the returned handle with LSFreePatternSet().
+*
+-----------------------------------------------------------------------------*/
+LPVOID LSCompilePatternSetA(const LPCSTR* ppszPatterns, UINT cPatterns)
+{
+    if (ppszPatterns == nullptr)
+    {
+        return nullptr;
+    }
+
+    std::vector<std::wstring> patterns(cPatterns);
+    std::vector<LPCWSTR> patternPtrs(cPatterns, nullptr);
+
+    for (UINT uIndex = 0; uIndex < cPatterns; ++uIndex)
+    {
+        if (ppszPatterns[uIndex] != nullptr)
+        {
+            patterns[uIndex] = MBSTOWCS(ppszPatterns[uIndex]);
+            patternPtrs[uIndex] = patterns[uIndex].c_str();
+        }
+    }
+
+    return WildcardSet::Create(patternPtrs.data(), cPatterns);
+}
+LPVOID LSCompilePatternSetW(const LPCWSTR* ppwzPatterns, UINT cPatterns)
+{
+    return WildcardSet::Create(ppwzPatterns, cPatterns);
+}
+
+UINT LSMatchPatternSetA(LPVOID pSet, LPCSTR pszText, UINT* puMatches, UINT cMaxMatches)
+{
+    if (pSet == nullptr || pszText == nullptr)
+    {
+        return 0;
+    }
+
+    return ((WildcardSet*)pSet)->Match(MBSTOWCS(pszText), puMatches, cMaxMatches);
+}
+UINT LSMatchPatternSetW(LPVOID pSet, LPCWSTR pwzText, UINT* puMatches, UINT cMaxMatches)
+{
+    if (pSet == nullptr || pwzText == nullptr)
+    {
+        return 0;
+    }
+
+    return ((WildcardSet*)pSet)->Match(pwzText, puMatches, cMaxMatches);
+}
+
+void LSFreePatternSet(LPVOID pSet)
+{
+    if (pSet != nullptr)
+    {
+        ((WildcardSet*)pSet)->Release();
+    }
 }
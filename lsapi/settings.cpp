@@ -21,12 +21,15 @@
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
 #include "settingsmanager.h"
 #include "lsapiInit.h"
+#include "SettingsTracker.h"
 #include "../utility/core.hpp"
 #include "../utility/stringutility.h"
 
 
 LPVOID LCOpenW(LPCWSTR pwzPath)
 {
+    SETTINGS_READER();
+
     LPVOID pFile = nullptr;
 
     if (g_LSAPIManager.IsInitialized())
@@ -50,7 +53,9 @@ LPVOID LCOpenW(LPCWSTR pwzPath)
 
 LPVOID LCOpenA(LPCSTR pszPath)
 {
-    return LCOpenW(std::unique_ptr<wchar_t>(WCSFromMBS(pszPath)).get());
+    SETTINGS_READER();
+
+    return LCOpenW(MBSTOWCS(pszPath));
 }
 
 
@@ -62,7 +67,7 @@ BOOL LCClose(LPVOID pFile)
     {
         if (pFile != nullptr)
         {
-            bReturn = g_LSAPIManager.GetSettingsManager()->LCClose(pFile);
+            bReturn = g_LSAPIManager.GetSettingsManager(pFile)->LCClose(pFile);
         }
     }
 
@@ -72,13 +77,15 @@ BOOL LCClose(LPVOID pFile)
 
 BOOL LCReadNextCommandW(LPVOID pFile, LPWSTR pwzValue, size_t cchValue)
 {
+    SETTINGS_READER();
+
     BOOL bReturn = FALSE;
 
     if (g_LSAPIManager.IsInitialized())
     {
         if (pFile != nullptr && pwzValue != nullptr && cchValue > 0)
         {
-            bReturn = g_LSAPIManager.GetSettingsManager()->LCReadNextCommand(
+            bReturn = g_LSAPIManager.GetSettingsManager(pFile)->LCReadNextCommand(
                 pFile, pwzValue, cchValue);
         }
     }
@@ -89,16 +96,18 @@ BOOL LCReadNextCommandW(LPVOID pFile, LPWSTR pwzValue, size_t cchValue)
 
 BOOL LCReadNextCommandA(LPVOID pFile, LPSTR pszValue, size_t cchValue)
 {
+    SETTINGS_READER();
+
     BOOL bReturn = FALSE;
 
     if (g_LSAPIManager.IsInitialized())
     {
         if (pFile != nullptr && pszValue != nullptr && cchValue > 0)
         {
-            std::unique_ptr<wchar_t> temp(new wchar_t[cchValue]);
-            bReturn = g_LSAPIManager.GetSettingsManager()->LCReadNextCommand(
+            ScratchBuffer<wchar_t, MAX_PATH> temp(cchValue);
+            bReturn = g_LSAPIManager.GetSettingsManager(pFile)->LCReadNextCommand(
                 pFile, temp.get(), cchValue);
-            WideCharToMultiByte(CP_ACP, 0, temp.get(), -1, pszValue, (int)cchValue, "?", nullptr);
+            ConvertWCSToMBS(temp.get(), pszValue, cchValue);
         }
     }
 
@@ -108,6 +117,8 @@ BOOL LCReadNextCommandA(LPVOID pFile, LPSTR pszValue, size_t cchValue)
 
 BOOL LCReadNextConfigW(LPVOID pFile, LPCWSTR pwzConfig, LPWSTR pwzValue, size_t cchValue)
 {
+    SETTINGS_READER();
+
     BOOL bReturn = FALSE;
 
     if (g_LSAPIManager.IsInitialized())
@@ -115,7 +126,7 @@ BOOL LCReadNextConfigW(LPVOID pFile, LPCWSTR pwzConfig, LPWSTR pwzValue, size_t
         if (pFile != nullptr && pwzConfig != nullptr &&
             pwzValue != nullptr && cchValue > 0)
         {
-            bReturn = g_LSAPIManager.GetSettingsManager()->LCReadNextConfig(
+            bReturn = g_LSAPIManager.GetSettingsManager(pFile)->LCReadNextConfig(
                 pFile, pwzConfig, pwzValue, cchValue);
         }
     }
@@ -126,6 +137,8 @@ BOOL LCReadNextConfigW(LPVOID pFile, LPCWSTR pwzConfig, LPWSTR pwzValue, size_t
 
 BOOL LCReadNextConfigA(LPVOID pFile, LPCSTR pszConfig, LPSTR pszValue, size_t cchValue)
 {
+    SETTINGS_READER();
+
     BOOL bReturn = FALSE;
 
     if (g_LSAPIManager.IsInitialized())
@@ -133,10 +146,10 @@ BOOL LCReadNextConfigA(LPVOID pFile, LPCSTR pszConfig, LPSTR pszValue, size_t cc
         if (pFile != nullptr && pszConfig != nullptr &&
             pszValue != nullptr && cchValue > 0)
         {
-            std::unique_ptr<wchar_t> temp(new wchar_t[cchValue]);
-            bReturn = g_LSAPIManager.GetSettingsManager()->LCReadNextConfig(
+            ScratchBuffer<wchar_t, MAX_PATH> temp(cchValue);
+            bReturn = g_LSAPIManager.GetSettingsManager(pFile)->LCReadNextConfig(
                 pFile, MBSTOWCS(pszConfig), temp.get(), cchValue);
-            WideCharToMultiByte(CP_ACP, 0, temp.get(), -1, pszValue, (int)cchValue, "?", nullptr);
+            ConvertWCSToMBS(temp.get(), pszValue, cchValue);
         }
     }
 
@@ -146,13 +159,15 @@ BOOL LCReadNextConfigA(LPVOID pFile, LPCSTR pszConfig, LPSTR pszValue, size_t cc
 
 BOOL LCReadNextLineW(LPVOID pFile, LPWSTR pwzValue, size_t cchValue)
 {
+    SETTINGS_READER();
+
     BOOL bReturn = FALSE;
 
     if (g_LSAPIManager.IsInitialized())
     {
         if (pFile != nullptr && pwzValue != nullptr && cchValue > 0)
         {
-            bReturn = g_LSAPIManager.GetSettingsManager()->LCReadNextLine(
+            bReturn = g_LSAPIManager.GetSettingsManager(pFile)->LCReadNextLine(
                 pFile, pwzValue, cchValue);
         }
     }
@@ -163,16 +178,18 @@ BOOL LCReadNextLineW(LPVOID pFile, LPWSTR pwzValue, size_t cchValue)
 
 BOOL LCReadNextLineA(LPVOID pFile, LPSTR pszValue, size_t cchValue)
 {
+    SETTINGS_READER();
+
     BOOL bReturn = FALSE;
 
     if (g_LSAPIManager.IsInitialized())
     {
         if (pFile != nullptr && pszValue != nullptr && cchValue > 0)
         {
-            std::unique_ptr<wchar_t> value(new wchar_t[cchValue]);
-            bReturn = g_LSAPIManager.GetSettingsManager()->LCReadNextLine(
+            ScratchBuffer<wchar_t, MAX_PATH> value(cchValue);
+            bReturn = g_LSAPIManager.GetSettingsManager(pFile)->LCReadNextLine(
                 pFile, value.get(), cchValue);
-            WideCharToMultiByte(CP_ACP, 0, value.get(), -1, pszValue, (int)cchValue, "?", nullptr);
+            ConvertWCSToMBS(value.get(), pszValue, cchValue);
         }
     }
 
@@ -182,6 +199,8 @@ BOOL LCReadNextLineA(LPVOID pFile, LPSTR pszValue, size_t cchValue)
 
 __int64 GetRCInt64W(LPCWSTR pwzKeyName, __int64 nDefault)
 {
+    SETTINGS_READER();
+
     if (g_LSAPIManager.IsInitialized())
     {
         return g_LSAPIManager.GetSettingsManager()->GetRCInt64(
@@ -194,12 +213,16 @@ __int64 GetRCInt64W(LPCWSTR pwzKeyName, __int64 nDefault)
 
 __int64 GetRCInt64A(LPCSTR pszKeyName, __int64 nDefault)
 {
-    return GetRCInt64W(std::unique_ptr<wchar_t>(WCSFromMBS(pszKeyName)).get(), nDefault);
+    SETTINGS_READER();
+
+    return GetRCInt64W(MBSTOWCS(pszKeyName), nDefault);
 }
 
 
 int GetRCIntW(LPCWSTR pwzKeyName, int nDefault)
 {
+    SETTINGS_READER();
+
     if (g_LSAPIManager.IsInitialized())
     {
         return g_LSAPIManager.GetSettingsManager()->GetRCInt(
@@ -212,12 +235,16 @@ int GetRCIntW(LPCWSTR pwzKeyName, int nDefault)
 
 int GetRCIntA(LPCSTR pszKeyName, int nDefault)
 {
-    return GetRCIntW(std::unique_ptr<wchar_t>(WCSFromMBS(pszKeyName)).get(), nDefault);
+    SETTINGS_READER();
+
+    return GetRCIntW(MBSTOWCS(pszKeyName), nDefault);
 }
 
 
 float GetRCFloatW(LPCWSTR pwzKeyName, float fDefault)
 {
+    SETTINGS_READER();
+
     if (g_LSAPIManager.IsInitialized())
     {
         return g_LSAPIManager.GetSettingsManager()->GetRCFloat(
@@ -230,12 +257,16 @@ float GetRCFloatW(LPCWSTR pwzKeyName, float fDefault)
 
 float GetRCFloatA(LPCSTR pszKeyName, float fDefault)
 {
-    return GetRCFloatW(std::unique_ptr<wchar_t>(WCSFromMBS(pszKeyName)).get(), fDefault);
+    SETTINGS_READER();
+
+    return GetRCFloatW(MBSTOWCS(pszKeyName), fDefault);
 }
 
 
 double GetRCDoubleW(LPCWSTR pwzKeyName, double dDefault)
 {
+    SETTINGS_READER();
+
     if (g_LSAPIManager.IsInitialized())
     {
         return g_LSAPIManager.GetSettingsManager()->GetRCDouble(
@@ -248,12 +279,16 @@ double GetRCDoubleW(LPCWSTR pwzKeyName, double dDefault)
 
 double GetRCDoubleA(LPCSTR pszKeyName, double dDefault)
 {
-    return GetRCDoubleW(std::unique_ptr<wchar_t>(WCSFromMBS(pszKeyName)).get(), dDefault);
+    SETTINGS_READER();
+
+    return GetRCDoubleW(MBSTOWCS(pszKeyName), dDefault);
 }
 
 
 BOOL GetRCBoolW(LPCWSTR pwzKeyName, BOOL ifFound)
 {
+    SETTINGS_READER();
+
     if (g_LSAPIManager.IsInitialized())
     {
         return g_LSAPIManager.GetSettingsManager()->GetRCBool(
@@ -266,12 +301,16 @@ BOOL GetRCBoolW(LPCWSTR pwzKeyName, BOOL ifFound)
 
 BOOL GetRCBoolA(LPCSTR pszKeyName, BOOL ifFound)
 {
-    return GetRCBoolW(std::unique_ptr<wchar_t>(WCSFromMBS(pszKeyName)).get(), ifFound);
+    SETTINGS_READER();
+
+    return GetRCBoolW(MBSTOWCS(pszKeyName), ifFound);
 }
 
 
 BOOL GetRCBoolDefW(LPCWSTR pwzKeyName, BOOL bDefault)
 {
+    SETTINGS_READER();
+
     if (g_LSAPIManager.IsInitialized())
     {
         return g_LSAPIManager.GetSettingsManager()->GetRCBoolDef(
@@ -284,12 +323,16 @@ BOOL GetRCBoolDefW(LPCWSTR pwzKeyName, BOOL bDefault)
 
 BOOL GetRCBoolDefA(LPCSTR pszKeyName, BOOL bDefault)
 {
-    return GetRCBoolDefW(std::unique_ptr<wchar_t>(WCSFromMBS(pszKeyName)).get(), bDefault);
+    SETTINGS_READER();
+
+    return GetRCBoolDefW(MBSTOWCS(pszKeyName), bDefault);
 }
 
 
 BOOL GetRCStringW(LPCWSTR pwzKeyName, LPWSTR pwzValue, LPCWSTR pwzDefStr, int maxLen)
 {
+    SETTINGS_READER();
+
     if (g_LSAPIManager.IsInitialized())
     {
         return g_LSAPIManager.GetSettingsManager()->GetRCString(
@@ -306,20 +349,22 @@ BOOL GetRCStringW(LPCWSTR pwzKeyName, LPWSTR pwzValue, LPCWSTR pwzDefStr, int ma
 
 BOOL GetRCStringA(LPCSTR pszKeyName, LPSTR pszValue, LPCSTR pszDefStr, int maxLen)
 {
+    SETTINGS_READER();
+
     if (g_LSAPIManager.IsInitialized())
     {
-        std::unique_ptr<wchar_t> tempValue(new wchar_t[maxLen]);
-        std::unique_ptr<wchar_t> key (WCSFromMBS(pszKeyName));
-        std::unique_ptr<wchar_t> def (WCSFromMBS(pszDefStr));
+        ScratchBuffer<wchar_t, MAX_PATH> tempValue(maxLen);
+        ConvertedWCS<> key(pszKeyName);
+        ConvertedWCS<> def(pszDefStr);
 
-        *tempValue = '\0';
+        tempValue.get()[0] = L'\0';
 
         BOOL bRet = g_LSAPIManager.GetSettingsManager()->GetRCString(
             key.get(), tempValue.get(), def.get(), maxLen);
 
         if (pszValue)
         {
-            WideCharToMultiByte(CP_ACP, 0, tempValue.get(), -1, pszValue, maxLen, "?", nullptr);
+            ConvertWCSToMBS(tempValue.get(), pszValue, maxLen);
         }
 
         return bRet;
@@ -335,6 +380,8 @@ BOOL GetRCStringA(LPCSTR pszKeyName, LPSTR pszValue, LPCSTR pszDefStr, int maxLe
 
 COLORREF GetRCColorW(LPCWSTR pwzKeyName, COLORREF colDef)
 {
+    SETTINGS_READER();
+
     if (g_LSAPIManager.IsInitialized())
     {
         return g_LSAPIManager.GetSettingsManager()->GetRCColor(
@@ -347,12 +394,16 @@ COLORREF GetRCColorW(LPCWSTR pwzKeyName, COLORREF colDef)
 
 COLORREF GetRCColorA(LPCSTR pszKeyName, COLORREF colDef)
 {
-    return GetRCColorW(std::unique_ptr<wchar_t>(WCSFromMBS(pszKeyName)).get(), colDef);
+    SETTINGS_READER();
+
+    return GetRCColorW(MBSTOWCS(pszKeyName), colDef);
 }
 
 
 BOOL GetRCLineW(LPCWSTR pwzKeyName, LPWSTR pwzBuffer, UINT nBufLen, LPCWSTR pwzDefault)
 {
+    SETTINGS_READER();
+
     if (g_LSAPIManager.IsInitialized())
     {
         return g_LSAPIManager.GetSettingsManager()->GetRCLine(
@@ -369,20 +420,22 @@ BOOL GetRCLineW(LPCWSTR pwzKeyName, LPWSTR pwzBuffer, UINT nBufLen, LPCWSTR pwzD
 
 BOOL GetRCLineA(LPCSTR pszKeyName, LPSTR pszBuffer, UINT nBufLen, LPCSTR pszDefault)
 {
+    SETTINGS_READER();
+
     if (g_LSAPIManager.IsInitialized())
     {
-        std::unique_ptr<wchar_t> tempValue(new wchar_t[nBufLen]);
-        std::unique_ptr<wchar_t> key (WCSFromMBS(pszKeyName));
-        std::unique_ptr<wchar_t> def (WCSFromMBS(pszDefault));
+        ScratchBuffer<wchar_t, MAX_PATH> tempValue(nBufLen);
+        ConvertedWCS<> key(pszKeyName);
+        ConvertedWCS<> def(pszDefault);
 
-        *tempValue = '\0';
+        tempValue.get()[0] = L'\0';
 
         BOOL bRet = g_LSAPIManager.GetSettingsManager()->GetRCLine(
             key.get(), tempValue.get(), nBufLen, def.get());
 
         if (pszBuffer)
         {
-            WideCharToMultiByte(CP_ACP, 0, tempValue.get(), -1, pszBuffer, nBufLen, "?", nullptr);
+            ConvertWCSToMBS(tempValue.get(), pszBuffer, nBufLen);
         }
 
         return bRet;
@@ -398,6 +451,8 @@ BOOL GetRCLineA(LPCSTR pszKeyName, LPSTR pszBuffer, UINT nBufLen, LPCSTR pszDefa
 
 BOOL LSGetVariableExW(LPCWSTR pszKeyName, LPWSTR pszValue, DWORD dwLength)
 {
+    SETTINGS_READER();
+
     if (g_LSAPIManager.IsInitialized())
     {
         return g_LSAPIManager.GetSettingsManager()->GetVariable(
@@ -410,14 +465,16 @@ BOOL LSGetVariableExW(LPCWSTR pszKeyName, LPWSTR pszValue, DWORD dwLength)
 
 BOOL LSGetVariableExA(LPCSTR pszKeyName, LPSTR pszValue, DWORD dwLength)
 {
+    SETTINGS_READER();
+
     if (g_LSAPIManager.IsInitialized())
     {
-        std::unique_ptr<wchar_t> temp(new wchar_t[dwLength]);
+        ScratchBuffer<wchar_t, MAX_PATH> temp(dwLength);
 
         BOOL bRet = g_LSAPIManager.GetSettingsManager()->GetVariable(
             MBSTOWCS(pszKeyName), temp.get(), dwLength);
 
-        WideCharToMultiByte(CP_ACP, 0, temp.get(), -1, pszValue, dwLength, "?", nullptr);
+        ConvertWCSToMBS(temp.get(), pszValue, dwLength);
 
         return bRet;
     }
@@ -428,6 +485,8 @@ BOOL LSGetVariableExA(LPCSTR pszKeyName, LPSTR pszValue, DWORD dwLength)
 
 BOOL LSGetVariableW(LPCWSTR pszKeyName, LPWSTR pszValue)
 {
+    SETTINGS_READER();
+
     BOOL bReturn = FALSE;
     wchar_t szTempValue[MAX_LINE_LENGTH];
 
@@ -453,6 +512,8 @@ BOOL LSGetVariableW(LPCWSTR pszKeyName, LPWSTR pszValue)
 
 BOOL LSGetVariableA(LPCSTR pszKeyName, LPSTR pszValue)
 {
+    SETTINGS_READER();
+
     BOOL bReturn = FALSE;
     wchar_t szTempValue[MAX_LINE_LENGTH];
 
@@ -488,7 +549,7 @@ void LSSetVariableW(LPCWSTR pszKeyName, LPCWSTR pszValue)
 void LSSetVariableA(LPCSTR pszKeyName, LPCSTR pszValue)
 {
     LSSetVariableW(
-        std::unique_ptr<wchar_t>(WCSFromMBS(pszKeyName)).get(),
-        std::unique_ptr<wchar_t>(WCSFromMBS(pszValue)).get()
+        MBSTOWCS(pszKeyName),
+        MBSTOWCS(pszValue)
         );
 }
@@ -22,13 +22,19 @@
 #include "SettingsManager.h"
 #include "SettingsFileParser.h"
 #include "MathEvaluate.h"
+#include "SettingsTracker.h"
 #include "../utility/macros.h"
 #include "../utility/core.hpp"
+#include "../utility/scan.h"
+
+// Bumped whenever the global settings change. It is not a member since the
+// SettingsManager is recreated when the settings are reloaded.
+static volatile LONG g_lGeneration = 0;
 
 
 SettingsManager::SettingsManager()
 {
-    // do nothing
+    InterlockedIncrement(&g_lGeneration);
 }
 
 
@@ -65,6 +71,20 @@ void SettingsManager::ParseFile(LPCWSTR pwzFileName)
 
     FileParser fpParser(&m_SettingsMap);
     fpParser.ParseFile(pwzFileName);
+
+    InterlockedIncrement(&g_lGeneration);
+}
+
+
+LONG SettingsManager::GetGeneration()
+{
+    return g_lGeneration;
+}
+
+
+void SettingsManager::NewGeneration()
+{
+    InterlockedIncrement(&g_lGeneration);
 }
 
 
@@ -73,6 +93,9 @@ BOOL SettingsManager::_FindLine(LPCWSTR pwzName, SettingsMap::iterator &it)
     ASSERT(NULL != pwzName);
     BOOL bReturn = FALSE;
 
+    // Whether or not it exists, the reader depends on it
+    SettingsTracker::RecordKey(pwzName);
+
     // first appearance of a setting takes effect
     it = m_SettingsMap.lower_bound(pwzName);
 
@@ -396,6 +419,25 @@ void SettingsManager::SetVariable(LPCWSTR pszKeyName, LPCWSTR pszValue, bool bTe
         {
             m_SettingsMap.insert(SettingsMap::value_type(pszKeyName, SettingValue(pszValue, bTerminal)));
         }
+
+        InterlockedIncrement(&g_lGeneration);
+    }
+}
+
+
+void SettingsManager::GetRawValues(LPCWSTR pwzKeyName, std::vector<std::wstring>& vecValues)
+{
+    vecValues.clear();
+
+    if (pwzKeyName)
+    {
+        std::pair<SettingsMap::iterator, SettingsMap::iterator> range =
+            m_SettingsMap.equal_range(pwzKeyName);
+
+        for (SettingsMap::iterator it = range.first; it != range.second; ++it)
+        {
+            vecValues.push_back(it->second.sValue);
+        }
     }
 }
 
@@ -407,7 +449,17 @@ void SettingsManager::VarExpansionEx(LPWSTR pwzExpandedString, LPCWSTR pwzTempla
 }
 
 
-void SettingsManager::VarExpansionEx(LPWSTR pwzExpandedString, LPCWSTR pwzTemplate, size_t stLength, const StringSet& recursiveVarSet)
+void SettingsManager::VarExpansionEx(LPWSTR pwzExpandedString, LPCWSTR pwzTemplate, size_t stLength, bool* pbStable)
+{
+    ASSERT(pbStable != nullptr);
+    *pbStable = true;
+
+    StringSet recursiveVarSet;
+    VarExpansionEx(pwzExpandedString, pwzTemplate, stLength, recursiveVarSet, pbStable);
+}
+
+
+void SettingsManager::VarExpansionEx(LPWSTR pwzExpandedString, LPCWSTR pwzTemplate, size_t stLength, const StringSet& recursiveVarSet, bool* pbStable)
 {
     wchar_t wzTempExpandedString[MAX_LINE_LENGTH] = { 0 };
     LPWSTR pwzTempExpandedString = wzTempExpandedString;
@@ -421,10 +473,18 @@ void SettingsManager::VarExpansionEx(LPWSTR pwzExpandedString, LPCWSTR pwzTempla
         {
             if (*pwzTemplate != L'$')
             {
-                *pwzTempExpandedString = *pwzTemplate;
-                ++pwzTemplate;
-                ++pwzTempExpandedString;
-                --cchTempExpanded;
+                // Copy everything up to the next variable in one go
+                size_t cchLiteral = ScanFor(pwzTemplate, SCAN_DOLLAR) - pwzTemplate;
+
+                if (cchLiteral > cchTempExpanded)
+                {
+                    cchLiteral = cchTempExpanded;
+                }
+
+                wmemcpy(pwzTempExpandedString, pwzTemplate, cchLiteral);
+                pwzTemplate += cchLiteral;
+                pwzTempExpandedString += cchLiteral;
+                cchTempExpanded -= (DWORD)cchLiteral;
             }
             else
             {
@@ -435,10 +495,7 @@ void SettingsManager::VarExpansionEx(LPWSTR pwzExpandedString, LPCWSTR pwzTempla
 
                 LPCWSTR pwzVariable = pwzTemplate;
 
-                while ((*pwzTemplate != L'$') && (*pwzTemplate != L'\0'))
-                {
-                    ++pwzTemplate;
-                }
+                pwzTemplate = ScanFor(pwzTemplate, SCAN_DOLLAR);
 
                 bool bSucceeded = false;
 
@@ -477,6 +534,11 @@ void SettingsManager::VarExpansionEx(LPWSTR pwzExpandedString, LPCWSTR pwzTempla
 
                             RESOURCE_MSGBOX_F(L"LiteStep", MB_ICONERROR);
 
+                            if (pbStable != nullptr)
+                            {
+                                *pbStable = false;
+                            }
+
                             pwzExpandedString[0] = L'\0';
                             return;
                         }
@@ -505,32 +567,44 @@ void SettingsManager::VarExpansionEx(LPWSTR pwzExpandedString, LPCWSTR pwzTempla
                                 GetTokenW(it->second.sValue.c_str(), wzTemp, NULL, FALSE);
 
                                 VarExpansionEx(pwzTempExpandedString, wzTemp,
-                                    (size_t)cchTempExpanded, newRecursiveVarSet);
+                                    (size_t)cchTempExpanded, newRecursiveVarSet,
+                                    pbStable);
                             }
 
                             bSucceeded = true;
                         }
-                        else if (GetEnvironmentVariableW(wzVariable,
-                            pwzTempExpandedString, cchTempExpanded))
-                        {
-                            bSucceeded = true;
-                        }
-#if defined(LS_COMPAT_MATH)
                         else
                         {
-                            std::wstring result;
+                            // Environment variables and math expressions,
+                            // or variables that aren't defined at all, can
+                            // change without the settings generation changing
+                            if (pbStable != nullptr)
+                            {
+                                *pbStable = false;
+                            }
 
-                            if (MathEvaluateString(m_SettingsMap, wzVariable,
-                                result, recursiveVarSet,
-                                MATH_EXCEPTION_ON_UNDEFINED |
-                                MATH_VALUE_TO_COMPATIBLE_STRING))
+                            if (GetEnvironmentVariableW(wzVariable,
+                                pwzTempExpandedString, cchTempExpanded))
                             {
-                                StringCchCopyW(pwzTempExpandedString,
-                                    (size_t)cchTempExpanded, result.c_str());
                                 bSucceeded = true;
                             }
-                        }
+#if defined(LS_COMPAT_MATH)
+                            else
+                            {
+                                std::wstring result;
+
+                                if (MathEvaluateString(m_SettingsMap, wzVariable,
+                                    result, recursiveVarSet,
+                                    MATH_EXCEPTION_ON_UNDEFINED |
+                                    MATH_VALUE_TO_COMPATIBLE_STRING))
+                                {
+                                    StringCchCopyW(pwzTempExpandedString,
+                                        (size_t)cchTempExpanded, result.c_str());
+                                    bSucceeded = true;
+                                }
+                            }
 #endif // LS_COMPAT_MATH
+                        }
                     }
                 }
 
@@ -574,6 +648,8 @@ LPVOID SettingsManager::LCOpen(LPCWSTR pwzPath)
 
         if (psiNew)
         {
+            Lock lock(m_CritSection);
+
             m_Iterators.insert(psiNew);
             pFile = (LPVOID)psiNew;
         }
@@ -666,6 +742,22 @@ BOOL SettingsManager::LCClose(LPVOID pFile)
 }
 
 
+bool SettingsManager::IsOpen(LPVOID pFile)
+{
+    Lock lock(m_CritSection);
+
+    return m_Iterators.find((SettingsIterator*)pFile) != m_Iterators.end();
+}
+
+
+bool SettingsManager::HasOpenFiles()
+{
+    Lock lock(m_CritSection);
+
+    return !m_Iterators.empty();
+}
+
+
 BOOL SettingsManager::LCReadNextConfig(LPVOID pFile, LPCWSTR pwzConfig, LPWSTR pwzValue, size_t cchValue)
 {
     BOOL bReturn = FALSE;
@@ -677,6 +769,16 @@ BOOL SettingsManager::LCReadNextConfig(LPVOID pFile, LPCWSTR pwzConfig, LPWSTR p
         IteratorSet::iterator it = m_Iterators.find((SettingsIterator*)pFile);
         if (it != m_Iterators.end())
         {
+            // Private files are not compared on selective recycles
+            if ((*it)->getPath().empty())
+            {
+                SettingsTracker::RecordKey(pwzConfig);
+            }
+            else
+            {
+                SettingsTracker::RecordAll();
+            }
+
             bReturn = (*it)->ReadNextConfig(pwzConfig,
                 wzTempValue, MAX_LINE_LENGTH);
 
@@ -702,6 +804,8 @@ BOOL SettingsManager::LCReadNextCommand(LPVOID pFile, LPWSTR pwzValue, size_t cc
 
         if (it != m_Iterators.end())
         {
+            SettingsTracker::RecordAll();
+
             bReturn = (*it)->ReadNextCommand(wzTempValue, MAX_LINE_LENGTH);
 
             if (bReturn)
@@ -726,6 +830,8 @@ BOOL SettingsManager::LCReadNextLine(LPVOID pFile, LPWSTR pwzValue, size_t cchVa
 
         if (it != m_Iterators.end())
         {
+            SettingsTracker::RecordAll();
+
             bReturn = (*it)->ReadNextLine(wzTempValue, MAX_LINE_LENGTH);
 
             if (bReturn)
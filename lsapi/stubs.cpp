@@ -19,6 +19,7 @@
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 //
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "SettingsTracker.h"
 #include "../utility/core.hpp"
 
 
@@ -121,6 +122,8 @@ BOOL WINAPIV LSLogPrintf(int nLevel, LPCSTR pszModule, LPCSTR pszFormat, ...)
 
 int GetRCCoordinate(LPCSTR pszKeyName, int nDefault, int nMaxVal)
 {
+    SETTINGS_READER();
+
     char strVal[MAX_LINE_LENGTH];
 
     if (!GetRCStringA(pszKeyName, strVal, NULL, MAX_LINE_LENGTH))
@@ -263,21 +266,25 @@ extern "C"
 {
     LSAPI LPVOID LCOpen(LPCSTR szPath)
     {
+        SETTINGS_READER();
         return LCOpenA(szPath);
     }
 
     LSAPI BOOL LCReadNextCommand(LPVOID pFile, LPSTR pszValue, size_t cchValue)
     {
+        SETTINGS_READER();
         return LCReadNextCommandA(pFile, pszValue, cchValue);
     }
 
     LSAPI BOOL LCReadNextConfig(LPVOID pFile, LPCSTR pszConfig, LPSTR pszValue, size_t cchValue)
     {
+        SETTINGS_READER();
         return LCReadNextConfigA(pFile, pszConfig, pszValue, cchValue);
     }
 
     LSAPI BOOL LCReadNextLine(LPVOID pFile, LPSTR pszValue, size_t cchValue)
     {
+        SETTINGS_READER();
         return LCReadNextLineA(pFile, pszValue, cchValue);
     }
 
@@ -288,41 +295,49 @@ extern "C"
 
     LSAPI int GetRCInt(LPCSTR lpKeyName, int nDefault)
     {
+        SETTINGS_READER();
         return GetRCIntA(lpKeyName, nDefault);
     }
 
     LSAPI BOOL GetRCString(LPCSTR lpKeyName, LPSTR value, LPCSTR defStr, int maxLen)
     {
+        SETTINGS_READER();
         return GetRCStringA(lpKeyName, value, defStr, maxLen);
     }
 
     LSAPI BOOL GetRCBool(LPCSTR lpKeyName, BOOL ifFound)
     {
+        SETTINGS_READER();
         return GetRCBoolA(lpKeyName, ifFound);
     }
 
     LSAPI BOOL GetRCBoolDef(LPCSTR lpKeyName, BOOL bDefault)
     {
+        SETTINGS_READER();
         return GetRCBoolDefA(lpKeyName, bDefault);
     }
 
     LSAPI BOOL GetRCLine(LPCSTR lpKeyName, LPSTR value, UINT maxLen, LPCSTR defStr)
     {
+        SETTINGS_READER();
         return GetRCLineA(lpKeyName, value, maxLen, defStr);
     }
 
     LSAPI COLORREF GetRCColor(LPCSTR lpKeyName, COLORREF colDef)
     {
+        SETTINGS_READER();
         return GetRCColorA(lpKeyName, colDef);
     }
 
     LSAPI BOOL LSGetVariable(LPCSTR pszKeyName, LPSTR pszValue)
     {
+        SETTINGS_READER();
         return LSGetVariableA(pszKeyName, pszValue);
     }
 
     LSAPI BOOL LSGetVariableEx(LPCSTR pszKeyName, LPSTR pszValue, DWORD dwLength)
     {
+        SETTINGS_READER();
         return LSGetVariableExA(pszKeyName, pszValue, dwLength);
     }
 
@@ -383,21 +398,25 @@ extern "C"
 
     LSAPI BOOL WINAPI LSGetLitestepPath(LPSTR pszPath, size_t cchPath)
     {
+        SETTINGS_READER();
         return LSGetLitestepPathA(pszPath, cchPath);
     }
 
     LSAPI BOOL WINAPI LSGetImagePath(LPSTR pszPath, size_t cchPath)
     {
+        SETTINGS_READER();
         return LSGetImagePathA(pszPath, cchPath);
     }
 
     LSAPI void VarExpansion(LPSTR pszExpandedString, LPCSTR pszTemplate)
     {
+        SETTINGS_READER();
         return VarExpansionA(pszExpandedString, pszTemplate);
     }
 
     LSAPI void VarExpansionEx(LPSTR pszExpandedString, LPCSTR pszTemplate, size_t cchExpandedString)
     {
+        SETTINGS_READER();
         return VarExpansionExA(pszExpandedString, pszTemplate, cchExpandedString);
     }
 
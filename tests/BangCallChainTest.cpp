@@ -0,0 +1,312 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "../lsapi/lsapi.h"
+#include "../lsapi/BangCallChain.h"
+#include "testing.h"
+#include <atomic>
+#include <string>
+#include <thread>
+
+//
+// Tests for the runaway bang command checks. Runs bang commands that call
+// bang commands through ParseBangCommand, and checks that calls beyond
+// LSBangMaxDepth and calls of a bang command that is already running with
+// the same arguments are refused, while everything else goes through.
+//
+// Like CommandCacheTest, this links lsapi.dll's object files and
+// initializes an LSAPI of its own.
+//
+
+
+/** Number of times each test bang command ran */
+static int g_cDepthCalls = 0;
+static int g_cCycleCalls = 0;
+static int g_cPingCalls = 0;
+static int g_cPongCalls = 0;
+static int g_cCountdownCalls = 0;
+static int g_cModalCalls = 0;
+
+/** Set while !ChainModal hides the chain */
+static bool g_bInModal = false;
+
+/** Tells CloseErrors to stop */
+static std::atomic<bool> g_bDone(false);
+
+
+//
+// DepthBang
+//
+// Calls itself with the next number, forever unless refused.
+//
+static void DepthBang(HWND, LPCWSTR pwzArgs)
+{
+    ++g_cDepthCalls;
+
+    std::wstring sNext = std::to_wstring(_wtoi(pwzArgs) + 1);
+    ParseBangCommandW(nullptr, L"!ChainDepth", sNext.c_str());
+}
+
+
+//
+// CycleBang
+//
+// Calls itself with the same arguments.
+//
+static void CycleBang(HWND, LPCWSTR pwzArgs)
+{
+    ++g_cCycleCalls;
+    ParseBangCommandW(nullptr, L"!ChainCycle", pwzArgs);
+}
+
+
+//
+// PingBang, PongBang
+//
+// Call each other with the same arguments.
+//
+static void PingBang(HWND, LPCWSTR pwzArgs)
+{
+    ++g_cPingCalls;
+    ParseBangCommandW(nullptr, L"!ChainPong", pwzArgs);
+}
+
+static void PongBang(HWND, LPCWSTR pwzArgs)
+{
+    ++g_cPongCalls;
+    ParseBangCommandW(nullptr, L"!ChainPing", pwzArgs);
+}
+
+
+//
+// CountdownBang
+//
+// Calls itself with one less, down to 0.
+//
+static void CountdownBang(HWND, LPCWSTR pwzArgs)
+{
+    ++g_cCountdownCalls;
+
+    int nCount = _wtoi(pwzArgs);
+
+    if (nCount > 0)
+    {
+        std::wstring sNext = std::to_wstring(nCount - 1);
+        ParseBangCommandW(nullptr, L"!ChainCountdown", sNext.c_str());
+    }
+}
+
+
+//
+// ModalBang
+//
+// Calls itself with the same arguments from a "modal loop", i.e. while
+// the chain is hidden. That call tries once more, which is a cycle within
+// the loop. Once the loop is over, it tries again from the outer call.
+//
+static void ModalBang(HWND, LPCWSTR pwzArgs)
+{
+    ++g_cModalCalls;
+
+    if (!g_bInModal)
+    {
+        g_bInModal = true;
+        {
+            BangCallChain::ModalScope modal;
+            ParseBangCommandW(nullptr, L"!ChainModal", pwzArgs);
+        }
+        g_bInModal = false;
+    }
+
+    ParseBangCommandW(nullptr, L"!ChainModal", pwzArgs);
+}
+
+
+//
+// CloseErrors
+//
+// Refused calls are reported in an error message box once the chain has
+// unwound. Closes those until the test is done.
+//
+static void CloseErrors()
+{
+    while (!g_bDone)
+    {
+        HWND hBox = FindWindowW(L"#32770", L"LiteStep");
+
+        if (hBox != nullptr)
+        {
+            PostMessageW(hBox, WM_COMMAND, IDOK, 0);
+        }
+
+        Sleep(10);
+    }
+}
+
+
+//
+// Initialize
+//
+// Initializes the LSAPI with an empty step.rc and adds the test bang
+// commands.
+//
+static bool Initialize()
+{
+    wchar_t wzPath[MAX_PATH];
+    wchar_t wzRcPath[MAX_PATH];
+
+    if (!GetTempPathW(MAX_PATH, wzPath) ||
+        FAILED(StringCchPrintfW(wzRcPath, MAX_PATH,
+            L"%lsBangCallChainTest.rc", wzPath)))
+    {
+        return false;
+    }
+
+    HANDLE hFile = CreateFileW(wzRcPath, GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    CloseHandle(hFile);
+
+    BOOL bInitialized = LSAPIInitialize(wzPath, wzRcPath);
+    DeleteFileW(wzRcPath);
+
+    return bInitialized &&
+        AddBangCommandW(L"!ChainDepth", DepthBang) &&
+        AddBangCommandW(L"!ChainCycle", CycleBang) &&
+        AddBangCommandW(L"!ChainPing", PingBang) &&
+        AddBangCommandW(L"!ChainPong", PongBang) &&
+        AddBangCommandW(L"!ChainCountdown", CountdownBang) &&
+        AddBangCommandW(L"!ChainModal", ModalBang);
+}
+
+
+//
+// TestDepthLimit
+//
+static void TestDepthLimit()
+{
+    // 32 by default
+    g_cDepthCalls = 0;
+    CHECK(ParseBangCommandW(nullptr, L"!ChainDepth", L"0"));
+    CHECK(g_cDepthCalls == 32);
+
+    LSSetVariableW(L"LSBangMaxDepth", L"8");
+    g_cDepthCalls = 0;
+    CHECK(ParseBangCommandW(nullptr, L"!ChainDepth", L"0"));
+    CHECK(g_cDepthCalls == 8);
+
+    // Bang commands that stop by themselves are left alone
+    g_cCountdownCalls = 0;
+    CHECK(ParseBangCommandW(nullptr, L"!ChainCountdown", L"7"));
+    CHECK(g_cCountdownCalls == 8);
+
+    // Invalid values fall back to the default
+    LSSetVariableW(L"LSBangMaxDepth", L"0");
+    g_cDepthCalls = 0;
+    CHECK(ParseBangCommandW(nullptr, L"!ChainDepth", L"0"));
+    CHECK(g_cDepthCalls == 32);
+}
+
+
+//
+// TestCycles
+//
+static void TestCycles()
+{
+    LSSetVariableW(L"LSBangMaxDepth", L"16");
+
+    // The same bang command with the same arguments
+    g_cCycleCalls = 0;
+    CHECK(ParseBangCommandW(nullptr, L"!ChainCycle", L"same"));
+    CHECK(g_cCycleCalls == 1);
+
+    g_cCycleCalls = 0;
+    CHECK(ParseBangCommandW(nullptr, L"!ChainCycle", nullptr));
+    CHECK(g_cCycleCalls == 1);
+
+    // Through another bang command
+    g_cPingCalls = 0;
+    g_cPongCalls = 0;
+    CHECK(ParseBangCommandW(nullptr, L"!ChainPing", L"ball"));
+    CHECK(g_cPingCalls == 1);
+    CHECK(g_cPongCalls == 1);
+
+    // Different arguments are not a cycle, so only the depth limit applies
+    g_cDepthCalls = 0;
+    CHECK(ParseBangCommandW(nullptr, L"!ChainDepth", L"0"));
+    CHECK(g_cDepthCalls == 16);
+
+    g_cCountdownCalls = 0;
+    CHECK(ParseBangCommandW(nullptr, L"!ChainCountdown", L"10"));
+    CHECK(g_cCountdownCalls == 11);
+
+    // Without the cycle check that is all there is
+    LSSetVariableW(L"LSBangCycleCheck", L"false");
+    g_cCycleCalls = 0;
+    CHECK(ParseBangCommandW(nullptr, L"!ChainCycle", L"same"));
+    CHECK(g_cCycleCalls == 16);
+
+    LSSetVariableW(L"LSBangCycleCheck", L"true");
+}
+
+
+//
+// TestModalScope
+//
+static void TestModalScope()
+{
+    // The outer call, its call from the "modal loop", and nothing more
+    g_cModalCalls = 0;
+    CHECK(ParseBangCommandW(nullptr, L"!ChainModal", L"menu"));
+    CHECK(g_cModalCalls == 2);
+    CHECK(!g_bInModal);
+
+    // The chain is back in place after the loop
+    g_cCycleCalls = 0;
+    CHECK(ParseBangCommandW(nullptr, L"!ChainCycle", L"same"));
+    CHECK(g_cCycleCalls == 1);
+}
+
+
+int main()
+{
+    if (!Initialize())
+    {
+        printf("Could not initialize the LSAPI\n");
+        return 1;
+    }
+
+    std::thread closer(CloseErrors);
+
+    TestDepthLimit();
+    TestCycles();
+    TestModalScope();
+
+    g_bDone = true;
+    closer.join();
+
+    return TestResult();
+}
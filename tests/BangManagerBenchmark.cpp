@@ -0,0 +1,373 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "../lsapi/BangManager.h"
+#include "../lsapi/BangCommand.h"
+#include "../utility/criticalsection.h"
+#include "../utility/stringutility.h"
+#include "testing.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// Contention benchmark for bang command lookup. N threads execute their
+// own bang commands through ExecuteBangCommand, while another thread adds
+// and removes bang commands and enumerates them with a slow callback, the
+// way the about box does. Compares BangManager with the same list behind a
+// critical section, the way BangManager kept it before.
+//
+// Links lsapi.dll's object files, since BangManager isn't exported.
+//
+
+
+// Bang commands each worker thread executes in turn
+#define BANGS_PER_WORKER 8
+
+// Bang commands that are only there to fill the list
+#define FILLER_BANGS 200
+
+
+/** Number of bang commands the calling thread executed */
+static thread_local long t_cCalls = 0;
+
+
+//
+// LockedBangManager
+//
+// The baseline: the bang commands in one map behind one lock, which is also
+// held while EnumBangs runs its callback.
+//
+class LockedBangManager
+{
+    typedef StringKeyedMaps<LPCWSTR, Bang*>::UnorderedMap BangMap;
+
+    BangMap m_bangs;
+    mutable CriticalSection m_cs;
+
+public:
+    ~LockedBangManager()
+    {
+        for (const BangMap::value_type& value : m_bangs)
+        {
+            value.second->Release();
+        }
+    }
+
+    BOOL AddBangCommand(Bang* pBang)
+    {
+        Lock lock(m_cs);
+
+        BangMap::iterator iter = m_bangs.find(pBang->GetCommand());
+
+        if (iter != m_bangs.end())
+        {
+            // The key is stored inside the Bang
+            Bang* pOld = iter->second;
+            m_bangs.erase(iter);
+            pOld->Release();
+        }
+
+        m_bangs.emplace(pBang->GetCommand(), pBang);
+        pBang->AddRef();
+
+        return TRUE;
+    }
+
+    BOOL RemoveBangCommand(LPCWSTR pwzName)
+    {
+        Lock lock(m_cs);
+
+        BangMap::iterator iter = m_bangs.find(pwzName);
+
+        if (iter == m_bangs.end())
+        {
+            return FALSE;
+        }
+
+        Bang* pBang = iter->second;
+        m_bangs.erase(iter);
+        pBang->Release();
+
+        return TRUE;
+    }
+
+    BOOL ExecuteBangCommand(LPCWSTR pwzName, HWND hCaller, LPCWSTR pwzParams)
+    {
+        Bang* pBang = nullptr;
+
+        m_cs.Acquire();
+
+        BangMap::const_iterator iter = m_bangs.find(pwzName);
+
+        if (iter != m_bangs.end())
+        {
+            pBang = iter->second;
+            pBang->AddRef();
+        }
+
+        m_cs.Release();
+
+        if (pBang == nullptr)
+        {
+            return FALSE;
+        }
+
+        pBang->Execute(hCaller, pwzParams);
+        pBang->Release();
+
+        return TRUE;
+    }
+
+    HRESULT EnumBangs(LSENUMBANGSV2PROCW pfnCallback, LPARAM lParam) const
+    {
+        Lock lock(m_cs);
+
+        for (const BangMap::value_type& value : m_bangs)
+        {
+            if (!pfnCallback(value.second->GetModule(), value.first, lParam))
+            {
+                return S_FALSE;
+            }
+        }
+
+        return S_OK;
+    }
+};
+
+
+//
+// CountBang
+//
+static void CountBang(HWND, LPCWSTR)
+{
+    ++t_cCalls;
+}
+
+
+//
+// SlowEnumProc
+//
+// Takes about as long per entry as adding a line to a list view.
+//
+static BOOL CALLBACK SlowEnumProc(HINSTANCE, LPCWSTR, LPARAM)
+{
+    volatile long lSum = 0;
+
+    for (long lIteration = 0; lIteration < 2000; ++lIteration)
+    {
+        lSum += lIteration;
+    }
+
+    return TRUE;
+}
+
+
+//
+// AddBang
+//
+// Adds a bang command that belongs to the calling thread, so executing it
+// from that thread calls it directly.
+//
+template <class Manager>
+static void AddBang(Manager& manager, LPCWSTR pwzName)
+{
+    Bang* pBang = new Bang(GetCurrentThreadId(), CountBang, pwzName);
+    manager.AddBangCommand(pBang);
+    pBang->Release();
+}
+
+
+//
+// Run
+//
+// Runs cWorkers threads that execute cCalls bang commands each, with or
+// without the churn thread. Returns the number of bang commands executed
+// per microsecond.
+//
+template <class Manager>
+static double Run(Manager& manager, int cWorkers, long cCalls, bool bChurn,
+    long* pcChurns)
+{
+    std::atomic<int> cReady(0);
+    std::atomic<bool> bStart(false);
+    std::atomic<bool> bStop(false);
+    std::atomic<long> cExecuted(0);
+    std::vector<std::thread> workers;
+
+    for (int nWorker = 0; nWorker < cWorkers; ++nWorker)
+    {
+        workers.emplace_back([&, nWorker]
+        {
+            std::vector<std::wstring> names;
+
+            for (int nBang = 0; nBang < BANGS_PER_WORKER; ++nBang)
+            {
+                names.push_back(L"!Worker" + std::to_wstring(nWorker) +
+                    L"_" + std::to_wstring(nBang));
+                AddBang(manager, names.back().c_str());
+            }
+
+            ++cReady;
+
+            while (!bStart)
+            {
+                std::this_thread::yield();
+            }
+
+            t_cCalls = 0;
+
+            for (long lCall = 0; lCall < cCalls; ++lCall)
+            {
+                manager.ExecuteBangCommand(
+                    names[lCall % BANGS_PER_WORKER].c_str(), nullptr, L"");
+            }
+
+            cExecuted += t_cCalls;
+        });
+    }
+
+    std::thread churn;
+    *pcChurns = 0;
+
+    if (bChurn)
+    {
+        churn = std::thread([&]
+        {
+            long cChurns = 0;
+
+            while (!bStop)
+            {
+                std::wstring sName =
+                    L"!Churn" + std::to_wstring(cChurns % 64);
+
+                AddBang(manager, sName.c_str());
+                manager.RemoveBangCommand(sName.c_str());
+
+                if (cChurns % 16 == 0)
+                {
+                    manager.EnumBangs(SlowEnumProc, 0);
+                }
+
+                ++cChurns;
+            }
+
+            *pcChurns = cChurns;
+        });
+    }
+
+    while (cReady < cWorkers)
+    {
+        std::this_thread::yield();
+    }
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    bStart = true;
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    double dMicroseconds = std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - start).count();
+
+    bStop = true;
+
+    if (churn.joinable())
+    {
+        churn.join();
+    }
+
+    CHECK(cExecuted == cWorkers * cCalls);
+
+    for (int nWorker = 0; nWorker < cWorkers; ++nWorker)
+    {
+        for (int nBang = 0; nBang < BANGS_PER_WORKER; ++nBang)
+        {
+            std::wstring sName = L"!Worker" + std::to_wstring(nWorker) +
+                L"_" + std::to_wstring(nBang);
+            manager.RemoveBangCommand(sName.c_str());
+        }
+    }
+
+    return (double)cExecuted / dMicroseconds;
+}
+
+
+//
+// Fill
+//
+template <class Manager>
+static void Fill(Manager& manager)
+{
+    for (int nBang = 0; nBang < FILLER_BANGS; ++nBang)
+    {
+        std::wstring sName = L"!Filler" + std::to_wstring(nBang);
+        AddBang(manager, sName.c_str());
+    }
+}
+
+
+int main()
+{
+    const long cCalls = 200000;
+    const int aWorkers[] = { 1, 2, 4, 8 };
+
+    BangManager* pLockFree = new BangManager;
+    LockedBangManager* pLocked = new LockedBangManager;
+
+    Fill(*pLockFree);
+    Fill(*pLocked);
+
+    for (bool bChurn : { false, true })
+    {
+        for (int cWorkers : aWorkers)
+        {
+            long cLockFreeChurns = 0;
+            long cLockedChurns = 0;
+
+            double dLockFree =
+                Run(*pLockFree, cWorkers, cCalls, bChurn, &cLockFreeChurns);
+            double dLocked =
+                Run(*pLocked, cWorkers, cCalls, bChurn, &cLockedChurns);
+
+            printf("%d workers%s: lock-free %6.2f calls/us, locked %6.2f "
+                "calls/us", cWorkers, bChurn ? " + churn" : "",
+                dLockFree, dLocked);
+
+            if (bChurn)
+            {
+                printf(" (churn %ld / %ld)", cLockFreeChurns, cLockedChurns);
+            }
+
+            printf("\n");
+        }
+    }
+
+    delete pLockFree;
+    delete pLocked;
+
+    return TestResult();
+}
@@ -0,0 +1,317 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "../lsapi/lsapi.h"
+#include "../lsapi/BangQueue.h"
+#include "../lsapi/ThreadWindow.h"
+#include "../utility/base.h"
+#include "testing.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+//
+// Benchmark for cross-thread bang commands. Sends bursts of bang commands
+// to a thread that owns a ThreadWindow, the way a module thread does, and
+// measures how long a burst takes to run and the round trip of a single
+// bang command. Compares the BangQueue with the ThreadedBangCommand thread
+// messages Bang::Execute used to post.
+//
+// Links lsapi.dll's object files, since BangQueue and ThreadWindow aren't
+// exported.
+//
+
+
+/** Arguments of every bang command sent */
+#define BURST_ARGS L"\"some argument\" 42"
+
+/** Round trips to average for the latency */
+#define ROUND_TRIPS 2000
+
+
+/** Number of times !Burst ran */
+static std::atomic<long> g_cExecuted(0);
+
+
+//
+// ThreadedBangCommand
+//
+// The baseline: a copy of the command, posted as a thread message, as
+// Bang::Execute did before BangQueue.
+//
+class ThreadedBangCommand : public CountedBase
+{
+public:
+    ThreadedBangCommand(HWND hCaller, LPCWSTR pwzName, LPCWSTR pwzParams)
+    :m_hCaller(hCaller)
+    {
+        StringCchCopyW(m_wzName, MAX_BANGCOMMAND, pwzName);
+        StringCchCopyW(m_wzParams, MAX_BANGARGS, pwzParams);
+    }
+
+    void Execute()
+    {
+        InternalExecuteBangCommand(m_hCaller, m_wzName, m_wzParams);
+    }
+
+private:
+    wchar_t m_wzName[MAX_BANGCOMMAND];
+    wchar_t m_wzParams[MAX_BANGARGS];
+    HWND m_hCaller;
+};
+
+
+//
+// BurstBang
+//
+static void BurstBang(HWND, LPCWSTR)
+{
+    ++g_cExecuted;
+}
+
+
+//
+// TargetThread
+//
+// Owns !Burst and runs a message loop like Module::ThreadProc, which
+// handled ThreadedBangCommand messages itself before BangQueue. Sets
+// *pdwThreadID once it is ready.
+//
+static void TargetThread(std::atomic<DWORD>* pdwThreadID)
+{
+    MSG msg;
+
+    // Create the message queue before anything is posted to it
+    PeekMessageW(&msg, nullptr, WM_USER, WM_USER, PM_NOREMOVE);
+
+    CHECK(ThreadWindow::Attach());
+    CHECK(AddBangCommandW(L"!Burst", BurstBang));
+
+    *pdwThreadID = GetCurrentThreadId();
+
+    while (GetMessageW(&msg, nullptr, 0, 0) > 0)
+    {
+        if (msg.hwnd == nullptr && msg.message == LM_THREAD_BANGCOMMAND)
+        {
+            ThreadedBangCommand* pInfo = (ThreadedBangCommand*)msg.wParam;
+
+            if (pInfo != nullptr)
+            {
+                pInfo->Execute();
+                pInfo->Release();
+            }
+        }
+        else
+        {
+            DispatchMessageW(&msg);
+        }
+    }
+
+    RemoveBangCommandW(L"!Burst");
+    ThreadWindow::Detach();
+}
+
+
+//
+// PostThreaded
+//
+// Returns false if the message was dropped, as the old code silently did.
+//
+static bool PostThreaded(DWORD dwThreadID)
+{
+    ThreadedBangCommand* pInfo =
+        new ThreadedBangCommand(nullptr, L"!Burst", BURST_ARGS);
+
+    if (!PostThreadMessageW(dwThreadID, LM_THREAD_BANGCOMMAND,
+        (WPARAM)pInfo, 0))
+    {
+        pInfo->Release();
+        return false;
+    }
+
+    return true;
+}
+
+
+//
+// PostQueued
+//
+// What Bang::Execute does now.
+//
+static bool PostQueued(BangQueue* pQueue)
+{
+    return pQueue->Post(nullptr, L"!Burst", BURST_ARGS);
+}
+
+
+//
+// WaitForExecuted
+//
+static void WaitForExecuted(long cExpected)
+{
+    while (g_cExecuted < cExpected)
+    {
+        std::this_thread::yield();
+    }
+}
+
+
+//
+// Burst
+//
+// Sends cBangs bang commands in a row and waits for them to run. Returns
+// the time that took in microseconds, and how many were dropped.
+//
+template <typename PostFn>
+static double Burst(PostFn post, long cBangs, long* pcDropped)
+{
+    g_cExecuted = 0;
+    *pcDropped = 0;
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    for (long lBang = 0; lBang < cBangs; ++lBang)
+    {
+        if (!post())
+        {
+            ++*pcDropped;
+        }
+    }
+
+    WaitForExecuted(cBangs - *pcDropped);
+
+    return std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+
+//
+// RoundTrip
+//
+// Sends one bang command at a time and waits for it to run. Returns the
+// average round trip in microseconds.
+//
+template <typename PostFn>
+static double RoundTrip(PostFn post)
+{
+    g_cExecuted = 0;
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    for (long lTrip = 1; lTrip <= ROUND_TRIPS; ++lTrip)
+    {
+        CHECK(post());
+        WaitForExecuted(lTrip);
+    }
+
+    return std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - start).count() / ROUND_TRIPS;
+}
+
+
+//
+// Initialize
+//
+// Initializes the LSAPI with an empty step.rc.
+//
+static bool Initialize()
+{
+    wchar_t wzPath[MAX_PATH];
+    wchar_t wzRcPath[MAX_PATH];
+
+    if (!GetTempPathW(MAX_PATH, wzPath) ||
+        FAILED(StringCchPrintfW(wzRcPath, MAX_PATH,
+            L"%lsBangQueueBenchmark.rc", wzPath)))
+    {
+        return false;
+    }
+
+    HANDLE hFile = CreateFileW(wzRcPath, GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    CloseHandle(hFile);
+
+    BOOL bInitialized = LSAPIInitialize(wzPath, wzRcPath);
+    DeleteFileW(wzRcPath);
+
+    return bInitialized != FALSE;
+}
+
+
+int main()
+{
+    if (!Initialize())
+    {
+        printf("Could not initialize the LSAPI\n");
+        return 1;
+    }
+
+    std::atomic<DWORD> dwReady(0);
+    std::thread target(TargetThread, &dwReady);
+
+    while (dwReady == 0)
+    {
+        std::this_thread::yield();
+    }
+
+    DWORD dwTarget = dwReady;
+    BangQueue* pQueue = BangQueue::ForThread(dwTarget);
+
+    auto postThreaded = [dwTarget] { return PostThreaded(dwTarget); };
+    auto postQueued = [pQueue] { return PostQueued(pQueue); };
+
+    // The thread message queue holds 10000 messages by default
+    const long acBangs[] = { 10, 100, 1000, 10000, 50000 };
+
+    for (long cBangs : acBangs)
+    {
+        long cThreadedDropped = 0;
+        long cQueuedDropped = 0;
+
+        double dThreaded = Burst(postThreaded, cBangs, &cThreadedDropped);
+        double dQueued = Burst(postQueued, cBangs, &cQueuedDropped);
+
+        CHECK(cQueuedDropped == 0);
+
+        printf("burst of %5ld: thread messages %9.0f us (%ld dropped), "
+            "queue %9.0f us\n", cBangs, dThreaded, cThreadedDropped, dQueued);
+    }
+
+    double dThreaded = RoundTrip(postThreaded);
+    double dQueued = RoundTrip(postQueued);
+
+    printf("round trip: thread messages %.2f us, queue %.2f us\n",
+        dThreaded, dQueued);
+
+    pQueue->Release();
+
+    PostThreadMessageW(dwTarget, WM_QUIT, 0, 0);
+    target.join();
+
+    return TestResult();
+}
@@ -0,0 +1,186 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "../lsapi/BangRequest.h"
+#include "testing.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+//
+// Checks the states of an asynchronous bang command request: starting,
+// cancelling, completing, and waiting on the thread that executes it.
+//
+
+
+/** Set by SlowCallback once it is done */
+static std::atomic<bool> g_bCallbackDone(false);
+
+
+//
+// SlowCallback
+//
+// Takes a while, and checks that nobody can see the request done yet.
+//
+static void CALLBACK SlowCallback(LPVOID pBang, BOOL bResult, LPARAM lParam)
+{
+    BangRequest* pRequest = (BangRequest*)pBang;
+
+    CHECK(bResult == TRUE);
+    CHECK(lParam == 42);
+    CHECK(pRequest->GetResult(nullptr) == E_PENDING);
+    CHECK(pRequest->Wait(0) == WAIT_TIMEOUT);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    g_bCallbackDone = true;
+}
+
+
+//
+// TestComplete
+//
+// A thread that polls the result only sees it once the callback has run.
+//
+static void TestComplete()
+{
+    BangRequest* pRequest = new BangRequest(SlowCallback, 42);
+    g_bCallbackDone = false;
+
+    std::thread poller([pRequest]
+    {
+        BOOL bResult = FALSE;
+
+        while (pRequest->GetResult(&bResult) == E_PENDING)
+        {
+            std::this_thread::yield();
+        }
+
+        CHECK(g_bCallbackDone);
+        CHECK(bResult == TRUE);
+    });
+
+    std::thread waiter([pRequest]
+    {
+        CHECK(pRequest->Wait(INFINITE) == WAIT_OBJECT_0);
+        CHECK(g_bCallbackDone);
+    });
+
+    CHECK(pRequest->Start());
+    pRequest->Complete(TRUE);
+
+    poller.join();
+    waiter.join();
+
+    // Done requests can't be started or cancelled anymore
+    CHECK(!pRequest->Start());
+    CHECK(!pRequest->Cancel());
+
+    pRequest->Release();
+}
+
+
+//
+// TestCancel
+//
+// Only pending requests can be cancelled, and cancelled ones never start.
+//
+static void TestCancel()
+{
+    BangRequest* pRequest = new BangRequest(nullptr, 0);
+
+    CHECK(pRequest->GetResult(nullptr) == E_PENDING);
+    CHECK(pRequest->Cancel());
+    CHECK(!pRequest->Cancel());
+    CHECK(!pRequest->Start());
+    CHECK(pRequest->GetResult(nullptr) == E_ABORT);
+    CHECK(pRequest->Wait(INFINITE) == WAIT_OBJECT_0);
+
+    pRequest->Release();
+
+    pRequest = new BangRequest(nullptr, 0);
+
+    CHECK(pRequest->Start());
+    CHECK(!pRequest->Cancel());
+
+    pRequest->Complete(FALSE);
+
+    BOOL bResult = TRUE;
+    CHECK(pRequest->GetResult(&bResult) == S_OK);
+    CHECK(bResult == FALSE);
+
+    pRequest->Release();
+}
+
+
+//
+// TestWaitOnOwningThread
+//
+// Waiting on the thread that is supposed to execute the request fails
+// instead of deadlocking, unless the request is done already.
+//
+static void TestWaitOnOwningThread()
+{
+    BangRequest* pRequest = new BangRequest(nullptr, 0);
+    pRequest->SetThread(GetCurrentThreadId());
+
+    // Pending, and not in this thread's queue
+    SetLastError(ERROR_SUCCESS);
+    CHECK(pRequest->Wait(INFINITE) == WAIT_FAILED);
+    CHECK(GetLastError() == ERROR_POSSIBLE_DEADLOCK);
+    CHECK(pRequest->Wait(0) == WAIT_TIMEOUT);
+
+    // Running, i.e. waiting for itself
+    CHECK(pRequest->Start());
+    SetLastError(ERROR_SUCCESS);
+    CHECK(pRequest->Wait(100) == WAIT_FAILED);
+    CHECK(GetLastError() == ERROR_POSSIBLE_DEADLOCK);
+
+    pRequest->Complete(TRUE);
+    CHECK(pRequest->Wait(INFINITE) == WAIT_OBJECT_0);
+
+    pRequest->Release();
+
+    // Other threads just wait
+    pRequest = new BangRequest(nullptr, 0);
+    pRequest->SetThread(GetCurrentThreadId());
+
+    std::thread waiter([pRequest]
+    {
+        CHECK(pRequest->Wait(INFINITE) == WAIT_OBJECT_0);
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(pRequest->Start());
+    pRequest->Complete(TRUE);
+
+    waiter.join();
+    pRequest->Release();
+}
+
+
+int main()
+{
+    TestComplete();
+    TestCancel();
+    TestWaitOnOwningThread();
+
+    return TestResult();
+}
@@ -0,0 +1,312 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "../lsapi/lsapi.h"
+#include "../lsapi/CommandCache.h"
+#include "../lsapi/SettingsManager.h"
+#include "testing.h"
+#include <atomic>
+#include <string>
+#include <thread>
+
+//
+// Tests for the compiled command cache used by LSExecute. Checks that
+// compiled commands go out of date when the settings generation changes
+// and when bang commands are added or removed, and that command lines
+// whose expansion depends on more than the settings are never cached.
+//
+// The cache needs an initialized LSAPI, so this links lsapi.dll's object
+// files rather than the DLL, and initializes it with a step.rc in the temp
+// directory.
+//
+
+
+/** Arguments the last call to a test bang command got */
+static std::wstring g_sLastArgs;
+
+/** Number of times OtherBang ran */
+static int g_cOtherCalls = 0;
+
+/** Tells CloseErrors to stop */
+static std::atomic<bool> g_bDone(false);
+
+
+//
+// CacheBang
+//
+static void CacheBang(HWND, LPCWSTR pwzArgs)
+{
+    g_sLastArgs = pwzArgs;
+}
+
+
+//
+// OtherBang
+//
+static void OtherBang(HWND, LPCWSTR pwzArgs)
+{
+    g_sLastArgs = pwzArgs;
+    ++g_cOtherCalls;
+}
+
+
+//
+// CloseErrors
+//
+// Undefined variables are evaluated as math, which shows an error message
+// box. Closes those until the test is done.
+//
+static void CloseErrors()
+{
+    while (!g_bDone)
+    {
+        HWND hBox = FindWindowW(L"#32770", L"LiteStep");
+
+        if (hBox != nullptr)
+        {
+            PostMessageW(hBox, WM_COMMAND, IDOK, 0);
+        }
+
+        Sleep(10);
+    }
+}
+
+
+//
+// Initialize
+//
+// Initializes the LSAPI with a step.rc that defines CacheColor.
+//
+static bool Initialize()
+{
+    wchar_t wzPath[MAX_PATH];
+    wchar_t wzRcPath[MAX_PATH];
+
+    if (!GetTempPathW(MAX_PATH, wzPath) ||
+        FAILED(StringCchPrintfW(wzRcPath, MAX_PATH,
+            L"%lsCommandCacheTest.rc", wzPath)))
+    {
+        return false;
+    }
+
+    HANDLE hFile = CreateFileW(wzRcPath, GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    const char szSettings[] = "CacheColor red\r\n";
+    DWORD cbWritten = 0;
+    WriteFile(hFile, szSettings, sizeof(szSettings) - 1, &cbWritten, nullptr);
+    CloseHandle(hFile);
+
+    BOOL bInitialized = LSAPIInitialize(wzPath, wzRcPath);
+    DeleteFileW(wzRcPath);
+
+    return bInitialized && AddBangCommandW(L"!CacheTest", CacheBang);
+}
+
+
+//
+// TestSettingsGeneration
+//
+// Compiled commands are shared until the settings change.
+//
+static void TestSettingsGeneration()
+{
+    CompiledCommand* pFirst =
+        CompiledCommand::FromCache(L"!CacheTest $CacheColor$");
+
+    CHECK(pFirst != nullptr);
+    CHECK(pFirst->IsBangCommand());
+    CHECK(wcscmp(pFirst->GetCommand(), L"!CacheTest") == 0);
+    CHECK(wcscmp(pFirst->GetArgs(), L"red") == 0);
+    CHECK(pFirst->IsCurrent());
+
+    CompiledCommand* pSecond =
+        CompiledCommand::FromCache(L"!CacheTest $CacheColor$");
+
+    CHECK(pSecond == pFirst);
+    pSecond->Release();
+
+    SettingsManager::NewGeneration();
+    CHECK(!pFirst->IsCurrent());
+
+    pSecond = CompiledCommand::FromCache(L"!CacheTest $CacheColor$");
+    CHECK(pSecond != pFirst);
+    CHECK(pSecond->IsCurrent());
+    pFirst->Release();
+
+    // LSSetVariable starts a new generation too
+    LSSetVariableW(L"CacheColor", L"blue");
+    CHECK(!pSecond->IsCurrent());
+    pSecond->Release();
+
+    pFirst = CompiledCommand::FromCache(L"!CacheTest $CacheColor$");
+    CHECK(wcscmp(pFirst->GetArgs(), L"blue") == 0);
+    CHECK(pFirst->Execute(nullptr));
+    CHECK(g_sLastArgs == L"blue");
+    pFirst->Release();
+
+    // Other command lines are cached the same way
+    pFirst = CompiledCommand::FromCache(L"$CacheColor$.exe --flag");
+    CHECK(!pFirst->IsBangCommand());
+    CHECK(wcscmp(pFirst->GetCommand(), L"blue.exe") == 0);
+    CHECK(wcscmp(pFirst->GetArgs(), L"--flag") == 0);
+    CHECK(pFirst->IsCurrent());
+
+    pSecond = CompiledCommand::FromCache(L"$CacheColor$.exe --flag");
+    CHECK(pSecond == pFirst);
+    pSecond->Release();
+    pFirst->Release();
+}
+
+
+//
+// TestBangEpoch
+//
+// Adding or removing any bang command makes compiled bang commands out of
+// date, and executing an out of date one looks the bang command up again.
+//
+static void TestBangEpoch()
+{
+    CompiledCommand* pCommand = CompiledCommand::FromCache(L"!CacheTest x");
+    CHECK(pCommand->IsCurrent());
+
+    CHECK(AddBangCommandW(L"!CacheOther", OtherBang));
+    CHECK(!pCommand->IsCurrent());
+    pCommand->Release();
+
+    pCommand = CompiledCommand::FromCache(L"!CacheTest x");
+    CHECK(pCommand->IsCurrent());
+
+    CHECK(RemoveBangCommandW(L"!CacheOther"));
+    CHECK(!pCommand->IsCurrent());
+
+    // Replace !CacheTest, the old compiled command must run the new one
+    CHECK(RemoveBangCommandW(L"!CacheTest"));
+    CHECK(AddBangCommandW(L"!CacheTest", OtherBang));
+
+    g_cOtherCalls = 0;
+    CHECK(pCommand->Execute(nullptr));
+    CHECK(g_cOtherCalls == 1);
+    CHECK(g_sLastArgs == L"x");
+    pCommand->Release();
+
+    // And a removed one must not run at all
+    CHECK(RemoveBangCommandW(L"!CacheTest"));
+    CHECK(LSExecuteW(nullptr, L"!CacheTest x", SW_SHOWNORMAL) == HINSTANCE(32));
+    CHECK(g_cOtherCalls == 1);
+
+    CHECK(AddBangCommandW(L"!CacheTest", CacheBang));
+}
+
+
+//
+// CheckUncached
+//
+// Compiles a command line twice, and checks that it wasn't cached and
+// that its arguments are as expected.
+//
+static void CheckUncached(LPCWSTR pwzCommandLine, LPCWSTR pwzArgs)
+{
+    CompiledCommand* pFirst = CompiledCommand::FromCache(pwzCommandLine);
+    CompiledCommand* pSecond = CompiledCommand::FromCache(pwzCommandLine);
+
+    CHECK(pFirst != nullptr && pSecond != nullptr);
+    CHECK(pFirst != pSecond);
+    CHECK(!pFirst->IsCurrent());
+    CHECK(!pSecond->IsCurrent());
+    CHECK(wcscmp(pSecond->GetArgs(), pwzArgs) == 0);
+
+    pFirst->Release();
+    pSecond->Release();
+}
+
+
+//
+// TestUnstableExpansions
+//
+// Environment variables, math and undefined variables can change without
+// the settings generation changing, so they are expanded every time.
+//
+static void TestUnstableExpansions()
+{
+    SetEnvironmentVariableW(L"CacheEnvironment", L"one");
+    CheckUncached(L"!CacheTest $CacheEnvironment$", L"one");
+
+    SetEnvironmentVariableW(L"CacheEnvironment", L"two");
+    CheckUncached(L"!CacheTest $CacheEnvironment$", L"two");
+
+    // Through a variable that is defined in the settings
+    LSSetVariableW(L"CacheIndirect", L"$CacheEnvironment$");
+    CheckUncached(L"!CacheTest $CacheIndirect$", L"two");
+
+    // Only the arguments depend on something else
+    CheckUncached(L"!CacheTest $CacheColor$-$CacheEnvironment$", L"blue-two");
+
+    CheckUncached(L"!CacheTest $1+2$", L"3");
+
+    // Shows an error for each expansion, see CloseErrors
+    CheckUncached(L"!CacheTest $CacheUndefined$", L"");
+
+    // Once it is defined, it is part of the settings
+    LSSetVariableW(L"CacheUndefined", L"defined");
+    CompiledCommand* pCommand =
+        CompiledCommand::FromCache(L"!CacheTest $CacheUndefined$");
+    CHECK(pCommand->IsCurrent());
+    CHECK(wcscmp(pCommand->GetArgs(), L"defined") == 0);
+    pCommand->Release();
+
+    // Not just for bang commands
+    SetEnvironmentVariableW(L"CacheEnvironment", L"three");
+    pCommand = CompiledCommand::FromCache(L"$CacheEnvironment$.exe");
+    CHECK(!pCommand->IsCurrent());
+    CHECK(wcscmp(pCommand->GetCommand(), L"three.exe") == 0);
+    pCommand->Release();
+}
+
+
+int main()
+{
+    CHECK(CompiledCommand::FromCache(L"!CacheTest") == nullptr);
+
+    if (!Initialize())
+    {
+        printf("Could not initialize the LSAPI\n");
+        return 1;
+    }
+
+    CHECK(CompiledCommand::FromCache(nullptr) == nullptr);
+
+    std::thread closer(CloseErrors);
+
+    TestSettingsGeneration();
+    TestBangEpoch();
+    TestUnstableExpansions();
+
+    g_bDone = true;
+    closer.join();
+
+    return TestResult();
+}
@@ -0,0 +1,204 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "../lsapi/lsapi.h"
+#include "../lsapi/CommandCache.h"
+#include "../lsapi/SettingsManager.h"
+#include "testing.h"
+#include <string>
+
+//
+// Tests for the expansion of bang command arguments. Checks that arguments
+// without variable references are passed on without being expanded, and
+// that cached expansions are dropped when the settings generation changes.
+//
+// Like CommandCacheTest, this links lsapi.dll's object files and
+// initializes an LSAPI of its own.
+//
+
+
+/** Arguments the last call to !ExpandTest got, and where they were */
+static std::wstring g_sLastArgs;
+static LPCWSTR g_pwzLastArgs = nullptr;
+
+
+//
+// ExpandBang
+//
+static void ExpandBang(HWND, LPCWSTR pwzArgs)
+{
+    g_sLastArgs = pwzArgs;
+    g_pwzLastArgs = pwzArgs;
+}
+
+
+//
+// Initialize
+//
+// Initializes the LSAPI with a step.rc that defines ExpandColor.
+//
+static bool Initialize()
+{
+    wchar_t wzPath[MAX_PATH];
+    wchar_t wzRcPath[MAX_PATH];
+
+    if (!GetTempPathW(MAX_PATH, wzPath) ||
+        FAILED(StringCchPrintfW(wzRcPath, MAX_PATH,
+            L"%lsExpandedStringTest.rc", wzPath)))
+    {
+        return false;
+    }
+
+    HANDLE hFile = CreateFileW(wzRcPath, GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    const char szSettings[] = "ExpandColor red\r\n";
+    DWORD cbWritten = 0;
+    WriteFile(hFile, szSettings, sizeof(szSettings) - 1, &cbWritten, nullptr);
+    CloseHandle(hFile);
+
+    BOOL bInitialized = LSAPIInitialize(wzPath, wzRcPath);
+    DeleteFileW(wzRcPath);
+
+    return bInitialized && AddBangCommandW(L"!ExpandTest", ExpandBang);
+}
+
+
+//
+// TestNeedsExpansion
+//
+static void TestNeedsExpansion()
+{
+    CHECK(!ExpandedString::NeedsExpansion(nullptr));
+    CHECK(!ExpandedString::NeedsExpansion(L""));
+    CHECK(!ExpandedString::NeedsExpansion(L"C:\\Program Files\\app.exe"));
+    CHECK(!ExpandedString::NeedsExpansion(L"[!About][!Recycle]"));
+    CHECK(ExpandedString::NeedsExpansion(L"$ExpandColor$"));
+    CHECK(ExpandedString::NeedsExpansion(L"costs 5$"));
+    CHECK(ExpandedString::NeedsExpansion(L"$$"));
+}
+
+
+//
+// TestSkipExpansion
+//
+// Arguments without a '$' reach the bang command as they are, not even
+// copied.
+//
+static void TestSkipExpansion()
+{
+    LPCWSTR pwzArgs = L"C:\\Program Files\\app.exe -flag";
+
+    CHECK(ParseBangCommandW(nullptr, L"!ExpandTest", pwzArgs));
+    CHECK(g_pwzLastArgs == pwzArgs);
+
+    // Expanding would cut these off at MAX_LINE_LENGTH
+    std::wstring sLong(MAX_LINE_LENGTH + 100, L'x');
+
+    CHECK(ParseBangCommandW(nullptr, L"!ExpandTest", sLong.c_str()));
+    CHECK(g_pwzLastArgs == sLong.c_str());
+    CHECK(g_sLastArgs.length() == sLong.length());
+
+    CHECK(ParseBangCommandW(nullptr, L"!ExpandTest", nullptr));
+    CHECK(g_sLastArgs.empty());
+
+    // Anything else is expanded
+    CHECK(ParseBangCommandW(nullptr, L"!ExpandTest", L"$ExpandColor$ $$"));
+    CHECK(g_sLastArgs == L"red $");
+}
+
+
+//
+// TestGeneration
+//
+// Expansions that only depend on the settings are shared until the
+// settings generation changes.
+//
+static void TestGeneration()
+{
+    ExpandedString* pFirst = ExpandedString::FromCache(L"is $ExpandColor$");
+
+    CHECK(pFirst != nullptr);
+    CHECK(wcscmp(pFirst->GetString(), L"is red") == 0);
+    CHECK(pFirst->IsCurrent());
+
+    ExpandedString* pSecond = ExpandedString::FromCache(L"is $ExpandColor$");
+    CHECK(pSecond == pFirst);
+    pSecond->Release();
+
+    SettingsManager::NewGeneration();
+    CHECK(!pFirst->IsCurrent());
+
+    pSecond = ExpandedString::FromCache(L"is $ExpandColor$");
+    CHECK(pSecond != pFirst);
+    CHECK(pSecond->IsCurrent());
+    pSecond->Release();
+    pFirst->Release();
+
+    // A changed variable is picked up by the next call
+    LSSetVariableW(L"ExpandColor", L"green");
+
+    pFirst = ExpandedString::FromCache(L"is $ExpandColor$");
+    CHECK(wcscmp(pFirst->GetString(), L"is green") == 0);
+    pFirst->Release();
+
+    CHECK(ParseBangCommandW(nullptr, L"!ExpandTest", L"is $ExpandColor$"));
+    CHECK(g_sLastArgs == L"is green");
+
+    // Environment variables can change at any time
+    SetEnvironmentVariableW(L"ExpandEnvironment", L"one");
+
+    pFirst = ExpandedString::FromCache(L"$ExpandEnvironment$");
+    pSecond = ExpandedString::FromCache(L"$ExpandEnvironment$");
+    CHECK(pFirst != pSecond);
+    CHECK(!pFirst->IsCurrent());
+    pSecond->Release();
+    pFirst->Release();
+
+    SetEnvironmentVariableW(L"ExpandEnvironment", L"two");
+    CHECK(ParseBangCommandW(nullptr, L"!ExpandTest", L"$ExpandEnvironment$"));
+    CHECK(g_sLastArgs == L"two");
+}
+
+
+int main()
+{
+    CHECK(ExpandedString::FromCache(L"$ExpandColor$") == nullptr);
+
+    if (!Initialize())
+    {
+        printf("Could not initialize the LSAPI\n");
+        return 1;
+    }
+
+    CHECK(ExpandedString::FromCache(nullptr) == nullptr);
+
+    TestNeedsExpansion();
+    TestSkipExpansion();
+    TestGeneration();
+
+    return TestResult();
+}
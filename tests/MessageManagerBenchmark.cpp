@@ -0,0 +1,190 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "../litestep/MessageManager.h"
+#include "../litestep/MessageTracer.h"
+#include "testing.h"
+#include <chrono>
+
+//
+// Overhead of the message tracer on MessageManager::SendMessage. Sends a
+// message to fake windows without a tracer, with a tracer that is off, and
+// with one that is on, and reports the cost per delivery and how much
+// tracing adds relative to no tracer at all.
+//
+// The fake windows either return right away, which shows the raw cost of
+// tracing, or spend about as long as a typical module's window procedure.
+//
+
+
+/** Windows registered for the message */
+#define WINDOWS 8
+
+/** Messages sent per measurement */
+#define SENDS 20000
+
+/** Measurements per configuration, the fastest one counts */
+#define RUNS 7
+
+// Carries plain values
+static const UINT VALUE_MESSAGE = LM_REDRAW;
+
+
+//
+// FakeTransport
+//
+// Delivers to made-up windows, each taking m_cWork loop iterations to
+// handle a message.
+//
+class FakeTransport : public IMessageTransport
+{
+public:
+    FakeTransport()
+        : m_cWork(0)
+    {
+        // do nothing
+    }
+
+    SendResult Send(HWND, UINT, WPARAM, LPARAM, UINT,
+        LRESULT* plResult) override
+    {
+        volatile long lSum = 0;
+
+        for (long lIteration = 0; lIteration < m_cWork; ++lIteration)
+        {
+            lSum += lIteration;
+        }
+
+        *plResult = 1;
+        return SEND_OK;
+    }
+
+    BOOL Post(HWND, UINT, WPARAM, LPARAM) override
+    {
+        return TRUE;
+    }
+
+    BOOL IsAlive(HWND) override
+    {
+        return TRUE;
+    }
+
+    HINSTANCE GetInstance(HWND hWnd) override
+    {
+        return (HINSTANCE)((UINT_PTR)hWnd * 0x10000);
+    }
+
+    DWORD GetTime() override
+    {
+        return 0;
+    }
+
+    long m_cWork;
+};
+
+
+//
+// Measure
+//
+// Sends SENDS messages. Keeps the time per delivery in nanoseconds in
+// *pdBest if it is the fastest so far.
+//
+static void Measure(MessageManager& manager, double* pdBest)
+{
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    for (int nSend = 0; nSend < SENDS; ++nSend)
+    {
+        manager.SendMessage(VALUE_MESSAGE, nSend, 0);
+    }
+
+    double dNanoseconds = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count() /
+        (SENDS * WINDOWS);
+
+    if (*pdBest == 0 || dNanoseconds < *pdBest)
+    {
+        *pdBest = dNanoseconds;
+    }
+}
+
+
+int main()
+{
+    wchar_t wzPath[MAX_PATH];
+    wchar_t wzTracePath[MAX_PATH];
+
+    if (!GetTempPathW(MAX_PATH, wzPath) ||
+        FAILED(StringCchPrintfW(wzTracePath, MAX_PATH,
+            L"%lsMessageManagerBenchmark.json", wzPath)))
+    {
+        printf("Could not get the temp directory\n");
+        return 1;
+    }
+
+    MessageManager manager;
+    FakeTransport* pTransport = new FakeTransport();
+    manager.SetTransport(pTransport);
+
+    for (UINT_PTR uWindow = 1; uWindow <= WINDOWS; ++uWindow)
+    {
+        manager.AddMessage((HWND)uWindow, VALUE_MESSAGE);
+    }
+
+    // Returning right away, and something like a real window procedure
+    const long acWork[] = { 0, 2000 };
+
+    for (long cWork : acWork)
+    {
+        pTransport->m_cWork = cWork;
+
+        MessageTracer tracer;
+        double dNone = 0;
+        double dOff = 0;
+        double dOn = 0;
+
+        // Taking turns evens out whatever else the machine is doing
+        for (int nRun = 0; nRun < RUNS; ++nRun)
+        {
+            manager.SetTracer(nullptr);
+            Measure(manager, &dNone);
+
+            manager.SetTracer(&tracer);
+            Measure(manager, &dOff);
+
+            tracer.Start(wzTracePath);
+            Measure(manager, &dOn);
+            tracer.Stop();
+        }
+
+        manager.SetTracer(nullptr);
+
+        printf("%ld iterations: %.1f ns/delivery without a tracer, tracer off "
+            "%+.1f%%, tracer on %+.1f%% (%.1f ns)\n", cWork, dNone,
+            (dOff - dNone) * 100 / dNone, (dOn - dNone) * 100 / dNone,
+            dOn - dNone);
+    }
+
+    DeleteFileW(wzTracePath);
+
+    return TestResult();
+}
@@ -0,0 +1,268 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "../litestep/MessageManager.h"
+#include "testing.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+//
+// Registers, unregisters and broadcasts messages from several threads at
+// once. Broadcasts run without holding a lock, so handlers that change the
+// registrations and windows that disappear mid-broadcast are thrown in too.
+//
+
+static const UINT FIRST_MESSAGE = WM_USER + 1000;
+static const UINT MESSAGE_COUNT = 8;
+static const UINT WINDOW_COUNT = 64;
+static const UINT WRITER_THREADS = 4;
+static const UINT BROADCAST_THREADS = 4;
+static const int RUN_SECONDS = 3;
+
+
+//
+// MakeWindow
+//
+// Made-up window handle. Windows whose number is a multiple of 13 don't
+// exist.
+//
+static HWND MakeWindow(UINT uNumber)
+{
+    return (HWND)(UINT_PTR)uNumber;
+}
+
+
+static bool IsDeadWindow(HWND hWnd)
+{
+    return ((UINT_PTR)hWnd % 13) == 0;
+}
+
+
+//
+// StressTransport
+//
+// Delivers to made-up windows. Window 1 registers itself again from within
+// its handler, like a module that calls back into the message manager.
+//
+class StressTransport : public IMessageTransport
+{
+public:
+    explicit StressTransport(MessageManager& manager)
+        : m_manager(manager)
+        , m_ulDelivered(0)
+    {
+        // do nothing
+    }
+
+    SendResult Send(HWND hWnd, UINT uMsg, WPARAM, LPARAM, UINT,
+        LRESULT* plResult) override
+    {
+        *plResult = 0;
+
+        if (IsDeadWindow(hWnd))
+        {
+            return SEND_FAILED;
+        }
+
+        if (hWnd == MakeWindow(1))
+        {
+            m_manager.RemoveWindow(hWnd);
+            m_manager.AddMessage(hWnd, uMsg);
+        }
+
+        ++m_ulDelivered;
+        *plResult = 1;
+
+        return SEND_OK;
+    }
+
+    BOOL Post(HWND hWnd, UINT, WPARAM, LPARAM) override
+    {
+        if (IsDeadWindow(hWnd))
+        {
+            return FALSE;
+        }
+
+        ++m_ulDelivered;
+        return TRUE;
+    }
+
+    BOOL IsAlive(HWND hWnd) override
+    {
+        return IsDeadWindow(hWnd) ? FALSE : TRUE;
+    }
+
+    HINSTANCE GetInstance(HWND hWnd) override
+    {
+        return (HINSTANCE)((UINT_PTR)hWnd * 0x10000);
+    }
+
+    DWORD GetTime() override
+    {
+        return 0;
+    }
+
+    ULONG GetDelivered() const
+    {
+        return m_ulDelivered;
+    }
+
+private:
+    MessageManager& m_manager;
+    std::atomic<ULONG> m_ulDelivered;
+};
+
+
+//
+// RunWriter
+//
+// Adds and removes registrations at random until told to stop.
+//
+static void RunWriter(MessageManager& manager, UINT uSeed,
+    const std::atomic<bool>& bStop)
+{
+    UINT uRandom = uSeed;
+
+    while (!bStop)
+    {
+        uRandom = uRandom * 1103515245 + 12345;
+
+        HWND hWnd = MakeWindow(1 + (uRandom >> 8) % WINDOW_COUNT);
+        UINT uMsg = FIRST_MESSAGE + (uRandom >> 16) % MESSAGE_COUNT;
+
+        switch (uRandom & 3)
+        {
+        case 0:
+            manager.AddMessage(hWnd, uMsg);
+            break;
+
+        case 1:
+            manager.RemoveMessage(hWnd, uMsg);
+            break;
+
+        case 2:
+            {
+                UINT aMessages[] =
+                {
+                    FIRST_MESSAGE, FIRST_MESSAGE + 3, FIRST_MESSAGE + 5, 0
+                };
+
+                manager.AddMessages(hWnd, aMessages);
+            }
+            break;
+
+        default:
+            if ((uRandom & 0x30) == 0)
+            {
+                manager.RemoveWindow(hWnd);
+            }
+            break;
+        }
+    }
+}
+
+
+//
+// RunBroadcaster
+//
+// Sends and posts every message in turn until told to stop.
+//
+static void RunBroadcaster(MessageManager& manager,
+    const std::atomic<bool>& bStop)
+{
+    while (!bStop)
+    {
+        for (UINT uMsg = FIRST_MESSAGE;
+             uMsg < FIRST_MESSAGE + MESSAGE_COUNT; ++uMsg)
+        {
+            manager.SendMessage(uMsg, 0, 0);
+            manager.PostMessage(uMsg, 0, 0);
+            manager.HandlerExists(uMsg);
+        }
+    }
+}
+
+
+int main()
+{
+    MessageManager manager;
+    StressTransport* pTransport = new StressTransport(manager);
+    manager.SetTransport(pTransport);
+
+    std::atomic<bool> bStop(false);
+    std::vector<std::thread> threads;
+
+    for (UINT uThread = 0; uThread < WRITER_THREADS; ++uThread)
+    {
+        threads.emplace_back(RunWriter,
+            std::ref(manager), uThread * 7919 + 1, std::cref(bStop));
+    }
+
+    for (UINT uThread = 0; uThread < BROADCAST_THREADS; ++uThread)
+    {
+        threads.emplace_back(RunBroadcaster,
+            std::ref(manager), std::cref(bStop));
+    }
+
+    // Throws everything away now and then
+    threads.emplace_back([&manager, &bStop]()
+    {
+        while (!bStop)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            manager.ClearMessages();
+        }
+    });
+
+    std::this_thread::sleep_for(std::chrono::seconds(RUN_SECONDS));
+    bStop = true;
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    printf("%lu messages delivered\n", pTransport->GetDelivered());
+    CHECK(pTransport->GetDelivered() > 0);
+
+    for (UINT uWindow = 1; uWindow <= WINDOW_COUNT; ++uWindow)
+    {
+        manager.RemoveWindow(MakeWindow(uWindow));
+    }
+
+    // Nothing may be left behind once every window is gone
+    for (UINT uMsg = FIRST_MESSAGE;
+         uMsg < FIRST_MESSAGE + MESSAGE_COUNT; ++uMsg)
+    {
+        MessageManager::windowSetT setWindows;
+
+        CHECK(!manager.HandlerExists(uMsg));
+        CHECK(!manager.GetWindowsForMessage(uMsg, setWindows));
+    }
+
+    // Registrations still work after all that
+    manager.AddMessage(MakeWindow(2), FIRST_MESSAGE);
+    CHECK(manager.SendMessage(FIRST_MESSAGE, 0, 0) == 1);
+
+    return TestResult();
+}
@@ -0,0 +1,310 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "../litestep/MessageManager.h"
+#include "testing.h"
+#include <set>
+
+//
+// Checks MessageManager's broadcast policies, registrations and delivery
+// counts against a fake transport, so no real windows are involved.
+//
+// The fake transport is what makes a slow recipient testable, but the test
+// still builds against the Win32 headers like the rest of the tree, so it
+// is built and run with MinGW by "make test".
+//
+
+// May carry pointers, never timed out or posted
+static const UINT POINTER_MESSAGE = LM_SYSTRAYW;
+static const UINT OTHER_POINTER_MESSAGE = LM_GETREVIDW;
+
+// Carries plain values
+static const UINT VALUE_MESSAGE = LM_REDRAW;
+
+
+//
+// FakeTransport
+//
+// Delivers to made-up windows. A hung window takes the whole time limit for
+// each message it is sent with one, and time only passes when that happens
+// or when a test moves the clock along.
+//
+class FakeTransport : public IMessageTransport
+{
+public:
+    FakeTransport()
+        : m_dwNow(0)
+        , m_nSends(0)
+        , m_nPosts(0)
+    {
+        // do nothing
+    }
+
+    SendResult Send(HWND hWnd, UINT, WPARAM, LPARAM, UINT uTimeout,
+        LRESULT* plResult) override
+    {
+        ++m_nSends;
+        *plResult = 0;
+
+        if (m_setDead.count(hWnd))
+        {
+            return SEND_FAILED;
+        }
+
+        if (uTimeout != 0 && m_setHung.count(hWnd))
+        {
+            m_dwNow += uTimeout;
+            return SEND_TIMEOUT;
+        }
+
+        *plResult = 1;
+        return SEND_OK;
+    }
+
+    BOOL Post(HWND hWnd, UINT, WPARAM, LPARAM) override
+    {
+        ++m_nPosts;
+        return m_setDead.count(hWnd) ? FALSE : TRUE;
+    }
+
+    BOOL IsAlive(HWND hWnd) override
+    {
+        return m_setDead.count(hWnd) ? FALSE : TRUE;
+    }
+
+    HINSTANCE GetInstance(HWND hWnd) override
+    {
+        return MakeInstance(hWnd);
+    }
+
+    DWORD GetTime() override
+    {
+        return m_dwNow;
+    }
+
+    static HINSTANCE MakeInstance(HWND hWnd)
+    {
+        return (HINSTANCE)((UINT_PTR)hWnd * 0x10000);
+    }
+
+    DWORD m_dwNow;
+    int m_nSends;
+    int m_nPosts;
+    std::set<HWND> m_setHung;
+    std::set<HWND> m_setDead;
+};
+
+
+static int g_nSlowWindows;
+
+
+static BOOL CALLBACK CountSlowWindow(const LSSLOWWINDOW* pInfo, LPARAM)
+{
+    CHECK(pInfo->cbSize == sizeof(LSSLOWWINDOW));
+    ++g_nSlowWindows;
+
+    return TRUE;
+}
+
+
+static int CountSlowWindows(const MessageManager& manager)
+{
+    g_nSlowWindows = 0;
+    manager.EnumSlowWindows(CountSlowWindow, 0);
+
+    return g_nSlowWindows;
+}
+
+
+//
+// TestBroadcastPolicy
+//
+// Time limits, skipping and posting only ever apply to value messages.
+//
+static void TestBroadcastPolicy()
+{
+    MessageManager manager;
+    FakeTransport* pTransport = new FakeTransport();
+    manager.SetTransport(pTransport);
+
+    HWND hHung = (HWND)1;
+    HWND hFine = (HWND)2;
+
+    manager.AddMessage(hHung, POINTER_MESSAGE);
+    manager.AddMessage(hFine, POINTER_MESSAGE);
+    manager.AddMessage(hHung, VALUE_MESSAGE);
+    manager.AddMessage(hFine, VALUE_MESSAGE);
+    pTransport->m_setHung.insert(hHung);
+
+    // No time limit by default
+    manager.SendMessage(POINTER_MESSAGE, 0, 0);
+    CHECK(pTransport->m_nSends == 2 && pTransport->m_dwNow == 0);
+
+    manager.SetBroadcastPolicy(100, MessageManager::SLOW_SKIP, 1000);
+
+    // Pointer messages are still sent without one
+    manager.SendMessage(POINTER_MESSAGE, 0, 0);
+    CHECK(pTransport->m_nSends == 4 && pTransport->m_dwNow == 0);
+
+    // The hung window times out once, then it is skipped
+    manager.SendMessage(VALUE_MESSAGE, 0, 0);
+    CHECK(pTransport->m_nSends == 6 && pTransport->m_dwNow == 100);
+
+    manager.SendMessage(VALUE_MESSAGE, 0, 0);
+    CHECK(pTransport->m_nSends == 7 && pTransport->m_dwNow == 100);
+    CHECK(pTransport->m_nPosts == 0);
+
+    // Value messages are posted to it instead, pointer messages never are
+    manager.SetBroadcastPolicy(100, MessageManager::SLOW_POST, 1000);
+
+    manager.SendMessage(VALUE_MESSAGE, 0, 0);
+    CHECK(pTransport->m_nSends == 8 && pTransport->m_nPosts == 1);
+
+    manager.SendMessage(POINTER_MESSAGE, 0, 0);
+    CHECK(pTransport->m_nSends == 9 && pTransport->m_nPosts == 1);
+
+    CHECK(CountSlowWindows(manager) == 1);
+
+    // Once the retry delay is up the window gets another chance
+    pTransport->m_dwNow += 1000;
+    pTransport->m_setHung.clear();
+
+    manager.SendMessage(VALUE_MESSAGE, 0, 0);
+    CHECK(pTransport->m_nSends == 11);
+    CHECK(CountSlowWindows(manager) == 0);
+}
+
+
+//
+// TestRegistrations
+//
+// Windows can be removed all at once, and dead windows are dropped.
+//
+static void TestRegistrations()
+{
+    MessageManager manager;
+    FakeTransport* pTransport = new FakeTransport();
+    manager.SetTransport(pTransport);
+
+    HWND hFirst = (HWND)1;
+    HWND hSecond = (HWND)2;
+    HWND hThird = (HWND)3;
+    MessageManager::windowSetT setWindows;
+
+    UINT aMessages[] = { 7, 3, 9, 5, 0 };
+    manager.AddMessages(hFirst, aMessages);
+    manager.AddMessages(hSecond, aMessages);
+
+    CHECK(manager.GetWindowsForMessage(3, setWindows));
+    CHECK(setWindows.size() == 2);
+
+    manager.RemoveWindow(hFirst);
+    setWindows.clear();
+    CHECK(manager.GetWindowsForMessage(9, setWindows));
+    CHECK(setWindows.size() == 1 && *setWindows.begin() == hSecond);
+
+    // Removing it again does no harm
+    manager.RemoveWindow(hFirst);
+    manager.AddMessage(hFirst, 5);
+
+    // A window that is gone is dropped from all messages on the first
+    // failed delivery
+    pTransport->m_setDead.insert(hSecond);
+    manager.SendMessage(5, 0, 0);
+
+    setWindows.clear();
+    CHECK(manager.GetWindowsForMessage(5, setWindows));
+    CHECK(setWindows.size() == 1 && *setWindows.begin() == hFirst);
+    CHECK(!manager.HandlerExists(7) && !manager.HandlerExists(3));
+
+    // Same for posting
+    manager.AddMessage(hThird, 7);
+    pTransport->m_setDead.insert(hThird);
+    CHECK(manager.PostMessage(7, 0, 0));
+    CHECK(!manager.HandlerExists(7));
+
+    manager.RemoveWindow(hFirst);
+    CHECK(!manager.HandlerExists(5));
+}
+
+
+//
+// TestDeliveryCounts
+//
+// Sent and posted messages are counted per instance, skipped ones aren't.
+//
+static void TestDeliveryCounts()
+{
+    MessageManager manager;
+    FakeTransport* pTransport = new FakeTransport();
+    manager.SetTransport(pTransport);
+
+    HWND hFirst = (HWND)1;
+    HWND hSecond = (HWND)2;
+    HINSTANCE hFirstInstance = FakeTransport::MakeInstance(hFirst);
+    HINSTANCE hSecondInstance = FakeTransport::MakeInstance(hSecond);
+
+    manager.AddMessage(hSecond, POINTER_MESSAGE);
+    manager.AddMessage(hFirst, POINTER_MESSAGE);
+    manager.AddMessage(hFirst, OTHER_POINTER_MESSAGE);
+
+    manager.SendMessage(POINTER_MESSAGE, 0, 0);
+    manager.SendMessage(OTHER_POINTER_MESSAGE, 0, 0);
+    manager.PostMessage(POINTER_MESSAGE, 0, 0);
+    CHECK(manager.GetDeliveryCount(hFirstInstance) == 3);
+    CHECK(manager.GetDeliveryCount(hSecondInstance) == 2);
+
+    manager.RemoveMessage(hFirst, POINTER_MESSAGE);
+    manager.SendMessage(POINTER_MESSAGE, 0, 0);
+    CHECK(manager.GetDeliveryCount(hFirstInstance) == 3);
+    CHECK(manager.GetDeliveryCount(hSecondInstance) == 3);
+
+    // Without a time limit a pointer message still gets through
+    manager.SetBroadcastPolicy(100, MessageManager::SLOW_SKIP, 1000);
+    pTransport->m_setHung.insert(hSecond);
+
+    manager.SendMessage(POINTER_MESSAGE, 0, 0);
+    manager.SendMessage(POINTER_MESSAGE, 0, 0);
+    CHECK(manager.GetDeliveryCount(hSecondInstance) == 5);
+
+    // A value message times out, and the next one is skipped
+    manager.AddMessage(hSecond, VALUE_MESSAGE);
+    manager.SendMessage(VALUE_MESSAGE, 0, 0);
+    manager.SendMessage(VALUE_MESSAGE, 0, 0);
+    CHECK(manager.GetDeliveryCount(hSecondInstance) == 5);
+
+    manager.ResetDeliveryCount(hFirstInstance);
+    CHECK(manager.GetDeliveryCount(hFirstInstance) == 0);
+    CHECK(manager.GetDeliveryCount((HINSTANCE)7) == 0);
+
+    manager.SendMessage(OTHER_POINTER_MESSAGE, 0, 0);
+    CHECK(manager.GetDeliveryCount(hFirstInstance) == 1);
+}
+
+
+int main()
+{
+    TestBroadcastPolicy();
+    TestRegistrations();
+    TestDeliveryCounts();
+
+    return TestResult();
+}
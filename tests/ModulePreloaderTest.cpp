@@ -0,0 +1,290 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "../litestep/ModulePreloader.h"
+#include "../utility/criticalsection.h"
+#include "testing.h"
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <thread>
+
+//
+// Checks ModulePreloader's scheduling against a fake loader that only
+// pretends to load DLLs, so no real modules are needed.
+//
+// ModulePreloader still uses Win32 events and critical sections, so like
+// the rest of the tree the test is built and run with MinGW by "make test".
+//
+
+
+//
+// FakeLoader
+//
+// Takes a fixed time per DLL, or waits until it is let go. Keeps track of
+// how many loads overlap and of the references it hands out. Paths that
+// contain "missing" fail to load.
+//
+class FakeLoader : public IModuleLoader
+{
+public:
+    explicit FakeLoader(DWORD dwDelay)
+        : m_dwDelay(dwDelay)
+        , m_hStarted(CreateEvent(nullptr, TRUE, FALSE, nullptr))
+        , m_hRelease(nullptr)
+        , m_nLoads(0)
+        , m_nActive(0)
+        , m_nPeak(0)
+    {
+        // do nothing
+    }
+
+    ~FakeLoader()
+    {
+        CloseHandle(m_hStarted);
+    }
+
+    HMODULE Load(LPCWSTR pwzPath) override
+    {
+        int nActive = ++m_nActive;
+        int nPeak = m_nPeak;
+
+        while (nActive > nPeak &&
+               !m_nPeak.compare_exchange_weak(nPeak, nActive))
+        {
+            // retry
+        }
+
+        SetEvent(m_hStarted);
+
+        if (m_hRelease != nullptr)
+        {
+            WaitForSingleObject(m_hRelease, INFINITE);
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(m_dwDelay));
+        }
+
+        --m_nActive;
+        ++m_nLoads;
+
+        if (wcsstr(pwzPath, L"missing") != nullptr)
+        {
+            return nullptr;
+        }
+
+        Lock lock(m_cs);
+
+        HMODULE hModule = (HMODULE)(UINT_PTR)(m_mapModules.size() + 1);
+
+        for (const auto& module : m_mapModules)
+        {
+            if (module.second == pwzPath)
+            {
+                hModule = module.first;
+            }
+        }
+
+        m_mapModules[hModule] = pwzPath;
+        ++m_mapReferences[pwzPath];
+
+        return hModule;
+    }
+
+    void Free(HMODULE hModule) override
+    {
+        Lock lock(m_cs);
+        --m_mapReferences[m_mapModules[hModule]];
+    }
+
+    /** Checks that every Load was matched by a Free */
+    bool AllFreed()
+    {
+        Lock lock(m_cs);
+
+        for (const auto& reference : m_mapReferences)
+        {
+            if (reference.second != 0)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /** Makes loads wait for an event instead of sleeping */
+    void BlockOn(HANDLE hRelease)
+    {
+        m_hRelease = hRelease;
+    }
+
+    const DWORD m_dwDelay;
+
+    /** Set once the first load has started */
+    HANDLE m_hStarted;
+
+    HANDLE m_hRelease;
+    std::atomic<int> m_nLoads;
+    std::atomic<int> m_nActive;
+    std::atomic<int> m_nPeak;
+
+private:
+    CriticalSection m_cs;
+    std::map<HMODULE, std::wstring> m_mapModules;
+    std::map<std::wstring, int> m_mapReferences;
+};
+
+
+static std::vector<std::wstring> MakePaths()
+{
+    std::vector<std::wstring> paths;
+
+    for (int nModule = 0; nModule < 12; ++nModule)
+    {
+        paths.push_back(
+            L"C:\\modules\\module" + std::to_wstring(nModule) + L".dll");
+    }
+
+    paths.push_back(L"C:\\modules\\missing.dll");
+
+    return paths;
+}
+
+
+//
+// TestOverlap
+//
+// Loads overlap up to the thread limit while the main thread claims the
+// DLLs in order, and everything is released by Stop.
+//
+static void TestOverlap()
+{
+    const DWORD dwDelay = 20;
+    const UINT uThreads = 4;
+    std::vector<std::wstring> paths = MakePaths();
+
+    FakeLoader* pLoader = new FakeLoader(dwDelay);
+    ModulePreloader preloader(pLoader);
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    preloader.Start(paths, uThreads);
+
+    for (const std::wstring& sPath : paths)
+    {
+        HANDLE hDone = preloader.Claim(sPath.c_str());
+
+        if (hDone != nullptr)
+        {
+            CHECK(WaitForSingleObject(hDone, INFINITE) == WAIT_OBJECT_0);
+        }
+    }
+
+    preloader.Stop();
+
+    long long llElapsed =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    printf("%d DLLs preloaded in %lld ms, %d at once, %lu ms one by one\n",
+        pLoader->m_nLoads.load(), llElapsed, pLoader->m_nPeak.load(),
+        (ULONG)(paths.size() * dwDelay));
+
+    CHECK(pLoader->m_nPeak >= 2 && pLoader->m_nPeak <= (int)uThreads);
+    CHECK(pLoader->AllFreed());
+    CHECK(preloader.Claim(paths[0].c_str()) == nullptr);
+}
+
+
+//
+// TestClaim
+//
+// Claiming a DLL that is being loaded returns an event, matching paths case
+// insensitively. Claiming a queued DLL cancels its preload.
+//
+static void TestClaim()
+{
+    std::vector<std::wstring> paths = MakePaths();
+    HANDLE hRelease = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+    FakeLoader* pLoader = new FakeLoader(0);
+    pLoader->BlockOn(hRelease);
+
+    ModulePreloader preloader(pLoader);
+    preloader.Start(paths, 1);
+
+    // The only worker is now stuck on the first DLL
+    WaitForSingleObject(pLoader->m_hStarted, INFINITE);
+
+    HANDLE hDone = preloader.Claim(L"C:\\MODULES\\MODULE0.DLL");
+    CHECK(hDone != nullptr);
+
+    for (size_t uPath = 1; uPath < paths.size(); ++uPath)
+    {
+        CHECK(preloader.Claim(paths[uPath].c_str()) == nullptr);
+    }
+
+    SetEvent(hRelease);
+
+    if (hDone != nullptr)
+    {
+        CHECK(WaitForSingleObject(hDone, INFINITE) == WAIT_OBJECT_0);
+    }
+
+    preloader.Stop();
+
+    CHECK(pLoader->m_nLoads == 1);
+    CHECK(pLoader->AllFreed());
+
+    CloseHandle(hRelease);
+}
+
+
+//
+// TestEdgeCases
+//
+// Unknown paths, nothing to preload, and no Stop before destruction.
+//
+static void TestEdgeCases()
+{
+    ModulePreloader preloader(new FakeLoader(1));
+
+    CHECK(preloader.Claim(L"unknown.dll") == nullptr);
+
+    preloader.Start(std::vector<std::wstring>(), 4);
+    preloader.Stop();
+
+    // The destructor stops it
+    preloader.Start(MakePaths(), 8);
+}
+
+
+int main()
+{
+    TestOverlap();
+    TestClaim();
+    TestEdgeCases();
+
+    return TestResult();
+}
@@ -0,0 +1,401 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "../litestep/ModuleScheduler.h"
+#include "testing.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+//
+// Checks ModuleScheduler with synthetic module graphs. Initialization is
+// simulated the way ModuleManager::_InitScheduled drives the scheduler, and
+// compared to initializing the same modules in the listed order.
+//
+
+
+/** A made-up module */
+struct TestModule
+{
+    std::wstring sName;
+    ModuleScheduler::Thread thread;
+
+    /** Time its initModule takes, in arbitrary units */
+    int nDuration;
+
+    std::vector<std::wstring> dependencies;
+};
+
+
+//
+// Simulate
+//
+// Runs the modules through the scheduler. Ready threaded modules start
+// right away, ready main thread modules run one after another, and when
+// nothing is ready the main thread waits for the next threaded module to
+// finish. Returns the time at which the last module is done.
+//
+static int Simulate(const std::vector<TestModule>& modules,
+    std::vector<size_t>* pOrder, std::vector<int>* pStart,
+    std::vector<int>* pFinish)
+{
+    ModuleScheduler scheduler;
+
+    for (const TestModule& module : modules)
+    {
+        scheduler.AddModule(module.sName, module.thread);
+    }
+
+    for (size_t uModule = 0; uModule < modules.size(); ++uModule)
+    {
+        for (const std::wstring& sDependency : modules[uModule].dependencies)
+        {
+            scheduler.AddDependency(uModule, sDependency);
+        }
+    }
+
+    scheduler.Start();
+
+    pStart->assign(modules.size(), -1);
+    pFinish->assign(modules.size(), -1);
+
+    // Threaded modules that are running, by the time they finish
+    std::vector<std::pair<int, size_t> > running;
+    int nNow = 0;
+
+    while (!scheduler.IsDone())
+    {
+        size_t uModule = 0;
+
+        if (scheduler.NextReady(ModuleScheduler::THREAD_WORKER, &uModule))
+        {
+            pOrder->push_back(uModule);
+            (*pStart)[uModule] = nNow;
+            running.push_back(
+                std::make_pair(nNow + modules[uModule].nDuration, uModule));
+        }
+        else if (scheduler.NextReady(ModuleScheduler::THREAD_MAIN, &uModule))
+        {
+            pOrder->push_back(uModule);
+            (*pStart)[uModule] = nNow;
+            nNow += modules[uModule].nDuration;
+            (*pFinish)[uModule] = nNow;
+            scheduler.Complete(uModule);
+        }
+        else if (!running.empty())
+        {
+            std::vector<std::pair<int, size_t> >::iterator iter =
+                std::min_element(running.begin(), running.end());
+
+            nNow = std::max(nNow, iter->first);
+            (*pFinish)[iter->second] = iter->first;
+            scheduler.Complete(iter->second);
+            running.erase(iter);
+        }
+        else
+        {
+            CHECK(scheduler.IsStalled());
+            scheduler.BreakCycle();
+        }
+    }
+
+    return nNow;
+}
+
+
+static int Simulate(const std::vector<TestModule>& modules,
+    std::vector<size_t>* pOrder)
+{
+    std::vector<int> start, finish;
+    return Simulate(modules, pOrder, &start, &finish);
+}
+
+
+//
+// FindModule
+//
+static size_t FindModule(const std::vector<TestModule>& modules,
+    const std::wstring& sName)
+{
+    for (size_t uModule = 0; uModule < modules.size(); ++uModule)
+    {
+        if (modules[uModule].sName == sName)
+        {
+            return uModule;
+        }
+    }
+
+    return modules.size();
+}
+
+
+//
+// SimulateListed
+//
+// Initializes the modules in the listed order, as ModuleManager does
+// without LSParallelModuleInit. Threaded modules are started as they come
+// up and waited for at the end. The main thread only waits for a threaded
+// module early if a module listed after it depends on it. Modules may only
+// depend on modules listed before them.
+//
+static int SimulateListed(const std::vector<TestModule>& modules)
+{
+    std::vector<int> finish(modules.size(), 0);
+    int nNow = 0;
+    int nEnd = 0;
+
+    for (size_t uModule = 0; uModule < modules.size(); ++uModule)
+    {
+        const TestModule& module = modules[uModule];
+
+        for (const std::wstring& sDependency : module.dependencies)
+        {
+            size_t uDependency = FindModule(modules, sDependency);
+
+            CHECK(uDependency < uModule);
+            nNow = std::max(nNow, finish[uDependency]);
+        }
+
+        finish[uModule] = nNow + module.nDuration;
+
+        if (module.thread == ModuleScheduler::THREAD_MAIN)
+        {
+            nNow = finish[uModule];
+        }
+
+        nEnd = std::max(nEnd, finish[uModule]);
+    }
+
+    return nEnd;
+}
+
+
+//
+// CheckSchedule
+//
+// No module starts before the modules it depends on are done, and main
+// thread modules don't overlap.
+//
+static void CheckSchedule(const std::vector<TestModule>& modules,
+    const std::vector<int>& start, const std::vector<int>& finish)
+{
+    for (size_t uModule = 0; uModule < modules.size(); ++uModule)
+    {
+        CHECK(start[uModule] >= 0 && finish[uModule] >= start[uModule]);
+
+        for (const std::wstring& sDependency : modules[uModule].dependencies)
+        {
+            size_t uDependency = FindModule(modules, sDependency);
+
+            CHECK(uDependency < modules.size());
+            CHECK(start[uModule] >= finish[uDependency]);
+        }
+
+        if (modules[uModule].thread != ModuleScheduler::THREAD_MAIN)
+        {
+            continue;
+        }
+
+        for (size_t uOther = 0; uOther < uModule; ++uOther)
+        {
+            if (modules[uOther].thread == ModuleScheduler::THREAD_MAIN)
+            {
+                CHECK(finish[uOther] <= start[uModule] ||
+                    finish[uModule] <= start[uOther]);
+            }
+        }
+    }
+}
+
+
+//
+// TestOrder
+//
+// Dependencies override the listed order, and names are compared case
+// insensitively.
+//
+static void TestOrder()
+{
+    std::vector<TestModule> modules;
+    modules.push_back(
+        { L"label", ModuleScheduler::THREAD_MAIN, 10, { L"Popup2" } });
+    modules.push_back(
+        { L"popup2", ModuleScheduler::THREAD_MAIN, 10, {} });
+
+    std::vector<size_t> order;
+    Simulate(modules, &order);
+
+    CHECK(order.size() == 2 && order[0] == 1 && order[1] == 0);
+}
+
+
+//
+// TestCycles
+//
+// Cycles are broken and unknown names ignored, so every module still gets
+// initialized.
+//
+static void TestCycles()
+{
+    std::vector<TestModule> modules;
+    modules.push_back({ L"a", ModuleScheduler::THREAD_MAIN, 1, { L"b" } });
+    modules.push_back({ L"b", ModuleScheduler::THREAD_MAIN, 1, { L"a" } });
+    modules.push_back(
+        { L"c", ModuleScheduler::THREAD_WORKER, 1, { L"unknown" } });
+
+    std::vector<size_t> order;
+    Simulate(modules, &order);
+
+    CHECK(order.size() == 3);
+
+    ModuleScheduler scheduler;
+    scheduler.AddModule(L"a", ModuleScheduler::THREAD_MAIN);
+
+    CHECK(!scheduler.AddDependency(0, L"unknown"));
+    CHECK(!scheduler.AddDependency(0, L"a"));
+}
+
+
+//
+// TestWaitingDependents
+//
+// A module has waiting dependents until they have all become ready.
+//
+static void TestWaitingDependents()
+{
+    ModuleScheduler scheduler;
+    scheduler.AddModule(L"tasks", ModuleScheduler::THREAD_WORKER);
+    scheduler.AddModule(L"label", ModuleScheduler::THREAD_MAIN);
+    scheduler.AddModule(L"clock", ModuleScheduler::THREAD_MAIN);
+    scheduler.AddDependency(1, L"tasks");
+    scheduler.Start();
+
+    size_t uModule = 0;
+
+    CHECK(scheduler.NextReady(ModuleScheduler::THREAD_WORKER, &uModule));
+    CHECK(uModule == 0);
+    CHECK(scheduler.HasWaitingDependents(0));
+    CHECK(!scheduler.HasWaitingDependents(2));
+
+    scheduler.Complete(0);
+    CHECK(!scheduler.HasWaitingDependents(0));
+}
+
+
+//
+// TestMixedGraph
+//
+// Slow threaded modules get going right away instead of after the main
+// thread modules listed before them.
+//
+static void TestMixedGraph()
+{
+    std::vector<TestModule> modules;
+    modules.push_back({ L"m1", ModuleScheduler::THREAD_MAIN, 20, {} });
+    modules.push_back({ L"t1", ModuleScheduler::THREAD_WORKER, 80, {} });
+    modules.push_back({ L"m2", ModuleScheduler::THREAD_MAIN, 20, {} });
+    modules.push_back({ L"t2", ModuleScheduler::THREAD_WORKER, 80, { L"m2" } });
+    modules.push_back({ L"t3", ModuleScheduler::THREAD_WORKER, 80, {} });
+    modules.push_back({ L"m3", ModuleScheduler::THREAD_MAIN, 20, { L"t1" } });
+    modules.push_back({ L"t4", ModuleScheduler::THREAD_WORKER, 80, {} });
+
+    std::vector<size_t> order;
+    std::vector<int> start, finish;
+    int nScheduled = Simulate(modules, &order, &start, &finish);
+    int nListed = SimulateListed(modules);
+
+    printf("mixed graph: %d scheduled, %d in listed order\n",
+        nScheduled, nListed);
+
+    CheckSchedule(modules, start, finish);
+    CHECK(nScheduled < nListed);
+}
+
+
+//
+// TestRandomGraphs
+//
+// Random graphs where modules only depend on modules listed before them,
+// so the listed order is valid too. Reports the speedup over it.
+//
+static void TestRandomGraphs()
+{
+    const int nGraphs = 20;
+    const int nModules = 25;
+    unsigned int uRandom = 12345;
+    double dTotalSpeedup = 0.0;
+
+    for (int nGraph = 0; nGraph < nGraphs; ++nGraph)
+    {
+        std::vector<TestModule> modules;
+
+        for (int nModule = 0; nModule < nModules; ++nModule)
+        {
+            TestModule module;
+            module.sName = L"module" + std::to_wstring(nModule);
+
+            uRandom = uRandom * 1103515245 + 12345;
+            module.thread = ((uRandom >> 16) % 3 == 0) ?
+                ModuleScheduler::THREAD_WORKER : ModuleScheduler::THREAD_MAIN;
+
+            uRandom = uRandom * 1103515245 + 12345;
+            module.nDuration = 5 + (uRandom >> 16) % 96;
+
+            uRandom = uRandom * 1103515245 + 12345;
+            int nDependencies = (nModule == 0) ? 0 : (uRandom >> 16) % 3;
+
+            for (int nDependency = 0; nDependency < nDependencies;
+                 ++nDependency)
+            {
+                uRandom = uRandom * 1103515245 + 12345;
+                module.dependencies.push_back(
+                    L"module" + std::to_wstring((uRandom >> 16) % nModule));
+            }
+
+            modules.push_back(module);
+        }
+
+        std::vector<size_t> order;
+        std::vector<int> start, finish;
+        int nScheduled = Simulate(modules, &order, &start, &finish);
+        int nListed = SimulateListed(modules);
+
+        CHECK(order.size() == modules.size());
+        CheckSchedule(modules, start, finish);
+
+        dTotalSpeedup += (double)nListed / nScheduled;
+    }
+
+    printf("%d random graphs of %d modules: %.2fx faster on average\n",
+        nGraphs, nModules, dTotalSpeedup / nGraphs);
+}
+
+
+int main()
+{
+    TestOrder();
+    TestCycles();
+    TestWaitingDependents();
+    TestMixedGraph();
+    TestRandomGraphs();
+
+    return TestResult();
+}
@@ -0,0 +1,453 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "../utility/scan.cpp"
+#include "testing.h"
+#include <string>
+
+//
+// Differential test for the character classifiers in utility/scan.cpp. The
+// scalar, SSE2 and AVX2 kernels must all agree with wcscspn and wcsspn for
+// every class combination, wherever the string starts relative to a vector
+// block, and for strings that end right before an inaccessible page.
+//
+// The kernels are static, so this includes scan.cpp instead of linking
+// scan.o.
+//
+
+
+/** Failures printed in full, the rest are only counted */
+#define MAX_REPORTS 20
+
+/** Every combination of ScanClass values */
+#define ALL_CLASSES 0x7F
+
+/** Longest string placed at the end of a page */
+#define MAX_EDGE_LENGTH 70
+
+
+/** A kernel under test */
+struct ScanKernel
+{
+    const char* pszName;
+    LPCWSTR (*pfnScanFor)(LPCWSTR pwzString, UINT uClasses);
+    LPCWSTR (*pfnSkipWhitespace)(LPCWSTR pwzString);
+
+    /** Whether it can handle strings that aren't wchar_t aligned */
+    bool bUnaligned;
+};
+
+
+#if defined(SCAN_USE_SSE2)
+//
+// ScanForSSE2
+//
+static LPCWSTR ScanForSSE2(LPCWSTR pwzString, UINT uClasses)
+{
+    ScanNeedles needles;
+    _BuildNeedles(uClasses, needles);
+
+    return _ScanForSSE2(pwzString, needles);
+}
+#endif
+
+
+#if defined(SCAN_USE_AVX2)
+//
+// ScanForAVX2
+//
+static LPCWSTR ScanForAVX2(LPCWSTR pwzString, UINT uClasses)
+{
+    ScanNeedles needles;
+    _BuildNeedles(uClasses, needles);
+
+    return _ScanForAVX2(pwzString, needles);
+}
+#endif
+
+
+/** Every kernel this CPU can run, then the public entry points */
+static ScanKernel g_aKernels[4];
+static int g_cKernels = 0;
+
+
+//
+// InitKernels
+//
+static void InitKernels()
+{
+    g_aKernels[g_cKernels++] =
+        { "scalar", _ScanForScalar, _SkipWhitespaceScalar, true };
+
+#if defined(SCAN_USE_SSE2)
+    g_aKernels[g_cKernels++] =
+        { "SSE2", ScanForSSE2, _SkipWhitespaceSSE2, false };
+#endif
+
+#if defined(SCAN_USE_AVX2)
+    if (s_bHasAVX2)
+    {
+        // There is no AVX2 SkipWhitespace
+        g_aKernels[g_cKernels++] =
+            { "AVX2", ScanForAVX2, _SkipWhitespaceScalar, false };
+    }
+#endif
+
+    g_aKernels[g_cKernels++] = { "public", ScanFor, SkipWhitespace, true };
+
+    for (int nKernel = 0; nKernel < g_cKernels; ++nKernel)
+    {
+        printf("%s ", g_aKernels[nKernel].pszName);
+    }
+
+    printf("kernels\n");
+}
+
+
+//
+// ReferenceScanFor
+//
+// ScanFor in terms of wcscspn. Returns the index of the first match.
+//
+static size_t ReferenceScanFor(LPCWSTR pwzString, UINT uClasses)
+{
+    std::wstring sSet;
+
+    if (uClasses & SCAN_WHITESPACE)
+    {
+        sSet += WHITESPACEW;
+    }
+
+    if (uClasses & SCAN_COMMENT)
+    {
+        sSet += L";";
+    }
+
+    if (uClasses & SCAN_QUOTE)
+    {
+        sSet += L"\"\'";
+    }
+
+    if (uClasses & SCAN_BRACKET)
+    {
+        sSet += L"[]";
+    }
+
+    if (uClasses & SCAN_DOLLAR)
+    {
+        sSet += L"$";
+    }
+
+    if (uClasses & SCAN_AT)
+    {
+        sSet += L"@";
+    }
+
+    if (uClasses & SCAN_ANYSPACE)
+    {
+        sSet += L"\t\n\v\f\r ";
+    }
+
+    size_t uEnd = wcscspn(pwzString, sSet.c_str());
+
+    if (uClasses & SCAN_ANYSPACE)
+    {
+        for (size_t uChar = 0; uChar < uEnd; ++uChar)
+        {
+            if (pwzString[uChar] > 0x7F)
+            {
+                return uChar;
+            }
+        }
+    }
+
+    return uEnd;
+}
+
+
+//
+// Report
+//
+static void Report(const char* pszWhat, const char* pszKernel,
+    const std::wstring& sString, UINT uClasses, size_t uOffset,
+    size_t uExpected, size_t uActual)
+{
+    if (g_nFailedChecks < MAX_REPORTS)
+    {
+        printf("%s: %s kernel, classes 0x%02X, offset %u, length %u: "
+            "expected %u, got %u\n", pszWhat, pszKernel, uClasses,
+            (unsigned)uOffset, (unsigned)sString.length(),
+            (unsigned)uExpected, (unsigned)uActual);
+    }
+
+    ++g_nFailedChecks;
+}
+
+
+//
+// CheckAt
+//
+// Runs every kernel on a copy of sString that starts at pbStart, and
+// compares the results with the references.
+//
+static void CheckAt(const std::wstring& sString, UINT uClasses,
+    size_t uExpected, size_t uSkipExpected, char* pbStart, size_t uOffset)
+{
+    memcpy(pbStart, sString.c_str(), (sString.length() + 1) * sizeof(wchar_t));
+
+    LPCWSTR pwzString = (LPCWSTR)pbStart;
+    bool bAligned = ((uintptr_t)pbStart & 1) == 0;
+
+    for (int nKernel = 0; nKernel < g_cKernels; ++nKernel)
+    {
+        const ScanKernel& kernel = g_aKernels[nKernel];
+
+        if (!bAligned && !kernel.bUnaligned)
+        {
+            continue;
+        }
+
+        size_t uActual = (size_t)((const char*)kernel.pfnScanFor(
+            pwzString, uClasses) - pbStart) / sizeof(wchar_t);
+
+        if (uActual != uExpected)
+        {
+            Report("ScanFor", kernel.pszName, sString, uClasses, uOffset,
+                uExpected, uActual);
+        }
+
+        uActual = (size_t)((const char*)kernel.pfnSkipWhitespace(
+            pwzString) - pbStart) / sizeof(wchar_t);
+
+        if (uActual != uSkipExpected)
+        {
+            Report("SkipWhitespace", kernel.pszName, sString, uClasses,
+                uOffset, uSkipExpected, uActual);
+        }
+    }
+}
+
+
+//
+// CheckString
+//
+// Checks sString at every byte offset within a 32 byte block.
+//
+static void CheckString(const std::wstring& sString, UINT uClasses)
+{
+    alignas(32) static char s_abBuffer[32 + 256 * sizeof(wchar_t)];
+
+    size_t uExpected = ReferenceScanFor(sString.c_str(), uClasses);
+    size_t uSkipExpected = wcsspn(sString.c_str(), WHITESPACEW);
+
+    for (size_t uOffset = 0; uOffset < 32; ++uOffset)
+    {
+        CheckAt(sString, uClasses, uExpected, uSkipExpected,
+            s_abBuffer + uOffset, uOffset);
+    }
+}
+
+
+/** Characters of every class, and non-ASCII ones sharing a byte with them */
+static std::wstring g_sAlphabet;
+
+
+//
+// InitAlphabet
+//
+static void InitAlphabet()
+{
+    for (wchar_t wc = 1; wc < 0x80; ++wc)
+    {
+        g_sAlphabet += wc;
+    }
+
+    const wchar_t awcOther[] =
+    {
+        0x80, 0xA0, 0xFF, 0x100, 0x109, 0x120, 0x920, 0x2009, 0x2020,
+        0x2028, 0x3000, 0x3B3B, 0x7F7F, 0xFEFF, 0xFF20, 0xFFFF
+    };
+
+    g_sAlphabet.append(awcOther, COUNTOF(awcOther));
+}
+
+
+//
+// TestCharacters
+//
+// Every character at every position up to a few vector blocks in, for
+// every class combination.
+//
+static void TestCharacters()
+{
+    for (UINT uClasses = 1; uClasses <= ALL_CLASSES; ++uClasses)
+    {
+        for (wchar_t wc : g_sAlphabet)
+        {
+            for (size_t uPosition = 0; uPosition < 40; ++uPosition)
+            {
+                std::wstring sString(uPosition, L'x');
+                sString += wc;
+                sString.append(7, L'x');
+
+                CheckString(sString, uClasses);
+            }
+        }
+    }
+}
+
+
+//
+// TestWhitespace
+//
+// Runs of whitespace of every length around the vector widths, followed by
+// every character.
+//
+static void TestWhitespace()
+{
+    const wchar_t awcWhitespace[] = { L' ', L'\t', L'\n', L'\r' };
+
+    for (size_t uLength = 0; uLength < MAX_EDGE_LENGTH; ++uLength)
+    {
+        for (wchar_t wc : g_sAlphabet)
+        {
+            std::wstring sString;
+
+            for (size_t uChar = 0; uChar < uLength; ++uChar)
+            {
+                sString += awcWhitespace[(uChar + wc) % 4];
+            }
+
+            sString += wc;
+            CheckString(sString, SCAN_WHITESPACE);
+            CheckString(sString, SCAN_ANYSPACE | SCAN_RESERVED);
+        }
+    }
+}
+
+
+//
+// TestPageEdge
+//
+// Strings whose terminator is the last character before a page that can't
+// be read, with and without a match, and with whitespace only.
+//
+static void TestPageEdge()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+
+    char* pbPages = (char*)VirtualAlloc(nullptr, 2 * info.dwPageSize,
+        MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    DWORD dwOldProtect = 0;
+
+    if (pbPages == nullptr)
+    {
+        printf("Could not allocate the pages\n");
+        ++g_nFailedChecks;
+        return;
+    }
+
+    CHECK(VirtualProtect(pbPages + info.dwPageSize, info.dwPageSize,
+        PAGE_NOACCESS, &dwOldProtect));
+
+    char* pbEdge = pbPages + info.dwPageSize;
+    const LPCWSTR apwzLast[] = { L"", L";", L"\x3000", L" \t" };
+
+    for (UINT uClasses = 1; uClasses <= ALL_CLASSES; ++uClasses)
+    {
+        for (size_t uLength = 0; uLength < MAX_EDGE_LENGTH; ++uLength)
+        {
+            for (LPCWSTR pwzLast : apwzLast)
+            {
+                std::wstring sString(uLength, L'x');
+                sString += pwzLast;
+
+                if (uClasses == SCAN_WHITESPACE)
+                {
+                    sString.replace(0, uLength, uLength, L' ');
+                }
+
+                size_t uExpected =
+                    ReferenceScanFor(sString.c_str(), uClasses);
+                size_t uSkipExpected =
+                    wcsspn(sString.c_str(), WHITESPACEW);
+                size_t cbString = (sString.length() + 1) * sizeof(wchar_t);
+
+                // Aligned, and one byte short of that
+                for (size_t uOffset = 0; uOffset < 2; ++uOffset)
+                {
+                    CheckAt(sString, uClasses, uExpected, uSkipExpected,
+                        pbEdge - cbString - uOffset, uOffset);
+                }
+            }
+        }
+    }
+
+    VirtualFree(pbPages, 0, MEM_RELEASE);
+}
+
+
+//
+// TestRandom
+//
+// Random strings made mostly of class characters, with random classes.
+//
+static void TestRandom()
+{
+    const int nStrings = 100000;
+    const wchar_t wzAlphabet[] = L" \t\n\r\v;\"'[]$@ab\x85\x3000";
+    const size_t cchAlphabet = COUNTOF(wzAlphabet) - 1;
+    unsigned int uRandom = 1;
+
+    for (int nString = 0; nString < nStrings; ++nString)
+    {
+        uRandom = uRandom * 1103515245 + 12345;
+        size_t cchLength = (uRandom >> 16) % 100;
+        UINT uClasses = (uRandom >> 8) % ALL_CLASSES + 1;
+
+        std::wstring sString;
+
+        for (size_t uChar = 0; uChar < cchLength; ++uChar)
+        {
+            uRandom = uRandom * 1103515245 + 12345;
+            sString += wzAlphabet[(uRandom >> 16) % cchAlphabet];
+        }
+
+        CheckString(sString, uClasses);
+    }
+
+    printf("%d random strings compared\n", nStrings);
+}
+
+
+int main()
+{
+    InitKernels();
+    InitAlphabet();
+
+    TestCharacters();
+    TestWhitespace();
+    TestPageEdge();
+    TestRandom();
+
+    return TestResult();
+}
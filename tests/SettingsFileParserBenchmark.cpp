@@ -0,0 +1,277 @@
+GPLHEADER
+#include "../lsapi/lsapi.h"
+#include "../lsapi/SettingsFileParser.h"
+#include "../utility/scan.h"
+#include "testing.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+//
+// Benchmark for the rc file parser and the scanners built on ScanFor and
+// SkipWhitespace. Parses a generated theme with FileParser, tokenizes and
+// expands its values, and compares ScanFor and SkipWhitespace with the
+// wcscspn and wcsspn calls they replaced on the same lines.
+//
+// Links lsapi.dll's object files, since FileParser isn't exported.
+//
+
+
+/** Sections in the generated rc file, each with SECTION_SETTINGS lines */
+#define SECTIONS 5000
+#define SECTION_SETTINGS 6
+
+/** Times each part is repeated */
+#define PARSES 10
+#define PASSES 20
+
+
+/** Keeps the compiler from dropping the work being timed */
+static volatile size_t g_uSink = 0;
+
+
+//
+// GenerateLines
+//
+// A theme-like mix of paths, quoted strings, variables, bang commands,
+// comments and indentation.
+//
+static std::vector<std::wstring> GenerateLines()
+{
+    std::vector<std::wstring> lines;
+
+    for (int nSection = 0; nSection < SECTIONS; ++nSection)
+    {
+        std::wstring sIndex = std::to_wstring(nSection);
+
+        lines.push_back(L"; Section " + sIndex + L", the usual clutter");
+        lines.push_back(L"ThemeVar" + sIndex +
+            L" \"C:\\Program Files\\LiteStep\\themes\\default\\image" +
+            sIndex + L".png\"   ; path");
+        lines.push_back(L"Label" + sIndex + L"Font \"Segoe UI\"");
+        lines.push_back(L"Label" + sIndex + L"X $BenchWidth$-200");
+        lines.push_back(L"Label" + sIndex + L"OnLeftClick [!Bench" +
+            sIndex + L" \"arg one\"][!Execute notepad.exe]");
+        lines.push_back(L"*Popup \"Item " + sIndex + L"\" !Bench" + sIndex);
+        lines.push_back(L"    Indented" + sIndex + L"\t\ttrue");
+    }
+
+    return lines;
+}
+
+
+//
+// WriteRcFile
+//
+static bool WriteRcFile(LPCWSTR pwzRcPath,
+    const std::vector<std::wstring>& lines, size_t* pcbFile)
+{
+    std::string sContents = "BenchWidth 1920\r\n";
+
+    for (const std::wstring& sLine : lines)
+    {
+        // The lines are ASCII
+        sContents.append(sLine.begin(), sLine.end());
+        sContents += "\r\n";
+    }
+
+    HANDLE hFile = CreateFileW(pwzRcPath, GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    DWORD cbWritten = 0;
+    WriteFile(hFile, sContents.c_str(), (DWORD)sContents.length(),
+        &cbWritten, nullptr);
+    CloseHandle(hFile);
+
+    *pcbFile = sContents.length();
+
+    return cbWritten == sContents.length();
+}
+
+
+//
+// Microseconds
+//
+static double Microseconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+
+//
+// BenchParse
+//
+static void BenchParse(LPCWSTR pwzRcPath, size_t cbFile)
+{
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    for (int nParse = 0; nParse < PARSES; ++nParse)
+    {
+        SettingsMap settings;
+        FileParser parser(&settings);
+
+        parser.ParseFile(pwzRcPath);
+
+        CHECK(settings.size() == SECTIONS * SECTION_SETTINGS + 1);
+        g_uSink += settings.size();
+    }
+
+    double dMicroseconds = Microseconds(start) / PARSES;
+
+    printf("FileParser: %.2f ms per parse, %.1f MB/s\n",
+        dMicroseconds / 1000, cbFile / dMicroseconds);
+}
+
+
+//
+// BenchValues
+//
+// What modules do with the values once they are read.
+//
+static void BenchValues(const std::vector<std::wstring>& lines)
+{
+    wchar_t wzToken[MAX_LINE_LENGTH];
+    wchar_t wzExpanded[MAX_LINE_LENGTH];
+    size_t cTokens = 0;
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    for (const std::wstring& sLine : lines)
+    {
+        LPCWSTR pwzNext = sLine.c_str();
+
+        while (GetTokenW(pwzNext, wzToken, &pwzNext, TRUE))
+        {
+            ++cTokens;
+        }
+    }
+
+    double dTokenize = Microseconds(start);
+    start = std::chrono::steady_clock::now();
+
+    for (const std::wstring& sLine : lines)
+    {
+        VarExpansionExW(wzExpanded, sLine.c_str(), MAX_LINE_LENGTH);
+        g_uSink += wcslen(wzExpanded);
+    }
+
+    double dExpand = Microseconds(start);
+
+    printf("GetToken: %.1f tokens/us, VarExpansionEx: %.1f lines/us\n",
+        cTokens / dTokenize, lines.size() / dExpand);
+}
+
+
+//
+// BenchScanners
+//
+// ScanFor and SkipWhitespace against the C runtime calls they replaced.
+//
+static void BenchScanners(const std::vector<std::wstring>& lines)
+{
+    const std::wstring sSet = std::wstring(WHITESPACEW) + RESERVEDCHARSW;
+    size_t cchTotal = 0;
+
+    for (const std::wstring& sLine : lines)
+    {
+        cchTotal += sLine.length();
+    }
+
+    // Walks each line from one special character to the next, the way the
+    // parser and the tokenizer do
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    for (int nPass = 0; nPass < PASSES; ++nPass)
+    {
+        for (const std::wstring& sLine : lines)
+        {
+            for (LPCWSTR pwzCurrent = sLine.c_str(); *pwzCurrent; ++pwzCurrent)
+            {
+                pwzCurrent = SkipWhitespace(pwzCurrent);
+                pwzCurrent = ScanFor(pwzCurrent,
+                    SCAN_WHITESPACE | SCAN_RESERVED);
+
+                if (*pwzCurrent == L'\0')
+                {
+                    break;
+                }
+
+                g_uSink += *pwzCurrent;
+            }
+        }
+    }
+
+    double dScan = Microseconds(start);
+    start = std::chrono::steady_clock::now();
+
+    for (int nPass = 0; nPass < PASSES; ++nPass)
+    {
+        for (const std::wstring& sLine : lines)
+        {
+            for (LPCWSTR pwzCurrent = sLine.c_str(); *pwzCurrent; ++pwzCurrent)
+            {
+                pwzCurrent += wcsspn(pwzCurrent, WHITESPACEW);
+                pwzCurrent += wcscspn(pwzCurrent, sSet.c_str());
+
+                if (*pwzCurrent == L'\0')
+                {
+                    break;
+                }
+
+                g_uSink += *pwzCurrent;
+            }
+        }
+    }
+
+    double dRuntime = Microseconds(start);
+    double cchPerPass = (double)cchTotal * PASSES;
+
+    printf("ScanFor/SkipWhitespace: %.0f chars/us, "
+        "wcscspn/wcsspn: %.0f chars/us\n",
+        cchPerPass / dScan, cchPerPass / dRuntime);
+}
+
+
+int main()
+{
+    wchar_t wzPath[MAX_PATH];
+    wchar_t wzRcPath[MAX_PATH];
+
+    if (!GetTempPathW(MAX_PATH, wzPath) ||
+        FAILED(StringCchPrintfW(wzRcPath, MAX_PATH,
+            L"%lsSettingsFileParserBenchmark.rc", wzPath)))
+    {
+        printf("Could not get the temp directory\n");
+        return 1;
+    }
+
+    std::vector<std::wstring> lines = GenerateLines();
+    size_t cbFile = 0;
+
+    if (!WriteRcFile(wzRcPath, lines, &cbFile) ||
+        !LSAPIInitialize(wzPath, wzRcPath))
+    {
+        printf("Could not initialize the LSAPI\n");
+        DeleteFileW(wzRcPath);
+        return 1;
+    }
+
+    printf("%u lines, %u bytes\n", (unsigned)lines.size(), (unsigned)cbFile);
+
+    BenchParse(wzRcPath, cbFile);
+    BenchValues(lines);
+    BenchScanners(lines);
+
+    DeleteFileW(wzRcPath);
+
+    return TestResult();
+}
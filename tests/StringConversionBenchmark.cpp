@@ -0,0 +1,431 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "../utility/common.h"
+#include "../utility/stringutility.h"
+#include "../lsapi/lsapi.h"
+#include "testing.h"
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <stdlib.h>
+
+//
+// Allocation-count benchmark for the ANSI argument conversions. Compares
+// the heap copies the A entry points used to make with ConvertedWCS and
+// ConvertedMBS, for short and long strings, with and without non-ASCII
+// characters. Then compares the A entry points that read settings with
+// their W counterparts, for buffers that fit the A entry points' inline
+// buffer and for larger ones.
+//
+// Links lsapi.dll's object files, so allocations made by the entry points
+// are counted as well.
+//
+
+
+static std::atomic<long> g_cAllocations(0);
+
+
+//
+// Counting allocator. Only counts allocations made by this program, which
+// includes the conversion code and the entry points since stringutility.o
+// and lsapi.dll's object files are linked in.
+//
+void* operator new(size_t cbSize)
+{
+    ++g_cAllocations;
+
+    void* pMemory = malloc(cbSize > 0 ? cbSize : 1);
+
+    if (pMemory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    return pMemory;
+}
+
+void* operator new[](size_t cbSize)
+{
+    return operator new(cbSize);
+}
+
+void operator delete(void* pMemory) noexcept
+{
+    free(pMemory);
+}
+
+void operator delete[](void* pMemory) noexcept
+{
+    free(pMemory);
+}
+
+
+//
+// HeapWCSFromMBS
+//
+// WCSFromMBS as it was before ConvertMBSToWCS, i.e. what every A entry
+// point did with its string arguments.
+//
+static wchar_t* HeapWCSFromMBS(const char* pszMBS)
+{
+    size_t nLen = strlen(pszMBS) + 1;
+    wchar_t* pwzWCS = new wchar_t[nLen];
+    MultiByteToWideChar(CP_ACP, 0, pszMBS, -1, pwzWCS, (int)nLen);
+
+    return pwzWCS;
+}
+
+
+//
+// HeapMBSFromWCS
+//
+static char* HeapMBSFromWCS(const wchar_t* pwzWCS)
+{
+    size_t nLen = wcslen(pwzWCS) + 1;
+    char* pszMBS = new char[nLen];
+    WideCharToMultiByte(
+        CP_ACP, 0, pwzWCS, -1, pszMBS, (int)nLen, "?", nullptr);
+
+    return pszMBS;
+}
+
+
+/** Results of one way of converting */
+struct Measurement
+{
+    double dAllocationsPerCall;
+    double dNanosecondsPerCall;
+};
+
+
+//
+// MeasureToWCS
+//
+static Measurement MeasureToWCS(LPCSTR pszString, bool bHeap, int nCalls)
+{
+    volatile wchar_t wcSink = 0;
+    long cAllocations = g_cAllocations;
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    for (int nCall = 0; nCall < nCalls; ++nCall)
+    {
+        if (bHeap)
+        {
+            std::unique_ptr<wchar_t[]> pwzString(HeapWCSFromMBS(pszString));
+            wcSink = pwzString[0];
+        }
+        else
+        {
+            wcSink = MBSTOWCS(pszString)[0];
+        }
+    }
+
+    Measurement measurement;
+    measurement.dNanosecondsPerCall =
+        std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count() / nCalls;
+    measurement.dAllocationsPerCall =
+        (double)(g_cAllocations - cAllocations) / nCalls;
+
+    (void)wcSink;
+    return measurement;
+}
+
+
+//
+// MeasureToMBS
+//
+static Measurement MeasureToMBS(LPCWSTR pwzString, bool bHeap, int nCalls)
+{
+    volatile char cSink = 0;
+    long cAllocations = g_cAllocations;
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    for (int nCall = 0; nCall < nCalls; ++nCall)
+    {
+        if (bHeap)
+        {
+            std::unique_ptr<char[]> pszString(HeapMBSFromWCS(pwzString));
+            cSink = pszString[0];
+        }
+        else
+        {
+            cSink = WCSTOMBS(pwzString)[0];
+        }
+    }
+
+    Measurement measurement;
+    measurement.dNanosecondsPerCall =
+        std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count() / nCalls;
+    measurement.dAllocationsPerCall =
+        (double)(g_cAllocations - cAllocations) / nCalls;
+
+    (void)cSink;
+    return measurement;
+}
+
+
+/** Output buffers for the entry points */
+static char g_szBuffer[MAX_LINE_LENGTH];
+static wchar_t g_wzBuffer[MAX_LINE_LENGTH];
+
+
+//
+// Entry point calls, each reading ConvValue into a buffer of cchBuffer
+//
+static void CallGetRCStringA(UINT cchBuffer)
+{
+    GetRCStringA("ConvValue", g_szBuffer, "default", cchBuffer);
+}
+
+static void CallGetRCStringW(UINT cchBuffer)
+{
+    GetRCStringW(L"ConvValue", g_wzBuffer, L"default", cchBuffer);
+}
+
+static void CallGetRCLineA(UINT cchBuffer)
+{
+    GetRCLineA("ConvValue", g_szBuffer, cchBuffer, "default");
+}
+
+static void CallGetRCLineW(UINT cchBuffer)
+{
+    GetRCLineW(L"ConvValue", g_wzBuffer, cchBuffer, L"default");
+}
+
+static void CallLSGetVariableExA(UINT cchBuffer)
+{
+    LSGetVariableExA("ConvValue", g_szBuffer, cchBuffer);
+}
+
+static void CallLSGetVariableExW(UINT cchBuffer)
+{
+    LSGetVariableExW(L"ConvValue", g_wzBuffer, cchBuffer);
+}
+
+static void CallVarExpansionExA(UINT cchBuffer)
+{
+    VarExpansionExA(g_szBuffer, "image: $ConvValue$", cchBuffer);
+}
+
+static void CallVarExpansionExW(UINT cchBuffer)
+{
+    VarExpansionExW(g_wzBuffer, L"image: $ConvValue$", cchBuffer);
+}
+
+
+//
+// MeasureEntryPoint
+//
+static Measurement MeasureEntryPoint(void (*pfnCall)(UINT), UINT cchBuffer,
+    int nCalls)
+{
+    long cAllocations = g_cAllocations;
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    for (int nCall = 0; nCall < nCalls; ++nCall)
+    {
+        pfnCall(cchBuffer);
+    }
+
+    Measurement measurement;
+    measurement.dNanosecondsPerCall =
+        std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count() / nCalls;
+    measurement.dAllocationsPerCall =
+        (double)(g_cAllocations - cAllocations) / nCalls;
+
+    return measurement;
+}
+
+
+//
+// Initialize
+//
+// Initializes the LSAPI with a step.rc that defines ConvValue, which has an
+// accented character in it.
+//
+static bool Initialize()
+{
+    wchar_t wzPath[MAX_PATH];
+    wchar_t wzRcPath[MAX_PATH];
+
+    if (!GetTempPathW(MAX_PATH, wzPath) ||
+        FAILED(StringCchPrintfW(wzRcPath, MAX_PATH,
+            L"%lsStringConversionBenchmark.rc", wzPath)))
+    {
+        return false;
+    }
+
+    HANDLE hFile = CreateFileW(wzRcPath, GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    // UTF-8
+    const char szSettings[] = "ConvValue \"C:\\Themes\\Bild\xC3\xA9r.png\"\r\n";
+    DWORD cbWritten = 0;
+    WriteFile(hFile, szSettings, sizeof(szSettings) - 1, &cbWritten, nullptr);
+    CloseHandle(hFile);
+
+    BOOL bInitialized = LSAPIInitialize(wzPath, wzRcPath);
+    DeleteFileW(wzRcPath);
+
+    return bInitialized != FALSE;
+}
+
+
+//
+// BenchEntryPoints
+//
+// The A entry points convert into a ScratchBuffer of MAX_PATH characters,
+// so they only allocate more than the W entry points for larger buffers.
+//
+static void BenchEntryPoints()
+{
+    const int nCalls = 100000;
+
+    struct
+    {
+        LPCSTR pszName;
+        void (*pfnA)(UINT);
+        void (*pfnW)(UINT);
+    } entryPoints[] =
+    {
+        { "GetRCString", CallGetRCStringA, CallGetRCStringW },
+        { "GetRCLine", CallGetRCLineA, CallGetRCLineW },
+        { "LSGetVariableEx", CallLSGetVariableExA, CallLSGetVariableExW },
+        { "VarExpansionEx", CallVarExpansionExA, CallVarExpansionExW }
+    };
+
+    const UINT acchBuffers[] = { 64, MAX_PATH, MAX_LINE_LENGTH };
+
+    for (const auto& entryPoint : entryPoints)
+    {
+        // Same result either way
+        entryPoint.pfnA(MAX_PATH);
+        entryPoint.pfnW(MAX_PATH);
+        CHECK(strcmp(WCSTOMBS(g_wzBuffer), g_szBuffer) == 0);
+
+        for (UINT cchBuffer : acchBuffers)
+        {
+            Measurement wide =
+                MeasureEntryPoint(entryPoint.pfnW, cchBuffer, nCalls);
+            Measurement ansi =
+                MeasureEntryPoint(entryPoint.pfnA, cchBuffer, nCalls);
+
+            printf("%-16s %4u chars: W %.2f allocs %7.1f ns, A %.2f allocs "
+                "%7.1f ns\n", entryPoint.pszName, cchBuffer,
+                wide.dAllocationsPerCall, wide.dNanosecondsPerCall,
+                ansi.dAllocationsPerCall, ansi.dNanosecondsPerCall);
+
+            CHECK(ansi.dAllocationsPerCall - wide.dAllocationsPerCall ==
+                (cchBuffer > MAX_PATH ? 1.0 : 0.0));
+        }
+    }
+}
+
+
+//
+// Report
+//
+static void Report(LPCSTR pszDirection, LPCSTR pszCase,
+    const Measurement& heap, const Measurement& converted)
+{
+    printf("%s %-16s heap copy %.2f allocs %7.1f ns, converted %.2f allocs "
+        "%7.1f ns\n", pszDirection, pszCase, heap.dAllocationsPerCall,
+        heap.dNanosecondsPerCall, converted.dAllocationsPerCall,
+        converted.dNanosecondsPerCall);
+}
+
+
+int main()
+{
+    const int nCalls = 1000000;
+
+    // Longer than MAX_PATH, so ConvertedWCS and ConvertedMBS need the heap
+    std::string sLong(400, 'x');
+    std::wstring wsLong(400, L'x');
+
+    // A character that is in every Latin code page, but not ASCII
+    std::string sLongAccented = sLong + "\xE9";
+    std::wstring wsLongAccented = wsLong + L"\x00E9";
+
+    struct
+    {
+        LPCSTR pszCase;
+        LPCSTR pszMBS;
+        LPCWSTR pwzWCS;
+        double dAllocations;
+    } cases[] =
+    {
+        { "short ASCII", "DesktopBackground", L"DesktopBackground", 0.0 },
+        { "short accented", "Bild\xE9r.png", L"Bild\x00E9r.png", 0.0 },
+        { "long ASCII", sLong.c_str(), wsLong.c_str(), 1.0 },
+        { "long accented", sLongAccented.c_str(), wsLongAccented.c_str(),
+          1.0 }
+    };
+
+    for (const auto& test : cases)
+    {
+        // Same result either way
+        std::unique_ptr<wchar_t[]> pwzHeap(HeapWCSFromMBS(test.pszMBS));
+        CHECK(wcscmp(pwzHeap.get(), MBSTOWCS(test.pszMBS)) == 0);
+
+        std::unique_ptr<char[]> pszHeap(HeapMBSFromWCS(test.pwzWCS));
+        CHECK(strcmp(pszHeap.get(), WCSTOMBS(test.pwzWCS)) == 0);
+
+        Measurement heap = MeasureToWCS(test.pszMBS, true, nCalls);
+        Measurement converted = MeasureToWCS(test.pszMBS, false, nCalls);
+        Report("A->W", test.pszCase, heap, converted);
+
+        CHECK(heap.dAllocationsPerCall == 1.0);
+        CHECK(converted.dAllocationsPerCall == test.dAllocations);
+
+        heap = MeasureToMBS(test.pwzWCS, true, nCalls);
+        converted = MeasureToMBS(test.pwzWCS, false, nCalls);
+        Report("W->A", test.pszCase, heap, converted);
+
+        CHECK(heap.dAllocationsPerCall == 1.0);
+        CHECK(converted.dAllocationsPerCall == test.dAllocations);
+    }
+
+    if (!Initialize())
+    {
+        printf("Could not initialize the LSAPI\n");
+        return 1;
+    }
+
+    BenchEntryPoints();
+
+    return TestResult();
+}
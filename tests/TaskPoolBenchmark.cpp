@@ -0,0 +1,339 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "../lsapi/lsapi.h"
+#include "testing.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//
+// Scheduler benchmark for the LSAPI task pool. Runs the same batches of
+// tasks on the work-stealing pool through LSSubmitTask, on a pool with a
+// single shared queue, one by one, and with a thread per task, and a
+// fork-join computation that submits tasks from inside tasks.
+//
+
+
+static std::atomic<long> g_lCompleted(0);
+
+
+//
+// Work
+//
+// A task that spins for lParam iterations.
+//
+static void CALLBACK Work(LPARAM lParam)
+{
+    volatile long lSum = 0;
+
+    for (long lIteration = 0; lIteration < (long)lParam; ++lIteration)
+    {
+        lSum += lIteration;
+    }
+
+    ++g_lCompleted;
+}
+
+
+//
+// GlobalQueuePool
+//
+// The baseline: a fixed number of threads that all take tasks from one
+// queue behind one lock.
+//
+class GlobalQueuePool
+{
+public:
+    explicit GlobalQueuePool(UINT uWorkers)
+        : m_cPending(0)
+        , m_bStopping(false)
+    {
+        for (UINT uWorker = 0; uWorker < uWorkers; ++uWorker)
+        {
+            m_threads.emplace_back(&GlobalQueuePool::_ThreadProc, this);
+        }
+    }
+
+    ~GlobalQueuePool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_bStopping = true;
+        }
+
+        m_cvWork.notify_all();
+
+        for (std::thread& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    void Push(LSTASKPROC pfnTask, LPARAM lParam)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push_back(std::make_pair(pfnTask, lParam));
+            ++m_cPending;
+        }
+
+        m_cvWork.notify_one();
+    }
+
+    /** Waits until every task pushed so far has run */
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cvDone.wait(lock, [this] { return m_cPending == 0; });
+    }
+
+private:
+    void _ThreadProc()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        for (;;)
+        {
+            m_cvWork.wait(lock,
+                [this] { return m_bStopping || !m_tasks.empty(); });
+
+            if (m_tasks.empty())
+            {
+                break;
+            }
+
+            std::pair<LSTASKPROC, LPARAM> task = m_tasks.front();
+            m_tasks.pop_front();
+
+            lock.unlock();
+            task.first(task.second);
+            lock.lock();
+
+            if (--m_cPending == 0)
+            {
+                m_cvDone.notify_all();
+            }
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_cvWork;
+    std::condition_variable m_cvDone;
+    std::deque<std::pair<LSTASKPROC, LPARAM> > m_tasks;
+    std::vector<std::thread> m_threads;
+    long m_cPending;
+    bool m_bStopping;
+};
+
+
+//
+// Milliseconds
+//
+static double Milliseconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+
+//
+// Fib
+//
+// Fork-join Fibonacci. Below the cutoff it's computed in place, with some
+// extra work so the leaves aren't free. Above it one half is submitted as
+// a task while the other half is computed by the caller, which then waits,
+// so most tasks are submitted by pool workers.
+//
+struct FibArgs
+{
+    long lN;
+    long lResult;
+};
+
+static long Fib(long lN, bool bTasks);
+
+static void CALLBACK FibTask(LPARAM lParam)
+{
+    FibArgs* pArgs = (FibArgs*)lParam;
+    pArgs->lResult = Fib(pArgs->lN, true);
+}
+
+static long Fib(long lN, bool bTasks)
+{
+    if (lN < 18)
+    {
+        long lPrevious = 0;
+        long lCurrent = 1;
+
+        for (long lStep = 0; lStep < lN; ++lStep)
+        {
+            long lNext = lPrevious + lCurrent;
+            lPrevious = lCurrent;
+            lCurrent = lNext;
+        }
+
+        Work(20000);
+
+        return lPrevious;
+    }
+
+    if (!bTasks)
+    {
+        return Fib(lN - 1, false) + Fib(lN - 2, false);
+    }
+
+    FibArgs args = { lN - 1, 0 };
+    LPVOID pTask = LSSubmitTask(FibTask, (LPARAM)&args);
+    long lResult = Fib(lN - 2, true);
+
+    LSWaitForTask(pTask, INFINITE);
+    LSCloseTask(pTask);
+
+    return args.lResult + lResult;
+}
+
+
+//
+// BenchmarkBatch
+//
+// Submits cTasks tasks of lWork iterations from the main thread and waits
+// for all of them, on each scheduler.
+//
+static void BenchmarkBatch(UINT uWorkers, int cTasks, long lWork,
+    bool bThreadPerTask)
+{
+    std::chrono::steady_clock::time_point start;
+
+    g_lCompleted = 0;
+    start = std::chrono::steady_clock::now();
+    {
+        std::vector<LPVOID> tasks;
+        tasks.reserve(cTasks);
+
+        for (int nTask = 0; nTask < cTasks; ++nTask)
+        {
+            tasks.push_back(LSSubmitTask(Work, (LPARAM)lWork));
+        }
+
+        for (LPVOID pTask : tasks)
+        {
+            CHECK(LSWaitForTask(pTask, INFINITE) == WAIT_OBJECT_0);
+            LSCloseTask(pTask);
+        }
+    }
+    double dStealing = Milliseconds(start);
+    CHECK(g_lCompleted == cTasks);
+
+    g_lCompleted = 0;
+    start = std::chrono::steady_clock::now();
+    {
+        GlobalQueuePool pool(uWorkers);
+
+        for (int nTask = 0; nTask < cTasks; ++nTask)
+        {
+            pool.Push(Work, (LPARAM)lWork);
+        }
+
+        pool.Wait();
+    }
+    double dGlobalQueue = Milliseconds(start);
+    CHECK(g_lCompleted == cTasks);
+
+    start = std::chrono::steady_clock::now();
+
+    for (int nTask = 0; nTask < cTasks; ++nTask)
+    {
+        Work((LPARAM)lWork);
+    }
+
+    double dSerial = Milliseconds(start);
+
+    printf("%6d tasks of %5ld: work stealing %7.1f ms, global queue "
+        "%7.1f ms, serial %7.1f ms", cTasks, lWork, dStealing, dGlobalQueue,
+        dSerial);
+
+    if (bThreadPerTask)
+    {
+        start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> threads;
+
+        for (int nTask = 0; nTask < cTasks; ++nTask)
+        {
+            threads.push_back(std::thread(Work, (LPARAM)lWork));
+        }
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        printf(", thread per task %7.1f ms", Milliseconds(start));
+    }
+
+    printf("\n");
+}
+
+
+//
+// BenchmarkForkJoin
+//
+static void BenchmarkForkJoin()
+{
+    const long lN = 32;
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    long lTasks = Fib(lN, true);
+    double dTasks = Milliseconds(start);
+
+    start = std::chrono::steady_clock::now();
+    long lSerial = Fib(lN, false);
+    double dSerial = Milliseconds(start);
+
+    printf("fib(%ld) fork-join: work stealing %.1f ms, serial %.1f ms\n",
+        lN, dTasks, dSerial);
+
+    CHECK(lTasks == lSerial);
+}
+
+
+int main()
+{
+    // LSSubmitTask's pool has one worker per processor
+    SYSTEM_INFO si = { 0 };
+    GetSystemInfo(&si);
+    UINT uWorkers = si.dwNumberOfProcessors > 0 ? si.dwNumberOfProcessors : 1;
+
+    printf("%u workers\n", uWorkers);
+
+    BenchmarkBatch(uWorkers, 200000, 0, false);
+    BenchmarkBatch(uWorkers, 200000, 2000, false);
+    BenchmarkBatch(uWorkers, 2000, 50000, true);
+    BenchmarkForkJoin();
+
+    return TestResult();
+}
@@ -0,0 +1,168 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "../lsapi/lsapi.h"
+#include "testing.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+//
+// Benchmark for pattern sets. Matches the same texts against 1, 10, 100 and
+// 1000 rules, once through a compiled set (LSMatchPatternSetW, i.e.
+// WildcardSet::Match) and once by calling matchW for every rule, the way
+// modules matched their rule lists before.
+//
+
+
+//
+// MakeRules
+//
+// Rules of the kinds modules use to pick out windows and files: full
+// paths, extensions, words anywhere in a title, and character sets.
+//
+static std::vector<std::wstring> MakeRules(int cRules)
+{
+    std::vector<std::wstring> rules;
+
+    for (int nRule = 0; nRule < cRules; ++nRule)
+    {
+        std::wstring sNumber = std::to_wstring(nRule);
+
+        switch (nRule % 4)
+        {
+        case 0:
+            rules.push_back(
+                L"C:\\Program Files\\Vendor" + sNumber + L"\\*.exe");
+            break;
+
+        case 1:
+            rules.push_back(L"*.ext" + sNumber);
+            break;
+
+        case 2:
+            rules.push_back(L"*Window " + sNumber + L" -*");
+            break;
+
+        default:
+            rules.push_back(L"[Aa]pp" + sNumber + L"?.*");
+            break;
+        }
+    }
+
+    return rules;
+}
+
+
+//
+// MakeTexts
+//
+// Texts that match some of the rules, and texts that almost do.
+//
+static std::vector<std::wstring> MakeTexts()
+{
+    std::vector<std::wstring> texts;
+
+    for (int nText = 0; nText < 16; ++nText)
+    {
+        std::wstring sNumber = std::to_wstring(nText * 7);
+
+        texts.push_back(
+            L"C:\\Program Files\\Vendor" + sNumber + L"\\program.exe");
+        texts.push_back(L"C:\\Users\\someone\\Documents\\file.ext" + sNumber);
+        texts.push_back(L"Document - Window " + sNumber + L" - Editor");
+        texts.push_back(L"app" + sNumber + L"x.dll");
+    }
+
+    return texts;
+}
+
+
+int main()
+{
+    const int aSizes[] = { 1, 10, 100, 1000 };
+    std::vector<std::wstring> texts = MakeTexts();
+
+    for (int cRules : aSizes)
+    {
+        std::vector<std::wstring> rules = MakeRules(cRules);
+        std::vector<LPCWSTR> rulePtrs;
+
+        for (const std::wstring& sRule : rules)
+        {
+            rulePtrs.push_back(sRule.c_str());
+        }
+
+        // About the same number of pattern checks for every size
+        const int nPasses = (cRules < 2000) ? 2000 / cRules : 1;
+
+        LPVOID pSet = LSCompilePatternSetW(rulePtrs.data(), (UINT)cRules);
+        CHECK(pSet != nullptr);
+
+        UINT cSetMatches = 0;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+
+        for (int nPass = 0; nPass < nPasses; ++nPass)
+        {
+            for (const std::wstring& sText : texts)
+            {
+                cSetMatches +=
+                    LSMatchPatternSetW(pSet, sText.c_str(), nullptr, 0);
+            }
+        }
+
+        double dSet = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count();
+
+        UINT cLoopMatches = 0;
+        start = std::chrono::steady_clock::now();
+
+        for (int nPass = 0; nPass < nPasses; ++nPass)
+        {
+            for (const std::wstring& sText : texts)
+            {
+                for (LPCWSTR pwzRule : rulePtrs)
+                {
+                    if (matchW(pwzRule, sText.c_str()))
+                    {
+                        ++cLoopMatches;
+                    }
+                }
+            }
+        }
+
+        double dLoop = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count();
+
+        LSFreePatternSet(pSet);
+
+        const double cTexts = (double)nPasses * texts.size();
+
+        printf("%4d rules: set %8.0f ns per text, matchW loop %8.0f ns per "
+            "text, %.1fx\n", cRules, dSet / cTexts, dLoop / cTexts,
+            dLoop / dSet);
+
+        CHECK(cSetMatches == cLoopMatches);
+    }
+
+    return TestResult();
+}
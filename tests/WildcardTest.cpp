@@ -0,0 +1,280 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "../lsapi/lsapi.h"
+#include "testing.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+//
+// Differential test for compiled wildcard patterns. matcheW still
+// interprets the pattern on every call, so it serves as the reference for
+// matchW's pattern cache, LSCompilePattern and LSCompilePatternSet, which
+// must give the same answer for every pattern and text.
+//
+
+
+/** A pattern, a text, and whether the text matches */
+struct CorpusEntry
+{
+    LPCWSTR pwzPattern;
+    LPCWSTR pwzText;
+    BOOL bMatch;
+};
+
+
+//
+// Hand-picked cases, including matcheW's quirks that the compiled patterns
+// have to keep
+//
+static const CorpusEntry g_corpus[] =
+{
+    // Literals, compared case insensitively
+    { L"", L"", TRUE },
+    { L"", L"a", FALSE },
+    { L"abc", L"abc", TRUE },
+    { L"abc", L"ABC", TRUE },
+    { L"abc", L"abcd", FALSE },
+    { L"abcd", L"abc", FALSE },
+
+    // '?' takes exactly one character
+    { L"a?c", L"abc", TRUE },
+    { L"a?c", L"ac", FALSE },
+    { L"???", L"ab", FALSE },
+
+    // '*' takes any number of characters
+    { L"*", L"", TRUE },
+    { L"*", L"anything", TRUE },
+    { L"a*", L"a", TRUE },
+    { L"*c", L"abc", TRUE },
+    { L"*c", L"abcd", FALSE },
+    { L"a*b*c", L"aXbYc", TRUE },
+    { L"a*b*c", L"aXcYb", FALSE },
+    { L"*.dll", L"lsapi.DLL", TRUE },
+    { L"*?", L"", FALSE },
+    { L"*?", L"a", TRUE },
+    { L"?*?", L"a", FALSE },
+
+    // A trailing "**" needs at least one more character
+    { L"a**", L"a", FALSE },
+    { L"a**", L"ab", TRUE },
+    { L"**", L"", FALSE },
+
+    // [..] sets and ranges are case sensitive, and ranges work backwards
+    { L"[abc]", L"b", TRUE },
+    { L"[abc]", L"B", FALSE },
+    { L"[a-c]x", L"bx", TRUE },
+    { L"[c-a]x", L"bx", TRUE },
+    { L"[a-c]", L"d", FALSE },
+    { L"[!a-c]", L"d", TRUE },
+    { L"[!a-c]", L"b", FALSE },
+    { L"[^a-c]", L"d", TRUE },
+    { L"[a-cx-z]", L"y", TRUE },
+    { L"[\\]]", L"]", TRUE },
+    { L"[\\-]", L"-", TRUE },
+    { L"[a\\-c]", L"b", FALSE },
+    { L"[a-\\]]", L"^", TRUE },
+    { L"[a-\\]]", L"[", FALSE },
+    { L"*[0-9]", L"module2", TRUE },
+    { L"*[0-9]", L"module", FALSE },
+
+    // Bad patterns never match
+    { L"[]", L"]", FALSE },
+    { L"[!]", L"a", FALSE },
+    { L"[abc", L"a", FALSE },
+    { L"[a-]", L"a", FALSE },
+    { L"[a-", L"a", FALSE },
+    { L"abc\\", L"abc", FALSE },
+    { L"*\\", L"abc", FALSE },
+
+    // Escaped characters are literals
+    { L"\\*", L"*", TRUE },
+    { L"\\*", L"a", FALSE },
+    { L"a\\?c", L"a?c", TRUE },
+    { L"a\\?c", L"abc", FALSE },
+    { L"*\\[*", L"x[y", TRUE },
+
+    // Set members past the one that matched aren't checked
+    { L"[ab-]", L"a", TRUE },
+};
+
+
+//
+// CheckPattern
+//
+// Compares every way of matching a pattern with matcheW. Returns the
+// reference result.
+//
+static bool CheckPattern(LPCWSTR pwzPattern, LPCWSTR pwzText)
+{
+    bool bExpected = (matcheW(pwzPattern, pwzText) == MATCH_VALID);
+    bool bCached = (matchW(pwzPattern, pwzText) != FALSE);
+
+    LPVOID pPattern = LSCompilePatternW(pwzPattern);
+    bool bCompiled = (LSMatchPatternW(pPattern, pwzText) != FALSE);
+    LSFreePattern(pPattern);
+
+    LPVOID pSet = LSCompilePatternSetW(&pwzPattern, 1);
+    bool bSet = (LSMatchPatternSetW(pSet, pwzText, nullptr, 0) == 1);
+    LSFreePatternSet(pSet);
+
+    if (bCached != bExpected || bCompiled != bExpected || bSet != bExpected)
+    {
+        printf("\"%ls\" against \"%ls\": matcheW %d, matchW %d, "
+            "LSMatchPattern %d, LSMatchPatternSet %d\n", pwzPattern, pwzText,
+            bExpected, bCached, bCompiled, bSet);
+
+        ++g_nFailedChecks;
+    }
+
+    return bExpected;
+}
+
+
+//
+// TestCorpus
+//
+static void TestCorpus()
+{
+    for (const CorpusEntry& entry : g_corpus)
+    {
+        bool bMatch = CheckPattern(entry.pwzPattern, entry.pwzText);
+
+        if (bMatch != (entry.bMatch != FALSE))
+        {
+            printf("\"%ls\" against \"%ls\": expected %d\n",
+                entry.pwzPattern, entry.pwzText, entry.bMatch);
+
+            ++g_nFailedChecks;
+        }
+    }
+}
+
+
+//
+// RandomString
+//
+static std::wstring RandomString(unsigned int& uRandom,
+    const wchar_t* pwzAlphabet, size_t cchMax)
+{
+    const size_t cchAlphabet = wcslen(pwzAlphabet);
+    std::wstring sResult;
+
+    uRandom = uRandom * 1103515245 + 12345;
+    size_t cchLength = (uRandom >> 16) % (cchMax + 1);
+
+    for (size_t uChar = 0; uChar < cchLength; ++uChar)
+    {
+        uRandom = uRandom * 1103515245 + 12345;
+        sResult += pwzAlphabet[(uRandom >> 16) % cchAlphabet];
+    }
+
+    return sResult;
+}
+
+
+//
+// TestRandom
+//
+// Random patterns against random texts. The pattern alphabet favors '*'
+// and '?', the text alphabet includes the special characters and mixed
+// case. Patterns with sets are built separately so they are mostly valid.
+//
+static void TestRandom()
+{
+    const int nPairs = 200000;
+    unsigned int uRandom = 1;
+
+    for (int nPair = 0; nPair < nPairs; ++nPair)
+    {
+        std::wstring sPattern = RandomString(uRandom, L"ab**?abA", 17);
+
+        if ((nPair % 4) == 0)
+        {
+            std::wstring sSet = RandomString(uRandom, L"!ab-c\\]", 5);
+            sPattern += L"[" + sSet + L"]" + RandomString(uRandom, L"a*?", 3);
+        }
+
+        std::wstring sText = RandomString(uRandom, L"abABc-]!\\*?[", 17);
+
+        CheckPattern(sPattern.c_str(), sText.c_str());
+    }
+
+    printf("%d random pairs compared\n", nPairs);
+}
+
+
+//
+// TestSet
+//
+// A set reports each of its patterns that matches, in order, and counts
+// the rest once there's no room left.
+//
+static void TestSet()
+{
+    LPCWSTR apwzPatterns[] =
+    {
+        L"*.exe", L"lite*", L"[!l]*", L"litestep.exe", L"[", L"*", L"x"
+    };
+    const UINT cPatterns = sizeof(apwzPatterns) / sizeof(apwzPatterns[0]);
+    LPCWSTR apwzTexts[] = { L"LiteStep.exe", L"x", L"", L"lsapi.dll" };
+
+    LPVOID pSet = LSCompilePatternSetW(apwzPatterns, cPatterns);
+    CHECK(pSet != nullptr);
+
+    for (LPCWSTR pwzText : apwzTexts)
+    {
+        std::vector<UINT> expected;
+
+        for (UINT uPattern = 0; uPattern < cPatterns; ++uPattern)
+        {
+            if (matcheW(apwzPatterns[uPattern], pwzText) == MATCH_VALID)
+            {
+                expected.push_back(uPattern);
+            }
+        }
+
+        UINT auMatches[cPatterns] = { 0 };
+        UINT cMatches =
+            LSMatchPatternSetW(pSet, pwzText, auMatches, cPatterns);
+
+        CHECK(cMatches == expected.size());
+        CHECK(std::equal(expected.begin(), expected.end(), auMatches));
+
+        CHECK(LSMatchPatternSetW(pSet, pwzText, auMatches, 1) == cMatches);
+    }
+
+    CHECK(LSMatchPatternSetW(pSet, nullptr, nullptr, 0) == 0);
+    CHECK(LSMatchPatternSetW(nullptr, L"x", nullptr, 0) == 0);
+
+    LSFreePatternSet(pSet);
+}
+
+
+int main()
+{
+    TestCorpus();
+    TestRandom();
+    TestSet();
+
+    return TestResult();
+}
@@ -0,0 +1,71 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(TESTING_H)
+#define TESTING_H
+
+#include <stdio.h>
+
+//
+// Helpers shared by the test programs in this directory. Each test program
+// is a console application that runs its checks and returns a non-zero exit
+// code if any of them failed, see "make test".
+//
+
+/** Number of checks that failed so far */
+static int g_nFailedChecks = 0;
+
+
+//
+// CHECK
+//
+// Reports a condition that doesn't hold, along with its location. Carries
+// on either way, so a single run shows all failures.
+//
+#define CHECK(expr) \
+    do \
+    { \
+        if (!(expr)) \
+        { \
+            printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #expr); \
+            ++g_nFailedChecks; \
+        } \
+    } while (false)
+
+
+//
+// TestResult
+//
+// Prints a summary and returns the exit code for main.
+//
+static inline int TestResult()
+{
+    if (g_nFailedChecks != 0)
+    {
+        printf("%d check(s) failed\n", g_nFailedChecks);
+        return 1;
+    }
+
+    printf("OK\n");
+    return 0;
+}
+
+#endif // TESTING_H
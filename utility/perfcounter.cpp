@@ -0,0 +1,90 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "perfcounter.h"
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// QueryFrequency
+//
+static ULONGLONG QueryFrequency()
+{
+    LARGE_INTEGER liFrequency;
+    QueryPerformanceFrequency(&liFrequency);
+
+    return (ULONGLONG)liFrequency.QuadPart;
+}
+
+static const ULONGLONG g_ullFrequency = QueryFrequency();
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// GetPerformanceCounter
+//
+ULONGLONG GetPerformanceCounter()
+{
+    LARGE_INTEGER liCounter;
+    QueryPerformanceCounter(&liCounter);
+
+    return (ULONGLONG)liCounter.QuadPart;
+}
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// GetPerformanceFrequency
+//
+ULONGLONG GetPerformanceFrequency()
+{
+    return g_ullFrequency;
+}
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// PerformanceTicksToMicroseconds
+//
+ULONGLONG PerformanceTicksToMicroseconds(ULONGLONG ullTicks)
+{
+    // Split the conversion to avoid overflowing the multiplication
+    return (ullTicks / g_ullFrequency) * 1000000 +
+        (ullTicks % g_ullFrequency) * 1000000 / g_ullFrequency;
+}
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// GetLog2Bucket
+//
+UINT GetLog2Bucket(ULONGLONG ullValue, UINT cBuckets)
+{
+    UINT uBucket = 0;
+
+    while (ullValue != 0 && uBucket < cBuckets - 1)
+    {
+        ullValue >>= 1;
+        ++uBucket;
+    }
+
+    return uBucket;
+}
@@ -0,0 +1,64 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(PERFCOUNTER_H)
+#define PERFCOUNTER_H
+
+#include "common.h"
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// Performance Counter Helpers
+//
+// Shared by the profiling code (BangProfile, MessageTracer, StartupTimeline,
+// module statistics), so their timings and histograms are comparable
+//
+
+//
+// GetPerformanceCounter
+// Current QueryPerformanceCounter value, in ticks.
+//
+ULONGLONG GetPerformanceCounter();
+
+//
+// GetPerformanceFrequency
+// Ticks per second. Queried once, since it never changes while the system is
+// running.
+//
+ULONGLONG GetPerformanceFrequency();
+
+//
+// PerformanceTicksToMicroseconds
+// Converts a number of ticks, such as the difference of two counter values.
+// Doesn't overflow for counter values since boot.
+//
+ULONGLONG PerformanceTicksToMicroseconds(ULONGLONG ullTicks);
+
+//
+// GetLog2Bucket
+// Histogram bucket for a value, i.e. its number of significant bits. Bucket 0
+// counts 0, bucket n counts values under 2^n, the last bucket everything
+// larger.
+//
+UINT GetLog2Bucket(ULONGLONG ullValue, UINT cBuckets);
+
+#endif // PERFCOUNTER_H
@@ -0,0 +1,440 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "scan.h"
+#include "core.hpp"
+
+#if defined(_M_X64) || defined(__x86_64__) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#  define SCAN_USE_SSE2
+#  include <emmintrin.h>
+#endif
+
+// AVX2 is only used after checking for it at runtime
+#if defined(SCAN_USE_SSE2) && \
+    ((defined(_MSC_VER) && _MSC_VER >= 1700) || defined(__GNUC__))
+#  define SCAN_USE_AVX2
+#  include <immintrin.h>
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#    define SCAN_TARGET_AVX2
+#  else
+#    define SCAN_TARGET_AVX2 __attribute__((target("avx2")))
+#  endif
+#endif
+
+
+//
+// Classification table for ASCII characters
+//
+static const BYTE s_aClassTable[128] =
+{
+    0, 0, 0, 0, 0, 0, 0, 0, 0,                          // 0x00 - 0x08
+    SCAN_WHITESPACE | SCAN_ANYSPACE,                    // \t
+    SCAN_WHITESPACE | SCAN_ANYSPACE,                    // \n
+    SCAN_ANYSPACE,                                      // \v
+    SCAN_ANYSPACE,                                      // \f
+    SCAN_WHITESPACE | SCAN_ANYSPACE,                    // \r
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x0E - 0x1F
+    SCAN_WHITESPACE | SCAN_ANYSPACE,                    // space
+    0,                                                  // !
+    SCAN_QUOTE,                                         // "
+    0,                                                  // #
+    SCAN_DOLLAR,                                        // $
+    0, 0,                                               // % &
+    SCAN_QUOTE,                                         // '
+    0, 0, 0, 0, 0, 0, 0, 0,                             // ( - /
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0,                       // 0 - 9
+    0,                                                  // :
+    SCAN_COMMENT,                                       // ;
+    0, 0, 0, 0,                                         // < = > ?
+    SCAN_AT,                                            // @
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,              // A - M
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,              // N - Z
+    SCAN_BRACKET,                                       // [
+    0,                                                  // backslash
+    SCAN_BRACKET,                                       // ]
+    0, 0, 0,                                            // ^ _ `
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,              // a - m
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,              // n - z
+    0, 0, 0, 0, 0                                       // { | } ~ DEL
+};
+
+
+//
+// _ScanForScalar
+//
+static LPCWSTR _ScanForScalar(LPCWSTR pwzString, UINT uClasses)
+{
+    const bool bNonASCII = (uClasses & SCAN_ANYSPACE) != 0;
+
+    for (;; ++pwzString)
+    {
+        wchar_t wc = *pwzString;
+
+        if (wc == L'\0' ||
+            (wc < 0x80 ? (s_aClassTable[wc] & uClasses) != 0 : bNonASCII))
+        {
+            return pwzString;
+        }
+    }
+}
+
+
+//
+// _SkipWhitespaceScalar
+//
+static LPCWSTR _SkipWhitespaceScalar(LPCWSTR pwzString)
+{
+    while (*pwzString < 0x80 && (s_aClassTable[*pwzString] & SCAN_WHITESPACE))
+    {
+        ++pwzString;
+    }
+
+    return pwzString;
+}
+
+
+#if defined(SCAN_USE_SSE2)
+
+//
+// ScanNeedles
+//
+// The individual characters a vector scan compares against
+//
+struct ScanNeedles
+{
+    wchar_t wcChars[12];
+    int nChars;
+    bool bAnySpace;
+};
+
+
+//
+// _BuildNeedles
+//
+static void _BuildNeedles(UINT uClasses, ScanNeedles& needles)
+{
+    static const struct
+    {
+        UINT uClass;
+        LPCWSTR pwzChars;
+    } s_aClassChars[] =
+    {
+        { SCAN_WHITESPACE, WHITESPACEW },
+        { SCAN_COMMENT,    L";"        },
+        { SCAN_QUOTE,      L"\"\'"     },
+        { SCAN_BRACKET,    L"[]"       },
+        { SCAN_DOLLAR,     L"$"        },
+        { SCAN_AT,         L"@"        }
+    };
+
+    needles.nChars = 0;
+    needles.bAnySpace = (uClasses & SCAN_ANYSPACE) != 0;
+
+    // SCAN_ANYSPACE already covers all of WHITESPACE
+    if (needles.bAnySpace)
+    {
+        uClasses &= ~SCAN_WHITESPACE;
+    }
+
+    for (size_t n = 0; n < COUNTOF(s_aClassChars); ++n)
+    {
+        if (uClasses & s_aClassChars[n].uClass)
+        {
+            for (LPCWSTR pwzChar = s_aClassChars[n].pwzChars; *pwzChar; ++pwzChar)
+            {
+                needles.wcChars[needles.nChars++] = *pwzChar;
+            }
+        }
+    }
+}
+
+
+//
+// _LowestBit
+//
+static inline unsigned _LowestBit(unsigned uMask)
+{
+#if defined(_MSC_VER)
+    unsigned long ulIndex;
+    _BitScanForward(&ulIndex, uMask);
+    return ulIndex;
+#else
+    return (unsigned)__builtin_ctz(uMask);
+#endif
+}
+
+
+//
+// _Match128
+//
+static inline __m128i _Match128(__m128i xChars, const __m128i* pxNeedles,
+                                int nNeedles, bool bAnySpace)
+{
+    const __m128i xZero = _mm_setzero_si128();
+    __m128i xMatch = _mm_cmpeq_epi16(xChars, xZero);
+
+    for (int n = 0; n < nNeedles; ++n)
+    {
+        xMatch = _mm_or_si128(xMatch, _mm_cmpeq_epi16(xChars, pxNeedles[n]));
+    }
+
+    if (bAnySpace)
+    {
+        // \t - \r: (c - 9) <= 4, unsigned
+        __m128i xControl = _mm_subs_epu16(
+            _mm_sub_epi16(xChars, _mm_set1_epi16(0x09)), _mm_set1_epi16(4));
+
+        // > 0x7F: (c - 0x7F) != 0, saturated
+        __m128i xASCII = _mm_cmpeq_epi16(
+            _mm_subs_epu16(xChars, _mm_set1_epi16(0x7F)), xZero);
+
+        xMatch = _mm_or_si128(xMatch, _mm_cmpeq_epi16(xControl, xZero));
+        xMatch = _mm_or_si128(xMatch,
+            _mm_cmpeq_epi16(xChars, _mm_set1_epi16(L' ')));
+        xMatch = _mm_or_si128(xMatch, _mm_andnot_si128(xASCII,
+            _mm_set1_epi16(-1)));
+    }
+
+    return xMatch;
+}
+
+
+//
+// _ScanForSSE2
+//
+// Works on aligned 16 byte blocks. Reading the rest of the block containing
+// the terminator is safe since an aligned block never crosses a page.
+//
+static LPCWSTR _ScanForSSE2(LPCWSTR pwzString, const ScanNeedles& needles)
+{
+    __m128i axNeedles[COUNTOF(needles.wcChars)];
+
+    for (int n = 0; n < needles.nChars; ++n)
+    {
+        axNeedles[n] = _mm_set1_epi16((short)needles.wcChars[n]);
+    }
+
+    uintptr_t uAddress = (uintptr_t)pwzString;
+    const __m128i* pxBlock = (const __m128i*)(uAddress & ~(uintptr_t)15);
+
+    unsigned uMask = (unsigned)_mm_movemask_epi8(_Match128(
+        _mm_load_si128(pxBlock), axNeedles, needles.nChars, needles.bAnySpace));
+    uMask &= 0xFFFFu << (unsigned)(uAddress & 15);
+
+    while (uMask == 0)
+    {
+        ++pxBlock;
+        uMask = (unsigned)_mm_movemask_epi8(_Match128(_mm_load_si128(pxBlock),
+            axNeedles, needles.nChars, needles.bAnySpace));
+    }
+
+    return (LPCWSTR)((const char*)pxBlock + _LowestBit(uMask));
+}
+
+
+//
+// _SkipWhitespaceSSE2
+//
+static LPCWSTR _SkipWhitespaceSSE2(LPCWSTR pwzString)
+{
+    const __m128i xSpace = _mm_set1_epi16(L' ');
+    const __m128i xTab = _mm_set1_epi16(L'\t');
+    const __m128i xLF = _mm_set1_epi16(L'\n');
+    const __m128i xCR = _mm_set1_epi16(L'\r');
+
+    uintptr_t uAddress = (uintptr_t)pwzString;
+    const __m128i* pxBlock = (const __m128i*)(uAddress & ~(uintptr_t)15);
+    unsigned uSkip = 0xFFFFu << (unsigned)(uAddress & 15);
+
+    for (;; ++pxBlock, uSkip = 0xFFFFu)
+    {
+        __m128i xChars = _mm_load_si128(pxBlock);
+        __m128i xWhite = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi16(xChars, xSpace),
+                         _mm_cmpeq_epi16(xChars, xTab)),
+            _mm_or_si128(_mm_cmpeq_epi16(xChars, xLF),
+                         _mm_cmpeq_epi16(xChars, xCR)));
+
+        unsigned uMask = ~(unsigned)_mm_movemask_epi8(xWhite) & 0xFFFFu & uSkip;
+
+        if (uMask != 0)
+        {
+            return (LPCWSTR)((const char*)pxBlock + _LowestBit(uMask));
+        }
+    }
+}
+
+#endif // SCAN_USE_SSE2
+
+
+#if defined(SCAN_USE_AVX2)
+
+//
+// _HasAVX2
+//
+static bool _HasAVX2()
+{
+#if defined(_MSC_VER)
+    int aInfo[4];
+
+    __cpuid(aInfo, 0);
+
+    if (aInfo[0] < 7)
+    {
+        return false;
+    }
+
+    // OSXSAVE and AVX, and the OS saves the YMM registers
+    __cpuid(aInfo, 1);
+
+    if ((aInfo[2] & 0x18000000) != 0x18000000 || (_xgetbv(0) & 6) != 6)
+    {
+        return false;
+    }
+
+    __cpuidex(aInfo, 7, 0);
+
+    return (aInfo[1] & 0x20) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+static const bool s_bHasAVX2 = _HasAVX2();
+
+
+//
+// _ScanForAVX2
+//
+SCAN_TARGET_AVX2
+static LPCWSTR _ScanForAVX2(LPCWSTR pwzString, const ScanNeedles& needles)
+{
+    const __m256i yZero = _mm256_setzero_si256();
+    __m256i ayNeedles[COUNTOF(needles.wcChars)];
+
+    for (int n = 0; n < needles.nChars; ++n)
+    {
+        ayNeedles[n] = _mm256_set1_epi16((short)needles.wcChars[n]);
+    }
+
+    const __m256i yTab = _mm256_set1_epi16(0x09);
+    const __m256i yFour = _mm256_set1_epi16(4);
+    const __m256i ySpace = _mm256_set1_epi16(L' ');
+    const __m256i yDEL = _mm256_set1_epi16(0x7F);
+
+    uintptr_t uAddress = (uintptr_t)pwzString;
+    const __m256i* pyBlock = (const __m256i*)(uAddress & ~(uintptr_t)31);
+    unsigned uSkip = 0xFFFFFFFFu << (unsigned)(uAddress & 31);
+
+    for (;; ++pyBlock, uSkip = 0xFFFFFFFFu)
+    {
+        __m256i yChars = _mm256_load_si256(pyBlock);
+        __m256i yMatch = _mm256_cmpeq_epi16(yChars, yZero);
+
+        for (int n = 0; n < needles.nChars; ++n)
+        {
+            yMatch = _mm256_or_si256(yMatch,
+                _mm256_cmpeq_epi16(yChars, ayNeedles[n]));
+        }
+
+        if (needles.bAnySpace)
+        {
+            __m256i yControl = _mm256_subs_epu16(
+                _mm256_sub_epi16(yChars, yTab), yFour);
+            __m256i yASCII = _mm256_cmpeq_epi16(
+                _mm256_subs_epu16(yChars, yDEL), yZero);
+
+            yMatch = _mm256_or_si256(yMatch,
+                _mm256_cmpeq_epi16(yControl, yZero));
+            yMatch = _mm256_or_si256(yMatch,
+                _mm256_cmpeq_epi16(yChars, ySpace));
+            yMatch = _mm256_or_si256(yMatch, _mm256_andnot_si256(yASCII,
+                _mm256_set1_epi16(-1)));
+        }
+
+        unsigned uMask = (unsigned)_mm256_movemask_epi8(yMatch) & uSkip;
+
+        if (uMask != 0)
+        {
+#if defined(_MSC_VER)
+            unsigned long ulIndex;
+            _BitScanForward(&ulIndex, uMask);
+#else
+            unsigned ulIndex = (unsigned)__builtin_ctz(uMask);
+#endif
+            return (LPCWSTR)((const char*)pyBlock + ulIndex);
+        }
+    }
+}
+
+#endif // SCAN_USE_AVX2
+
+
+//
+// ScanFor
+//
+LPCWSTR ScanFor(LPCWSTR pwzString, UINT uClasses)
+{
+    ASSERT(pwzString != nullptr);
+
+#if defined(SCAN_USE_SSE2)
+    // The vector code needs wchar_t alignment to find the terminator
+    if (((uintptr_t)pwzString & 1) == 0)
+    {
+        ScanNeedles needles;
+        _BuildNeedles(uClasses, needles);
+
+#if defined(SCAN_USE_AVX2)
+        if (s_bHasAVX2)
+        {
+            return _ScanForAVX2(pwzString, needles);
+        }
+#endif
+
+        return _ScanForSSE2(pwzString, needles);
+    }
+#endif
+
+    return _ScanForScalar(pwzString, uClasses);
+}
+
+
+//
+// SkipWhitespace
+//
+LPCWSTR SkipWhitespace(LPCWSTR pwzString)
+{
+    ASSERT(pwzString != nullptr);
+
+#if defined(SCAN_USE_SSE2)
+    // Most strings start with at most a few whitespace characters
+    if (((uintptr_t)pwzString & 1) == 0 &&
+        *pwzString < 0x80 && (s_aClassTable[*pwzString] & SCAN_WHITESPACE))
+    {
+        return _SkipWhitespaceSSE2(pwzString);
+    }
+#endif
+
+    return _SkipWhitespaceScalar(pwzString);
+}
@@ -0,0 +1,81 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(SCAN_H)
+#define SCAN_H
+
+#include "common.h"
+
+
+//
+// ScanClass
+//
+// Character classes understood by ScanFor. All classes are ASCII only, except
+// for SCAN_ANYSPACE which matches every non-ASCII character so that callers
+// can decide with iswspace.
+//
+enum ScanClass
+{
+    SCAN_WHITESPACE = 0x01,  // WHITESPACE: space, \t, \n, \r
+    SCAN_COMMENT    = 0x02,  // ;
+    SCAN_QUOTE      = 0x04,  // " and '
+    SCAN_BRACKET    = 0x08,  // [ and ]
+    SCAN_DOLLAR     = 0x10,  // $
+    SCAN_AT         = 0x20,  // @
+    SCAN_ANYSPACE   = 0x40,  // \t through \r, space, and anything above 0x7F
+
+    // RESERVEDCHARS
+    SCAN_RESERVED   = SCAN_COMMENT | SCAN_QUOTE | SCAN_BRACKET | SCAN_DOLLAR
+};
+
+
+/**
+ * Finds the first character in a string that belongs to any of the given
+ * classes. Uses SSE2 or AVX2 when the CPU supports it.
+ *
+ * @param  pwzString  String to scan
+ * @param  uClasses   Combination of ScanClass values
+ * @return Pointer to the first matching character, or to the terminating
+ *         null character if there is none
+ */
+LPCWSTR ScanFor(LPCWSTR pwzString, UINT uClasses);
+
+/**
+ * Skips over WHITESPACE characters. Same as pwzString + wcsspn(pwzString,
+ * WHITESPACE).
+ *
+ * @param  pwzString  String to scan
+ * @return Pointer to the first character that is not whitespace
+ */
+LPCWSTR SkipWhitespace(LPCWSTR pwzString);
+
+
+inline LPWSTR ScanFor(LPWSTR pwzString, UINT uClasses)
+{
+    return const_cast<LPWSTR>(ScanFor(const_cast<LPCWSTR>(pwzString), uClasses));
+}
+
+inline LPWSTR SkipWhitespace(LPWSTR pwzString)
+{
+    return const_cast<LPWSTR>(SkipWhitespace(const_cast<LPCWSTR>(pwzString)));
+}
+
+#endif // SCAN_H
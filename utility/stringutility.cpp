@@ -22,6 +22,98 @@
 #include "stringutility.h"
 #include "common.h"
 
+#if defined(_M_X64) || defined(__x86_64__) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#  define STRINGUTILITY_USE_SSE2
+#  include <emmintrin.h>
+#endif
+
+
+//
+// _WidenASCII
+//   (local helper function)
+//
+// Copies cch characters from an ASCII string to a wide string. Returns false
+// as soon as a non-ASCII character shows up.
+//
+static bool _WidenASCII(const char *pszMBS, size_t cch, wchar_t *pwzWCS)
+{
+    size_t n = 0;
+
+#if defined(STRINGUTILITY_USE_SSE2)
+    const __m128i xZero = _mm_setzero_si128();
+
+    for (; n + 16 <= cch; n += 16)
+    {
+        __m128i xChars = _mm_loadu_si128((const __m128i*)(pszMBS + n));
+
+        if (_mm_movemask_epi8(xChars) != 0)
+        {
+            return false;
+        }
+
+        _mm_storeu_si128((__m128i*)(pwzWCS + n), _mm_unpacklo_epi8(xChars, xZero));
+        _mm_storeu_si128((__m128i*)(pwzWCS + n + 8), _mm_unpackhi_epi8(xChars, xZero));
+    }
+#endif
+
+    for (; n < cch; ++n)
+    {
+        if ((unsigned char)pszMBS[n] >= 0x80)
+        {
+            return false;
+        }
+
+        pwzWCS[n] = (wchar_t)pszMBS[n];
+    }
+
+    return true;
+}
+
+
+//
+// _NarrowASCII
+//   (local helper function)
+//
+// Copies cch characters from a wide string to an ASCII string. Returns false
+// as soon as a non-ASCII character shows up.
+//
+static bool _NarrowASCII(const wchar_t *pwzWCS, size_t cch, char *pszMBS)
+{
+    size_t n = 0;
+
+#if defined(STRINGUTILITY_USE_SSE2)
+    const __m128i xZero = _mm_setzero_si128();
+    const __m128i xNonASCII = _mm_set1_epi16((short)0xFF80);
+
+    for (; n + 16 <= cch; n += 16)
+    {
+        __m128i xLow = _mm_loadu_si128((const __m128i*)(pwzWCS + n));
+        __m128i xHigh = _mm_loadu_si128((const __m128i*)(pwzWCS + n + 8));
+        __m128i xTest = _mm_and_si128(_mm_or_si128(xLow, xHigh), xNonASCII);
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(xTest, xZero)) != 0xFFFF)
+        {
+            return false;
+        }
+
+        _mm_storeu_si128((__m128i*)(pszMBS + n), _mm_packus_epi16(xLow, xHigh));
+    }
+#endif
+
+    for (; n < cch; ++n)
+    {
+        if (pwzWCS[n] >= 0x80)
+        {
+            return false;
+        }
+
+        pszMBS[n] = (char)pwzWCS[n];
+    }
+
+    return true;
+}
+
 
 //
 // WCSFromMBS
@@ -32,7 +124,7 @@ wchar_t *WCSFromMBS(const char *pszMBS)
     {
         size_t nLen = strlen(pszMBS) + 1;
         wchar_t *pwzWCS = new wchar_t[nLen];
-        MultiByteToWideChar(CP_ACP, 0, pszMBS, -1, pwzWCS, (int)nLen);
+        ConvertMBSToWCS(pszMBS, pwzWCS, nLen);
         return pwzWCS;
     }
     return nullptr;
@@ -48,8 +140,54 @@ char *MBSFromWCS(const wchar_t *pwzWCS)
     {
         size_t nLen = wcslen(pwzWCS) + 1;
         char *pszMBS = new char[nLen];
-        WideCharToMultiByte(CP_ACP, 0, pwzWCS, -1, pszMBS, (int)nLen, "?", nullptr);
+        ConvertWCSToMBS(pwzWCS, pszMBS, nLen);
         return pszMBS;
     }
     return nullptr;
 }
+
+
+//
+// ConvertMBSToWCS
+//
+void ConvertMBSToWCS(LPCSTR pszMBS, LPWSTR pwzBuffer, size_t cchBuffer)
+{
+    if (pwzBuffer == nullptr || cchBuffer == 0)
+    {
+        return;
+    }
+
+    size_t cchMBS = strlen(pszMBS) + 1;
+
+    if (cchMBS > cchBuffer || !_WidenASCII(pszMBS, cchMBS, pwzBuffer))
+    {
+        if (MultiByteToWideChar(CP_ACP, 0, pszMBS, -1,
+            pwzBuffer, (int)cchBuffer) == 0)
+        {
+            pwzBuffer[cchBuffer - 1] = L'\0';
+        }
+    }
+}
+
+
+//
+// ConvertWCSToMBS
+//
+void ConvertWCSToMBS(LPCWSTR pwzWCS, LPSTR pszBuffer, size_t cchBuffer)
+{
+    if (pszBuffer == nullptr || cchBuffer == 0)
+    {
+        return;
+    }
+
+    size_t cchWCS = wcslen(pwzWCS) + 1;
+
+    if (cchWCS > cchBuffer || !_NarrowASCII(pwzWCS, cchWCS, pszBuffer))
+    {
+        if (WideCharToMultiByte(CP_ACP, 0, pwzWCS, -1,
+            pszBuffer, (int)cchBuffer, "?", nullptr) == 0)
+        {
+            pszBuffer[cchBuffer - 1] = '\0';
+        }
+    }
+}
@@ -270,10 +270,151 @@ struct StringKeyedSets
 //
 // Quick conversion
 //
+// WCSFromMBS and MBSFromWCS return heap copies which the caller must delete.
+// The ConvertedWCS and ConvertedMBS classes below should be preferred for
+// temporaries, they only touch the heap for long strings.
+//
 wchar_t *WCSFromMBS(const char *pszMBS);
 char *MBSFromWCS(const wchar_t *pwzWCS);
 
-#define WCSTOMBS(str) std::unique_ptr<char>(MBSFromWCS(str)).get()
-#define MBSTOWCS(str) std::unique_ptr<wchar_t>(WCSFromMBS(str)).get()
+/**
+ * Converts a CP_ACP string to UTF-16. Pure ASCII strings are widened
+ * directly, without going through MultiByteToWideChar. The result is always
+ * null terminated. Does nothing if pwzBuffer is NULL.
+ *
+ * @param  pszMBS     String to convert
+ * @param  pwzBuffer  Receives the converted string
+ * @param  cchBuffer  Size of pwzBuffer
+ */
+void ConvertMBSToWCS(LPCSTR pszMBS, LPWSTR pwzBuffer, size_t cchBuffer);
+
+/**
+ * Converts a UTF-16 string to CP_ACP. Pure ASCII strings are narrowed
+ * directly, anything else goes through WideCharToMultiByte with '?' as the
+ * default character. The result is always null terminated. Does nothing if
+ * pszBuffer is NULL.
+ *
+ * @param  pwzWCS     String to convert
+ * @param  pszBuffer  Receives the converted string
+ * @param  cchBuffer  Size of pszBuffer
+ */
+void ConvertWCSToMBS(LPCWSTR pwzWCS, LPSTR pszBuffer, size_t cchBuffer);
+
+
+//
+// ScratchBuffer
+//
+// Temporary buffer which lives on the stack as long as the requested size
+// fits in cchInline elements, and on the heap otherwise.
+//
+template <typename Type, size_t cchInline>
+class ScratchBuffer
+{
+    ScratchBuffer(const ScratchBuffer&);
+    ScratchBuffer& operator=(const ScratchBuffer&);
+
+public:
+    explicit ScratchBuffer(size_t cchSize)
+        : m_pHeap(nullptr)
+        , m_pBuffer(m_aInline)
+    {
+        if (cchSize > cchInline)
+        {
+            m_pHeap = new Type[cchSize];
+            m_pBuffer = m_pHeap;
+        }
+    }
+
+    ~ScratchBuffer()
+    {
+        delete [] m_pHeap;
+    }
+
+    Type *get() const
+    {
+        return m_pBuffer;
+    }
+
+private:
+    Type m_aInline[cchInline];
+    Type *m_pHeap;
+    Type *m_pBuffer;
+};
+
+
+//
+// ConvertedWCS
+//
+// UTF-16 copy of a CP_ACP string, for passing ANSI arguments on to the wide
+// implementation. get() returns nullptr if the source string was nullptr.
+//
+template <size_t cchInline = MAX_PATH>
+class ConvertedWCS
+{
+    ConvertedWCS(const ConvertedWCS&);
+    ConvertedWCS& operator=(const ConvertedWCS&);
+
+public:
+    explicit ConvertedWCS(LPCSTR pszMBS)
+        : m_cchString(pszMBS ? strlen(pszMBS) + 1 : 0)
+        , m_buffer(m_cchString)
+        , m_pwzString(pszMBS ? m_buffer.get() : nullptr)
+    {
+        if (pszMBS != nullptr)
+        {
+            ConvertMBSToWCS(pszMBS, m_pwzString, m_cchString);
+        }
+    }
+
+    LPWSTR get() const
+    {
+        return m_pwzString;
+    }
+
+private:
+    size_t m_cchString;
+    ScratchBuffer<wchar_t, cchInline> m_buffer;
+    LPWSTR m_pwzString;
+};
+
+
+//
+// ConvertedMBS
+//
+// CP_ACP copy of a UTF-16 string, for calling back into ANSI code.
+// get() returns nullptr if the source string was nullptr.
+//
+template <size_t cchInline = 3 * MAX_PATH>
+class ConvertedMBS
+{
+    ConvertedMBS(const ConvertedMBS&);
+    ConvertedMBS& operator=(const ConvertedMBS&);
+
+public:
+    explicit ConvertedMBS(LPCWSTR pwzWCS)
+        // UTF-8 needs at most three bytes per UTF-16 code unit, DBCS two
+        : m_cchString(pwzWCS ? 3 * wcslen(pwzWCS) + 1 : 0)
+        , m_buffer(m_cchString)
+        , m_pszString(pwzWCS ? m_buffer.get() : nullptr)
+    {
+        if (pwzWCS != nullptr)
+        {
+            ConvertWCSToMBS(pwzWCS, m_pszString, m_cchString);
+        }
+    }
+
+    LPSTR get() const
+    {
+        return m_pszString;
+    }
+
+private:
+    size_t m_cchString;
+    ScratchBuffer<char, cchInline> m_buffer;
+    LPSTR m_pszString;
+};
+
+#define WCSTOMBS(str) ConvertedMBS<>(str).get()
+#define MBSTOWCS(str) ConvertedWCS<>(str).get()
 
 #endif // STRINGUTILITY_H
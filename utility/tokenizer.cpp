@@ -0,0 +1,304 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#include "tokenizer.h"
+#include "core.hpp"
+#include "scan.h"
+#include <wctype.h>
+
+
+//
+// TokenSegment
+//
+// One (possibly quoted) run of characters. A token consists of one or more
+// adjacent segments.
+//
+struct TokenSegment
+{
+    LPCWSTR pwzStart;
+    LPCWSTR pwzEnd;
+    LPCWSTR pwzValue;
+    size_t cchValue;
+    LPCWSTR pwzNext;
+    wchar_t cQuote;
+    bool bAppend;
+};
+
+
+//
+// _ScanSegment
+//   (local helper function)
+//
+// This is the scanning loop of the original GetToken. The rules are kept
+// exactly the same, quirks included, since modules depend on them.
+//
+static void _ScanSegment(LPCWSTR pwzString, bool bUseBrackets, TokenSegment& segment)
+{
+    LPCWSTR pwzCurrent = SkipWhitespace(pwzString);
+    LPCWSTR pwzStartMarker = nullptr;
+    int iBracketLevel = 0;
+    wchar_t cQuote = L'\0';
+    bool bAppend = false;
+
+    // Only spaces, quotes and brackets can end or change a token
+    const UINT uStopClasses =
+        SCAN_ANYSPACE | SCAN_QUOTE | (bUseBrackets ? SCAN_BRACKET : 0);
+
+    segment.pwzStart = pwzCurrent;
+
+    for (; *pwzCurrent; ++pwzCurrent)
+    {
+        if (iswspace((wint_t)*pwzCurrent) && !cQuote)
+        {
+            break;
+        }
+
+        if (bUseBrackets && (*pwzCurrent == L'[' || *pwzCurrent == L']') &&
+            (cQuote == L'\0' || cQuote == L'['))
+        {
+            if (*pwzCurrent == L'[')
+            {
+                if (pwzStartMarker && !cQuote)
+                {
+                    break;
+                }
+
+                ++iBracketLevel;
+                cQuote = L'[';
+
+                if (iBracketLevel == 1)
+                {
+                    continue;
+                }
+            }
+            else
+            {
+                --iBracketLevel;
+
+                if (iBracketLevel <= 0)
+                {
+                    break;
+                }
+            }
+        }
+
+        if ((*pwzCurrent == L'\"' || *pwzCurrent == L'\'') && cQuote != L'[')
+        {
+            if (!cQuote)
+            {
+                if (pwzStartMarker)
+                {
+                    bAppend = true;
+                    break;
+                }
+
+                cQuote = *pwzCurrent;
+                continue;
+            }
+            else if (*pwzCurrent == cQuote)
+            {
+                break;
+            }
+        }
+
+        if (!pwzStartMarker)
+        {
+            pwzStartMarker = pwzCurrent;
+        }
+
+        pwzCurrent = ScanFor(pwzCurrent + 1, uStopClasses) - 1;
+    }
+
+    segment.pwzValue = pwzStartMarker;
+    segment.cchValue = pwzStartMarker ? pwzCurrent - pwzStartMarker : 0;
+    segment.cQuote = cQuote;
+    segment.bAppend = bAppend;
+
+    // With an open quote the loop can only stop at the matching closing
+    // character, which belongs to the raw token text
+    segment.pwzEnd = (cQuote && *pwzCurrent) ? pwzCurrent + 1 : pwzCurrent;
+
+    if (!bAppend && *pwzCurrent)
+    {
+        ++pwzCurrent;
+    }
+
+    segment.pwzNext = SkipWhitespace(pwzCurrent);
+}
+
+
+//
+// TokenSpan::TokenSpan
+//
+TokenSpan::TokenSpan()
+    : pwzRaw(nullptr)
+    , cchRaw(0)
+    , pwzValue(nullptr)
+    , cchValue(0)
+    , cchLength(0)
+    , cQuote(L'\0')
+    , bJoined(false)
+    , bUseBrackets(false)
+{
+}
+
+
+//
+// TokenSpan::CopyTo
+//
+HRESULT TokenSpan::CopyTo(LPWSTR pwzBuffer, size_t cchBuffer) const
+{
+    if (pwzBuffer == nullptr || cchBuffer == 0)
+    {
+        return STRSAFE_E_INVALID_PARAMETER;
+    }
+
+    if (!bJoined)
+    {
+        return StringCchCopyNW(pwzBuffer, cchBuffer,
+            pwzValue ? pwzValue : L"", cchValue);
+    }
+
+    HRESULT hr = S_OK;
+    size_t cchCopied = 0;
+    TokenSegment segment;
+    LPCWSTR pwzNext = pwzRaw;
+
+    pwzBuffer[0] = L'\0';
+
+    do
+    {
+        _ScanSegment(pwzNext, bUseBrackets, segment);
+
+        if (segment.cchValue > 0)
+        {
+            hr = StringCchCopyNW(pwzBuffer + cchCopied, cchBuffer - cchCopied,
+                segment.pwzValue, segment.cchValue);
+
+            if (FAILED(hr))
+            {
+                break;
+            }
+
+            cchCopied += segment.cchValue;
+        }
+
+        pwzNext = segment.pwzNext;
+    }
+    while (segment.bAppend && *pwzNext);
+
+    return hr;
+}
+
+
+//
+// TokenSpan::IsEqual
+//
+bool TokenSpan::IsEqual(LPCWSTR pwzString, bool bCaseSensitive) const
+{
+    if (pwzString == nullptr || wcslen(pwzString) != cchLength)
+    {
+        return false;
+    }
+
+    TokenSegment segment;
+    LPCWSTR pwzNext = pwzRaw;
+
+    if (!bJoined)
+    {
+        segment.pwzValue = pwzValue;
+        segment.cchValue = cchValue;
+        segment.bAppend = false;
+    }
+
+    do
+    {
+        if (bJoined)
+        {
+            _ScanSegment(pwzNext, bUseBrackets, segment);
+            pwzNext = segment.pwzNext;
+        }
+
+        if (segment.cchValue > 0)
+        {
+            int nResult = bCaseSensitive ?
+                wcsncmp(pwzString, segment.pwzValue, segment.cchValue) :
+                _wcsnicmp(pwzString, segment.pwzValue, segment.cchValue);
+
+            if (nResult != 0)
+            {
+                return false;
+            }
+
+            pwzString += segment.cchValue;
+        }
+    }
+    while (segment.bAppend && *pwzNext);
+
+    return true;
+}
+
+
+//
+// Tokenizer::Tokenizer
+//
+Tokenizer::Tokenizer(LPCWSTR pwzString, bool bUseBrackets)
+    : m_pwzNext(pwzString)
+    , m_bUseBrackets(bUseBrackets)
+{
+}
+
+
+//
+// Tokenizer::Next
+//
+bool Tokenizer::Next(TokenSpan& token)
+{
+    if (m_pwzNext == nullptr)
+    {
+        return false;
+    }
+
+    TokenSegment segment;
+    _ScanSegment(m_pwzNext, m_bUseBrackets, segment);
+
+    token.pwzRaw = segment.pwzStart;
+    token.pwzValue = segment.pwzValue;
+    token.cchValue = segment.cchValue;
+    token.cchLength = segment.cchValue;
+    token.cQuote = segment.cQuote;
+    token.bJoined = false;
+    token.bUseBrackets = m_bUseBrackets;
+
+    // Quotes directly following a token continue it, like in foo"bar baz"
+    while (segment.bAppend && *segment.pwzNext)
+    {
+        _ScanSegment(segment.pwzNext, m_bUseBrackets, segment);
+
+        token.cchLength += segment.cchValue;
+        token.bJoined = true;
+    }
+
+    token.cchRaw = segment.pwzEnd - token.pwzRaw;
+    m_pwzNext = *segment.pwzNext ? segment.pwzNext : nullptr;
+
+    return true;
+}
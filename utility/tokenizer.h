@@ -0,0 +1,130 @@
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// This is a part of the Litestep Shell source code.
+//
+// Copyright (C) 1997-2015  LiteStep Development Team
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+#if !defined(TOKENIZER_H)
+#define TOKENIZER_H
+
+#include "common.h"
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// TokenSpan
+//
+// Describes one token found by a Tokenizer. The span points into the string
+// that was tokenized, so it is only valid as long as that string is.
+//
+// Most tokens are a single (possibly quoted) run of characters, in which case
+// pwzValue/cchValue hold the unquoted value directly. Quoted segments that
+// directly follow a token (foo"bar baz") are joined into the same token, just
+// like GetToken does. For those bJoined is set and the value has to be
+// retrieved through CopyTo or compared through IsEqual.
+//
+struct TokenSpan
+{
+    // Raw token text, including quotes and brackets
+    LPCWSTR pwzRaw;
+    size_t cchRaw;
+
+    // Unquoted value of the first segment, nullptr if the token is empty
+    LPCWSTR pwzValue;
+    size_t cchValue;
+
+    // Total length of the unquoted value, including joined segments
+    size_t cchLength;
+
+    // Opening character of the first segment: '"', '\'', '[' or '\0'
+    wchar_t cQuote;
+
+    bool bJoined;
+    bool bUseBrackets;
+
+    TokenSpan();
+
+    /**
+     * Checks if the token has a value. An empty pair of quotes yields a token
+     * without a value.
+     */
+    bool IsValid() const
+    {
+        return pwzValue != nullptr;
+    }
+
+    /**
+     * Copies the unquoted token value to a buffer. The buffer is always null
+     * terminated.
+     *
+     * @param  pwzBuffer  Buffer that receives the value
+     * @param  cchBuffer  Size of the buffer, in characters
+     * @return <code>S_OK</code> on success, or
+     *         <code>STRSAFE_E_INSUFFICIENT_BUFFER</code> if the value was
+     *         truncated
+     */
+    HRESULT CopyTo(LPWSTR pwzBuffer, size_t cchBuffer) const;
+
+    /**
+     * Compares the unquoted token value to a string without copying it.
+     *
+     * @param  pwzString       String to compare to
+     * @param  bCaseSensitive  Whether the comparison is case sensitive
+     * @return <code>true</code> if the value equals the string
+     */
+    bool IsEqual(LPCWSTR pwzString, bool bCaseSensitive = false) const;
+};
+
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
+//
+// Tokenizer
+//
+// Walks a string token by token, applying the same quoting and bracket rules
+// as GetToken, without copying anything. Finding the tokens takes a single
+// pass over the string; TokenSpan::CopyTo and IsEqual read a token's
+// characters again when its value is needed.
+//
+class Tokenizer
+{
+public:
+    Tokenizer(LPCWSTR pwzString, bool bUseBrackets);
+
+    /**
+     * Retrieves the next token.
+     *
+     * @param  token  Receives the token
+     * @return <code>false</code> if there is nothing left to tokenize
+     */
+    bool Next(TokenSpan& token);
+
+    /**
+     * Returns the untokenized remainder of the string, or nullptr if the end
+     * of the string has been reached. Equivalent to GetToken's pszNextToken.
+     */
+    LPCWSTR GetRemainder() const
+    {
+        return m_pwzNext;
+    }
+
+private:
+    LPCWSTR m_pwzNext;
+    bool m_bUseBrackets;
+};
+
+#endif // TOKENIZER_H